@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "sys/sys.h"
 #include "common.h"
@@ -8,7 +9,7 @@
 
 typedef struct
 {
-	const char *name;
+	const char *name;			// first so the command index can read it
 	const char *description;
 	cmdfunction_t function;
 } cmd_t;
@@ -27,6 +28,7 @@ typedef struct
 } cmdmap_t;
 
 static cmdmap_t *cmdmap;
+static nameindex_t cmdindex;		// all the commands sorted by name, rebuilt from the map after commands are added or removed
 static char cmdbuffer[DEF_CMD_BUFFER_SIZE];
 static size_t cmdbufferlen;
 
@@ -80,6 +82,46 @@ static cmd_t *FindCommand(const char *name)
 	return(NULL);
 }
 
+/*
+* Function: GatherCmds
+* Fills in every command for the command index
+* 
+* 	items: Output for the commands
+* 
+* Returns: The number of commands written
+*/
+static size_t GatherCmds(void **items)
+{
+	size_t numcmds = 0;
+
+	for (size_t i=0; i<cmdmap->capacity; i++)
+	{
+		for (cmdentry_t *current=cmdmap->cmds[i]; current; current=current->next)
+			items[numcmds++] = current->value;
+	}
+
+	return(numcmds);
+}
+
+/*
+* Function: FindPrefixRange
+* Finds the range of commands in the sorted index whose names start with a prefix, rebuilding the index first if needed
+* 
+* 	prefix: The name prefix, an empty prefix matches every command
+* 	first: Output for the index of the first matching command
+* 
+* Returns: The number of matching commands
+*/
+static size_t FindPrefixRange(const char *prefix, size_t *first)
+{
+	*first = 0;
+
+	if (!NameIndex_Build(&cmdindex, cmdmap->numcmds, GatherCmds, "command"))
+		return(0);
+
+	return(NameIndex_FindPrefix(&cmdindex, prefix, first));
+}
+
 /*
 * Function: ExecuteCommand
 * Tokenizes and executes a command
@@ -185,6 +227,39 @@ static void Help_Cmd(const cmdargs_t *args)
 	Common_Printf("Command: %s, Description: %s", cmd->name, cmd->description);
 }
 
+/*
+* Function: Cmdlist_Cmd
+* Lists all the commands in name order, or only the commands that start with a prefix
+* 
+* 	args: The command arguments, argv[1] is an optional name prefix, a trailing * is allowed: cmdlist r_*
+*/
+static void Cmdlist_Cmd(const cmdargs_t *args)
+{
+	if (args->argc > 2)
+	{
+		Common_Printf("Usage: %s [prefix*]", args->argv[0]);
+		return;
+	}
+
+	char prefix[CMD_MAX_STR_LEN] = { 0 };
+	if (args->argc == 2)
+	{
+		if (!NameIndex_ParsePattern(args->argv[1], prefix, sizeof(prefix)))
+		{
+			Common_Printf("Invalid pattern: %s, only a trailing * is supported", args->argv[1]);
+			return;
+		}
+	}
+
+	size_t first = 0;
+	size_t count = FindPrefixRange(prefix, &first);
+
+	for (size_t i=first; i<(first + count); i++)
+		Common_Printf("%s: %s", ((const cmd_t *)cmdindex.items[i])->name, ((const cmd_t *)cmdindex.items[i])->description);
+
+	Common_Printf("%zu commands", count);
+}
+
 /*
 * Function: Cmd_Init
 * Initializes the command system
@@ -217,7 +292,11 @@ bool Cmd_Init(void)
 	for (size_t i=0; i<cmdmap->capacity; i++)
 		cmdmap->cmds[i] = NULL;
 
+	memset(&cmdindex, 0, sizeof(cmdindex));
+	cmdindex.dirty = true;
+
 	Cmd_RegisterCommand("help", Help_Cmd, "Prints out the help message or the description of a specific command");
+	Cmd_RegisterCommand("cmdlist", Cmdlist_Cmd, "Lists all commands, or the commands that start with a prefix: cmdlist [prefix*]");
 
 	initialized = true;
 
@@ -250,6 +329,8 @@ void Cmd_Shutdown(void)
 	MemCache_Free(cmdmap->cmds);
 	MemCache_Free(cmdmap);
 
+	NameIndex_Free(&cmdindex);
+
 	initialized = false;
 }
 
@@ -315,6 +396,7 @@ void Cmd_RegisterCommand(const char *name, cmdfunction_t function, const char *d
 	}
 
 	cmdmap->numcmds++;
+	cmdindex.dirty = true;
 
 	if (cmdmap->numcmds >= (cmdmap->capacity * 0.75))	// if the number of cmds is at 75% capacity, resize the map to double
 	{
@@ -389,6 +471,7 @@ void Cmd_RemoveCommand(const char *name)
 			MemCache_Free(current->value);
 			MemCache_Free(current);
 			cmdmap->numcmds--;
+			cmdindex.dirty = true;
 			return;
 		}
 
@@ -397,6 +480,30 @@ void Cmd_RemoveCommand(const char *name)
 	}
 }
 
+/*
+* Function: Cmd_CompleteName
+* Finds the commands whose names start with a prefix, in name order, for completing partially typed commands
+* 
+* 	prefix: The name prefix, an empty prefix matches every command
+* 	names: Output array for the matching names, can be NULL to only count the matches
+* 	maxnames: The size of the names array
+* 
+* Returns: The total number of matching commands, this can be more than maxnames
+*/
+size_t Cmd_CompleteName(const char *prefix, const char **names, size_t maxnames)
+{
+	if (!initialized || !prefix)
+		return(0);
+
+	size_t first = 0;
+	size_t count = FindPrefixRange(prefix, &first);
+
+	for (size_t i=0; names && i<count && i<maxnames; i++)
+		names[i] = ((const cmd_t *)cmdindex.items[first + i])->name;
+
+	return(count);
+}
+
 /*
 * Function: Cmd_BufferCommand
 * Buffers a command to be executed, appends the command to the buffer or executes it immediately depending on the execution type
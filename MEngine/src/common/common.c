@@ -6,6 +6,7 @@
 #include "sys/sys.h"
 #include "common.h"
 #include "renderer/renderer.h"
+#include "renderer/world.h"
 
 typedef enum
 {
@@ -24,6 +25,7 @@ static memcache_t memcache;
 static cvarsystem_t cvarsystem;
 static filesystem_t filesystem;
 static sys_t sys;
+static worldsystem_t worldsystem;
 
 static unsigned long long cmdlineflags;
 static void *gamedllhandle;
@@ -34,6 +36,11 @@ static bool isatty;
 
 static char dllpath[SYS_MAX_PATH];
 static char basepath[SYS_MAX_PATH];
+static char fstracepath[SYS_MAX_PATH];
+static char worldbenchpath[SYS_MAX_PATH];
+
+static cvar_t *comflushinterval;
+static unsigned long long lastflushtime;
 
 static bool gameinitialized;
 
@@ -52,6 +59,8 @@ static void PrintUsage(void)
 	fprintf(stderr, "-nocache                 Do not use the memory cache allocator, use the regular malloc/free instead\n");
 	fprintf(stderr, "-basepath=\"<fullpath>\" Quoted full path to the game data: -basepath=\"/root/path/to/game/data\"\n");
 	fprintf(stderr, "-dllpath=\"<fullpath>\"  Quoted name of the game DLL/SO relative to the base path: -dllpath=\"game.dll\" or -dllpath=\"/path/to/game/file.dll\"\n");
+	fprintf(stderr, "-fstrace=\"<filename>\" Quoted name of a CSV file to trace every filesystem operation to from startup: -fstrace=\"logs/fstrace.csv\"\n");
+	fprintf(stderr, "-worldbench=\"<filename>\" Runs the world loading benchmark without a window or the game, writes the results to a CSV file and exits: -worldbench=\"logs/worldbench.csv\"\n");
 }
 
 /*
@@ -119,6 +128,12 @@ static bool ProcessCommandLine(void)
 		else if (strcmp(arg, "dllpath") == 0)
 			ExtractCommandVar(cmdline, cmdline->args[i], &i, dllpath, SYS_MAX_PATH);
 
+		else if (strcmp(arg, "fstrace") == 0)
+			ExtractCommandVar(cmdline, cmdline->args[i], &i, fstracepath, SYS_MAX_PATH);
+
+		else if (strcmp(arg, "worldbench") == 0)
+			ExtractCommandVar(cmdline, cmdline->args[i], &i, worldbenchpath, SYS_MAX_PATH);
+
 		else
 			fprintf(stderr, "Unknown command line token: %s\n", cmdline->args[i]);
 	}
@@ -169,14 +184,34 @@ static void CreateMServices(void)
 		.SetString = Cvar_SetString,
 		.SetInt = Cvar_SetInt,
 		.SetFloat = Cvar_SetFloat,
-		.SetBool = Cvar_SetBool
+		.SetBool = Cvar_SetBool,
+		.GetModifiedCount = Cvar_GetModifiedCount,
+		.AddCallback = Cvar_AddCallback,
+		.RemoveCallback = Cvar_RemoveCallback
 	};
 
 	filesystem = (filesystem_t)
 	{
 		.FileExists = FileSys_FileExists,
 		.ListFiles = FileSys_ListFiles,
-		.FreeFileList = FileSys_FreeFileList
+		.FreeFileList = FileSys_FreeFileList,
+		.ReadFile = FileSys_ReadFile,
+		.FreeFile = FileSys_FreeFile,
+		.AcquireFile = FileSys_AcquireFile,
+		.ReleaseFile = FileSys_ReleaseFile,
+		.GetCacheStats = FileSys_GetCacheStats,
+		.GetIOStats = FSTrace_GetStats,
+		.MapFile = FileSys_MapFile,
+		.UnmapFile = FileSys_UnmapFile,
+		.OpenStream = FileSys_OpenStream,
+		.ReadStream = FileSys_ReadStream,
+		.CloseStream = FileSys_CloseStream,
+		.ReadAsync = FileSys_ReadAsync,
+		.PollRead = FileSys_PollRead,
+		.WaitRead = FileSys_WaitRead,
+		.CancelRead = FileSys_CancelRead,
+		.ListFileNames = FileSys_ListFileNames,
+		.ListFilesInPAK = FileSys_ListFilesInPAK
 	};
 
 	sys = (sys_t)
@@ -202,6 +237,17 @@ static void CreateMServices(void)
 		.GetProcAddress = Sys_GetProcAddress
 	};
 
+	worldsystem = (worldsystem_t)
+	{
+		.FindEntity = Render_FindEntity,
+		.FindEntitiesInRect = Render_FindEntitiesInRect,
+		.FindEntitiesInRadius = Render_FindEntitiesInRadius,
+		.GetNumEntities = Render_GetNumEntities,
+		.SetFocus = Render_SetWorldFocus,
+		.FindChunk = Render_FindChunk,
+		.FindChunksInRadius = Render_FindChunksInRadius
+	};
+
 	mservices = (mservices_t)
 	{
 		.version = MENGINE_VERSION,
@@ -210,7 +256,8 @@ static void CreateMServices(void)
 		.cmdsystem = &cmdsystem,
 		.cvarsystem = &cvarsystem,
 		.filesystem = &filesystem,
-		.sys = &sys
+		.sys = &sys,
+		.world = &worldsystem
 	};
 }
 
@@ -290,6 +337,26 @@ static void ShutdownGame(void)
 	gameinitialized = false;
 }
 
+/*
+* Function: FlushConfigs
+* Queues the cvar and bindings files to be written if they have changed, at most once every com_flushinterval seconds
+*/
+static void FlushConfigs(void)
+{
+	int interval = 0;
+	if (!Cvar_GetInt(comflushinterval, &interval) || interval <= 0)
+		return;
+
+	unsigned long long now = Sys_GetMicroseconds();
+	if ((now - lastflushtime) < ((unsigned long long)interval * 1000000ULL))
+		return;
+
+	lastflushtime = now;
+
+	Cvar_FlushArchive();
+	Input_FlushBindings();
+}
+
 /*
 * Function: Common_Init
 * Initializes the engine and all the subsystems
@@ -317,16 +384,20 @@ bool Common_Init(void)
 		|| !Log_Init()
 		|| !Cmd_Init()
 		|| !Cvar_Init()
+		|| !FSTrace_Init(fstracepath)
 		|| !FileSys_Init(basepath)
 		|| !Sys_Init()
 		|| !Input_Init()
 		|| !Event_Init()
-		|| !InitGame())
+		|| (!Common_IsHeadless() && !InitGame()))		// a headless run has no window, renderer or game
 	{
 		Common_Errorf("Failed to initialize the engine, shutting down...");
 		return(false);
 	}
 
+	comflushinterval = Cvar_RegisterInt("com_flushinterval", 5, CVAR_SYSTEM | CVAR_ARCHIVE, "How often in seconds changed config files are written to disk in the background, 0 only writes them at shutdown");
+	lastflushtime = Sys_GetMicroseconds();
+
 	if (!MemCache_UseCache())
 	{
 		const char *memcachemsg = memcachemsg = "Not enough system memory for the memory cache, using the default allocator";
@@ -358,6 +429,7 @@ void Common_Shutdown(void)
 	Input_Shutdown();
 	Sys_Shutdown();
 	FileSys_Shutdown();
+	FSTrace_Shutdown();
 	Cvar_Shutdown();
 	Cmd_Shutdown();
 	MemCache_Shutdown();
@@ -376,8 +448,12 @@ void Common_Shutdown(void)
 */
 void Common_Frame(void)
 {
+	FSTrace_Frame();
+	FileSys_Frame();
 	Event_RunEventLoop();
 
+	FlushConfigs();
+
 	gameservices.RunFrame();
 
 	Render_StartFrame();
@@ -494,6 +570,29 @@ void Common_Errorf(const char *msg, ...)
 	va_end(argptr);
 }
 
+/*
+* Function: Common_IsHeadless
+* Returns if the engine is doing a headless run, like -worldbench, which runs once after Common_Init instead of the frame loop
+*/
+bool Common_IsHeadless(void)
+{
+	return(worldbenchpath[0] != '\0');
+}
+
+/*
+* Function: Common_RunHeadless
+* Runs the headless work the command line asked for, the engine is shut down after it
+* 
+* Returns: A boolean if the headless run succeeded or not, the process exit status
+*/
+bool Common_RunHeadless(void)
+{
+	if (worldbenchpath[0])
+		return(World_Benchmark(worldbenchpath));
+
+	return(true);
+}
+
 /*
 * Function: Common_EditorMode
 * Returns if the engine is in editor mode
@@ -20,6 +20,8 @@ void Common_Frame(void);
 void Common_Printf(const char *msg, ...);
 void Common_Warnf(const char *msg, ...);
 void Common_Errorf(const char *msg, ...);
+bool Common_IsHeadless(void);
+bool Common_RunHeadless(void);
 
 bool Common_EditorMode(void);
 bool Common_DebugMode(void);
@@ -43,6 +45,19 @@ size_t MemCache_GetMemUsed(void);
 size_t MemCache_GetTotalMemory(void);
 bool MemCache_UseCache(void);
 
+typedef struct		// a sorted index over named items, used for name prefix queries, every item must start with its const char *name
+{
+	void **items;
+	size_t numitems;
+	size_t capacity;
+	bool dirty;			// set when items are added or removed, the index is rebuilt before it is next searched
+} nameindex_t;
+
+bool NameIndex_Build(nameindex_t *index, size_t numitems, size_t (*Gather)(void **items), const char *what);
+size_t NameIndex_FindPrefix(const nameindex_t *index, const char *prefix, size_t *first);
+bool NameIndex_ParsePattern(const char *pattern, char *prefix, size_t prefixsize);
+void NameIndex_Free(nameindex_t *index);
+
 #define CMD_MAX_STR_LEN 1024
 #define CMD_MAX_ARGS 32
 
@@ -57,12 +72,15 @@ bool Cmd_Init(void);
 void Cmd_Shutdown(void);
 void Cmd_RegisterCommand(const char *name, cmdfunction_t function, const char *description);
 void Cmd_RemoveCommand(const char *name);
+size_t Cmd_CompleteName(const char *prefix, const char **names, size_t maxnames);
 void Cmd_BufferCommand(const cmdexecution_t exec, const char *cmd);
 void Cmd_ExecuteCommandBuffer(void);
 
 bool Cvar_Init(void);
 void Cvar_Shutdown(void);
+void Cvar_FlushArchive(void);
 cvar_t *Cvar_Find(const char *name);
+size_t Cvar_CompleteName(const char *prefix, const char **names, size_t maxnames);
 cvar_t *Cvar_RegisterString(const char *name, const char *value, const unsigned long long flags, const char *description);
 cvar_t *Cvar_RegisterInt(const char *name, const int value, const unsigned long long flags, const char *description);
 cvar_t *Cvar_RegisterFloat(const char *name, const float value, const unsigned long long flags, const char *description);
@@ -75,6 +93,9 @@ void Cvar_SetString(cvar_t *cvar, const char *value);
 void Cvar_SetInt(cvar_t *cvar, const int value);
 void Cvar_SetFloat(cvar_t *cvar, const float value);
 void Cvar_SetBool(cvar_t *cvar, const bool value);
+unsigned int Cvar_GetModifiedCount(const cvar_t *cvar);
+bool Cvar_AddCallback(cvar_t *cvar, cvarcallback_t callback);
+void Cvar_RemoveCallback(cvar_t *cvar, cvarcallback_t callback);
 
 struct filedata
 {
@@ -85,14 +106,78 @@ struct filedata
 	char filename[SYS_MAX_PATH];
 };
 
+bool FSTrace_Init(const char *filename);
+void FSTrace_Shutdown(void);
+unsigned long long FSTrace_Begin(void);
+void FSTrace_Record(fsioop_t op, const char *path, size_t bytes, unsigned long long start);
+void FSTrace_Frame(void);
+void FSTrace_GetStats(fsiostats_t *total, fsiostats_t *lastframe);
+
 bool FileSys_Init(const char *basepath);
 void FileSys_Shutdown(void);
+const char *FileSys_GetDataPath(void);
 bool FileSys_FileExists(const char *filename);
+void *FileSys_ReadFile(const char *filename, size_t *size);
+void FileSys_FreeFile(void *data);
+const void *FileSys_AcquireFile(const char *filename, size_t *size);
+void FileSys_ReleaseFile(const void *data);
+void FileSys_GetCacheStats(fscachestats_t *stats);
+const void *FileSys_MapFile(const char *filename, size_t *size);
+void FileSys_UnmapFile(const void *data, size_t size);
+fsstream_t *FileSys_OpenStream(const char *filename, size_t *size);
+size_t FileSys_ReadStream(fsstream_t *stream, void *buffer, size_t length);
+void FileSys_CloseStream(fsstream_t *stream);
+unsigned int FileSys_ReadAsync(const char *filename, size_t offset, size_t length, void *buffer, fspriority_t priority, fsreadcallback_t callback, void *userdata);
+fsreadstatus_t FileSys_PollRead(unsigned int handle);
+fsreadstatus_t FileSys_WaitRead(unsigned int handle);
+bool FileSys_CancelRead(unsigned int handle);
+void FileSys_CompleteRead(unsigned int handle);
+void FileSys_Frame(void);
+bool FileSys_QueueWrite(const char *filename, const void *data, size_t size);
 filedata_t *FileSys_ListFiles(unsigned int *numfiles, const char *directory, const char *filter);
+filedata_t *FileSys_ListFileNames(unsigned int *numfiles, const char *directory, const char *filter);
+filedata_t *FileSys_ListFilesInPAK(unsigned int *numfiles, const char *directory, const char *filter);
 void FileSys_FreeFileList(filedata_t **filelist);
 
+typedef struct
+{
+	char *data;
+	size_t size;
+	size_t capacity;
+	unsigned int texthash;
+	unsigned int numrecords;
+} snapshotwriter_t;
+
+typedef struct
+{
+	const char *data;		// the mapped snapshot file
+	size_t size;
+	size_t offset;
+	unsigned int numrecords;
+	unsigned int numread;
+} snapshotreader_t;
+
+typedef struct
+{
+	unsigned char tag;
+	unsigned short keylen;
+	unsigned short valuelen;
+	const char *key;		// points into the mapped snapshot, not null terminated
+	const char *value;
+} snapshotrecord_t;
+
+unsigned int Snapshot_HashText(const void *data, size_t size);
+bool Snapshot_BeginWrite(snapshotwriter_t *writer, unsigned int texthash);
+bool Snapshot_WriteRecord(snapshotwriter_t *writer, unsigned char tag, const void *key, unsigned short keylen, const void *value, unsigned short valuelen);
+bool Snapshot_EndWrite(snapshotwriter_t *writer, const char *filename);
+void Snapshot_CancelWrite(snapshotwriter_t *writer);
+bool Snapshot_Open(snapshotreader_t *reader, const char *filename, unsigned int texthash);
+bool Snapshot_ReadRecord(snapshotreader_t *reader, snapshotrecord_t *record);
+void Snapshot_Close(snapshotreader_t *reader);
+
 bool Input_Init(void);
 void Input_Shutdown(void);
+void Input_FlushBindings(void);
 void Input_ProcessKeyInput(const int key, bool down);
 void Input_ClearKeyStates(void);
 
@@ -102,6 +187,7 @@ typedef enum
 	EVENT_KEY,			// evar1 is the keycode, evar2 is an eventstate_t (key up or down)
 	EVENT_MOUSE,		// evar1 is the posx and evar2 is the posy of the mouse
 	EVENT_CHAR,			// evar1 stores the unicode char
+	EVENT_FILEIO,		// evar1 is the handle of a finished async file read
 } eventtype_t;
 
 typedef enum
@@ -112,5 +198,5 @@ typedef enum
 
 bool Event_Init(void);
 void Event_Shutdown(void);
-void Event_QueueEvent(const eventtype_t type, int var1, int var2);
+bool Event_QueueEvent(const eventtype_t type, int var1, int var2);
 void Event_RunEventLoop(void);
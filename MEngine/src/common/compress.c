@@ -0,0 +1,293 @@
+#include <string.h>
+#include "compress.h"
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5			// the last bytes of a block are always literals
+#define MATCH_FIND_LIMIT 12		// a match cannot start in the last bytes of a block
+#define MAX_OFFSET 0xffff
+#define HASH_BITS 12
+#define RUN_MASK 15
+
+/*
+* Function: Read32
+* Reads 4 bytes from an unaligned address
+* 
+*	ptr: The address to read from
+* 
+* Returns: The 4 bytes as an integer
+*/
+static unsigned int Read32(const unsigned char *ptr)
+{
+	unsigned int value;
+	memcpy(&value, ptr, sizeof(value));
+
+	return(value);
+}
+
+/*
+* Function: HashSequence
+* Hashes 4 bytes of input to an index in the match finder table
+* 
+*	sequence: The 4 bytes to hash
+* 
+* Returns: The index in the table
+*/
+static unsigned int HashSequence(unsigned int sequence)
+{
+	return((sequence * 2654435761u) >> (32 - HASH_BITS));
+}
+
+/*
+* Function: WriteLength
+* Writes the extra bytes of a literal or match length that did not fit in the token
+* 
+*	out: The output position, moved past the written bytes
+*	outend: The end of the output buffer
+*	length: The length minus the 15 stored in the token
+* 
+* Returns: A boolean if the bytes fit in the output or not
+*/
+static bool WriteLength(unsigned char **out, const unsigned char *outend, size_t length)
+{
+	while (length >= 255)
+	{
+		if (*out >= outend)
+			return(false);
+
+		*(*out)++ = 255;
+		length -= 255;
+	}
+
+	if (*out >= outend)
+		return(false);
+
+	*(*out)++ = (unsigned char)length;
+
+	return(true);
+}
+
+/*
+* Function: WriteSequence
+* Writes a sequence of literals followed by a match, or only literals if the match length is 0
+* 
+*	out: The output position, moved past the sequence
+*	outend: The end of the output buffer
+*	literals: The literal bytes
+*	litlen: The number of literal bytes
+*	offset: The distance back to the match
+*	matchlen: The length of the match, 0 for the last sequence
+* 
+* Returns: A boolean if the sequence fit in the output or not
+*/
+static bool WriteSequence(unsigned char **out, const unsigned char *outend, const unsigned char *literals, size_t litlen, size_t offset, size_t matchlen)
+{
+	if (*out >= outend)
+		return(false);
+
+	unsigned char *token = (*out)++;
+	size_t matchcode = matchlen ? (matchlen - MIN_MATCH) : 0;
+
+	*token = (unsigned char)(((litlen >= RUN_MASK) ? RUN_MASK : litlen) << 4);
+	if ((litlen >= RUN_MASK) && !WriteLength(out, outend, litlen - RUN_MASK))
+		return(false);
+
+	if ((size_t)(outend - *out) < litlen)
+		return(false);
+
+	memcpy(*out, literals, litlen);
+	*out += litlen;
+
+	if (matchlen == 0)
+		return(true);
+
+	if ((outend - *out) < 2)
+		return(false);
+
+	*(*out)++ = (unsigned char)(offset & 0xff);
+	*(*out)++ = (unsigned char)(offset >> 8);
+
+	*token |= (unsigned char)((matchcode >= RUN_MASK) ? RUN_MASK : matchcode);
+	if ((matchcode >= RUN_MASK) && !WriteLength(out, outend, matchcode - RUN_MASK))
+		return(false);
+
+	return(true);
+}
+
+/*
+* Function: ReadLength
+* Reads the extra bytes of a literal or match length
+* 
+*	in: The input position, moved past the read bytes
+*	inend: The end of the input
+*	length: The length to add the extra bytes to
+* 
+* Returns: A boolean if the length was read or not
+*/
+static bool ReadLength(const unsigned char **in, const unsigned char *inend, size_t *length)
+{
+	unsigned char byte = 255;
+
+	while (byte == 255)
+	{
+		if (*in >= inend)
+			return(false);
+
+		byte = *(*in)++;
+		*length += byte;
+	}
+
+	return(true);
+}
+
+/*
+* Function: Compress_Bound
+* Gets the largest size a block can compress to, for data that does not compress at all
+* 
+*	srclen: The size of the uncompressed data
+* 
+* Returns: The largest possible compressed size
+*/
+size_t Compress_Bound(size_t srclen)
+{
+	return(srclen + (srclen / 255) + 16);
+}
+
+/*
+* Function: Compress_Block
+* Compresses a block of data, using a single hash table match finder that favours speed over ratio
+* 
+*	src: The data to compress
+*	srclen: The size of the data, at most COMPRESS_BLOCK_SIZE
+*	dst: The output buffer
+*	dstcap: The size of the output buffer
+* 
+* Returns: The compressed size, or 0 if the compressed data did not fit in the output buffer
+*/
+size_t Compress_Block(const void *src, size_t srclen, void *dst, size_t dstcap)
+{
+	const unsigned char *in = src;
+	const unsigned char *inend = in + srclen;
+	const unsigned char *anchor = in;
+	const unsigned char *ip = in;
+
+	unsigned char *out = dst;
+	const unsigned char *outend = out + dstcap;
+
+	if ((srclen > COMPRESS_BLOCK_SIZE) || !dst)
+		return(0);
+
+	if (srclen > MATCH_FIND_LIMIT)
+	{
+		unsigned int table[1 << HASH_BITS];		// positions in the block of the last 4 bytes with each hash
+		memset(table, 0, sizeof(table));
+
+		const unsigned char *matchlimit = inend - LAST_LITERALS;
+		const unsigned char *findlimit = inend - MATCH_FIND_LIMIT;
+
+		while (ip < findlimit)
+		{
+			unsigned int sequence = Read32(ip);
+			unsigned int hash = HashSequence(sequence);
+			const unsigned char *ref = in + table[hash];
+
+			table[hash] = (unsigned int)(ip - in);
+
+			if ((ref >= ip) || ((size_t)(ip - ref) > MAX_OFFSET) || (Read32(ref) != sequence))
+			{
+				ip++;
+				continue;
+			}
+
+			const unsigned char *matchend = ip + MIN_MATCH;
+			const unsigned char *refend = ref + MIN_MATCH;
+			while ((matchend < matchlimit) && (*matchend == *refend))
+			{
+				matchend++;
+				refend++;
+			}
+
+			if (!WriteSequence(&out, outend, anchor, (size_t)(ip - anchor), (size_t)(ip - ref), (size_t)(matchend - ip)))
+				return(0);
+
+			ip = matchend;
+			anchor = ip;
+		}
+	}
+
+	if (!WriteSequence(&out, outend, anchor, (size_t)(inend - anchor), 0, 0))
+		return(0);
+
+	return((size_t)(out - (unsigned char *)dst));
+}
+
+/*
+* Function: Decompress_Block
+* Decompresses a block of data, every length and offset is checked so corrupt data cannot read or write out of bounds
+* 
+*	src: The compressed data
+*	srclen: The size of the compressed data
+*	dst: The output buffer
+*	dstlen: The exact size of the uncompressed data
+* 
+* Returns: A boolean if the block was decompressed to exactly dstlen bytes or not
+*/
+bool Decompress_Block(const void *src, size_t srclen, void *dst, size_t dstlen)
+{
+	const unsigned char *ip = src;
+	const unsigned char *inend = ip + srclen;
+
+	unsigned char *op = dst;
+	unsigned char *outstart = op;
+	const unsigned char *outend = op + dstlen;
+
+	while (ip < inend)
+	{
+		unsigned char token = *ip++;
+
+		size_t litlen = token >> 4;
+		if ((litlen == RUN_MASK) && !ReadLength(&ip, inend, &litlen))
+			return(false);
+
+		if ((litlen > (size_t)(inend - ip)) || (litlen > (size_t)(outend - op)))
+			return(false);
+
+		memcpy(op, ip, litlen);
+		op += litlen;
+		ip += litlen;
+
+		if (ip == inend)
+			break;		// the last sequence has no match
+
+		if ((inend - ip) < 2)
+			return(false);
+
+		size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+
+		if ((offset == 0) || (offset > (size_t)(op - outstart)))
+			return(false);
+
+		size_t matchlen = token & RUN_MASK;
+		if ((matchlen == RUN_MASK) && !ReadLength(&ip, inend, &matchlen))
+			return(false);
+
+		matchlen += MIN_MATCH;
+		if (matchlen > (size_t)(outend - op))
+			return(false);
+
+		const unsigned char *match = op - offset;
+
+		if (offset >= matchlen)
+			memcpy(op, match, matchlen);
+
+		else
+		{
+			for (size_t i=0; i<matchlen; i++)		// overlapping copy, repeats the last offset bytes
+				op[i] = match[i];
+		}
+
+		op += matchlen;
+	}
+
+	return(op == outend);
+}
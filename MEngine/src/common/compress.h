@@ -0,0 +1,26 @@
+/*
+* The engines block compression codec, an LZ4 style byte oriented LZ77 format. Shared by the engine and the MEnginePak tool,
+* so this code does not depend on any engine system.
+* 
+* Overview:
+* A compressed block is a list of sequences, each sequence is a run of literal bytes followed by a copy of earlier output:
+*	- A token byte, the high 4 bits are the literal length and the low 4 bits are the match length minus 4.
+*	- If the literal length is 15, more bytes follow and are added to it, until a byte that is not 255.
+*	- The literal bytes.
+*	- A 2 byte little endian offset back into the output to copy the match from, 1 to 65535.
+*	- If the match length is 15, more bytes follow and are added to it, the same as the literal length.
+* 
+* The last sequence only has literals and always covers at least the last 5 bytes of the block.
+* Blocks are never bigger than COMPRESS_BLOCK_SIZE bytes uncompressed, larger data is split into blocks.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define COMPRESS_BLOCK_SIZE 0x10000
+
+size_t Compress_Bound(size_t srclen);
+size_t Compress_Block(const void *src, size_t srclen, void *dst, size_t dstcap);
+bool Decompress_Block(const void *src, size_t srclen, void *dst, size_t dstlen);
@@ -3,12 +3,16 @@
 #include <string.h>
 #include <time.h>
 #include <errno.h>
+#include <stdatomic.h>
 #include "sys/sys.h"
 #include "common.h"
 
 #define DEF_CVAR_MAP_CAPACITY 128
+#define DEF_INTERN_MAP_CAPACITY 256
 #define CVAR_MAX_STR_LEN 260
 #define CVAR_MAX_LINE_LEN 520		// double the max string length
+#define STR_ARENA_BLOCK_SIZE 0x4000		// 16KB per string arena block
+#define STR_LEN_PREFIX sizeof(unsigned short)
 
 typedef enum
 {
@@ -18,496 +22,1357 @@ typedef enum
 	CVAR_BOOL
 } cvartype_t;
 
-typedef union
+typedef union		// 8 bytes, string values live in the string arena or in their own allocation
 {
 	bool b;
-	char s[CVAR_MAX_STR_LEN];
 	int i;
 	float f;
+	const char *s;
 } cvarvalue_t;
 
-struct cvar
+typedef union		// the stored value, written by the main thread only and readable from any thread without a lock
 {
-	char *name;
-	cvarvalue_t value;
-	const char *description;
+	atomic_bool b;
+	atomic_int i;
+	_Atomic float f;
+	_Atomic(const char *) s;		// string values are immutable, publishing a new pointer is an atomic snapshot of the whole string
+} cvaratomic_t;
+
+typedef struct
+{
+	const char *name;
 	cvartype_t type;
-	unsigned long long flags;
-};
+} setcommand_t;
+
+typedef struct
+{
+	const char *name;
+	cvarflags_t flag;
+} flagname_t;
+
+typedef struct
+{
+	char cmdname[CVAR_MAX_STR_LEN];
+	char name[CVAR_MAX_STR_LEN];
+	char value[CVAR_MAX_STR_LEN];
+} configline_t;
 
-typedef struct cvarentry
+typedef struct cvarlistener
 {
-	cvar_t *value;
-	struct cvarentry *next;
-} cvarentry_t;
+	cvarcallback_t callback;
+	struct cvarlistener *next;
+} cvarlistener_t;
+
+struct cvar			// kept to a single cache line, the fields used by lookups come first
+{
+	const char *name;				// interned in the string arena, first so the cvar index can read it
+	struct cvar *next;				// next cvar in the same hash map bucket
+	unsigned int hash;				// full hash of the name, compared before the name and reused when resizing the map
+	cvartype_t type;
+	cvaratomic_t value;
+	unsigned long long flags;
+	atomic_uint modified;			// incremented every time the value changes
+	atomic_uint readers;			// the number of Cvar_GetString calls copying the value right now, fits in the padding after modified
+	const char *description;
+	cvarlistener_t *listeners;		// list of callbacks to run when the value changes
+};
 
 typedef struct
 {
 	size_t numcvars;
 	size_t capacity;
-	cvarentry_t **cvars;
+	cvar_t **cvars;
 } cvarmap_t;
 
+typedef struct strblock
+{
+	size_t used;
+	struct strblock *next;
+	char data[STR_ARENA_BLOCK_SIZE];
+} strblock_t;
+
+typedef struct ownedstring		// a string value set after registration, stored as [next][unsigned short length][characters][\0]
+{
+	struct ownedstring *next;		// the next retired value
+	const struct cvar *cvar;		// the cvar the value was retired from, its reader count decides when the value can be freed
+} ownedstring_t;
+
+typedef struct		// string arena, strings are stored as [unsigned short length][characters][\0] and never freed until shutdown
+{
+	strblock_t *blocks;			// the head is the block currently being filled
+	size_t numstrings;
+	size_t capacity;
+	const char **strings;		// open addressing intern table, points at the characters of each stored string
+} strarena_t;
+
+static const setcommand_t setcommands[] =
+{
+	{ "seta", CVAR_STRING },
+	{ "seti", CVAR_INT },
+	{ "setf", CVAR_FLOAT },
+	{ "setb", CVAR_BOOL }
+};
+
+static const flagname_t flagnames[] =
+{
+	{ "archive", CVAR_ARCHIVE },
+	{ "readonly", CVAR_READONLY },
+	{ "renderer", CVAR_RENDERER },
+	{ "system", CVAR_SYSTEM },
+	{ "filesystem", CVAR_FILESYSTEM },
+	{ "game", CVAR_GAME }
+};
+
 static cvarmap_t *cvarmap;
+static nameindex_t cvarindex;		// all the cvars sorted by name, rebuilt from the map after cvars are registered
+static strarena_t strarena;
+static ownedstring_t *retiredstrings;		// values replaced by Cvar_SetString, freed once no reader of their cvar can be copying them
 static FILE *cvarfile;
 
 static const char *cvardir = "configs";
 static const char *cvarfilename = "mengine.cfg";
+static const char *cvarsnapshotname = "mengine.cfgb";
 static const char *overridefilename = "overrides.cfg";
 static char cvarfullname[SYS_MAX_PATH];
+static char cvarsnapshotfullname[SYS_MAX_PATH];
+static bool archivedirty;		// set when an archived cvar changes, cleared when the cvar file is queued for writing
+static unsigned int archivehash;	// hash of the cvar file contents as last read or written
+static bool snapshotcurrent;		// the snapshot on disk was written alongside the cvar file with archivehash
 
 static bool initialized;
 
 /*
-* Function: HashCvarName
-* Hashes the name of the cvar to generate an index, using the FNV-1a algorithm
+* Function: HashString
+* Hashes a string, using the FNV-1a algorithm
 * 
-*	name: The name of the cvar
+*	str: The string to hash
+*	len: The length of the string
 * 
 * Returns: The hash value
 */
-static size_t HashCvarName(const char *name)
+static unsigned int HashString(const char *str, size_t len)
 {
-	size_t hash = 2166136261u;	// initial offset basis, large prime number
-	size_t len = Sys_Strlen(name, CVAR_MAX_STR_LEN);
+	unsigned int hash = 2166136261u;	// initial offset basis, large prime number
 
 	for (size_t i=0; i<len; i++)
 	{
-		hash ^= (unsigned char)name[i];
+		hash ^= (unsigned char)str[i];
 		hash *= 16777619;	// FNV prime number
 	}
 
-	return(hash & (cvarmap->capacity - 1));
+	return(hash);
 }
 
 /*
-* Function: HandleConversionErrors
-* Handles errors that occur during string to numeric type conversion
+* Function: HashCvarName
+* Hashes the name of the cvar to generate the full hash stored in the cvar, mask with the map capacity to get an index
 * 
-*	value: The string to convert for logging purposes
-*	end: If the conversion failed, this will point to the first invalid character
+*	name: The name of the cvar
 * 
-* Returns: A boolean if the conversion was successful or not
+* Returns: The hash value
 */
-static bool HandleConversionErrors(const char *value, const char *end)
+static unsigned int HashCvarName(const char *name)
 {
-	if (value == end)
-	{
-		Log_Writef(LOG_ERROR, "Failed to convert string to int: %s", value);
-		return(false);
-	}
+	return(HashString(name, Sys_Strlen(name, CVAR_MAX_STR_LEN)));
+}
 
-	if (errno == ERANGE)
-	{
-		Log_Writef(LOG_ERROR, "%s: Failed to convert string to int: %s", strerror(errno), value);
-		return(false);
-	}
+/*
+* Function: InternedLength
+* Gets the length of a string stored in the string arena from its length prefix
+* 
+*	str: The interned string
+* 
+* Returns: The length of the string
+*/
+static size_t InternedLength(const char *str)
+{
+	unsigned short len = 0;
+	memcpy(&len, str - STR_LEN_PREFIX, sizeof(len));	// the prefix is not guaranteed to be aligned
+	return(len);
+}
 
-	if ((errno == 0) && end && (strcmp(end, "") != 0))
+/*
+* Function: InitStringArena
+* Initializes the string arena and its intern table
+* 
+* Returns: A boolean if the initialization was successful or not
+*/
+static bool InitStringArena(void)
+{
+	strarena.blocks = NULL;
+	strarena.numstrings = 0;
+	strarena.capacity = DEF_INTERN_MAP_CAPACITY;
+
+	strarena.strings = MemCache_Alloc(sizeof(*strarena.strings) * strarena.capacity);
+	if (!strarena.strings)
 	{
-		Log_Writef(LOG_ERROR, "Invalid characters in string, additional characters remain: %s", value);
+		Log_Write(LOG_ERROR, "Failed to allocate memory for the cvar string intern table");
 		return(false);
 	}
 
-	if (errno != 0)
+	for (size_t i=0; i<strarena.capacity; i++)
+		strarena.strings[i] = NULL;
+
+	return(true);
+}
+
+/*
+* Function: ShutdownStringArena
+* Frees all the strings in the string arena and the intern table
+*/
+static void ShutdownStringArena(void)
+{
+	strblock_t *current = strarena.blocks;
+	while (current)
 	{
-		Log_Writef(LOG_ERROR, "%s: An error occured: %s", value, strerror(errno));
-		return(false);
+		strblock_t *next = current->next;
+		MemCache_Free(current);
+		current = next;
 	}
 
-	return(true);
+	if (strarena.strings)
+		MemCache_Free(strarena.strings);
+
+	strarena = (strarena_t){ 0 };
 }
 
 /*
-* Function: ListAllCvars
-* Lists all the cvars in the hashmap
+* Function: GrowInternTable
+* Doubles the capacity of the intern table and reinserts all the interned strings
+* 
+* Returns: A boolean if the table was resized or not, the old table is kept on failure
 */
-static void ListAllCvars(void)
+static bool GrowInternTable(void)
 {
-	Log_Writef(LOG_INFO, "\t\tCvar Dump [number of cvars: %zu, cvar map capacity: %zu]", cvarmap->numcvars, cvarmap->capacity);
+	size_t newcapacity = strarena.capacity * 2;
 
-	size_t numcvars = 0;
-	for (size_t i=0; i<cvarmap->capacity; i++)
+	const char **newstrings = MemCache_Alloc(sizeof(*newstrings) * newcapacity);
+	if (!newstrings)
 	{
-		cvarentry_t *current = cvarmap->cvars[i];
-		while (current)
-		{
-			cvar_t *cvar = current->value;
-			switch (cvar->type)
-			{
-				case CVAR_BOOL:
-					Log_Writef(LOG_INFO, "\t\t\tCvar: %s, Value: %d, Type: %d, Flags: %llu Description: %s", cvar->name, cvar->value.b, cvar->type, cvar->flags, cvar->description);
-					break;
+		Log_Write(LOG_ERROR, "Failed to allocate memory for new cvar string intern table");
+		return(false);
+	}
 
-				case CVAR_INT:
-					Log_Writef(LOG_INFO, "\t\t\tCvar: %s, Value: %d, Type: %d, Flags: %llu, Description: %s", cvar->name, cvar->value.i, cvar->type, cvar->flags, cvar->description);
-					break;
+	for (size_t i=0; i<newcapacity; i++)
+		newstrings[i] = NULL;
 
-				case CVAR_FLOAT:
-					Log_Writef(LOG_INFO, "\t\t\tCvar: %s, Value: %f, Type: %d, Flags: %llu, Description: %s", cvar->name, cvar->value.f, cvar->type, cvar->flags, cvar->description);
-					break;
+	for (size_t i=0; i<strarena.capacity; i++)
+	{
+		const char *str = strarena.strings[i];
+		if (!str)
+			continue;
 
-				case CVAR_STRING:
-					Log_Writef(LOG_INFO, "\t\t\tCvar: %s, Value: %s, Type: %d, Flags: %llu, Description: %s", cvar->name, cvar->value.s, cvar->type, cvar->flags, cvar->description);
-					break;
-			}
+		size_t index = HashString(str, InternedLength(str)) & (newcapacity - 1);
+		while (newstrings[index])
+			index = (index + 1) & (newcapacity - 1);
 
-			numcvars++;
-			current = current->next;
-		}
+		newstrings[index] = str;
 	}
 
-	Log_Write(LOG_INFO, "\t\tEnd of Cvar Dump");
+	MemCache_Free(strarena.strings);
+	strarena.strings = newstrings;
+	strarena.capacity = newcapacity;
+
+	return(true);
 }
 
 /*
-* Function: GetNameValue
-* Gets a name and value pair from the config file. Ignores comments and leading whitespace.
-* A comment is a line that starts with a # symbol
-*
-*	line: The line to parse
-*	length: The length of the line
-*	name: The first word in the name-value pair
-*	value: The second term in the name-value pair, enclosed in double quotes
-*
-* Returns: A boolean if it's acceptable or not
+* Function: InternString
+* Stores a string in the string arena, if the same string has already been stored the existing copy is returned.
+* Strings are never freed until shutdown, so only cvar names and registered values are interned, all cvars with the same one share the same memory
+* 
+*	str: The string to intern, truncated to CVAR_MAX_STR_LEN - 1 characters
+* 
+* Returns: A pointer to the interned string, or NULL if it could not be stored
 */
-static bool GetNameValue(const char *line, const size_t length, char *name, char *value)
+static const char *InternString(const char *str)
 {
-	bool acceptable = true;
-	bool readingvalue = false;	// this changes to true when we are inside quotes
+	if (!str)
+		str = "";
 
-	int i = 0, ni = 0, vi = 0;
-	while (i < length && line[i] != '\0')
+	size_t len = Sys_Strlen(str, CVAR_MAX_STR_LEN - 1);
+	unsigned int hash = HashString(str, len);
+
+	size_t index = hash & (strarena.capacity - 1);
+	while (strarena.strings[index])
 	{
-		if (line[i] == '"')
-		{
-			if (readingvalue)		// end quote reached, save the value
-				break;
+		const char *existing = strarena.strings[index];
+		if ((InternedLength(existing) == len) && (memcmp(existing, str, len) == 0))
+			return(existing);
 
-			else
-				readingvalue = true;	// start quote reached, save the name
-		}
+		index = (index + 1) & (strarena.capacity - 1);
+	}
 
-		else if (line[i] == ' ')
-		{
-			if (readingvalue)
-			{
-				value[vi] += line[i];	// names are not allowed to have whitespace, only add to values
-				vi += 1;
-			}
+	size_t needed = STR_LEN_PREFIX + len + 1;
 
-			else
-			{
-				if (i == length - 1 || line[i + 1] != '"')		// the next char must be a quote to be acceptable
-				{
-					acceptable = false;
-					break;
-				}
-			}
+	strblock_t *block = strarena.blocks;
+	if (!block || ((block->used + needed) > STR_ARENA_BLOCK_SIZE))
+	{
+		block = MemCache_Alloc(sizeof(*block));
+		if (!block)
+		{
+			Log_Write(LOG_ERROR, "Failed to allocate memory for cvar string arena block");
+			return(NULL);
 		}
 
-		else if (line[i] == '#')
-		{
-			if (!readingvalue)
-			{
-				acceptable = false;		// this is a comment, ignore anything after this
-				break;
-			}
+		block->used = 0;
+		block->next = strarena.blocks;
+		strarena.blocks = block;
+	}
 
-			else
-			{
-				value[vi] = line[i];
-				vi += 1;
-			}
-		}
+	unsigned short prefix = (unsigned short)len;
+	char *stored = block->data + block->used + STR_LEN_PREFIX;
 
-		else if (line[i] == '\n' || line[i] == '\r')
-		{
-			acceptable = false;		// we do not allow these characters
-			break;
-		}
+	memcpy(block->data + block->used, &prefix, sizeof(prefix));
+	memcpy(stored, str, len);
+	stored[len] = '\0';
 
-		else
-		{
-			if (readingvalue)
-			{
-				value[vi] = line[i];
-				vi += 1;
-			}
+	block->used += needed;
 
-			else
-			{
-				name[ni] = line[i];
-				ni += 1;
-			}
-		}
+	strarena.strings[index] = stored;
+	strarena.numstrings++;
+
+	if (strarena.numstrings >= (strarena.capacity * 0.75))	// if the table is at 75% capacity, resize it to double
+		GrowInternTable();
+
+	return(stored);
+}
+
+/*
+* Function: FindInterned
+* Finds a string in the string arena without storing it
+* 
+*	str: The string to find, truncated to CVAR_MAX_STR_LEN - 1 characters
+* 
+* Returns: A pointer to the interned string, or NULL if it has not been interned
+*/
+static const char *FindInterned(const char *str)
+{
+	size_t len = Sys_Strlen(str, CVAR_MAX_STR_LEN - 1);
+	size_t index = HashString(str, len) & (strarena.capacity - 1);
+
+	while (strarena.strings[index])
+	{
+		const char *existing = strarena.strings[index];
+		if ((InternedLength(existing) == len) && (memcmp(existing, str, len) == 0))
+			return(existing);
 
-		i++;
+		index = (index + 1) & (strarena.capacity - 1);
 	}
 
-	name[ni] = '\0';
-	value[vi] = '\0';
+	return(NULL);
+}
+
+/*
+* Function: OwnedString
+* Gets the allocation holding a string value that is not in the string arena
+* 
+*	str: The string value
+* 
+* Returns: The allocation, or NULL if the string is interned
+*/
+static ownedstring_t *OwnedString(const char *str)
+{
+	if (FindInterned(str) == str)
+		return(NULL);
 
-	return(acceptable);
+	return((ownedstring_t *)(str - STR_LEN_PREFIX - sizeof(ownedstring_t)));
 }
 
 /*
-* Function: ReadCvarsFromFile
-* Inserts the cvars into the hashmap from the file given. The input file can be a regular config file or an override file
+* Function: AllocString
+* Stores a string value in its own allocation, used for the values set on cvars after they are registered
+* so a value that keeps changing does not fill the string arena
+* 
+*	str: The string to store, truncated to CVAR_MAX_STR_LEN - 1 characters
 * 
-*	infile: The file with the cvars in it
-*	filename: A string to insert into the log messages so you can tell what file it came from
+* Returns: A pointer to the stored string, or NULL if it could not be stored
 */
-static void ReadCvarsFromFile(FILE *infile, const char *filename)
+static const char *AllocString(const char *str)
 {
-	char line[1024] = { 0 };
-	while (fgets(line, sizeof(line), infile))
-	{
-		char cmdline[CMD_MAX_STR_LEN] = { 0 };
+	size_t len = Sys_Strlen(str, CVAR_MAX_STR_LEN - 1);
 
-		if (line[0] == '\n' || line[0] == '\r' || line[0] == '#')
-			continue;
+	ownedstring_t *owned = MemCache_Alloc(sizeof(*owned) + STR_LEN_PREFIX + len + 1);
+	if (!owned)
+	{
+		Log_Write(LOG_ERROR, "Failed to allocate memory for cvar string value");
+		return(NULL);
+	}
 
-		char *args = NULL;
-		char * const cmdname = Sys_Strtok(line, " ", &args);
+	unsigned short prefix = (unsigned short)len;
+	char *stored = (char *)(owned + 1) + STR_LEN_PREFIX;
 
-		if (!cmdname)
-		{
-			Log_Writef(LOG_ERROR, "Failed to read the command name from file: %s", filename);
-			continue;
-		}
+	owned->next = NULL;
+	owned->cvar = NULL;
+	memcpy((char *)(owned + 1), &prefix, sizeof(prefix));
+	memcpy(stored, str, len);
+	stored[len] = '\0';
 
-		if (!args)
-		{
-			Log_Writef(LOG_ERROR, "Failed to read the arguments from file: %s", filename);
-			continue;
-		}
+	return(stored);
+}
 
-		char name[CVAR_MAX_STR_LEN] = { 0 };
-		char value[CVAR_MAX_STR_LEN] = { 0 };
+/*
+* Function: ReclaimStrings
+* Frees the retired string values of every cvar no reader is copying from, a reader that starts after a value was replaced
+* always sees the new value, so once the reader count of a cvar is seen at 0 nothing can still be using its retired values.
+* Readers of one cvar never hold back the values retired from the others
+* 
+*	shutdown: Frees every retired value without looking at the cvars, only when no other thread can be reading them
+*/
+static void ReclaimStrings(bool shutdown)
+{
+	ownedstring_t **link = &retiredstrings;
 
-		if (!GetNameValue(args, Sys_Strlen(args, sizeof(line) - (cmdname - line)), name, value))
+	while (*link)
+	{
+		ownedstring_t *owned = *link;
+		if (!shutdown && (atomic_load(&owned->cvar->readers) != 0))
 		{
-			Log_Writef(LOG_ERROR, "Failed to read cvar from file: %s", filename);
+			link = &owned->next;		// tried again on the next set
 			continue;
 		}
 
-		snprintf(cmdline, sizeof(cmdline), "%s %s %s", cmdname, name, value);
-
-		Cmd_BufferCommand(CMD_EXEC_NOW, cmdline);
+		*link = owned->next;
+		MemCache_Free(owned);
 	}
 }
 
 /*
-* Function: RegisterCvar
-* Registers a cvar with the cvar system and adds it to the cvar hash map.
+* Function: HandleConversionErrors
+* Handles errors that occur during string to numeric type conversion
 * 
-*	name: The name of the cvar
-*	value: The value struct of the cvar
-*	type: The enum type of the cvar
-*	flags: Bitfield to define the cvars properties
-*	description: A short description of the cvar
+*	value: The string to convert for logging purposes
+*	end: If the conversion failed, this will point to the first invalid character
 * 
-* Returns: A pointer to the newly registered cvar
+* Returns: A boolean if the conversion was successful or not
 */
-static cvar_t *RegisterCvar(const char *name, const cvarvalue_t value, const cvartype_t type, const unsigned long long flags, const char *description)
+static bool HandleConversionErrors(const char *value, const char *end)
 {
-	if (!name || !name[0])
+	if (value == end)
 	{
-		Log_Write(LOG_WARN, "Failed to register cvar, invalid cvar name: Cvar name could be empty");
-		return(NULL);
+		Log_Writef(LOG_ERROR, "Failed to convert string to int: %s", value);
+		return(false);
 	}
 
-	cvar_t *existing = Cvar_Find(name);	// check if the cvar already exists and update its params if it does
-	if (existing)
+	if (errno == ERANGE)
 	{
-		Log_Writef(LOG_INFO, "Cvar already exists: (%s): updating new parameters", name);
-		existing->flags = flags;
-		existing->description = description;
-		return(existing);
+		Log_Writef(LOG_ERROR, "%s: Failed to convert string to int: %s", strerror(errno), value);
+		return(false);
 	}
 
-	cvar_t *cvar = MemCache_Alloc(sizeof(*cvar));
-	if (!cvar)
+	if ((errno == 0) && end && (strcmp(end, "") != 0))
 	{
-		Log_Writef(LOG_ERROR, "Failed to allocate memory for cvar: %s", name);
-		return(NULL);
+		Log_Writef(LOG_ERROR, "Invalid characters in string, additional characters remain: %s", value);
+		return(false);
 	}
 
-	char *dupname = MemCache_Alloc(CVAR_MAX_STR_LEN);
-	if (!dupname)
+	if (errno != 0)
 	{
-		Log_Writef(LOG_ERROR, "Failed to allocate memory for cvar name: %s", dupname);
-		MemCache_Free(cvar);
-		return(NULL);
+		Log_Writef(LOG_ERROR, "%s: An error occured: %s", value, strerror(errno));
+		return(false);
+	}
+
+	return(true);
+}
+
+/*
+* Function: GatherCvars
+* Fills in every cvar for the cvar index
+* 
+*	items: Output for the cvars
+* 
+* Returns: The number of cvars written
+*/
+static size_t GatherCvars(void **items)
+{
+	size_t numcvars = 0;
+
+	for (size_t i=0; i<cvarmap->capacity; i++)
+	{
+		for (cvar_t *cvar=cvarmap->cvars[i]; cvar; cvar=cvar->next)
+			items[numcvars++] = cvar;
 	}
 
-	snprintf(dupname, CVAR_MAX_STR_LEN, "%s", name);
+	return(numcvars);
+}
+
+/*
+* Function: BuildCvarIndex
+* Rebuilds the sorted cvar index from the hashmap if cvars have been registered since it was last built
+* 
+* Returns: A boolean if the index is up to date or not
+*/
+static bool BuildCvarIndex(void)
+{
+	return(NameIndex_Build(&cvarindex, cvarmap->numcvars, GatherCvars, "cvar"));
+}
+
+/*
+* Function: FindPrefixRange
+* Finds the range of cvars in the sorted index whose names start with a prefix, rebuilding the index first if needed
+* 
+*	prefix: The name prefix, an empty prefix matches every cvar
+*	first: Output for the index of the first matching cvar
+* 
+* Returns: The number of matching cvars
+*/
+static size_t FindPrefixRange(const char *prefix, size_t *first)
+{
+	*first = 0;
+
+	if (!BuildCvarIndex())
+		return(0);
+
+	return(NameIndex_FindPrefix(&cvarindex, prefix, first));
+}
+
+/*
+* Function: NotifyChange
+* Bumps the modification count of a cvar and runs all of its registered change callbacks
+* 
+*	cvar: The cvar that has changed
+*/
+static void NotifyChange(cvar_t *cvar)
+{
+	atomic_fetch_add_explicit(&cvar->modified, 1, memory_order_release);
+
+	if (cvar->flags & CVAR_ARCHIVE)
+		archivedirty = true;
+
+	cvarlistener_t *current = cvar->listeners;
+	while (current)
+	{
+		cvarlistener_t *next = current->next;		// the callback is allowed to remove itself
+		current->callback(cvar);
+		current = next;
+	}
+}
+
+/*
+* Function: ListAllCvars
+* Lists all the cvars in the hashmap
+*/
+static void ListAllCvars(void)
+{
+	Log_Writef(LOG_INFO, "\t\tCvar Dump [number of cvars: %zu, cvar map capacity: %zu]", cvarmap->numcvars, cvarmap->capacity);
+
+	size_t numcvars = 0;
+	for (size_t i=0; i<cvarmap->capacity; i++)
+	{
+		cvar_t *cvar = cvarmap->cvars[i];
+		while (cvar)
+		{
+			switch (cvar->type)
+			{
+				case CVAR_BOOL:
+					Log_Writef(LOG_INFO, "\t\t\tCvar: %s, Value: %d, Type: %d, Flags: %llu Description: %s", cvar->name, atomic_load(&cvar->value.b), cvar->type, cvar->flags, cvar->description);
+					break;
+
+				case CVAR_INT:
+					Log_Writef(LOG_INFO, "\t\t\tCvar: %s, Value: %d, Type: %d, Flags: %llu, Description: %s", cvar->name, atomic_load(&cvar->value.i), cvar->type, cvar->flags, cvar->description);
+					break;
+
+				case CVAR_FLOAT:
+					Log_Writef(LOG_INFO, "\t\t\tCvar: %s, Value: %f, Type: %d, Flags: %llu, Description: %s", cvar->name, (double)atomic_load(&cvar->value.f), cvar->type, cvar->flags, cvar->description);
+					break;
+
+				case CVAR_STRING:
+					Log_Writef(LOG_INFO, "\t\t\tCvar: %s, Value: %s, Type: %d, Flags: %llu, Description: %s", cvar->name, atomic_load(&cvar->value.s), cvar->type, cvar->flags, cvar->description);
+					break;
+			}
+
+			numcvars++;
+			cvar = cvar->next;
+		}
+	}
+
+	Log_Write(LOG_INFO, "\t\tEnd of Cvar Dump");
+}
+
+/*
+* Function: RegisterCvar
+* Registers a cvar with the cvar system and adds it to the cvar hash map.
+* 
+*	name: The name of the cvar
+*	value: The value struct of the cvar
+*	type: The enum type of the cvar
+*	flags: Bitfield to define the cvars properties
+*	description: A short description of the cvar
+* 
+* Returns: A pointer to the newly registered cvar
+*/
+static cvar_t *RegisterCvar(const char *name, const cvarvalue_t value, const cvartype_t type, const unsigned long long flags, const char *description)
+{
+	if (!name || !name[0])
+	{
+		Log_Write(LOG_WARN, "Failed to register cvar, invalid cvar name: Cvar name could be empty");
+		return(NULL);
+	}
+
+	cvar_t *existing = Cvar_Find(name);	// check if the cvar already exists and update its params if it does
+	if (existing)
+	{
+		Log_Writef(LOG_INFO, "Cvar already exists: (%s): updating new parameters", name);
+
+		if ((existing->flags ^ flags) & CVAR_ARCHIVE)
+			archivedirty = true;
+
+		existing->flags = flags;
+		existing->description = description;
+		return(existing);
+	}
+
+	const char *internname = InternString(name);
+	if (!internname)
+	{
+		Log_Writef(LOG_ERROR, "Failed to store cvar name: %s", name);
+		return(NULL);
+	}
+
+	cvar_t *cvar = MemCache_Alloc(sizeof(*cvar));
+	if (!cvar)
+	{
+		Log_Writef(LOG_ERROR, "Failed to allocate memory for cvar: %s", name);
+		return(NULL);
+	}
+
+	cvar->name = internname;
+	cvar->hash = HashCvarName(internname);
+	cvar->type = type;
+	cvar->flags = flags;
+	cvar->description = description;
+	cvar->listeners = NULL;
+
+	if (flags & CVAR_ARCHIVE)
+		archivedirty = true;
+
+	atomic_init(&cvar->modified, 0);
+	atomic_init(&cvar->readers, 0);
+
+	switch (type)		// the cvar is not visible to other threads until it is in the map
+	{
+		case CVAR_BOOL:
+			atomic_init(&cvar->value.b, value.b);
+			break;
+
+		case CVAR_INT:
+			atomic_init(&cvar->value.i, value.i);
+			break;
+
+		case CVAR_FLOAT:
+			atomic_init(&cvar->value.f, value.f);
+			break;
+
+		case CVAR_STRING:
+			atomic_init(&cvar->value.s, value.s);
+			break;
+	}
+
+	size_t index = cvar->hash & (cvarmap->capacity - 1);
+
+	cvar->next = cvarmap->cvars[index];		// add to start of the bucket list
+	cvarmap->cvars[index] = cvar;
+
+	cvarmap->numcvars++;
+	cvarindex.dirty = true;
+
+	if (cvarmap->numcvars >= (cvarmap->capacity * 0.75))	// if the number of cvars is at 75% capacity, resize the map to double
+	{
+		size_t newcapacity = cvarmap->capacity * 2;
+
+		cvar_t **newcvars = MemCache_Alloc(sizeof(*newcvars) * newcapacity);
+		if (!newcvars)
+		{
+			Log_Write(LOG_ERROR, "Failed to allocate memory for new cvar map, keeping the current map");
+			return(cvar);
+		}
+
+		for (size_t i=0; i<newcapacity; i++)
+			newcvars[i] = NULL;
+
+		for (size_t i=0; i<cvarmap->capacity; i++)
+		{
+			cvar_t *current = cvarmap->cvars[i];
+			while (current)
+			{
+				cvar_t *next = current->next;
+				size_t newindex = current->hash & (newcapacity - 1);
+
+				current->next = newcvars[newindex];
+				newcvars[newindex] = current;
+
+				current = next;
+			}
+		}
+
+		MemCache_Free(cvarmap->cvars);
+		cvarmap->cvars = newcvars;
+		cvarmap->capacity = newcapacity;
+	}
+
+	return(cvar);
+}
+
+/*
+* Function: WriteArchive
+* Writes all the archived cvars into a buffer in the cvar file format in name order, call with a NULL buffer to get the size needed,
+* the cvar index must be built first
+* 
+*	out: The output buffer, can be NULL
+*	outlen: The size of the output buffer
+* 
+* Returns: The length of the archive text, not including the null terminator
+*/
+static size_t WriteArchive(char *out, size_t outlen)
+{
+	size_t len = 0;
+
+	for (size_t i=0; i<cvarindex.numitems; i++)
+	{
+		const cvar_t *cvar = cvarindex.items[i];
+		if (!(cvar->flags & CVAR_ARCHIVE))
+			continue;
+
+		char *dst = out ? out + len : NULL;
+		size_t dstlen = out ? outlen - len : 0;
+		int written = 0;
+
+		switch (cvar->type)
+		{
+			case CVAR_BOOL:
+				written = snprintf(dst, dstlen, "setb %s \"%d\"\n", cvar->name, atomic_load(&cvar->value.b));
+				break;
+
+			case CVAR_INT:
+				written = snprintf(dst, dstlen, "seti %s \"%d\"\n", cvar->name, atomic_load(&cvar->value.i));
+				break;
+
+			case CVAR_FLOAT:
+				written = snprintf(dst, dstlen, "setf %s \"%f\"\n", cvar->name, (double)atomic_load(&cvar->value.f));
+				break;
+
+			case CVAR_STRING:
+				written = snprintf(dst, dstlen, "seta %s \"%s\"\n", cvar->name, atomic_load(&cvar->value.s));
+				break;
+		}
+
+		if (written > 0)
+			len += written;
+	}
+
+	return(len);
+}
+
+/*
+* Function: SetExistingCvar
+* Checks if a cvar that already exists can be set from one of the set commands, logs the reason if it cannot
+* 
+*	cvar: The existing cvar
+*	type: The type of the value the command is trying to set
+* 
+* Returns: A boolean if the cvar can be set or not
+*/
+static bool SetExistingCvar(const cvar_t *cvar, const cvartype_t type)
+{
+	if (cvar->type != type)
+	{
+		Log_Writef(LOG_WARN, "Failed to set cvar, type mismatch: %s", cvar->name);
+		return(false);
+	}
+
+	if (cvar->flags & CVAR_READONLY)
+	{
+		Log_Writef(LOG_WARN, "Failed to set cvar, cvar is read only: %s", cvar->name);
+		return(false);
+	}
+
+	return(true);
+}
+
+/*
+* Function: SetCvarValue
+* Sets a cvar to a value, registers the cvar if it does not exist yet
+* 
+*	type: The type of the value
+*	name: The name of the cvar
+*	value: The value to set
+* 
+* Returns: A boolean if the cvar was set or not
+*/
+static bool SetCvarValue(const cvartype_t type, const char *name, const cvarvalue_t value)
+{
+	cvar_t *cvar = Cvar_Find(name);
+	if (cvar)
+	{
+		if (!SetExistingCvar(cvar, type))
+			return(false);
+
+		switch (type)
+		{
+			case CVAR_BOOL:
+				Cvar_SetBool(cvar, value.b);
+				break;
+
+			case CVAR_INT:
+				Cvar_SetInt(cvar, value.i);
+				break;
+
+			case CVAR_FLOAT:
+				Cvar_SetFloat(cvar, value.f);
+				break;
+
+			case CVAR_STRING:
+				Cvar_SetString(cvar, value.s);
+				break;
+		}
+
+		return(true);
+	}
+
+	switch (type)
+	{
+		case CVAR_BOOL:
+			cvar = Cvar_RegisterBool(name, value.b, CVAR_NONE, "");
+			break;
+
+		case CVAR_INT:
+			cvar = Cvar_RegisterInt(name, value.i, CVAR_NONE, "");
+			break;
+
+		case CVAR_FLOAT:
+			cvar = Cvar_RegisterFloat(name, value.f, CVAR_NONE, "");
+			break;
+
+		case CVAR_STRING:
+			cvar = Cvar_RegisterString(name, value.s, CVAR_NONE, "");
+			break;
+	}
+
+	if (!cvar)
+	{
+		Log_Writef(LOG_ERROR, "Failed to set cvar: %s", name);
+		return(false);
+	}
+
+	return(true);
+}
+
+/*
+* Function: SetCvarFromString
+* Sets a cvar from a string value, converting it to the type given, registers the cvar if it does not exist yet,
+* this is shared by the set commands and the config file reader
+* 
+*	type: The type of the value
+*	name: The name of the cvar
+*	value: The value as a string
+* 
+* Returns: A boolean if the cvar was set or not
+*/
+static bool SetCvarFromString(const cvartype_t type, const char *name, const char *value)
+{
+	cvarvalue_t castval = { 0 };
+
+	errno = 0;
+	char *end = NULL;
+
+	switch (type)
+	{
+		case CVAR_BOOL:
+			castval.b = strtol(value, &end, 10);
+			HandleConversionErrors(value, end);
+			break;
+
+		case CVAR_INT:
+			castval.i = strtol(value, &end, 10);
+			HandleConversionErrors(value, end);
+			break;
+
+		case CVAR_FLOAT:
+			castval.f = strtof(value, &end);
+			HandleConversionErrors(value, end);
+			break;
+
+		case CVAR_STRING:
+			castval.s = value;
+			break;
+	}
+
+	return(SetCvarValue(type, name, castval));
+}
+
+/*
+* Function: Seta_Cmd
+* Sets a cvar to a string value from the command line
+* 
+*	args: The command arguments, argv[1] is the cvar name, argv[2] is the value
+*/
+static void Seta_Cmd(const cmdargs_t *args)
+{
+	if (args->argc != 3)
+	{
+		Log_Writef(LOG_INFO, "Usage: %s [cvarname] \"[value]\"", args->argv[0]);
+		return;
+	}
+
+	SetCvarFromString(CVAR_STRING, args->argv[1], args->argv[2]);
+}
+
+/*
+* Function: Seti_Cmd
+* Sets a cvar to an integer value from the command line
+* 
+* 	args: The command arguments, argv[1] is the cvar name, argv[2] is the value
+*/
+static void Seti_Cmd(const cmdargs_t *args)
+{
+	if (args->argc != 3)
+	{
+		Log_Writef(LOG_INFO, "Usage: %s [cvarname] \"[value]\"", args->argv[0]);
+		return;
+	}
+
+	SetCvarFromString(CVAR_INT, args->argv[1], args->argv[2]);
+}
+
+/*
+* Function: Setf_Cmd
+* Sets a cvar to a float value from the command line
+* 
+* 	args: The command arguments, argv[1] is the cvar name, argv[2] is the value
+*/
+static void Setf_Cmd(const cmdargs_t *args)
+{
+	if (args->argc != 3)
+	{
+		Log_Writef(LOG_INFO, "Usage: %s [cvarname] \"[value]\"", args->argv[0]);
+		return;
+	}
+
+	SetCvarFromString(CVAR_FLOAT, args->argv[1], args->argv[2]);
+}
+
+/*
+* Function: Setb_Cmd
+* Sets a cvar to a boolean value from the command line
+* 
+* 	args: The command arguments, argv[1] is the cvar name, argv[2] is the value
+*/
+static void Setb_Cmd(const cmdargs_t *args)
+{
+	if (args->argc != 3)
+	{
+		Log_Writef(LOG_INFO, "Usage: %s [cvarname] \"[value]\"", args->argv[0]);
+		return;
+	}
+
+	SetCvarFromString(CVAR_BOOL, args->argv[1], args->argv[2]);
+}
+
+/*
+* Function: Cvarlist_Cmd
+* Lists the cvars in name order, optionally only the cvars that start with a prefix and have all of the given flags
+* 
+*	args: The command arguments, an optional name prefix with an optional trailing *, followed by any flag names: cvarlist r_* archive
+*/
+static void Cvarlist_Cmd(const cmdargs_t *args)
+{
+	char prefix[CVAR_MAX_STR_LEN] = { 0 };
+	unsigned long long flags = 0;
+
+	for (int i=1; i<args->argc; i++)
+	{
+		bool isflag = false;
+		for (size_t j=0; j<(sizeof(flagnames) / sizeof(*flagnames)); j++)
+		{
+			if (strcmp(args->argv[i], flagnames[j].name) == 0)
+			{
+				flags |= flagnames[j].flag;
+				isflag = true;
+			}
+		}
+
+		if (isflag)
+			continue;
+
+		if (prefix[0] || (i != 1))
+		{
+			Common_Printf("Usage: %s [prefix*] [archive|readonly|renderer|system|filesystem|game ...]", args->argv[0]);
+			return;
+		}
+
+		if (!NameIndex_ParsePattern(args->argv[i], prefix, sizeof(prefix)))
+		{
+			Common_Printf("Invalid pattern: %s, only a trailing * is supported", args->argv[i]);
+			return;
+		}
+	}
+
+	size_t first = 0;
+	size_t count = FindPrefixRange(prefix, &first);
+	size_t numlisted = 0;
+
+	for (size_t i=first; i<(first + count); i++)
+	{
+		const cvar_t *cvar = cvarindex.items[i];
+		if ((cvar->flags & flags) != flags)
+			continue;
+
+		switch (cvar->type)
+		{
+			case CVAR_BOOL:
+				Common_Printf("%s \"%d\" [flags: %llu]", cvar->name, atomic_load(&cvar->value.b), cvar->flags);
+				break;
+
+			case CVAR_INT:
+				Common_Printf("%s \"%d\" [flags: %llu]", cvar->name, atomic_load(&cvar->value.i), cvar->flags);
+				break;
+
+			case CVAR_FLOAT:
+				Common_Printf("%s \"%f\" [flags: %llu]", cvar->name, (double)atomic_load(&cvar->value.f), cvar->flags);
+				break;
+
+			case CVAR_STRING:
+				Common_Printf("%s \"%s\" [flags: %llu]", cvar->name, atomic_load(&cvar->value.s), cvar->flags);
+				break;
+		}
+
+		numlisted++;
+	}
+
+	Common_Printf("%zu cvars", numlisted);
+}
+
+/*
+* Function: CopyField
+* Copies a field of a config line into a null terminated buffer of CVAR_MAX_STR_LEN bytes
+* 
+*	out: The output buffer
+*	start: The start of the field
+*	length: The length of the field
+* 
+* Returns: A boolean if the field fit in the buffer or not
+*/
+static bool CopyField(char *out, const char *start, size_t length)
+{
+	if (length >= CVAR_MAX_STR_LEN)
+		return(false);
+
+	memcpy(out, start, length);
+	out[length] = '\0';
+
+	return(true);
+}
+
+/*
+* Function: ParseConfigLine
+* Parses a config line in the form: command name "value", the value can contain spaces and '#',
+* anything after the closing quote is ignored
+* 
+*	line: The start of the line, leading whitespace already skipped
+*	length: The length of the line, not including the line ending
+*	out: The parsed line
+* 
+* Returns: NULL if the line was parsed, or a description of the error
+*/
+static const char *ParseConfigLine(const char *line, size_t length, configline_t *out)
+{
+	const char *p = line;
+	const char *end = line + length;
+
+	const char *start = p;
+	while (p < end && *p != ' ' && *p != '\t')
+		p++;
+
+	if (!CopyField(out->cmdname, start, p - start))
+		return("command name is too long");
+
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+
+	start = p;
+	while (p < end && *p != ' ' && *p != '\t' && *p != '"')
+		p++;
+
+	if (p == start)
+		return("missing cvar name");
+
+	if (memchr(start, '#', p - start))		// a comment before the value
+		return("missing quoted value");
+
+	if (!CopyField(out->name, start, p - start))
+		return("cvar name is too long");
+
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+
+	if (p == end || *p != '"')
+		return("missing quoted value");
+
+	start = ++p;
+
+	const char *endquote = memchr(p, '"', end - p);
+	if (!endquote)
+		return("missing closing quote");
+
+	if (!CopyField(out->value, start, endquote - start))
+		return("value is too long");
+
+	return(NULL);
+}
+
+/*
+* Function: ParseCvarText
+* Parses a config file in a single pass, set commands are applied straight to the cvar table,
+* any other command is passed on to the command system
+* 
+*	data: The contents of the config file
+*	size: The size of the contents
+*	filename: The name of the config file, used for error messages
+* 
+* Returns: The number of cvars set
+*/
+static unsigned int ParseCvarText(const char *data, size_t size, const char *filename)
+{
+	unsigned int linenum = 0;
+	unsigned int numset = 0;
 
-	cvar->name = dupname;
-	cvar->value = value;
-	cvar->type = type;
-	cvar->flags = flags;
-	cvar->description = description;
+	const char *p = data;
+	const char *end = data + size;
 
-	cvarentry_t *entry = MemCache_Alloc(sizeof(*entry));
-	if (!entry)
+	while (p < end)
 	{
-		Log_Writef(LOG_ERROR, "Failed to allocate memory for cvar entry: %s", name);
-		MemCache_Free(cvar);
-		MemCache_Free(dupname);
-		return(NULL);
-	}
+		const char *line = p;
+		const char *lineend = memchr(p, '\n', end - p);
 
-	entry->value = cvar;
-	entry->next = NULL;
+		if (lineend)
+			p = lineend + 1;
 
-	size_t index = HashCvarName(name);
+		else
+		{
+			lineend = end;
+			p = end;
+		}
 
-	if (!cvarmap->cvars[index])
-		cvarmap->cvars[index] = entry;
+		linenum++;
 
-	else	// collision, add to start of list
-	{
-		entry->next = cvarmap->cvars[index];
-		cvarmap->cvars[index] = entry;
-	}
+		while (line < lineend && (*line == ' ' || *line == '\t'))
+			line++;
 
-	cvarmap->numcvars++;
+		if (lineend > line && lineend[-1] == '\r')
+			lineend--;
 
-	if (cvarmap->numcvars >= (cvarmap->capacity * 0.75))	// if the number of cvars is at 75% capacity, resize the map to double
-	{
-		cvarmap->capacity *= 2;
+		if (line == lineend || *line == '#')
+			continue;
 
-		cvarentry_t **newcvars = MemCache_Alloc(sizeof(*newcvars) * cvarmap->capacity);
-		if (!newcvars)
+		configline_t parsed;
+		const char *error = ParseConfigLine(line, lineend - line, &parsed);
+		if (error)
 		{
-			Log_Write(LOG_ERROR, "Failed to allocate memory for new cvar map");
-			MemCache_Free(cvarmap->cvars);
-			MemCache_Free(cvarmap);
-			return(NULL);
+			Log_Writef(LOG_ERROR, "%s:%u: Failed to read cvar, %s", filename, linenum, error);
+			continue;
 		}
 
-		for (size_t i=0; i<cvarmap->capacity; i++)
-			newcvars[i] = NULL;
-
-		for (size_t i=0; i<cvarmap->capacity/2; i++)
+		const setcommand_t *setcmd = NULL;
+		for (size_t i=0; !setcmd && i<(sizeof(setcommands) / sizeof(*setcommands)); i++)
 		{
-			cvarentry_t *current = cvarmap->cvars[i];
-			while (current)
-			{
-				cvarentry_t *next = current->next;
-				size_t newindex = HashCvarName(current->value->name);
+			if (strcmp(parsed.cmdname, setcommands[i].name) == 0)
+				setcmd = &setcommands[i];
+		}
 
-				if (!newcvars[newindex])
-					newcvars[newindex] = current;
+		if (!setcmd)
+		{
+			char cmdline[CMD_MAX_STR_LEN] = { 0 };
+			snprintf(cmdline, sizeof(cmdline), "%s %s \"%s\"", parsed.cmdname, parsed.name, parsed.value);
 
-				else
-				{
-					current->next = newcvars[newindex];
-					newcvars[newindex] = current;
-				}
+			Cmd_BufferCommand(CMD_EXEC_NOW, cmdline);
+			continue;
+		}
 
-				current = next;
-			}
+		if (!SetCvarFromString(setcmd->type, parsed.name, parsed.value))
+		{
+			Log_Writef(LOG_ERROR, "%s:%u: Failed to set cvar: %s", filename, linenum, parsed.name);
+			continue;
 		}
 
-		MemCache_Free(cvarmap->cvars);
-		cvarmap->cvars = newcvars;
+		numset++;
 	}
 
-	return(cvar);
+	return(numset);
 }
 
 /*
-* Function: Seta_Cmd
-* Sets a cvar to a string value from the command line
+* Function: ReadCvarSnapshot
+* Reads the cvars from a binary snapshot, the snapshot is only used if it was written alongside the current cvar file
 * 
-*	args: The command arguments, argv[1] is the cvar name, argv[2] is the value
+*	filename: The snapshot file
+*	texthash: The hash of the current cvar file
+*	numset: Output for the number of cvars set
+* 
+* Returns: A boolean if the snapshot was used or not, if not the cvar file has to be parsed instead
 */
-static void Seta_Cmd(const cmdargs_t *args)
+static bool ReadCvarSnapshot(const char *filename, unsigned int texthash, unsigned int *numset)
 {
-	if (args->argc != 3)
-	{
-		Log_Writef(LOG_INFO, "Usage: %s [cvarname] \"[value]\"", args->argv[0]);
-		return;
-	}
+	*numset = 0;
 
-	if (!Cvar_RegisterString(args->argv[1], args->argv[2], CVAR_NONE, ""))
-		Log_Writef(LOG_ERROR, "Failed to set cvar: %s", args->argv[1]);
-}
+	snapshotreader_t reader;
+	if (!Snapshot_Open(&reader, filename, texthash))
+		return(false);
 
-/*
-* Function: Seti_Cmd
-* Sets a cvar to an integer value from the command line
-* 
-* 	args: The command arguments, argv[1] is the cvar name, argv[2] is the value
-*/
-static void Seti_Cmd(const cmdargs_t *args)
-{
-	if (args->argc != 3)
+	snapshotrecord_t record;
+	while (Snapshot_ReadRecord(&reader, &record))
 	{
-		Log_Writef(LOG_INFO, "Usage: %s [cvarname] \"[value]\"", args->argv[0]);
-		return;
+		char name[CVAR_MAX_STR_LEN] = { 0 };
+		char string[CVAR_MAX_STR_LEN] = { 0 };
+		cvarvalue_t value = { 0 };
+
+		if (!CopyField(name, record.key, record.keylen))
+			break;
+
+		bool valid = false;
+		switch (record.tag)
+		{
+			case CVAR_BOOL:
+				valid = (record.valuelen == 1);
+				if (valid)
+					value.b = record.value[0];
+				break;
+
+			case CVAR_INT:
+				valid = (record.valuelen == sizeof(value.i));
+				if (valid)
+					memcpy(&value.i, record.value, sizeof(value.i));
+				break;
+
+			case CVAR_FLOAT:
+				valid = (record.valuelen == sizeof(value.f));
+				if (valid)
+					memcpy(&value.f, record.value, sizeof(value.f));
+				break;
+
+			case CVAR_STRING:
+				valid = CopyField(string, record.value, record.valuelen);
+				value.s = string;
+				break;
+		}
+
+		if (!valid)
+			break;
+
+		if (SetCvarValue(record.tag, name, value))
+			(*numset)++;
 	}
 
-	errno = 0;
-	char *end = NULL;
+	bool complete = (reader.numread == reader.numrecords);		// anything set so far is set again by the text parser if not
 
-	int castval = strtol(args->argv[2], &end, 10);
-	HandleConversionErrors(args->argv[2], end);
+	if (!complete)
+		Log_Writef(LOG_WARN, "Snapshot is damaged, reading the text config instead: %s", filename);
 
-	if (!Cvar_RegisterInt(args->argv[1], castval, CVAR_NONE, ""))
-		Log_Writef(LOG_ERROR, "Failed to set cvar: %s", args->argv[1]);
+	Snapshot_Close(&reader);
+
+	return(complete);
 }
 
 /*
-* Function: Setf_Cmd
-* Sets a cvar to a float value from the command line
+* Function: WriteCvarSnapshot
+* Queues a binary snapshot of the archived cvars to be written, float values are stored as they would be read back
+* from the text file so that both files give exactly the same values, the cvar index must be built first
 * 
-* 	args: The command arguments, argv[1] is the cvar name, argv[2] is the value
+*	filename: The snapshot file
+*	texthash: The hash of the cvar file written with the snapshot
+* 
+* Returns: A boolean if the snapshot was queued or not
 */
-static void Setf_Cmd(const cmdargs_t *args)
+static bool WriteCvarSnapshot(const char *filename, unsigned int texthash)
 {
-	if (args->argc != 3)
+	snapshotwriter_t writer;
+	if (!Snapshot_BeginWrite(&writer, texthash))
+		return(false);
+
+	bool written = true;
+
+	for (size_t i=0; written && i<cvarindex.numitems; i++)
 	{
-		Log_Writef(LOG_INFO, "Usage: %s [cvarname] \"[value]\"", args->argv[0]);
-		return;
-	}
+		const cvar_t *cvar = cvarindex.items[i];
+		if (!(cvar->flags & CVAR_ARCHIVE))
+			continue;
 
-	errno = 0;
-	char *end = NULL;
+		unsigned short namelen = (unsigned short)InternedLength(cvar->name);
+
+		switch (cvar->type)
+		{
+			case CVAR_BOOL:
+			{
+				unsigned char b = atomic_load(&cvar->value.b);
+				written = Snapshot_WriteRecord(&writer, CVAR_BOOL, cvar->name, namelen, &b, sizeof(b));
+				break;
+			}
+
+			case CVAR_INT:
+			{
+				int v = atomic_load(&cvar->value.i);
+				written = Snapshot_WriteRecord(&writer, CVAR_INT, cvar->name, namelen, &v, sizeof(v));
+				break;
+			}
+
+			case CVAR_FLOAT:
+			{
+				char text[CVAR_MAX_STR_LEN] = { 0 };
+				snprintf(text, sizeof(text), "%f", (double)atomic_load(&cvar->value.f));
+
+				float f = strtof(text, NULL);
+				written = Snapshot_WriteRecord(&writer, CVAR_FLOAT, cvar->name, namelen, &f, sizeof(f));
+				break;
+			}
+
+			case CVAR_STRING:
+			{
+				const char *str = atomic_load(&cvar->value.s);
+				written = Snapshot_WriteRecord(&writer, CVAR_STRING, cvar->name, namelen, str, (unsigned short)InternedLength(str));
+				break;
+			}
+		}
+	}
 
-	float castval = strtof(args->argv[2], &end);
-	HandleConversionErrors(args->argv[2], end);
+	if (!written)
+	{
+		Snapshot_CancelWrite(&writer);
+		return(false);
+	}
 
-	if (!Cvar_RegisterFloat(args->argv[1], castval, CVAR_NONE, ""))
-		Log_Writef(LOG_ERROR, "Failed to set cvar: %s", args->argv[1]);
+	return(Snapshot_EndWrite(&writer, filename));
 }
 
 /*
-* Function: Setb_Cmd
-* Sets a cvar to a boolean value from the command line
+* Function: ReadCvarsFromFile
+* Reads a config file, if a snapshot name is given and the snapshot matches the config file the snapshot is read instead
 * 
-* 	args: The command arguments, argv[1] is the cvar name, argv[2] is the value
+*	filename: The config file to read
+*	snapshotname: The snapshot file written alongside the config file, or NULL
 */
-static void Setb_Cmd(const cmdargs_t *args)
+static void ReadCvarsFromFile(const char *filename, const char *snapshotname)
 {
-	if (args->argc != 3)
+	size_t size = 0;
+	char *data = Sys_MapFile(filename, &size);		// user config, read from where it is written rather than through the archives
+	if (!data)
+		return;		// empty files are not mapped, errors are logged by the sys layer
+
+	unsigned long long starttime = Sys_GetMicroseconds();
+	unsigned int numset = 0;
+	bool usedsnapshot = false;
+
+	if (snapshotname)
 	{
-		Log_Writef(LOG_INFO, "Usage: %s [cvarname] \"[value]\"", args->argv[0]);
-		return;
+		archivehash = Snapshot_HashText(data, size);
+		usedsnapshot = ReadCvarSnapshot(snapshotname, archivehash, &numset);
+		snapshotcurrent = usedsnapshot;
 	}
 
-	errno = 0;
-	char *end = NULL;
+	if (!usedsnapshot)
+		numset = ParseCvarText(data, size, filename);
 
-	bool castval = strtol(args->argv[2], &end, 10);
-	HandleConversionErrors(args->argv[2], end);
+	Sys_UnmapFile(data, size);
 
-	if (!Cvar_RegisterBool(args->argv[1], castval, CVAR_NONE, ""))
-		Log_Writef(LOG_ERROR, "Failed to set cvar: %s", args->argv[1]);
+	Log_Writef(LOG_INFO, "Read %u cvars from %s in %llu microseconds", numset, usedsnapshot ? snapshotname : filename, Sys_GetMicroseconds() - starttime);
 }
 
 /*
@@ -525,12 +1390,12 @@ bool Cvar_Init(void)
 	Cmd_RegisterCommand("seti", Seti_Cmd, "Sets or registers a cvar to an integer value");
 	Cmd_RegisterCommand("setf", Setf_Cmd, "Sets or registers a cvar to a float value");
 	Cmd_RegisterCommand("setb", Setb_Cmd, "Sets or registers a cvar to a boolean value");
+	Cmd_RegisterCommand("cvarlist", Cvarlist_Cmd, "Lists all cvars, or the cvars that start with a prefix and have the given flags: cvarlist [prefix*] [flags]");
 
 	cvarmap = MemCache_Alloc(sizeof(*cvarmap));
 	if (!cvarmap)
 	{
 		Log_Write(LOG_ERROR, "Failed to allocate memory for cvar map");
-		fclose(cvarfile);
 		return(false);
 	}
 
@@ -542,20 +1407,30 @@ bool Cvar_Init(void)
 	{
 		Log_Write(LOG_ERROR, "Failed to allocate memory for cvar map entries");
 		MemCache_Free(cvarmap);
-		fclose(cvarfile);
 		return(false);
 	}
 
 	for (size_t i=0; i<cvarmap->capacity; i++)
 		cvarmap->cvars[i] = NULL;
 
+	memset(&cvarindex, 0, sizeof(cvarindex));
+	cvarindex.dirty = true;
+
+	if (!InitStringArena())
+	{
+		MemCache_Free(cvarmap->cvars);
+		MemCache_Free(cvarmap);
+		return(false);
+	}
+
 	if (!Sys_Mkdir(cvardir))
 		return(false);
 
 	snprintf(cvarfullname, sizeof(cvarfullname), "%s/%s", cvardir, cvarfilename);
+	snprintf(cvarsnapshotfullname, sizeof(cvarsnapshotfullname), "%s/%s", cvardir, cvarsnapshotname);
 
 	// read the cvar file and populate the cvar list if cvars exist
-	if (!FileSys_FileExists(cvarfullname))
+	if (!Sys_FileExists(cvarfullname))
 	{
 		cvarfile = fopen(cvarfullname, "w+");	// try to just recreate file, will lose cvars if file cant be read properly
 		if (!cvarfile)
@@ -568,34 +1443,16 @@ bool Cvar_Init(void)
 		cvarfile = NULL;
 	}
 
-	cvarfile = fopen(cvarfullname, "r");
-	if (!cvarfile)
-	{
-		Log_Writef(LOG_ERROR, "Failed to open cvar file: %s", cvarfullname);
-		return(false);
-	}
-
-	ReadCvarsFromFile(cvarfile, cvarfullname);
+	archivehash = Snapshot_HashText(NULL, 0);
+	snapshotcurrent = false;
 
-	fclose(cvarfile);
-	cvarfile = NULL;
+	ReadCvarsFromFile(cvarfullname, cvarsnapshotfullname);
 
 	// read the overrides file and populate the cvar list if cvars exist and if the file exists
-	if (FileSys_FileExists(overridefilename))
+	if (Sys_FileExists(overridefilename))
 	{
-		FILE *overridesfile = fopen(overridefilename, "r");
-		if (!overridesfile)
-		{
-			Log_Writef(LOG_ERROR, "Failed to open overrides file: %s", overridefilename);
-			return(false);
-		}
-
 		Log_Writef(LOG_INFO, "Reading data from the overrides file: %s", overridefilename);
-
-		ReadCvarsFromFile(overridesfile, overridefilename);
-
-		fclose(overridesfile);
-		overridesfile = NULL;
+		ReadCvarsFromFile(overridefilename, NULL);
 	}
 
 	initialized = true;
@@ -620,60 +1477,111 @@ void Cvar_Shutdown(void)
 
 	(void)ListAllCvars;
 
-	cvarfile = fopen(cvarfullname, "w");
-	if (!cvarfile)
-	{
-		Log_Writef(LOG_ERROR, "Failed to open cvar file: %s", cvarfullname);
-		return;
-	}
+	Cvar_FlushArchive();	// the filesystem is already shut down, so this is written straight away if anything changed
 
-	// go through the map and write all the cvars to the file and free the memory
+	// go through the map and free the memory
 	for (size_t i=0; i<cvarmap->capacity; i++)
 	{
-		cvarentry_t *current = cvarmap->cvars[i];
-		while (current)
+		cvar_t *cvar = cvarmap->cvars[i];
+		while (cvar)
 		{
-			cvar_t * const cvar = current->value;
-
-			if (cvar->flags & CVAR_ARCHIVE)
+			cvarlistener_t *listener = cvar->listeners;
+			while (listener)
 			{
-				switch (cvar->type)
-				{
-					case CVAR_BOOL:
-						fprintf(cvarfile, "setb %s \"%d\"\n", cvar->name, cvar->value.b);
-						break;
-
-					case CVAR_INT:
-						fprintf(cvarfile, "seti %s \"%d\"\n", cvar->name, cvar->value.i);
-						break;
-
-					case CVAR_FLOAT:
-						fprintf(cvarfile, "setf %s \"%f\"\n", cvar->name, cvar->value.f);
-						break;
-
-					case CVAR_STRING:
-						fprintf(cvarfile, "seta %s \"%s\"\n", cvar->name, cvar->value.s);
-						break;
-				}
+				cvarlistener_t *nextlistener = listener->next;
+				MemCache_Free(listener);
+				listener = nextlistener;
 			}
 
-			cvarentry_t *next = current->next;
-			MemCache_Free(current->value->name);
-			MemCache_Free(current->value);
-			MemCache_Free(current);
-			current = next;
+			ownedstring_t *owned = (cvar->type == CVAR_STRING) ? OwnedString(atomic_load(&cvar->value.s)) : NULL;
+			if (owned)
+				MemCache_Free(owned);
+
+			cvar_t *next = cvar->next;
+			MemCache_Free(cvar);
+			cvar = next;
 		}
 	}
 
-	fclose(cvarfile);
-	cvarfile = NULL;
-
 	MemCache_Free(cvarmap->cvars);
 	MemCache_Free(cvarmap);
 
+	NameIndex_Free(&cvarindex);
+
+	ReclaimStrings(true);		// every other thread has stopped reading cvars by now, the cvars themselves are already freed
+	ShutdownStringArena();
+
+	archivedirty = false;
+
 	initialized = false;
 }
 
+/*
+* Function: Cvar_FlushArchive
+* Queues the archived cvars to be written to the cvar file and its binary snapshot if any of them have changed since
+* the last flush, the files are written by the filesystem writer thread to a temporary file and renamed over the old one
+*/
+void Cvar_FlushArchive(void)
+{
+	if (!initialized || !archivedirty)
+		return;
+
+	if (!BuildCvarIndex())		// the files are written in name order so unchanged cvars give an unchanged file
+		return;
+
+	size_t size = WriteArchive(NULL, 0);
+
+	char *buffer = MemCache_Alloc(size + 1);
+	if (!buffer)
+	{
+		Log_Writef(LOG_ERROR, "Failed to allocate memory for cvar file: %s", cvarfullname);
+		return;
+	}
+
+	WriteArchive(buffer, size + 1);
+
+	unsigned int hash = Snapshot_HashText(buffer, size);
+	if ((hash == archivehash) && snapshotcurrent)		// the files on disk already hold these values
+	{
+		archivedirty = false;
+		MemCache_Free(buffer);
+		return;
+	}
+
+	if (FileSys_QueueWrite(cvarfullname, buffer, size))
+	{
+		archivedirty = false;
+		archivehash = hash;
+		snapshotcurrent = WriteCvarSnapshot(cvarsnapshotfullname, hash);
+	}
+
+	MemCache_Free(buffer);
+}
+
+/*
+* Function: Cvar_CompleteName
+* Finds the cvars whose names start with a prefix, in name order, for completing partially typed cvar names
+* 
+*	prefix: The name prefix, an empty prefix matches every cvar
+*	names: Output array for the matching names, can be NULL to only count the matches
+*	maxnames: The size of the names array
+* 
+* Returns: The total number of matching cvars, this can be more than maxnames
+*/
+size_t Cvar_CompleteName(const char *prefix, const char **names, size_t maxnames)
+{
+	if (!initialized || !prefix)
+		return(0);
+
+	size_t first = 0;
+	size_t count = FindPrefixRange(prefix, &first);
+
+	for (size_t i=0; names && i<count && i<maxnames; i++)
+		names[i] = ((const cvar_t *)cvarindex.items[first + i])->name;
+
+	return(count);
+}
+
 /*
 * Function: Cvar_Find
 * Finds a cvar in the hashmap
@@ -687,12 +1595,12 @@ cvar_t *Cvar_Find(const char *name)
 	if (!name || !name[0])
 		return(NULL);
 
-	size_t index = HashCvarName(name);
-	cvarentry_t *current = cvarmap->cvars[index];
+	unsigned int hash = HashCvarName(name);
+	cvar_t *current = cvarmap->cvars[hash & (cvarmap->capacity - 1)];
 	while (current)
 	{
-		if (strcmp(current->value->name, name) == 0)
-			return(current->value);
+		if ((current->hash == hash) && (strcmp(current->name, name) == 0))
+			return(current);
 
 		current = current->next;
 	}
@@ -714,7 +1622,13 @@ cvar_t *Cvar_Find(const char *name)
 cvar_t *Cvar_RegisterString(const char *name, const char *value, const unsigned long long flags, const char *description)
 {
 	cvarvalue_t cvarvalue = { 0 };
-	snprintf(cvarvalue.s, sizeof(cvarvalue.s), "%s", value);
+	cvarvalue.s = InternString(value);
+	if (!cvarvalue.s)
+	{
+		Log_Writef(LOG_ERROR, "Failed to store cvar value: %s", name);
+		return(NULL);
+	}
+
 	return(RegisterCvar(name, cvarvalue, CVAR_STRING, flags, description));
 }
 
@@ -774,7 +1688,7 @@ cvar_t *Cvar_RegisterBool(const char *name, const bool value, const unsigned lon
 
 /*
 * Function: Cvar_GetString
-* Gets the string value of a cvar
+* Gets the string value of a cvar, lock free and safe to call from any thread
 * 
 *	cvar: The cvar to get the value from
 *	out: The output buffer to store the value
@@ -786,13 +1700,19 @@ bool Cvar_GetString(const cvar_t *cvar, char *out)
 	if ((!cvar) || (cvar->type != CVAR_STRING))
 		return(false);
 
-	snprintf(out, sizeof(cvar->value.s), "%s", cvar->value.s);
+	atomic_uint *readers = &((cvar_t *)cvar)->readers;		// the reader count is bookkeeping, not part of the value
+	atomic_fetch_add(readers, 1);		// keeps the value from being freed while it is copied
+
+	const char *value = atomic_load(&cvar->value.s);
+	memcpy(out, value, InternedLength(value) + 1);		// stored strings are always shorter than CVAR_MAX_STR_LEN
+
+	atomic_fetch_sub_explicit(readers, 1, memory_order_release);
 	return(true);
 }
 
 /*
 * Function: Cvar_GetInt
-* Gets the integer value of a cvar
+* Gets the integer value of a cvar, lock free and safe to call from any thread
 * 
 *	cvar: The cvar to get the value from
 *	out: The output buffer to store the value
@@ -804,13 +1724,13 @@ bool Cvar_GetInt(const cvar_t *cvar, int *out)
 	if ((!cvar) || (cvar->type != CVAR_INT))
 		return(false);
 
-	*out = cvar->value.i;
+	*out = atomic_load_explicit(&cvar->value.i, memory_order_acquire);
 	return(true);
 }
 
 /*
 * Function: Cvar_GetFloat
-* Gets the float value of a cvar
+* Gets the float value of a cvar, lock free and safe to call from any thread
 * 
 *	cvar: The cvar to get the value from
 *	out: The output buffer to store the value
@@ -822,13 +1742,13 @@ bool Cvar_GetFloat(const cvar_t *cvar, float *out)
 	if ((!cvar) || (cvar->type != CVAR_FLOAT))
 		return(false);
 
-	*out = cvar->value.f;
+	*out = atomic_load_explicit(&cvar->value.f, memory_order_acquire);
 	return(true);
 }
 
 /*
 * Function: Cvar_GetBool
-* Gets the boolean value of a cvar
+* Gets the boolean value of a cvar, lock free and safe to call from any thread
 * 
 *	cvar: The cvar to get the value from
 *	out: The output buffer to store the value
@@ -840,28 +1760,52 @@ bool Cvar_GetBool(const cvar_t *cvar, bool *out)
 	if ((!cvar) || (cvar->type != CVAR_BOOL))
 		return(false);
 
-	*out = cvar->value.b;
+	*out = atomic_load_explicit(&cvar->value.b, memory_order_acquire);
 	return(true);
 }
 
 /*
 * Function: Cvar_SetString
-* Sets the string value of a cvar
+* Sets the string value of a cvar, only the main thread may set cvars
 * 
 *	cvar: The cvar to set the value of
 *	value: The value to set
 */
 void Cvar_SetString(cvar_t *cvar, const char *value)
 {
-	if ((!cvar) || (cvar->type != CVAR_STRING) || (cvar->flags & CVAR_READONLY))
+	if ((!cvar) || (!value) || (cvar->type != CVAR_STRING) || (cvar->flags & CVAR_READONLY))
+		return;
+
+	const char *current = atomic_load_explicit(&cvar->value.s, memory_order_relaxed);		// only the main thread writes
+	size_t len = Sys_Strlen(value, CVAR_MAX_STR_LEN - 1);
+
+	if ((InternedLength(current) == len) && (memcmp(current, value, len) == 0))
+		return;
+
+	const char *newvalue = FindInterned(value);		// a name or registered value is shared, anything else gets its own copy
+	if (!newvalue)
+		newvalue = AllocString(value);
+
+	if (!newvalue)
 		return;
 
-	snprintf(cvar->value.s, sizeof(cvar->value.s), "%s", value);
+	atomic_store(&cvar->value.s, newvalue);
+
+	ownedstring_t *owned = OwnedString(current);
+	if (owned)
+	{
+		owned->next = retiredstrings;
+		owned->cvar = cvar;
+		retiredstrings = owned;
+	}
+
+	ReclaimStrings(false);
+	NotifyChange(cvar);
 }
 
 /*
 * Function: Cvar_SetInt
-* Sets the integer value of a cvar
+* Sets the integer value of a cvar, only the main thread may set cvars
 * 
 *	cvar: The cvar to set the value of
 *	value: The value to set
@@ -871,12 +1815,17 @@ void Cvar_SetInt(cvar_t *cvar, const int value)
 	if ((!cvar) || (cvar->type != CVAR_INT) || (cvar->flags & CVAR_READONLY))
 		return;
 
-	cvar->value.i = value;
+	if (atomic_load_explicit(&cvar->value.i, memory_order_relaxed) == value)		// only the main thread writes
+		return;
+
+	atomic_store_explicit(&cvar->value.i, value, memory_order_release);
+	ReclaimStrings(false);		// values retired while their cvar was being read are freed by the next set of any cvar
+	NotifyChange(cvar);
 }
 
 /*
 * Function: Cvar_SetFloat
-* Sets the float value of a cvar
+* Sets the float value of a cvar, only the main thread may set cvars
 * 
 *	cvar: The cvar to set the value of
 *	value: The value to set
@@ -886,12 +1835,17 @@ void Cvar_SetFloat(cvar_t *cvar, const float value)
 	if ((!cvar) || (cvar->type != CVAR_FLOAT) || (cvar->flags & CVAR_READONLY))
 		return;
 
-	cvar->value.f = value;
+	if (atomic_load_explicit(&cvar->value.f, memory_order_relaxed) == value)		// only the main thread writes
+		return;
+
+	atomic_store_explicit(&cvar->value.f, value, memory_order_release);
+	ReclaimStrings(false);
+	NotifyChange(cvar);
 }
 
 /*
 * Function: Cvar_SetBool
-* Sets the boolean value of a cvar
+* Sets the boolean value of a cvar, only the main thread may set cvars
 * 
 *	cvar: The cvar to set the value of
 *	value: The value to set
@@ -901,5 +1855,93 @@ void Cvar_SetBool(cvar_t *cvar, const bool value)
 	if ((!cvar) || (cvar->type != CVAR_BOOL) || (cvar->flags & CVAR_READONLY))
 		return;
 
-	cvar->value.b = value;
+	if (atomic_load_explicit(&cvar->value.b, memory_order_relaxed) == value)		// only the main thread writes
+		return;
+
+	atomic_store_explicit(&cvar->value.b, value, memory_order_release);
+	ReclaimStrings(false);
+	NotifyChange(cvar);
+}
+
+/*
+* Function: Cvar_GetModifiedCount
+* Gets the number of times the value of a cvar has changed, cache this and compare against it to see if the cvar has been modified
+* 
+*	cvar: The cvar to get the modification count of
+* 
+* Returns: The modification count, 0 if the cvar is NULL or has never changed
+*/
+unsigned int Cvar_GetModifiedCount(const cvar_t *cvar)
+{
+	if (!cvar)
+		return(0);
+
+	return(atomic_load_explicit(&cvar->modified, memory_order_acquire));
+}
+
+/*
+* Function: Cvar_AddCallback
+* Adds a callback that is run every time the value of the cvar changes, the same callback can only be added once per cvar
+* 
+*	cvar: The cvar to watch
+*	callback: The function to call after the value has changed
+* 
+* Returns: A boolean if the callback was added or not
+*/
+bool Cvar_AddCallback(cvar_t *cvar, cvarcallback_t callback)
+{
+	if (!cvar || !callback)
+		return(false);
+
+	for (cvarlistener_t *current=cvar->listeners; current; current=current->next)
+	{
+		if (current->callback == callback)
+			return(true);
+	}
+
+	cvarlistener_t *listener = MemCache_Alloc(sizeof(*listener));
+	if (!listener)
+	{
+		Log_Writef(LOG_ERROR, "Failed to allocate memory for cvar callback: %s", cvar->name);
+		return(false);
+	}
+
+	listener->callback = callback;
+	listener->next = cvar->listeners;
+	cvar->listeners = listener;
+
+	return(true);
+}
+
+/*
+* Function: Cvar_RemoveCallback
+* Removes a callback previously added with Cvar_AddCallback
+* 
+*	cvar: The cvar the callback was added to
+*	callback: The callback to remove
+*/
+void Cvar_RemoveCallback(cvar_t *cvar, cvarcallback_t callback)
+{
+	if (!cvar || !callback)
+		return;
+
+	cvarlistener_t *prev = NULL;
+	cvarlistener_t *current = cvar->listeners;
+	while (current)
+	{
+		if (current->callback == callback)
+		{
+			if (!prev)
+				cvar->listeners = current->next;
+
+			else
+				prev->next = current->next;
+
+			MemCache_Free(current);
+			return;
+		}
+
+		prev = current;
+		current = current->next;
+	}
 }
@@ -56,6 +56,9 @@ static void ProcessEvent(event_t event)
 {
 	if (event.type == EVENT_KEY)
 		Input_ProcessKeyInput(event.evar1, event.evar2);
+
+	else if (event.type == EVENT_FILEIO)
+		FileSys_CompleteRead((unsigned int)event.evar1);
 }
 
 /*
@@ -102,8 +105,10 @@ void Event_Shutdown(void)
 * 	type: The type of event
 * 	var1: The first event variable
 * 	var2: The second event variable
+* 
+* Returns: A boolean if the event was queued or not, events are discarded when the queue is full
 */
-void Event_QueueEvent(const eventtype_t type, int var1, int var2)
+bool Event_QueueEvent(const eventtype_t type, int var1, int var2)
 {
 	if (eventcount >= MAX_EVENTS)
 	{
@@ -113,7 +118,7 @@ void Event_QueueEvent(const eventtype_t type, int var1, int var2)
 			lastlogframe = currentframe;
 		}
 
-		return;
+		return(false);
 	}
 
 	eventqueue[queuetail].type = type;
@@ -121,6 +126,8 @@ void Event_QueueEvent(const eventtype_t type, int var1, int var2)
 	eventqueue[queuetail].evar2 = var2;
 	queuetail = (queuetail + 1) % MAX_EVENTS;
 	eventcount++;
+
+	return(true);
 }
 
 /*
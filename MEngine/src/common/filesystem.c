@@ -1,191 +1,2635 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include "sys/sys.h"
 #include "common.h"
+#include "pak.h"
+#include "compress.h"
+
+#define FS_MAX_PENDING_WRITES 16
+#define FS_MAX_PAKS 64
+#define FS_DEF_INDEX_CAPACITY 1024
+#define FS_TEMP_EXT ".tmp"
+#define FS_MAX_READS 256				// the slot index is stored in the low bits of a read handle
+#define FS_READ_SLOT_BITS 8
+#define FS_READ_MAX_GENERATION 0x7fffff	// keeps handles positive so they fit in an event variable
+#define FS_MAX_READ_THREADS 8
+#define FS_PAGE_SIZE 4096
+#define FS_MAX_DIR_CACHE 32
+#define FS_DEF_FILE_LIST_SIZE 64
+#define FS_CACHE_BUCKETS 256
+
+typedef enum
+{
+	WRITE_FREE = 0,
+	WRITE_PENDING,
+	WRITE_ACTIVE,
+	WRITE_DONE
+} writestate_t;
+
+typedef struct
+{
+	writestate_t state;
+	char filename[SYS_MAX_PATH];
+	void *data;
+	size_t size;
+} writejob_t;
+
+typedef enum
+{
+	FILTER_ALL = 0,			// "*"
+	FILTER_EXACT,			// no wildcards
+	FILTER_PREFIX,			// "name*"
+	FILTER_SUFFIX,			// "*.ext"
+	FILTER_PREFIX_SUFFIX,	// "name*.ext"
+	FILTER_GLOB				// more than one wildcard
+} filtertype_t;
+
+typedef struct
+{
+	filtertype_t type;
+	const char *pattern;
+	size_t prefixlen;		// the prefix is the start of the pattern
+	const char *suffix;
+	size_t suffixlen;
+} fsfilter_t;
+
+typedef enum
+{
+	READ_FREE = 0,
+	READ_PENDING,
+	READ_ACTIVE,
+	READ_DONE
+} readstate_t;
+
+typedef struct
+{
+	readstate_t state;
+	unsigned int generation;		// bumped each time the slot is freed so old handles are rejected
+	unsigned long long sequence;	// reads of the same priority are served in submission order
+	fspriority_t priority;
+	char filename[SYS_MAX_PATH];
+	size_t offset;
+	size_t length;
+	void *buffer;					// caller owned buffer, or NULL to get a view of the mapped file
+	const void *view;				// the mapping to release once the read is delivered
+	size_t viewsize;
+	const void *data;
+	size_t size;
+	bool failed;
+	bool posted;					// an event for the read is in the event queue
+	fsreadcallback_t callback;
+	void *userdata;
+} readrequest_t;
+
+typedef struct
+{
+	char directory[SYS_MAX_PATH];
+	filedata_t *files;				// every file in the directory with its stats, unfiltered
+	unsigned int numfiles;
+	void *watch;					// the cache entry is rebuilt when the watch reports a change
+	unsigned long long lastused;
+} dircache_t;
+
+typedef struct
+{
+	char filename[SYS_MAX_PATH];
+	char *data;					// the whole archive, mapped while the archive is mounted
+	size_t size;
+	time_t mtime;
+	pakheader_t header;
+	pakentry_t *entries;		// the central directory, the string table follows the entries in the same allocation
+	const char *strings;
+	size_t stringsize;
+} pakfile_t;
+
+typedef struct
+{
+	const pakentry_t *entry;	// NULL if the slot is empty
+	pakfile_t *pak;
+} fsnode_t;
+
+typedef struct		// every file in every mounted archive, open addressing keyed by the hash of the normalized path
+{
+	fsnode_t *nodes;
+	size_t numnodes;
+	size_t capacity;
+} fsindex_t;
+
+typedef struct
+{
+	char path[SYS_MAX_PATH];		// normalized path, the key for the content cache
+	const fsnode_t *node;			// set if the file is in a mounted archive
+	char loosepath[SYS_MAX_PATH];	// set if the file is in the data directory
+	time_t mtime;
+	size_t size;
+} fileref_t;
+
+typedef struct
+{
+	const unsigned char *src;		// the stored data, compressed blocks or the file itself
+	size_t srcsize;
+	size_t srcoffset;
+	size_t size;					// the uncompressed size of the file
+	size_t offset;					// the uncompressed position of the next read
+	bool compressed;
+	unsigned char *block;			// scratch of COMPRESS_BLOCK_SIZE bytes for a block that is only partly read, can be NULL
+	size_t blocksize;
+	size_t blockoffset;
+	bool failed;
+} streamstate_t;
+
+struct fsstream
+{
+	streamstate_t state;
+	char filename[SYS_MAX_PATH];
+	size_t bytesread;				// recorded as one read when the stream is closed
+	unsigned long long readtime;
+	const void *view;				// the mapping of a file that is not in an archive
+	size_t viewsize;
+	unsigned char block[COMPRESS_BLOCK_SIZE];
+};
+
+typedef struct cacheentry
+{
+	char path[SYS_MAX_PATH];
+	unsigned int hash;
+	time_t mtime;
+	size_t size;
+	unsigned int refcount;
+	bool stale;						// replaced by a newer version of the file, freed on the last release
+	struct cacheentry *hashnext;
+	struct cacheentry *prev;		// least recently used list, the head is the most recently used
+	struct cacheentry *next;
+} cacheentry_t;
+
+#define FS_CACHE_HEADER_SIZE ((sizeof(cacheentry_t) + 15) & ~(size_t)15)		// the file data follows the header, kept 16 byte aligned
 
 static cvar_t *fsbasepath;
 static cvar_t *fssavepath;
 static cvar_t *fsdatapath;
 
+static char datapath[SYS_MAX_PATH];
+static pakfile_t paks[FS_MAX_PAKS];			// in mount order, the last mounted archive has the highest priority
+static unsigned int numpaks;
+static fsindex_t fsindex;
+
+static mutex_t *writelock;
+static condvar_t *writecond;
+static thread_t *writethread;
+static bool stopwriter;
+static writejob_t writequeue[FS_MAX_PENDING_WRITES];
+
+static cvar_t *fsreadthreads;
+static mutex_t *readlock;
+static condvar_t *readcond;			// signalled when a read is submitted
+static condvar_t *readdonecond;		// broadcast when a read finishes
+static thread_t *readthreads[FS_MAX_READ_THREADS];
+static unsigned int numreadthreads;
+static bool stopreaders;
+static unsigned long long nextreadsequence;
+static readrequest_t readrequests[FS_MAX_READS];
+
+static cvar_t *fsdircache;
+static dircache_t dircache[FS_MAX_DIR_CACHE];		// only used from the main thread
+static unsigned long long dircacheclock;
+
+static cvar_t *fscachesize;
+static cacheentry_t *cachebuckets[FS_CACHE_BUCKETS];		// only used from the main thread
+static cacheentry_t *lruhead;
+static cacheentry_t *lrutail;
+static size_t cachebytes;
+static unsigned int cacheentries;
+static unsigned long long cachehits;
+static unsigned long long cachemisses;
+static unsigned long long cacheevictions;
+
 static bool initialized;
 
 /*
-* Function: PathMatchSpec
-* Matches a path to a filter, can also be a file type
+* Function: CompileFilter
+* Compiles a filename filter once so it can be matched against many names, filters with a single wildcard
+* are turned into plain prefix and suffix compares, anything else falls back to a full wildcard match
+* 
+*	filter: The filter to compile, wildcard as *, the string must outlive the compiled filter
+*	out: The compiled filter
+*/
+static void CompileFilter(const char *filter, fsfilter_t *out)
+{
+	memset(out, 0, sizeof(*out));
+	out->pattern = filter;
+
+	const char *star = strchr(filter, '*');
+	if (!star)
+	{
+		out->type = FILTER_EXACT;
+		return;
+	}
+
+	if (strchr(star + 1, '*'))
+	{
+		const char *rest = star;
+		while (*rest == '*')
+			rest++;
+
+		out->type = (*rest || (star != filter)) ? FILTER_GLOB : FILTER_ALL;		// "**" is the same as "*"
+		return;
+	}
+
+	out->prefixlen = (size_t)(star - filter);
+	out->suffix = star + 1;
+	out->suffixlen = strlen(out->suffix);
+
+	if ((out->prefixlen == 0) && (out->suffixlen == 0))
+		out->type = FILTER_ALL;
+
+	else if (out->prefixlen == 0)
+		out->type = FILTER_SUFFIX;		// the common "*.ext" case
+
+	else if (out->suffixlen == 0)
+		out->type = FILTER_PREFIX;
+
+	else
+		out->type = FILTER_PREFIX_SUFFIX;
+}
+
+/*
+* Function: MatchGlob
+* Matches a name against a filter with any number of wildcards, without recursion,
+* on a mismatch only the most recent wildcard is retried so the match is never exponential
 * 
-*	path: The full path or filename to match
+*	name: The name to match
 *	filter: The filter to match against, wildcard as *
 * 
-* Returns: A boolean if the path matches the filter
+* Returns: A boolean if the name matches the filter
 */
-static bool PathMatchSpec(const char *path, const char *filter)
+static bool MatchGlob(const char *name, const char *filter)
 {
-	while (*filter && *path)
+	const char *star = NULL;
+	const char *resume = NULL;
+
+	while (*name)
 	{
 		if (*filter == '*')
 		{
-			filter++;
-			if (!*filter)
-				return(true);
+			star = filter++;
+			resume = name;
+		}
 
-			while (*path)
-			{
-				if (PathMatchSpec(filter, path))
-					return(true);
+		else if (*filter == *name)
+		{
+			filter++;
+			name++;
+		}
 
-				path++;
-			}
+		else if (star)
+		{
+			filter = star + 1;
+			name = ++resume;
 		}
-		
-		else if (*filter != *path)
+
+		else
 			return(false);
+	}
 
+	while (*filter == '*')
 		filter++;
-		path++;
-	}
 
-	return(!*filter && !*path);
+	return(*filter == '\0');
 }
 
 /*
-* Function: FileSys_Init
-* Initializes the filesystem, if no PAK files are found, the filesystem will use the regular disk instead of the PAKs
+* Function: MatchFilter
+* Matches a name against a compiled filter
 * 
-*	basepath: The base path for the engine, if NULL or empty, the current working directory will be used, all paths will be relative to this base path
+*	name: The name to match
+*	filter: The compiled filter
 * 
-* Returns: A boolean if initialization was successful or not
+* Returns: A boolean if the name matches the filter
 */
-bool FileSys_Init(const char *basepath)
+static bool MatchFilter(const char *name, const fsfilter_t *filter)
 {
-	if (initialized)
-		return(true);
+	switch (filter->type)
+	{
+		case FILTER_ALL:
+			return(true);
 
-	char basepathbuf[SYS_MAX_PATH] = { 0 };
-	snprintf(basepathbuf, SYS_MAX_PATH, "%s", (!basepath || !basepath[0]) ? basepath : "");
+		case FILTER_EXACT:
+			return(strcmp(name, filter->pattern) == 0);
 
-	fsbasepath = Cvar_RegisterString("fs_basepath", basepathbuf, CVAR_FILESYSTEM | CVAR_READONLY, "The base path for the engine. Defaults to the path of the installation");
-	fssavepath = Cvar_RegisterString("fs_savepath", "save", CVAR_FILESYSTEM, "The path to the games save files, relative to the base path");
-	fsdatapath = Cvar_RegisterString("fs_datapath", "data", CVAR_FILESYSTEM, "The path to the games data files, relative to the base path");
+		case FILTER_GLOB:
+			return(MatchGlob(name, filter->pattern));
 
-	initialized = true;
+		default:
+			break;
+	}
 
-	return(true);
+	size_t namelen = strlen(name);
+	if (namelen < (filter->prefixlen + filter->suffixlen))
+		return(false);
+
+	return((strncmp(name, filter->pattern, filter->prefixlen) == 0)
+		&& (memcmp(name + namelen - filter->suffixlen, filter->suffix, filter->suffixlen) == 0));
 }
 
 /*
-* Function: FileSys_Shutdown
-* Shuts down the filesystem
+* Function: ReadDirectory
+* Reads the files in a directory in one pass into a list that grows as needed, directories are skipped
+* 
+* 	directory: The directory to read
+* 	filter: The filter to apply to the file names, or NULL to keep every file
+* 	stats: If the file stats should be read, if not only the filenames are filled and no stat calls are made
+* 	numfiles: The number of files found
+* 
+* Returns: A list of filedata_t structs, or NULL if the directory could not be read or has no matching files
 */
-void FileSys_Shutdown(void)
+static filedata_t *ReadDirectory(const char *directory, const fsfilter_t *filter, bool stats, unsigned int *numfiles)
 {
-	if (!initialized)
-		return;
+	*numfiles = 0;
 
-	Log_Write(LOG_INFO, "Shutting down filesystem");
+	unsigned long long start = FSTrace_Begin();
 
-	initialized = false;
+	void *dir = Sys_OpenDir(directory);
+	if (!dir)
+		return(NULL);
+
+	filedata_t *filelist = NULL;
+	unsigned int capacity = 0;
+	unsigned int filecount = 0;
+
+	char filename[SYS_MAX_PATH] = { 0 };
+	bool isdirectory = false;
+
+	while (Sys_ReadDir(dir, filename, SYS_MAX_PATH, &isdirectory))
+	{
+		if (isdirectory || (filter && !MatchFilter(filename, filter)))
+			continue;
+
+		char filepath[SYS_MAX_PATH] = { 0 };
+		if (snprintf(filepath, SYS_MAX_PATH, "%s/%s", directory, filename) >= SYS_MAX_PATH)
+		{
+			Log_Writef(LOG_WARN, "File path too long: %s/%s", directory, filename);
+			continue;
+		}
+
+		if (filecount == capacity)
+		{
+			unsigned int newcapacity = capacity ? (capacity * 2) : FS_DEF_FILE_LIST_SIZE;
+
+			filedata_t *newlist = MemCache_Alloc(newcapacity * sizeof(*newlist));
+			if (!newlist)
+			{
+				if (filelist)
+					MemCache_Free(filelist);
+
+				Sys_CloseDir(dir);
+				return(NULL);
+			}
+
+			if (filelist)
+			{
+				memcpy(newlist, filelist, filecount * sizeof(*filelist));
+				MemCache_Free(filelist);
+			}
+
+			filelist = newlist;
+			capacity = newcapacity;
+		}
+
+		filedata_t *filedata = &filelist[filecount++];
+		memset(filedata, 0, sizeof(*filedata));
+		snprintf(filedata->filename, SYS_MAX_PATH, "%s", filepath);
+
+		if (stats)
+		{
+			unsigned long long statstart = FSTrace_Begin();
+			Sys_Stat(filepath, filedata);
+			FSTrace_Record(FS_IO_STAT, filepath, 0, statstart);
+		}
+	}
+
+	Sys_CloseDir(dir);
+
+	FSTrace_Record(FS_IO_LIST, directory, 0, start);
+
+	*numfiles = filecount;
+	return(filelist);
 }
 
 /*
-* Function: FileSys_FileExists
-* Checks if a file exists on the filesystem
+* Function: FreeDirCacheEntry
+* Frees a directory cache entry and stops watching its directory
 * 
-* 	filename: The filename to check
+* 	entry: The cache entry
+*/
+static void FreeDirCacheEntry(dircache_t *entry)
+{
+	if (entry->files)
+		MemCache_Free(entry->files);
+
+	Sys_UnwatchDir(entry->watch);
+	memset(entry, 0, sizeof(*entry));
+}
+
+/*
+* Function: GetDirCacheEntry
+* Gets the cached listing of a directory, reading the directory if it is not cached or has changed
 * 
-* Returns: A boolean if the file exists or not
+* 	directory: The directory
+* 
+* Returns: The cache entry, or NULL if the directory cannot be cached
 */
-bool FileSys_FileExists(const char *filename)
+static dircache_t *GetDirCacheEntry(const char *directory)
 {
-	if (!filename)
-		return(false);
+	bool usecache = false;
+	if (!initialized || !Cvar_GetBool(fsdircache, &usecache) || !usecache)
+		return(NULL);
 
-	FILE *file = fopen(filename, "r");
-	if (!file)
-		return(false);
+	dircache_t *entry = NULL;
+	dircache_t *oldest = &dircache[0];
 
-	fclose(file);
-	return(true);
+	for (int i=0; !entry && i<FS_MAX_DIR_CACHE; i++)
+	{
+		if (dircache[i].watch && (strcmp(dircache[i].directory, directory) == 0))
+			entry = &dircache[i];
+
+		else if (!dircache[i].watch || (oldest->watch && (dircache[i].lastused < oldest->lastused)))
+			oldest = &dircache[i];
+	}
+
+	if (entry && Sys_DirChanged(entry->watch))
+	{
+		if (entry->files)
+			MemCache_Free(entry->files);
+
+		entry->files = ReadDirectory(directory, NULL, true, &entry->numfiles);
+	}
+
+	if (!entry)
+	{
+		void *watch = Sys_WatchDir(directory);
+		if (!watch)
+			return(NULL);		// not supported on this platform or the directory is missing
+
+		FreeDirCacheEntry(oldest);		// evict the least recently used directory when the cache is full
+
+		entry = oldest;
+		snprintf(entry->directory, SYS_MAX_PATH, "%s", directory);
+		entry->watch = watch;
+		entry->files = ReadDirectory(directory, NULL, true, &entry->numfiles);
+	}
+
+	entry->lastused = ++dircacheclock;
+
+	return(entry);
 }
 
 /*
-* Function: FileSys_ListFiles
-* Lists all files in a directory with a given filter
+* Function: ListFilesInDirectory
+* Lists the files in a directory with a given filter, from the directory cache when it is enabled
 * 
 * 	numfiles: The number of files found
 * 	directory: The directory to search
 * 	filter: The filter to apply to the file list
+* 	stats: If the file stats are needed
 * 
 * Returns: A list of filedata_t structs
 */
-filedata_t *FileSys_ListFiles(unsigned int *numfiles, const char *directory, const char *filter)
+static filedata_t *ListFilesInDirectory(unsigned int *numfiles, const char *directory, const char *filter, bool stats)
 {
-	void *dir = Sys_OpenDir(directory);
-	if (!dir)
-	{
-		*numfiles = 0;
+	*numfiles = 0;
+
+	if (!directory || !filter)
 		return(NULL);
-	}
 
-	unsigned int filecount = 0;
-	char filename[SYS_MAX_PATH] = { 0 };
+	fsfilter_t compiled;
+	CompileFilter(filter, &compiled);
+
+	const dircache_t *entry = GetDirCacheEntry(directory);
+	if (!entry)
+		return(ReadDirectory(directory, &compiled, stats, numfiles));
 
-	while (Sys_ReadDir(dir, filename, SYS_MAX_PATH))
+	size_t dirlen = Sys_Strlen(directory, SYS_MAX_PATH) + 1;		// the cached names include the directory
+
+	unsigned int filecount = 0;
+	for (unsigned int i=0; i<entry->numfiles; i++)
 	{
-		if (PathMatchSpec(filename, filter))
+		if (MatchFilter(entry->files[i].filename + dirlen, &compiled))
 			filecount++;
 	}
 
 	if (filecount == 0)
-	{
-		Sys_CloseDir(dir);
-		*numfiles = 0;
 		return(NULL);
+
+	filedata_t *filelist = MemCache_Alloc(filecount * sizeof(*filelist));
+	if (!filelist)
+		return(NULL);
+
+	unsigned int index = 0;
+	for (unsigned int i=0; (i < entry->numfiles) && (index < filecount); i++)
+	{
+		if (MatchFilter(entry->files[i].filename + dirlen, &compiled))
+			filelist[index++] = entry->files[i];
 	}
 
 	*numfiles = filecount;
+	return(filelist);
+}
 
-	filedata_t *filelist = MemCache_Alloc(filecount * sizeof(*filelist));
-	if (!filelist)
+/*
+* Function: HashPath
+* Hashes a normalized path, using the FNV-1a algorithm, this must match the hash stored in the pak entries
+* 
+*	path: The normalized path
+* 
+* Returns: The hash value
+*/
+static unsigned int HashPath(const char *path)
+{
+	unsigned int hash = 2166136261u;
+
+	for (; *path; path++)
 	{
-		Sys_CloseDir(dir);
-		return(NULL);
+		hash ^= (unsigned char)*path;
+		hash *= 16777619u;
 	}
 
-	Sys_CloseDir(dir);	// reset the directory pointer
-	dir = NULL;
+	return(hash);
+}
+
+/*
+* Function: NormalizePath
+* Normalizes a path the same way paths are stored in pak archives, forward slashes only, lower case,
+* no leading slash, no empty or "." path segments
+* 
+*	path: The path to normalize
+*	out: The output buffer
+*	outlen: The size of the output buffer
+* 
+* Returns: A boolean if the path fit in the output buffer or not
+*/
+static bool NormalizePath(const char *path, char *out, size_t outlen)
+{
+	size_t len = 0;
 
-	dir = Sys_OpenDir(directory);
-	if (!dir)
+	for (size_t i=0; path[i]; i++)
 	{
-		MemCache_Free(filelist);
-		return(NULL);
+		char c = (path[i] == '\\') ? '/' : (char)tolower((unsigned char)path[i]);
+		char next = (path[i + 1] == '\\') ? '/' : path[i + 1];
+
+		if ((c == '/') && ((len == 0) || (out[len - 1] == '/')))
+			continue;
+
+		if ((c == '.') && ((len == 0) || (out[len - 1] == '/')) && ((next == '/') || (next == '\0')))
+			continue;
+
+		if ((len + 1) >= outlen)
+			return(false);
+
+		out[len++] = c;
 	}
 
-	unsigned int index = 0;
-	while (Sys_ReadDir(dir, filename, SYS_MAX_PATH))
+	out[len] = '\0';
+
+	return(true);
+}
+
+/*
+* Function: FindNode
+* Finds a file in the archive index
+* 
+*	path: The normalized path of the file
+* 
+* Returns: The index node of the file, or NULL if no mounted archive has the file
+*/
+static fsnode_t *FindNode(const char *path)
+{
+	if (fsindex.numnodes == 0)
+		return(NULL);
+
+	unsigned int hash = HashPath(path);
+
+	for (size_t i=hash & (fsindex.capacity - 1); fsindex.nodes[i].entry; i=(i + 1) & (fsindex.capacity - 1))
 	{
-		if (PathMatchSpec(filename, filter))
-		{
-			size_t dirlen = Sys_Strlen(directory, SYS_MAX_PATH) + 1;
-			size_t filelen = Sys_Strlen(filename, SYS_MAX_PATH) + 1;
+		fsnode_t *node = &fsindex.nodes[i];
 
-			if ((dirlen + filelen) > SYS_MAX_PATH)
-			{
-				Log_Writef(LOG_WARN, "File path too long: %s/%s", directory, filename);
-				continue;
-			}
+		if ((node->entry->pathhash == hash) && (strcmp(node->pak->strings + node->entry->pathoffset, path) == 0))
+			return(node);
+	}
+
+	return(NULL);
+}
 
-			char filepath[SYS_MAX_PATH + 1] = { 0 };
-			snprintf(filepath, SYS_MAX_PATH + 1, "%s/%s", directory, filename);
+/*
+* Function: LooseFileExists
+* Checks if a file exists on the filesystem, outside of the mounted archives, with a single stat and without opening it
+* 
+*	path: The path of the file
+* 
+* Returns: A boolean if the file exists or not
+*/
+static bool LooseFileExists(const char *path)
+{
+	unsigned long long start = FSTrace_Begin();
+	bool exists = Sys_FileExists(path);
+	FSTrace_Record(FS_IO_STAT, path, 0, start);
 
-			Sys_Stat(filepath, &filelist[index]);
-			index++;
-		}
+	return(exists);
+}
+
+/*
+* Function: BuildLoosePath
+* Builds the path of a loose file in the data directory, a path that does not fit is logged and never used shortened
+* 
+* 	filename: The path of the file relative to the data directory
+* 	loosepath: Output for the path, SYS_MAX_PATH in size
+* 
+* Returns: A boolean if the path fits or not
+*/
+static bool BuildLoosePath(const char *filename, char *loosepath)
+{
+	if (snprintf(loosepath, SYS_MAX_PATH, "%s/%s", datapath, filename) >= SYS_MAX_PATH)
+	{
+		Log_Writef(LOG_WARN, "File path too long: %s/%s", datapath, filename);
+		return(false);
 	}
 
-	Sys_CloseDir(dir);
-	return(filelist);
+	return(true);
+}
+
+/*
+* Function: MountPak
+* Maps a pak archive, copies its central directory and adds it to the mounted archives,
+* the archive stays mapped until shutdown so files can be read straight out of the mapping
+* 
+*	filename: The pak file to mount
+*	mtime: The modification time of the pak file
+* 
+* Returns: A boolean if the archive was mounted or not
+*/
+static bool MountPak(const char *filename, time_t mtime)
+{
+	if (numpaks >= FS_MAX_PAKS)
+	{
+		Log_Writef(LOG_WARN, "Too many pak files, not mounting: %s", filename);
+		return(false);
+	}
+
+	pakfile_t *pak = &paks[numpaks];
+	memset(pak, 0, sizeof(*pak));
+
+	unsigned long long start = FSTrace_Begin();
+	pak->data = Sys_MapFile(filename, &pak->size);
+	FSTrace_Record(FS_IO_OPEN, filename, pak->size, start);
+
+	if (!pak->data)
+	{
+		Log_Writef(LOG_ERROR, "Failed to map pak file: %s", filename);
+		return(false);
+	}
+
+	if (pak->size >= sizeof(pak->header))
+		memcpy(&pak->header, pak->data, sizeof(pak->header));
+
+	if ((pak->size < sizeof(pak->header))
+		|| (memcmp(pak->header.magic, PAK_MAGIC, PAK_MAGIC_LEN) != 0)
+		|| (pak->header.version != PAK_VERSION)
+		|| (pak->header.diroffset > pak->size)
+		|| (pak->header.dirsize > (pak->size - pak->header.diroffset))
+		|| (pak->header.dirsize < ((unsigned long long)pak->header.entrycount * sizeof(pakentry_t))))
+	{
+		Log_Writef(LOG_ERROR, "Invalid pak file header: %s", filename);
+		Sys_UnmapFile(pak->data, pak->size);
+		return(false);
+	}
+
+	if (pak->header.dirsize > 0)
+	{
+		pak->entries = MemCache_Alloc((size_t)pak->header.dirsize + 1);		// copied so the entries are aligned and the string table is terminated
+		if (!pak->entries)
+		{
+			Log_Writef(LOG_ERROR, "Failed to allocate memory for the pak directory: %s", filename);
+			Sys_UnmapFile(pak->data, pak->size);
+			return(false);
+		}
+
+		memcpy(pak->entries, pak->data + pak->header.diroffset, (size_t)pak->header.dirsize);
+
+		pak->strings = (const char *)(pak->entries + pak->header.entrycount);
+		pak->stringsize = (size_t)pak->header.dirsize - (pak->header.entrycount * sizeof(pakentry_t));
+		((char *)pak->entries)[pak->header.dirsize] = '\0';
+	}
+
+	for (unsigned int i=0; i<pak->header.entrycount; i++)
+	{
+		const pakentry_t *entry = &pak->entries[i];
+
+		if ((entry->pathoffset >= pak->stringsize)
+			|| (entry->offset > pak->size)
+			|| (entry->storedsize > (pak->size - entry->offset)))
+		{
+			Log_Writef(LOG_ERROR, "Invalid pak directory entry %u: %s", i, filename);
+			MemCache_Free(pak->entries);
+			Sys_UnmapFile(pak->data, pak->size);
+			return(false);
+		}
+	}
+
+	snprintf(pak->filename, SYS_MAX_PATH, "%s", filename);
+	pak->mtime = mtime;
+	numpaks++;
+
+	Log_Writef(LOG_INFO, "Mounted pak file: %s [files: %u]", filename, pak->header.entrycount);
+
+	return(true);
+}
+
+/*
+* Function: BuildIndex
+* Builds the index of every file in the mounted archives, archives mounted later replace the files of earlier archives
+* 
+* Returns: A boolean if the index was built or not
+*/
+static bool BuildIndex(void)
+{
+	size_t numentries = 0;
+	for (unsigned int i=0; i<numpaks; i++)
+		numentries += paks[i].header.entrycount;
+
+	if (numentries == 0)
+		return(true);
+
+	size_t capacity = FS_DEF_INDEX_CAPACITY;
+	while (capacity < (numentries * 2))		// keep the load factor at or below 50%
+		capacity *= 2;
+
+	fsindex.nodes = MemCache_Alloc(sizeof(*fsindex.nodes) * capacity);
+	if (!fsindex.nodes)
+	{
+		Log_Write(LOG_ERROR, "Failed to allocate memory for the filesystem index");
+		return(false);
+	}
+
+	memset(fsindex.nodes, 0, sizeof(*fsindex.nodes) * capacity);
+	fsindex.capacity = capacity;
+	fsindex.numnodes = 0;
+
+	for (unsigned int i=0; i<numpaks; i++)
+	{
+		pakfile_t *pak = &paks[i];
+
+		for (unsigned int j=0; j<pak->header.entrycount; j++)
+		{
+			const pakentry_t *entry = &pak->entries[j];
+			const char *path = pak->strings + entry->pathoffset;
+
+			size_t index = entry->pathhash & (capacity - 1);
+			while (fsindex.nodes[index].entry)
+			{
+				fsnode_t *node = &fsindex.nodes[index];
+				if ((node->entry->pathhash == entry->pathhash) && (strcmp(node->pak->strings + node->entry->pathoffset, path) == 0))
+					break;
+
+				index = (index + 1) & (capacity - 1);
+			}
+
+			if (!fsindex.nodes[index].entry)
+				fsindex.numnodes++;
+
+			fsindex.nodes[index].entry = entry;
+			fsindex.nodes[index].pak = pak;
+		}
+	}
+
+	return(true);
+}
+
+/*
+* Function: ComparePakNames
+* Compares two pak files by name, paks are mounted in name order
+* 
+*	a: The first filedata_t struct
+*	b: The second filedata_t struct
+* 
+* Returns: The result of comparing the names
+*/
+static int ComparePakNames(const void *a, const void *b)
+{
+	return(strcmp(((const filedata_t *)a)->filename, ((const filedata_t *)b)->filename));
+}
+
+/*
+* Function: MountSearchPaths
+* Mounts every pak file in the data directory in name order and builds the file index
+* 
+* Returns: A boolean if the search paths were mounted or not
+*/
+static bool MountSearchPaths(void)
+{
+	fsfilter_t filter;
+	CompileFilter("*" PAK_EXTENSION, &filter);
+
+	unsigned int filecount = 0;
+	filedata_t *filelist = ReadDirectory(datapath, &filter, true, &filecount);
+
+	if (!filelist)
+		return(true);		// no archives, all files are read from the data directory
+
+	qsort(filelist, filecount, sizeof(*filelist), ComparePakNames);
+
+	for (unsigned int i=0; i<filecount; i++)
+		MountPak(filelist[i].filename, filelist[i].mtime);
+
+	FileSys_FreeFileList(&filelist);
+
+	return(BuildIndex());
+}
+
+/*
+* Function: UnmountSearchPaths
+* Closes all the mounted pak files and frees the file index
+*/
+static void UnmountSearchPaths(void)
+{
+	for (unsigned int i=0; i<numpaks; i++)
+	{
+		if (paks[i].entries)
+			MemCache_Free(paks[i].entries);
+
+		if (paks[i].data)
+			Sys_UnmapFile(paks[i].data, paks[i].size);
+	}
+
+	memset(paks, 0, sizeof(paks));
+	numpaks = 0;
+
+	if (fsindex.nodes)
+		MemCache_Free(fsindex.nodes);
+
+	memset(&fsindex, 0, sizeof(fsindex));
+}
+
+/*
+* Function: ResolveFile
+* Finds where a file is read from, the mounted archives are searched first in priority order, then the data directory
+* 
+*	filename: The path of the file relative to the data directory
+*	ref: Output for the location, size and modification time of the file
+* 
+* Returns: A boolean if the file was found or not
+*/
+static bool ResolveFile(const char *filename, fileref_t *ref)
+{
+	memset(ref, 0, sizeof(*ref));
+
+	if (!NormalizePath(filename, ref->path, SYS_MAX_PATH))
+	{
+		Log_Writef(LOG_WARN, "File path too long: %s", filename);
+		return(false);
+	}
+
+	ref->node = FindNode(ref->path);
+	if (ref->node)
+	{
+		ref->mtime = ref->node->pak->mtime;		// archives do not change while they are mounted
+		ref->size = (size_t)ref->node->entry->size;
+		return(true);
+	}
+
+	if (!BuildLoosePath(filename, ref->loosepath))
+		return(false);
+
+	filedata_t filedata = { 0 };
+	unsigned long long start = FSTrace_Begin();
+	bool found = Sys_StatFile(ref->loosepath, &filedata);		// one stat both checks the file exists and gets its size and time
+	FSTrace_Record(FS_IO_STAT, ref->loosepath, 0, start);
+
+	if (!found)
+		return(false);
+
+	ref->mtime = filedata.mtime;
+	ref->size = filedata.filesize;
+
+	return(true);
+}
+
+/*
+* Function: StreamInit
+* Starts reading a file as a stream, from an archive entry or from a view of an uncompressed file
+* 
+*	stream: The stream to start
+*	node: The archive entry to read, or NULL to read the view
+*	view: The uncompressed file if node is NULL
+*	viewsize: The size of the view
+*	block: Scratch of COMPRESS_BLOCK_SIZE bytes, only needed for reads that do not end on a block boundary
+*/
+static void StreamInit(streamstate_t *stream, const fsnode_t *node, const void *view, size_t viewsize, unsigned char *block)
+{
+	memset(stream, 0, sizeof(*stream));
+	stream->block = block;
+
+	if (!node)
+	{
+		stream->src = view;
+		stream->srcsize = viewsize;
+		stream->size = viewsize;
+		return;
+	}
+
+	stream->src = (const unsigned char *)node->pak->data + node->entry->offset;
+	stream->srcsize = (size_t)node->entry->storedsize;
+	stream->size = (size_t)node->entry->size;
+	stream->compressed = (node->entry->flags & PAK_ENTRY_COMPRESSED) != 0;
+
+	if (!stream->compressed && (stream->size > stream->srcsize))
+		stream->failed = true;
+}
+
+/*
+* Function: StreamNextBlock
+* Reads and checks the header of the next compressed block in a stream
+* 
+*	stream: The stream
+*	storedsize: Output for the size of the block data
+*	rawsize: Output for the uncompressed size of the block
+* 
+* Returns: A boolean if the block header is valid or not, the stream is marked as failed if not
+*/
+static bool StreamNextBlock(streamstate_t *stream, unsigned int *storedsize, unsigned int *rawsize)
+{
+	if ((stream->srcsize - stream->srcoffset) < PAK_BLOCK_HEADER_SIZE)
+	{
+		stream->failed = true;
+		return(false);
+	}
+
+	memcpy(storedsize, stream->src + stream->srcoffset, sizeof(*storedsize));
+	memcpy(rawsize, stream->src + stream->srcoffset + sizeof(*storedsize), sizeof(*rawsize));
+
+	if ((*rawsize == 0) || (*rawsize > COMPRESS_BLOCK_SIZE) || (*rawsize > (stream->size - stream->offset))
+		|| (*storedsize > *rawsize) || (*storedsize > (stream->srcsize - stream->srcoffset - PAK_BLOCK_HEADER_SIZE)))
+	{
+		stream->failed = true;
+		return(false);
+	}
+
+	return(true);
+}
+
+/*
+* Function: StreamDecodeBlock
+* Decodes the next block of a stream, the block header must have been checked with StreamNextBlock
+* 
+*	stream: The stream
+*	storedsize: The size of the block data
+*	rawsize: The uncompressed size of the block
+*	dst: Output for the uncompressed block, at least rawsize bytes
+* 
+* Returns: A boolean if the block was decoded or not, the stream is marked as failed if not
+*/
+static bool StreamDecodeBlock(streamstate_t *stream, unsigned int storedsize, unsigned int rawsize, unsigned char *dst)
+{
+	const unsigned char *data = stream->src + stream->srcoffset + PAK_BLOCK_HEADER_SIZE;
+
+	if (storedsize == rawsize)		// the block did not compress and is stored as is
+		memcpy(dst, data, rawsize);
+
+	else if (!Decompress_Block(data, storedsize, dst, rawsize))
+	{
+		stream->failed = true;
+		return(false);
+	}
+
+	stream->srcoffset += PAK_BLOCK_HEADER_SIZE + storedsize;
+
+	return(true);
+}
+
+/*
+* Function: StreamRead
+* Reads the next bytes of a stream, whole blocks are decoded straight into the output and only
+* a block that does not fit is decoded into the stream scratch
+* 
+*	stream: The stream
+*	dst: Output for the data
+*	length: The number of bytes to read
+* 
+* Returns: The number of bytes read, less than length at the end of the file or if the data is corrupt
+*/
+static size_t StreamRead(streamstate_t *stream, void *dst, size_t length)
+{
+	unsigned char *out = dst;
+	size_t total = 0;
+
+	while ((length > 0) && (stream->offset < stream->size) && !stream->failed)
+	{
+		size_t count = 0;
+
+		if (stream->blockoffset < stream->blocksize)
+		{
+			count = ((stream->blocksize - stream->blockoffset) < length) ? (stream->blocksize - stream->blockoffset) : length;
+			memcpy(out, stream->block + stream->blockoffset, count);
+			stream->blockoffset += count;
+		}
+
+		else if (!stream->compressed)
+		{
+			count = ((stream->size - stream->offset) < length) ? (stream->size - stream->offset) : length;
+			memcpy(out, stream->src + stream->offset, count);
+		}
+
+		else
+		{
+			unsigned int storedsize = 0;
+			unsigned int rawsize = 0;
+			if (!StreamNextBlock(stream, &storedsize, &rawsize))
+				break;
+
+			if (rawsize <= length)
+			{
+				if (!StreamDecodeBlock(stream, storedsize, rawsize, out))
+					break;
+
+				count = rawsize;
+			}
+
+			else
+			{
+				if (!stream->block)
+				{
+					stream->failed = true;
+					break;
+				}
+
+				if (!StreamDecodeBlock(stream, storedsize, rawsize, stream->block))
+					break;
+
+				stream->blocksize = rawsize;
+				stream->blockoffset = 0;
+				continue;
+			}
+		}
+
+		out += count;
+		length -= count;
+		stream->offset += count;
+		total += count;
+	}
+
+	return(total);
+}
+
+/*
+* Function: StreamSkip
+* Moves a stream forward without reading, compressed blocks that are skipped whole are not decoded
+* 
+*	stream: The stream
+*	count: The number of bytes to skip
+* 
+* Returns: A boolean if the bytes were skipped or not
+*/
+static bool StreamSkip(streamstate_t *stream, size_t count)
+{
+	while ((count > 0) && (stream->offset < stream->size) && !stream->failed)
+	{
+		size_t skip = 0;
+
+		if (stream->blockoffset < stream->blocksize)
+		{
+			skip = ((stream->blocksize - stream->blockoffset) < count) ? (stream->blocksize - stream->blockoffset) : count;
+			stream->blockoffset += skip;
+		}
+
+		else if (!stream->compressed)
+			skip = ((stream->size - stream->offset) < count) ? (stream->size - stream->offset) : count;
+
+		else
+		{
+			unsigned int storedsize = 0;
+			unsigned int rawsize = 0;
+			if (!StreamNextBlock(stream, &storedsize, &rawsize))
+				break;
+
+			if (rawsize <= count)
+			{
+				stream->srcoffset += PAK_BLOCK_HEADER_SIZE + storedsize;
+				skip = rawsize;
+			}
+
+			else
+			{
+				if (!stream->block)
+				{
+					stream->failed = true;
+					break;
+				}
+
+				if (!StreamDecodeBlock(stream, storedsize, rawsize, stream->block))
+					break;
+
+				stream->blocksize = rawsize;
+				stream->blockoffset = 0;
+				continue;
+			}
+		}
+
+		count -= skip;
+		stream->offset += skip;
+	}
+
+	return(!stream->failed && (count == 0));
+}
+
+/*
+* Function: LoadFile
+* Reads a resolved file into a new null terminated buffer, the buffer can have room for a header before the file data
+* 
+*	ref: The file found by ResolveFile
+*	headersize: The number of bytes to reserve before the file data
+* 
+* Returns: The start of the buffer, the file data starts headersize bytes in, or NULL if the file could not be read
+*/
+static char *LoadFile(const fileref_t *ref, size_t headersize)
+{
+	char *buffer = MemCache_Alloc(headersize + ref->size + 1);
+	if (!buffer)
+	{
+		Log_Writef(LOG_ERROR, "Failed to allocate memory for file: %s", ref->path);
+		return(NULL);
+	}
+
+	char *data = buffer + headersize;
+
+	if (ref->node)
+	{
+		streamstate_t stream;
+		StreamInit(&stream, ref->node, NULL, 0, NULL);		// the whole file is read so every block is decoded in place
+
+		if (StreamRead(&stream, data, ref->size) != ref->size)
+		{
+			Log_Writef(LOG_ERROR, "Failed to read corrupt file in pak: %s", ref->path);
+			MemCache_Free(buffer);
+			return(NULL);
+		}
+	}
+
+	else
+	{
+		unsigned long long start = FSTrace_Begin();
+		FILE *file = fopen(ref->loosepath, "rb");
+		FSTrace_Record(FS_IO_OPEN, ref->loosepath, 0, start);
+
+		if (!file || ((ref->size > 0) && (fread(data, ref->size, 1, file) != 1)))
+		{
+			Log_Writef(LOG_ERROR, "Failed to read file: %s", ref->loosepath);
+			MemCache_Free(buffer);
+
+			if (file)
+				fclose(file);
+
+			return(NULL);
+		}
+
+		fclose(file);
+	}
+
+	data[ref->size] = '\0';
+
+	return(buffer);
+}
+
+/*
+* Function: UnlinkCacheEntry
+* Removes a content cache entry from the lookup table and the least recently used list, the entry is not freed
+* 
+*	entry: The cache entry
+*/
+static void UnlinkCacheEntry(cacheentry_t *entry)
+{
+	cacheentry_t **link = &cachebuckets[entry->hash & (FS_CACHE_BUCKETS - 1)];
+	while (*link && (*link != entry))
+		link = &(*link)->hashnext;
+
+	if (*link)
+		*link = entry->hashnext;
+
+	if (entry->prev)
+		entry->prev->next = entry->next;
+
+	else
+		lruhead = entry->next;
+
+	if (entry->next)
+		entry->next->prev = entry->prev;
+
+	else
+		lrutail = entry->prev;
+
+	entry->hashnext = NULL;
+	entry->prev = NULL;
+	entry->next = NULL;
+	cacheentries--;
+}
+
+/*
+* Function: LinkCacheEntry
+* Adds a content cache entry to the lookup table and as the most recently used entry
+* 
+*	entry: The cache entry
+*/
+static void LinkCacheEntry(cacheentry_t *entry)
+{
+	cacheentry_t **bucket = &cachebuckets[entry->hash & (FS_CACHE_BUCKETS - 1)];
+	entry->hashnext = *bucket;
+	*bucket = entry;
+
+	entry->prev = NULL;
+	entry->next = lruhead;
+
+	if (lruhead)
+		lruhead->prev = entry;
+
+	lruhead = entry;
+
+	if (!lrutail)
+		lrutail = entry;
+
+	cacheentries++;
+}
+
+/*
+* Function: FreeCacheEntry
+* Frees a content cache entry that is no longer linked
+* 
+*	entry: The cache entry
+*/
+static void FreeCacheEntry(cacheentry_t *entry)
+{
+	cachebytes -= entry->size;
+	MemCache_Free(entry);
+}
+
+/*
+* Function: EvictCacheEntries
+* Frees the least recently used content cache entries that are not in use until the cache fits in fs_cachesize
+*/
+static void EvictCacheEntries(void)
+{
+	int budgetmb = 0;
+	Cvar_GetInt(fscachesize, &budgetmb);
+
+	size_t budget = (budgetmb > 0) ? ((size_t)budgetmb * 1024 * 1024) : 0;
+
+	cacheentry_t *entry = lrutail;
+	while (entry && (cachebytes > budget))
+	{
+		cacheentry_t *prev = entry->prev;
+
+		if (entry->refcount == 0)
+		{
+			UnlinkCacheEntry(entry);
+			FreeCacheEntry(entry);
+			cacheevictions++;
+		}
+
+		entry = prev;
+	}
+}
+
+/*
+* Function: FlushContentCache
+* Frees every content cache entry, entries still in use are left to be freed when they are released
+*/
+static void FlushContentCache(void)
+{
+	cacheentry_t *entry = lruhead;
+	while (entry)
+	{
+		cacheentry_t *next = entry->next;
+
+		UnlinkCacheEntry(entry);
+
+		if (entry->refcount == 0)
+			FreeCacheEntry(entry);
+
+		else
+			entry->stale = true;
+
+		entry = next;
+	}
+}
+
+/*
+* Function: Fscacheinfo_Cmd
+* Prints the content cache statistics, "fscacheinfo flush" also empties the cache
+* 
+* 	args: The command arguments, argv[1] can be flush
+*/
+static void Fscacheinfo_Cmd(const cmdargs_t *args)
+{
+	if ((args->argc > 1) && (strcmp(args->argv[1], "flush") == 0))
+		FlushContentCache();
+
+	fscachestats_t stats;
+	FileSys_GetCacheStats(&stats);
+
+	unsigned long long lookups = stats.hits + stats.misses;
+
+	Common_Printf("Content cache: %u files, %zu / %zu bytes", stats.numentries, stats.bytesused, stats.budget);
+	Common_Printf("Hits: %llu, misses: %llu (%.1f%% hit rate), evictions: %llu",
+		stats.hits,
+		stats.misses,
+		lookups ? ((double)stats.hits * 100.0 / (double)lookups) : 0.0,
+		stats.evictions
+	);
+}
+
+/*
+* Function: WriteFileAtomic
+* Writes data to a temporary file, syncs it to the disk and renames it over the target file,
+* a crash during the write leaves either the old file or the new file, never a partial one
+* 
+*	filename: The file to write
+*	data: The data to write
+*	size: The size of the data in bytes
+* 
+* Returns: A boolean if the file was written or not
+*/
+static bool WriteFileAtomic(const char *filename, const void *data, size_t size)
+{
+	char tempname[SYS_MAX_PATH] = { 0 };
+	if (snprintf(tempname, SYS_MAX_PATH, "%s%s", filename, FS_TEMP_EXT) >= SYS_MAX_PATH)
+	{
+		Log_Writef(LOG_ERROR, "File path too long: %s", filename);
+		return(false);
+	}
+
+	unsigned long long start = FSTrace_Begin();
+
+	FILE *file = fopen(tempname, "wb");
+	if (!file)
+	{
+		Log_Writef(LOG_ERROR, "Failed to open file for writing: %s", tempname);
+		return(false);
+	}
+
+	bool written = (fwrite(data, 1, size, file) == size) && Sys_SyncFile(file);
+	fclose(file);
+
+	FSTrace_Record(FS_IO_WRITE, filename, size, start);
+
+	if (!written || !Sys_Rename(tempname, filename))
+	{
+		Log_Writef(LOG_ERROR, "Failed to write file: %s", filename);
+		remove(tempname);
+		return(false);
+	}
+
+	return(true);
+}
+
+/*
+* Function: ReclaimFinishedWrites
+* Frees the data of all the write jobs the writer thread has finished, the write lock must be held
+*/
+static void ReclaimFinishedWrites(void)
+{
+	for (int i=0; i<FS_MAX_PENDING_WRITES; i++)
+	{
+		writejob_t *job = &writequeue[i];
+
+		if (job->state == WRITE_DONE)
+		{
+			MemCache_Free(job->data);
+			memset(job, 0, sizeof(*job));
+		}
+	}
+}
+
+/*
+* Function: ProcessWriteQueue
+* Writes the queued files to the disk in another thread, all pending writes are finished before the thread exits
+* 
+*	args: The arguments to the thread function, unused for this function
+* 
+* Returns: NULL, the thread will exit when the function returns
+*/
+static void *ProcessWriteQueue(void *args)
+{
+	(void)args;
+
+	Sys_LockMutex(writelock);
+
+	while (1)
+	{
+		writejob_t *job = NULL;
+		for (int i=0; !job && i<FS_MAX_PENDING_WRITES; i++)
+		{
+			if (writequeue[i].state == WRITE_PENDING)
+				job = &writequeue[i];
+		}
+
+		if (!job)
+		{
+			if (stopwriter)
+				break;
+
+			Sys_WaitCondVar(writecond, writelock);
+			continue;
+		}
+
+		job->state = WRITE_ACTIVE;	// the main thread will not touch an active job, so the lock can be dropped for the write
+		Sys_UnlockMutex(writelock);
+
+		WriteFileAtomic(job->filename, job->data, job->size);
+
+		Sys_LockMutex(writelock);
+		job->state = WRITE_DONE;
+	}
+
+	Sys_UnlockMutex(writelock);
+
+	return(NULL);
+}
+
+/*
+* Function: MapView
+* Maps a file as a read only view without recording it as a filesystem operation, see FileSys_MapFile
+* 
+*	filename: The path of the file relative to the data directory
+*	size: Output for the size of the view in bytes
+* 
+* Returns: A read only view of the file, or NULL if the file was not found, is empty or is compressed
+*/
+static const void *MapView(const char *filename, size_t *size)
+{
+	*size = 0;
+
+	if (!filename)
+		return(NULL);
+
+	char loosepath[SYS_MAX_PATH] = { 0 };
+
+	if (initialized)
+	{
+		char normalized[SYS_MAX_PATH] = { 0 };
+		const fsnode_t *node = NormalizePath(filename, normalized, SYS_MAX_PATH) ? FindNode(normalized) : NULL;
+
+		if (node && (node->entry->flags & PAK_ENTRY_COMPRESSED))
+		{
+			Log_Writef(LOG_WARN, "Cannot map a compressed file, use a stream instead: %s", filename);
+			return(NULL);
+		}
+
+		if (node)
+		{
+			*size = (size_t)node->entry->size;
+			return(node->pak->data + node->entry->offset);
+		}
+
+		if (!BuildLoosePath(filename, loosepath))
+			return(NULL);
+
+		if (LooseFileExists(loosepath))
+			filename = loosepath;
+	}
+
+	unsigned long long start = FSTrace_Begin();
+	const void *view = Sys_MapFile(filename, size);
+	FSTrace_Record(FS_IO_OPEN, filename, *size, start);
+
+	return(view);
+}
+
+/*
+* Function: PerformRead
+* Reads the data for an async read request, called from a read thread without the read lock held
+* 
+*	request: The active read request
+*/
+static void PerformRead(readrequest_t *request)
+{
+	char normalized[SYS_MAX_PATH] = { 0 };
+	const fsnode_t *node = NormalizePath(request->filename, normalized, SYS_MAX_PATH) ? FindNode(normalized) : NULL;
+
+	if (node && (node->entry->flags & PAK_ENTRY_COMPRESSED))		// decoded straight into the callers buffer, compressed files have no view
+	{
+		unsigned char block[COMPRESS_BLOCK_SIZE];
+
+		streamstate_t stream;
+		StreamInit(&stream, node, NULL, 0, block);
+
+		size_t available = (request->offset <= stream.size) ? (stream.size - request->offset) : 0;
+		size_t length = request->length ? request->length : available;
+
+		if (!request->buffer || (request->offset > stream.size) || (length > available)
+			|| !StreamSkip(&stream, request->offset) || (StreamRead(&stream, request->buffer, length) != length))
+		{
+			Log_Writef(LOG_ERROR, "Async read of compressed file failed, a buffer is required: %s [offset: %zu, length: %zu]", request->filename, request->offset, request->length);
+			request->failed = true;
+			return;
+		}
+
+		request->data = request->buffer;
+		request->size = length;
+		return;
+	}
+
+	size_t viewsize = 0;
+	const char *view = MapView(request->filename, &viewsize);
+
+	size_t available = (view && (request->offset <= viewsize)) ? (viewsize - request->offset) : 0;
+	size_t length = request->length ? request->length : available;
+
+	if (!view || (request->offset > viewsize) || (length > available))
+	{
+		Log_Writef(LOG_ERROR, "Async read failed: %s [offset: %zu, length: %zu]", request->filename, request->offset, request->length);
+		FileSys_UnmapFile(view, viewsize);
+		request->failed = true;
+		return;
+	}
+
+	if (request->buffer)
+	{
+		memcpy(request->buffer, view + request->offset, length);
+		FileSys_UnmapFile(view, viewsize);
+
+		request->data = request->buffer;
+		request->size = length;
+		return;
+	}
+
+	volatile unsigned char touch = 0;		// fault the pages in here so the main thread never waits on the disk
+	for (size_t i=0; i<length; i+=FS_PAGE_SIZE)
+		touch ^= (unsigned char)view[request->offset + i];
+
+	(void)touch;
+
+	request->view = view;
+	request->viewsize = viewsize;
+	request->data = view + request->offset;
+	request->size = length;
+}
+
+/*
+* Function: ProcessReadQueue
+* Serves async read requests in a read thread, the highest priority request is always taken first
+* 
+*	args: The arguments to the thread function, unused for this function
+* 
+* Returns: NULL, the thread will exit when the function returns
+*/
+static void *ProcessReadQueue(void *args)
+{
+	(void)args;
+
+	Sys_LockMutex(readlock);
+
+	while (1)
+	{
+		readrequest_t *request = NULL;
+		for (int i=0; i<FS_MAX_READS; i++)
+		{
+			readrequest_t *candidate = &readrequests[i];
+			if (candidate->state != READ_PENDING)
+				continue;
+
+			if (!request || (candidate->priority > request->priority)
+				|| ((candidate->priority == request->priority) && (candidate->sequence < request->sequence)))
+				request = candidate;
+		}
+
+		if (!request)
+		{
+			if (stopreaders)
+				break;
+
+			Sys_WaitCondVar(readcond, readlock);
+			continue;
+		}
+
+		request->state = READ_ACTIVE;	// the main thread will not touch an active request, so the lock can be dropped for the read
+		Sys_UnlockMutex(readlock);
+
+		unsigned long long start = FSTrace_Begin();
+		PerformRead(request);
+
+		if (!request->failed)
+			FSTrace_Record(FS_IO_READ, request->filename, request->size, start);
+
+		Sys_LockMutex(readlock);
+		request->state = READ_DONE;
+		Sys_BroadcastCondVar(readdonecond);
+	}
+
+	Sys_UnlockMutex(readlock);
+
+	return(NULL);
+}
+
+/*
+* Function: FindReadRequest
+* Finds the slot of a read handle, the read lock must be held
+* 
+*	handle: The read handle
+* 
+* Returns: The read request, or NULL if the handle is not in use
+*/
+static readrequest_t *FindReadRequest(unsigned int handle)
+{
+	readrequest_t *request = &readrequests[handle & (FS_MAX_READS - 1)];
+
+	if ((request->state == READ_FREE) || (request->generation != (handle >> FS_READ_SLOT_BITS)))
+		return(NULL);
+
+	return(request);
+}
+
+/*
+* Function: ReleaseReadRequest
+* Frees a read request slot so it can be reused, the read lock must be held
+* 
+*	request: The read request
+*/
+static void ReleaseReadRequest(readrequest_t *request)
+{
+	unsigned int generation = (request->generation % FS_READ_MAX_GENERATION) + 1;
+
+	memset(request, 0, sizeof(*request));
+	request->generation = generation;
+}
+
+/*
+* Function: StartReadThreads
+* Creates the async read threads, the number of threads is set by fs_readthreads
+* 
+* Returns: A boolean if the read threads were started or not
+*/
+static bool StartReadThreads(void)
+{
+	int threadcount = 0;
+	Cvar_GetInt(fsreadthreads, &threadcount);
+
+	if (threadcount < 1)
+		threadcount = 1;
+
+	if (threadcount > FS_MAX_READ_THREADS)
+		threadcount = FS_MAX_READ_THREADS;
+
+	memset(readrequests, 0, sizeof(readrequests));
+	for (int i=0; i<FS_MAX_READS; i++)
+		readrequests[i].generation = 1;
+
+	stopreaders = false;
+	nextreadsequence = 0;
+
+	readlock = Sys_CreateMutex();
+	readcond = Sys_CreateCondVar();
+	readdonecond = Sys_CreateCondVar();
+
+	if (!readlock || !readcond || !readdonecond)
+		return(false);
+
+	for (numreadthreads=0; numreadthreads<(unsigned int)threadcount; numreadthreads++)
+	{
+		readthreads[numreadthreads] = Sys_CreateThread(ProcessReadQueue, NULL);
+		if (!readthreads[numreadthreads])
+			return(false);
+	}
+
+	return(true);
+}
+
+/*
+* Function: StopReadThreads
+* Stops the async read threads, reads that have not started are dropped and finished reads are not delivered
+*/
+static void StopReadThreads(void)
+{
+	if (readlock)
+	{
+		Sys_LockMutex(readlock);
+		stopreaders = true;
+
+		for (int i=0; i<FS_MAX_READS; i++)
+		{
+			if (readrequests[i].state == READ_PENDING)
+				ReleaseReadRequest(&readrequests[i]);
+		}
+
+		Sys_UnlockMutex(readlock);
+	}
+
+	if (readcond)
+		Sys_BroadcastCondVar(readcond);
+
+	for (unsigned int i=0; i<numreadthreads; i++)
+		Sys_JoinThread(readthreads[i]);
+
+	for (int i=0; i<FS_MAX_READS; i++)
+		FileSys_UnmapFile(readrequests[i].view, readrequests[i].viewsize);
+
+	if (readdonecond)
+		Sys_DestroyCondVar(readdonecond);
+
+	if (readcond)
+		Sys_DestroyCondVar(readcond);
+
+	if (readlock)
+		Sys_DestroyMutex(readlock);
+
+	memset(readthreads, 0, sizeof(readthreads));
+	memset(readrequests, 0, sizeof(readrequests));
+	numreadthreads = 0;
+	readdonecond = NULL;
+	readcond = NULL;
+	readlock = NULL;
+}
+
+/*
+* Function: FileSys_Init
+* Initializes the filesystem, if no PAK files are found, the filesystem will use the regular disk instead of the PAKs
+* 
+*	basepath: The base path for the engine, if NULL or empty, the current working directory will be used, all paths will be relative to this base path
+* 
+* Returns: A boolean if initialization was successful or not
+*/
+bool FileSys_Init(const char *basepath)
+{
+	if (initialized)
+		return(true);
+
+	char basepathbuf[SYS_MAX_PATH] = { 0 };
+	snprintf(basepathbuf, SYS_MAX_PATH, "%s", (basepath && basepath[0]) ? basepath : "");
+
+	fsbasepath = Cvar_RegisterString("fs_basepath", basepathbuf, CVAR_FILESYSTEM | CVAR_READONLY, "The base path for the engine. Defaults to the path of the installation");
+	fssavepath = Cvar_RegisterString("fs_savepath", "save", CVAR_FILESYSTEM, "The path to the games save files, relative to the base path");
+	fsdatapath = Cvar_RegisterString("fs_datapath", "data", CVAR_FILESYSTEM, "The path to the games data files, relative to the base path");
+	fsdircache = Cvar_RegisterBool("fs_dircache", true, CVAR_FILESYSTEM | CVAR_ARCHIVE, "Caches directory listings, a directory is read again when it changes on disk");
+	fscachesize = Cvar_RegisterInt("fs_cachesize", 64, CVAR_FILESYSTEM | CVAR_ARCHIVE, "The memory budget of the file content cache in megabytes, 0 only keeps files that are in use");
+	fsreadthreads = Cvar_RegisterInt("fs_readthreads", 2, CVAR_FILESYSTEM | CVAR_ARCHIVE, "The number of threads serving async file reads, read at startup");
+
+	char basepathval[SYS_MAX_PATH] = { 0 };
+	char datapathval[SYS_MAX_PATH] = { 0 };
+
+	Cvar_GetString(fsbasepath, basepathval);
+	Cvar_GetString(fsdatapath, datapathval);
+
+	int datapathlen = 0;
+	if (basepathval[0])
+		datapathlen = snprintf(datapath, SYS_MAX_PATH, "%s/%s", basepathval, datapathval);
+
+	else
+		datapathlen = snprintf(datapath, SYS_MAX_PATH, "%s", datapathval);
+
+	if (datapathlen >= SYS_MAX_PATH)
+	{
+		Log_Writef(LOG_ERROR, "Data path too long: %s/%s", basepathval, datapathval);
+		datapath[0] = '\0';
+		return(false);
+	}
+
+	if (!MountSearchPaths())
+	{
+		UnmountSearchPaths();
+		return(false);
+	}
+
+	memset(writequeue, 0, sizeof(writequeue));
+	stopwriter = false;
+
+	writelock = Sys_CreateMutex();
+	writecond = Sys_CreateCondVar();
+	writethread = Sys_CreateThread(ProcessWriteQueue, NULL);
+
+	if (!writelock || !writecond || !writethread)
+	{
+		Sys_JoinThread(writethread);
+		Sys_DestroyCondVar(writecond);
+		Sys_DestroyMutex(writelock);
+
+		writethread = NULL;
+		writecond = NULL;
+		writelock = NULL;
+
+		UnmountSearchPaths();
+		return(false);
+	}
+
+	if (!StartReadThreads())
+	{
+		Log_Write(LOG_ERROR, "Failed to start the async file read threads");
+		FileSys_Shutdown();		// cleans up the writer and the archives
+		return(false);
+	}
+
+	Cmd_RegisterCommand("fscacheinfo", Fscacheinfo_Cmd, "Prints the file content cache statistics: fscacheinfo [flush]");
+
+	initialized = true;
+
+	return(true);
+}
+
+/*
+* Function: FileSys_Shutdown
+* Shuts down the filesystem
+*/
+void FileSys_Shutdown(void)
+{
+	if (!writelock)		// not started, or already shut down
+		return;
+
+	Log_Write(LOG_INFO, "Shutting down filesystem");
+
+	StopReadThreads();
+
+	Sys_LockMutex(writelock);
+	stopwriter = true;
+	Sys_UnlockMutex(writelock);
+
+	Sys_SignalCondVar(writecond);
+
+	Sys_JoinThread(writethread);	// the writer finishes any pending writes before exiting
+	Sys_DestroyCondVar(writecond);
+	Sys_DestroyMutex(writelock);
+
+	writethread = NULL;
+	writecond = NULL;
+	writelock = NULL;
+
+	for (int i=0; i<FS_MAX_PENDING_WRITES; i++)
+	{
+		if (writequeue[i].data)
+			MemCache_Free(writequeue[i].data);
+	}
+
+	memset(writequeue, 0, sizeof(writequeue));
+
+	UnmountSearchPaths();
+
+	for (int i=0; i<FS_MAX_DIR_CACHE; i++)
+		FreeDirCacheEntry(&dircache[i]);
+
+	if (cachebytes > 0)
+		Log_Writef(LOG_INFO, "File content cache: %llu hits, %llu misses, %llu evictions", cachehits, cachemisses, cacheevictions);
+
+	FlushContentCache();
+
+	if (cachebytes > 0)
+		Log_Writef(LOG_WARN, "Files still acquired from the content cache at shutdown: %zu bytes", cachebytes);
+
+	memset(cachebuckets, 0, sizeof(cachebuckets));
+	lruhead = NULL;
+	lrutail = NULL;
+	cachebytes = 0;
+	cacheentries = 0;
+	cachehits = 0;
+	cachemisses = 0;
+	cacheevictions = 0;
+
+	initialized = false;
+}
+
+/*
+* Function: FileSys_GetDataPath
+* Gets the path of the data directory that loose files are read from, for writing files the filesystem can then read
+* 
+* Returns: The data directory path, relative to the working directory unless the base path is absolute
+*/
+const char *FileSys_GetDataPath(void)
+{
+	return(datapath);
+}
+
+/*
+* Function: FileSys_FileExists
+* Checks if a file exists in the mounted archives, the data directory, or on the filesystem as given
+* 
+* 	filename: The filename to check
+* 
+* Returns: A boolean if the file exists or not
+*/
+bool FileSys_FileExists(const char *filename)
+{
+	if (!filename)
+		return(false);
+
+	if (initialized)		// before init there are no archives and no data directory, only the path as given is checked
+	{
+		char normalized[SYS_MAX_PATH] = { 0 };
+		if (NormalizePath(filename, normalized, SYS_MAX_PATH) && FindNode(normalized))
+			return(true);
+
+		char loosepath[SYS_MAX_PATH] = { 0 };
+		if (!BuildLoosePath(filename, loosepath))
+			return(false);
+
+		if (LooseFileExists(loosepath))
+			return(true);
+	}
+
+	return(LooseFileExists(filename));
+}
+
+/*
+* Function: FileSys_ReadFile
+* Reads a whole file into memory, the mounted archives are searched first in priority order, then the data directory,
+* the data is null terminated so text files can be used as strings
+* 
+* 	filename: The path of the file relative to the data directory
+* 	size: Output for the size of the file in bytes
+* 
+* Returns: The contents of the file, free with FileSys_FreeFile, or NULL if the file was not found
+*/
+void *FileSys_ReadFile(const char *filename, size_t *size)
+{
+	*size = 0;
+
+	if (!filename || !initialized)
+		return(NULL);
+
+	unsigned long long start = FSTrace_Begin();
+
+	fileref_t ref;
+	if (!ResolveFile(filename, &ref))
+		return(NULL);
+
+	char *data = LoadFile(&ref, 0);
+	if (data)
+	{
+		*size = ref.size;
+		FSTrace_Record(FS_IO_READ, filename, ref.size, start);
+	}
+
+	return(data);
+}
+
+/*
+* Function: FileSys_FreeFile
+* Frees a file read with FileSys_ReadFile
+* 
+* 	data: The file data
+*/
+void FileSys_FreeFile(void *data)
+{
+	if (data)
+		MemCache_Free(data);
+}
+
+/*
+* Function: FileSys_AcquireFile
+* Gets the contents of a file from the content cache, reading it with FileSys_ReadFile search order if it is not cached
+* or has changed on disk since it was cached. The data is shared, read only and null terminated, must be called from the main thread
+* 
+* 	filename: The path of the file relative to the data directory
+* 	size: Output for the size of the file in bytes
+* 
+* Returns: The contents of the file, release with FileSys_ReleaseFile, or NULL if the file was not found
+*/
+const void *FileSys_AcquireFile(const char *filename, size_t *size)
+{
+	*size = 0;
+
+	if (!filename || !initialized)
+		return(NULL);
+
+	fileref_t ref;
+	if (!ResolveFile(filename, &ref))
+		return(NULL);
+
+	unsigned int hash = HashPath(ref.path);
+
+	cacheentry_t *entry = cachebuckets[hash & (FS_CACHE_BUCKETS - 1)];
+	while (entry && ((entry->hash != hash) || (strcmp(entry->path, ref.path) != 0)))
+		entry = entry->hashnext;
+
+	if (entry && (entry->mtime == ref.mtime) && (entry->size == ref.size))
+	{
+		UnlinkCacheEntry(entry);		// move to the front of the least recently used list
+		LinkCacheEntry(entry);
+
+		entry->refcount++;
+		cachehits++;
+
+		*size = entry->size;
+		return((const char *)entry + FS_CACHE_HEADER_SIZE);
+	}
+
+	if (entry)		// the file changed on disk, drop the old contents
+	{
+		UnlinkCacheEntry(entry);
+
+		if (entry->refcount == 0)
+			FreeCacheEntry(entry);
+
+		else
+			entry->stale = true;
+	}
+
+	cachemisses++;
+
+	unsigned long long start = FSTrace_Begin();
+
+	char *buffer = LoadFile(&ref, FS_CACHE_HEADER_SIZE);
+	if (!buffer)
+		return(NULL);
+
+	FSTrace_Record(FS_IO_READ, filename, ref.size, start);
+
+	entry = (cacheentry_t *)buffer;
+	memset(entry, 0, sizeof(*entry));
+	snprintf(entry->path, SYS_MAX_PATH, "%s", ref.path);
+	entry->hash = hash;
+	entry->mtime = ref.mtime;
+	entry->size = ref.size;
+	entry->refcount = 1;
+
+	LinkCacheEntry(entry);
+	cachebytes += entry->size;
+
+	EvictCacheEntries();
+
+	*size = entry->size;
+	return(buffer + FS_CACHE_HEADER_SIZE);
+}
+
+/*
+* Function: FileSys_ReleaseFile
+* Releases a file acquired with FileSys_AcquireFile, the contents stay cached until they are evicted
+* 
+* 	data: The file data
+*/
+void FileSys_ReleaseFile(const void *data)
+{
+	if (!data)
+		return;
+
+	cacheentry_t *entry = (cacheentry_t *)((const char *)data - FS_CACHE_HEADER_SIZE);
+	if (entry->refcount == 0)
+	{
+		Log_Writef(LOG_WARN, "File released more times than it was acquired: %s", entry->path);
+		return;
+	}
+
+	entry->refcount--;
+
+	if (entry->stale && (entry->refcount == 0))
+		FreeCacheEntry(entry);
+
+	else
+		EvictCacheEntries();
+}
+
+/*
+* Function: FileSys_GetCacheStats
+* Gets the content cache statistics
+* 
+* 	stats: Output for the statistics
+*/
+void FileSys_GetCacheStats(fscachestats_t *stats)
+{
+	int budgetmb = 0;
+	Cvar_GetInt(fscachesize, &budgetmb);
+
+	stats->hits = cachehits;
+	stats->misses = cachemisses;
+	stats->evictions = cacheevictions;
+	stats->bytesused = cachebytes;
+	stats->budget = (budgetmb > 0) ? ((size_t)budgetmb * 1024 * 1024) : 0;
+	stats->numentries = cacheentries;
+}
+
+/*
+* Function: FileSys_MapFile
+* Maps a file as a read only view without copying it, using the same search order as FileSys_ReadFile.
+* Files in a mounted archive are returned as a slice of the archive mapping, other files are mapped on their own,
+* files given as a path that is not in the data directory are mapped as given
+* 
+* 	filename: The path of the file relative to the data directory
+* 	size: Output for the size of the view in bytes
+* 
+* Returns: A read only view of the file, unmap with FileSys_UnmapFile, or NULL if the file was not found or is empty
+*/
+const void *FileSys_MapFile(const char *filename, size_t *size)
+{
+	unsigned long long start = FSTrace_Begin();
+	const void *view = MapView(filename, size);
+
+	if (view)
+		FSTrace_Record(FS_IO_MAP, filename, *size, start);
+
+	return(view);
+}
+
+/*
+* Function: FileSys_UnmapFile
+* Releases a view returned by FileSys_MapFile, slices of a mounted archive stay mapped until shutdown
+* 
+* 	data: The view returned by FileSys_MapFile
+* 	size: The size returned by FileSys_MapFile
+*/
+void FileSys_UnmapFile(const void *data, size_t size)
+{
+	if (!data)
+		return;
+
+	for (unsigned int i=0; i<numpaks; i++)
+	{
+		if (((const char *)data >= paks[i].data) && ((const char *)data < (paks[i].data + paks[i].size)))
+			return;
+	}
+
+	Sys_UnmapFile((void *)data, size);
+}
+
+/*
+* Function: FileSys_OpenStream
+* Opens a file to be read in chunks with FileSys_ReadStream, using the same search order as FileSys_ReadFile.
+* Compressed files in a mounted archive are decompressed a block at a time as they are read, so the whole file is never in memory
+* 
+* 	filename: The path of the file relative to the data directory
+* 	size: Output for the size of the file in bytes
+* 
+* Returns: The open stream, close with FileSys_CloseStream, or NULL if the file was not found or is empty
+*/
+fsstream_t *FileSys_OpenStream(const char *filename, size_t *size)
+{
+	*size = 0;
+
+	if (!filename || !initialized)
+		return(NULL);
+
+	char normalized[SYS_MAX_PATH] = { 0 };
+	const fsnode_t *node = NormalizePath(filename, normalized, SYS_MAX_PATH) ? FindNode(normalized) : NULL;
+
+	const void *view = NULL;
+	size_t viewsize = 0;
+
+	if (!node)
+	{
+		view = MapView(filename, &viewsize);
+		if (!view)
+			return(NULL);
+	}
+
+	fsstream_t *stream = MemCache_Alloc(sizeof(*stream));
+	if (!stream)
+	{
+		Log_Writef(LOG_ERROR, "Failed to allocate memory for file stream: %s", filename);
+		FileSys_UnmapFile(view, viewsize);
+		return(NULL);
+	}
+
+	StreamInit(&stream->state, node, view, viewsize, stream->block);
+	snprintf(stream->filename, SYS_MAX_PATH, "%s", filename);
+	stream->view = view;
+	stream->viewsize = viewsize;
+
+	*size = stream->state.size;
+
+	return(stream);
+}
+
+/*
+* Function: FileSys_ReadStream
+* Reads the next chunk of a stream into a buffer
+* 
+* 	stream: The stream opened with FileSys_OpenStream
+* 	buffer: The buffer to read into
+* 	length: The number of bytes to read
+* 
+* Returns: The number of bytes read, 0 at the end of the file, less than length at the end of the file or if the data is corrupt
+*/
+size_t FileSys_ReadStream(fsstream_t *stream, void *buffer, size_t length)
+{
+	if (!stream || !buffer)
+		return(0);
+
+	unsigned long long start = FSTrace_Begin();
+
+	bool failed = stream->state.failed;
+	size_t count = StreamRead(&stream->state, buffer, length);
+
+	stream->bytesread += count;
+	stream->readtime += Sys_GetMicroseconds() - start;
+
+	if (!failed && stream->state.failed)		// only logged once
+		Log_Write(LOG_ERROR, "Failed to read from a file stream, the file is corrupt");
+
+	return(count);
+}
+
+/*
+* Function: FileSys_CloseStream
+* Closes a stream opened with FileSys_OpenStream, everything read from the stream is recorded as one read
+* 
+* 	stream: The stream
+*/
+void FileSys_CloseStream(fsstream_t *stream)
+{
+	if (!stream)
+		return;
+
+	if (stream->bytesread > 0)
+		FSTrace_Record(FS_IO_READ, stream->filename, stream->bytesread, Sys_GetMicroseconds() - stream->readtime);		// the duration is the time spent reading, not the time the stream was open
+
+	FileSys_UnmapFile(stream->view, stream->viewsize);
+	MemCache_Free(stream);
+}
+
+/*
+* Function: FileSys_ReadAsync
+* Submits a read to be done by the read threads, when it finishes the callback is called on the main thread from the event loop.
+* Without a buffer the callback gets a view of the mapped file that is only valid during the callback
+* 
+* 	filename: The path of the file relative to the data directory, found with the same search order as FileSys_ReadFile
+* 	offset: The offset in the file to start reading from
+* 	length: The number of bytes to read, 0 reads to the end of the file
+* 	buffer: A buffer of at least length bytes to read into, or NULL, the buffer must stay valid until the read is delivered or cancelled
+* 	priority: Higher priority reads are started before lower priority reads
+* 	callback: The function to call when the read is delivered, can be NULL if the read is waited on or polled
+* 	userdata: Passed to the callback
+* 
+* Returns: A handle to the read, or 0 if the read could not be submitted
+*/
+unsigned int FileSys_ReadAsync(const char *filename, size_t offset, size_t length, void *buffer, fspriority_t priority, fsreadcallback_t callback, void *userdata)
+{
+	if (!initialized || !filename || (buffer && (length == 0)))
+		return(0);
+
+	Sys_LockMutex(readlock);
+
+	readrequest_t *request = NULL;
+	unsigned int index = 0;
+
+	for (; index<FS_MAX_READS; index++)
+	{
+		if (readrequests[index].state == READ_FREE)
+		{
+			request = &readrequests[index];
+			break;
+		}
+	}
+
+	if (!request)
+	{
+		Sys_UnlockMutex(readlock);
+		Log_Writef(LOG_WARN, "Too many async reads in flight, cannot read: %s", filename);
+		return(0);
+	}
+
+	snprintf(request->filename, SYS_MAX_PATH, "%s", filename);
+	request->offset = offset;
+	request->length = length;
+	request->buffer = buffer;
+	request->priority = priority;
+	request->sequence = nextreadsequence++;
+	request->callback = callback;
+	request->userdata = userdata;
+	request->state = READ_PENDING;
+
+	unsigned int handle = (request->generation << FS_READ_SLOT_BITS) | index;
+
+	Sys_SignalCondVar(readcond);
+	Sys_UnlockMutex(readlock);
+
+	return(handle);
+}
+
+/*
+* Function: FileSys_PollRead
+* Gets the status of an async read
+* 
+* 	handle: The read handle
+* 
+* Returns: The status of the read, reads are invalid once they have been delivered
+*/
+fsreadstatus_t FileSys_PollRead(unsigned int handle)
+{
+	if (!initialized)
+		return(FS_READ_INVALID);
+
+	fsreadstatus_t status = FS_READ_INVALID;
+
+	Sys_LockMutex(readlock);
+
+	const readrequest_t *request = FindReadRequest(handle);
+	if (request)
+	{
+		if (request->state != READ_DONE)
+			status = FS_READ_PENDING;
+
+		else
+			status = request->failed ? FS_READ_FAILED : FS_READ_COMPLETE;
+	}
+
+	Sys_UnlockMutex(readlock);
+
+	return(status);
+}
+
+/*
+* Function: FileSys_WaitRead
+* Blocks until an async read has finished, then delivers it straight away instead of waiting for the event loop,
+* must be called from the main thread
+* 
+* 	handle: The read handle
+* 
+* Returns: The final status of the read, FS_READ_INVALID if the handle is not in use
+*/
+fsreadstatus_t FileSys_WaitRead(unsigned int handle)
+{
+	if (!initialized)
+		return(FS_READ_INVALID);
+
+	Sys_LockMutex(readlock);
+
+	const readrequest_t *request = FindReadRequest(handle);
+	while (request && (request->state != READ_DONE))
+	{
+		Sys_WaitCondVar(readdonecond, readlock);
+		request = FindReadRequest(handle);
+	}
+
+	fsreadstatus_t status = FS_READ_INVALID;
+	if (request)
+		status = request->failed ? FS_READ_FAILED : FS_READ_COMPLETE;
+
+	Sys_UnlockMutex(readlock);
+
+	if (status != FS_READ_INVALID)
+		FileSys_CompleteRead(handle);
+
+	return(status);
+}
+
+/*
+* Function: FileSys_CancelRead
+* Cancels an async read that has not been started yet, the callback will not be called
+* 
+* 	handle: The read handle
+* 
+* Returns: A boolean if the read was cancelled, reads that have started or finished cannot be cancelled
+*/
+bool FileSys_CancelRead(unsigned int handle)
+{
+	if (!initialized)
+		return(false);
+
+	Sys_LockMutex(readlock);
+
+	readrequest_t *request = FindReadRequest(handle);
+	bool cancelled = request && (request->state == READ_PENDING);
+
+	if (cancelled)
+		ReleaseReadRequest(request);
+
+	Sys_UnlockMutex(readlock);
+
+	return(cancelled);
+}
+
+/*
+* Function: FileSys_CompleteRead
+* Delivers a finished async read to its callback and frees the read, called on the main thread by the event loop
+* 
+* 	handle: The read handle
+*/
+void FileSys_CompleteRead(unsigned int handle)
+{
+	if (!initialized)
+		return;
+
+	Sys_LockMutex(readlock);
+
+	readrequest_t *request = FindReadRequest(handle);
+	if (!request || (request->state != READ_DONE))		// already delivered by FileSys_WaitRead
+	{
+		Sys_UnlockMutex(readlock);
+		return;
+	}
+
+	readrequest_t finished = *request;
+	ReleaseReadRequest(request);
+
+	Sys_UnlockMutex(readlock);
+
+	if (finished.callback)
+		finished.callback(handle, finished.failed ? NULL : finished.data, finished.failed ? 0 : finished.size, finished.userdata);
+
+	FileSys_UnmapFile(finished.view, finished.viewsize);
+}
+
+/*
+* Function: FileSys_Frame
+* Queues an event for each async read that finished since the last frame, so reads are delivered by the event loop
+*/
+void FileSys_Frame(void)
+{
+	if (!initialized)
+		return;
+
+	Sys_LockMutex(readlock);
+
+	for (unsigned int i=0; i<FS_MAX_READS; i++)
+	{
+		readrequest_t *request = &readrequests[i];
+		if ((request->state != READ_DONE) || request->posted)
+			continue;
+
+		if (!Event_QueueEvent(EVENT_FILEIO, (int)((request->generation << FS_READ_SLOT_BITS) | i), 0))
+			break;		// the event queue is full, try again next frame
+
+		request->posted = true;
+	}
+
+	Sys_UnlockMutex(readlock);
+}
+
+/*
+* Function: FileSys_ListFilesInPAK
+* Lists all files in the mounted archives under a directory with a given filter, files replaced by a later archive are only listed once
+* 
+* 	numfiles: The number of files found
+* 	directory: The directory in the archives to search, relative to the data directory, empty for the root
+* 	filter: The filter to apply to the file names
+* 
+* Returns: A list of filedata_t structs, the filenames are the normalized archive paths
+*/
+filedata_t *FileSys_ListFilesInPAK(unsigned int *numfiles, const char *directory, const char *filter)
+{
+	*numfiles = 0;
+
+	char prefix[SYS_MAX_PATH] = { 0 };
+	if (!NormalizePath(directory ? directory : "", prefix, SYS_MAX_PATH - 1))
+		return(NULL);
+
+	size_t prefixlen = Sys_Strlen(prefix, SYS_MAX_PATH);
+	if ((prefixlen > 0) && (prefix[prefixlen - 1] != '/'))
+		prefix[prefixlen++] = '/';
+
+	char lowerfilter[SYS_MAX_PATH] = { 0 };		// archive paths are stored in lower case
+	for (size_t i=0; filter && filter[i] && (i < (SYS_MAX_PATH - 1)); i++)
+		lowerfilter[i] = (char)tolower((unsigned char)filter[i]);
+
+	fsfilter_t compiled;
+	CompileFilter(filter ? lowerfilter : "*", &compiled);
+
+	unsigned int filecount = 0;
+	for (int pass=0; pass<2; pass++)	// count the matches then fill the list
+	{
+		filedata_t *filelist = NULL;
+
+		if (pass == 1)
+		{
+			if (filecount == 0)
+				return(NULL);
+
+			filelist = MemCache_Alloc(filecount * sizeof(*filelist));
+			if (!filelist)
+				return(NULL);
+
+			memset(filelist, 0, filecount * sizeof(*filelist));
+		}
+
+		unsigned int index = 0;
+		for (size_t i=0; i<fsindex.capacity; i++)
+		{
+			const fsnode_t *node = &fsindex.nodes[i];
+			if (!node->entry)
+				continue;
+
+			const char *path = node->pak->strings + node->entry->pathoffset;
+			if (strncmp(path, prefix, prefixlen) != 0)
+				continue;
+
+			const char *name = path + prefixlen;
+			if (strchr(name, '/') || !MatchFilter(name, &compiled))		// only the files directly in the directory
+				continue;
+
+			if (pass == 0)
+			{
+				filecount++;
+				continue;
+			}
+
+			snprintf(filelist[index].filename, SYS_MAX_PATH, "%s", path);
+			filelist[index].filesize = (size_t)node->entry->size;
+			filelist[index].atime = node->pak->mtime;
+			filelist[index].mtime = node->pak->mtime;
+			filelist[index].ctime = node->pak->mtime;
+			index++;
+		}
+
+		if (pass == 1)
+		{
+			*numfiles = filecount;
+			return(filelist);
+		}
+	}
+
+	return(NULL);
+}
+
+/*
+* Function: FileSys_QueueWrite
+* Queues a file to be written to the disk by the writer thread, the data is copied so the caller can free it straight away,
+* a pending write to the same file is replaced, if the filesystem is not running the file is written immediately
+* 
+*	filename: The file to write
+*	data: The data to write
+*	size: The size of the data in bytes
+* 
+* Returns: A boolean if the write was queued or written
+*/
+bool FileSys_QueueWrite(const char *filename, const void *data, size_t size)
+{
+	if (!filename || (!data && size > 0))
+		return(false);
+
+	if (!initialized)
+		return(WriteFileAtomic(filename, data, size));
+
+	void *copy = MemCache_Alloc(size + 1);
+	if (!copy)
+		return(WriteFileAtomic(filename, data, size));
+
+	memcpy(copy, data, size);
+
+	writejob_t *job = NULL;
+
+	Sys_LockMutex(writelock);
+
+	ReclaimFinishedWrites();
+
+	for (int i=0; !job && i<FS_MAX_PENDING_WRITES; i++)
+	{
+		if ((writequeue[i].state == WRITE_PENDING) && (strcmp(writequeue[i].filename, filename) == 0))
+		{
+			job = &writequeue[i];
+			MemCache_Free(job->data);
+		}
+	}
+
+	for (int i=0; !job && i<FS_MAX_PENDING_WRITES; i++)
+	{
+		if (writequeue[i].state == WRITE_FREE)
+		{
+			job = &writequeue[i];
+			snprintf(job->filename, SYS_MAX_PATH, "%s", filename);
+		}
+	}
+
+	if (job)
+	{
+		job->data = copy;
+		job->size = size;
+		job->state = WRITE_PENDING;
+	}
+
+	Sys_UnlockMutex(writelock);
+
+	if (!job)	// the queue is full, write the file on this thread instead
+	{
+		MemCache_Free(copy);
+		return(WriteFileAtomic(filename, data, size));
+	}
+
+	Sys_SignalCondVar(writecond);
+
+	return(true);
+}
+
+/*
+* Function: FileSys_ListFiles
+* Lists all files in a directory with a given filter, sub directories are not included
+* 
+* 	numfiles: The number of files found
+* 	directory: The directory to search
+* 	filter: The filter to apply to the file list
+* 
+* Returns: A list of filedata_t structs
+*/
+filedata_t *FileSys_ListFiles(unsigned int *numfiles, const char *directory, const char *filter)
+{
+	return(ListFilesInDirectory(numfiles, directory, filter, true));
+}
+
+/*
+* Function: FileSys_ListFileNames
+* Lists all files in a directory with a given filter like FileSys_ListFiles, but only the filenames are filled in,
+* this avoids reading the stats of every file when the directory is not cached
+* 
+* 	numfiles: The number of files found
+* 	directory: The directory to search
+* 	filter: The filter to apply to the file list
+* 
+* Returns: A list of filedata_t structs, only the filename of each is valid
+*/
+filedata_t *FileSys_ListFileNames(unsigned int *numfiles, const char *directory, const char *filter)
+{
+	return(ListFilesInDirectory(numfiles, directory, filter, false));
 }
 
 /*
@@ -0,0 +1,534 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sys/sys.h"
+#include "common.h"
+
+#define FSTRACE_HEADER "time,frame,op,bytes,duration,path"
+#define FSTRACE_MAX_LINE (SYS_MAX_PATH + 128)
+#define FSTRACE_STREAM_CHUNK 0x10000
+
+typedef enum
+{
+	REPLAY_READ = 0,		// FileSys_ReadFile
+	REPLAY_CACHE,			// FileSys_AcquireFile
+	REPLAY_MAP,				// FileSys_MapFile, every page is touched
+	REPLAY_STREAM,			// FileSys_OpenStream, read in chunks
+	REPLAY_NUM_BACKENDS
+} replaybackend_t;
+
+static const char *opnames[FS_IO_NUM_OPS] =
+{
+	"open",
+	"read",
+	"map",
+	"stat",
+	"list",
+	"write"
+};
+
+static const char *backendnames[REPLAY_NUM_BACKENDS] =
+{
+	"read",
+	"cache",
+	"map",
+	"stream"
+};
+
+static mutex_t *iolock;				// I/O is recorded from the read and write threads too
+static fsiostats_t totalstats;
+static fsiostats_t framestartstats;
+static fsiostats_t lastframestats;
+static unsigned long long framecount;
+
+static FILE *tracefile;
+static char tracename[SYS_MAX_PATH];
+static unsigned long long tracestarttime;
+static bool replaying;				// the replay is counted but not written to the trace
+
+static bool initialized;
+
+/*
+* Function: FindOp
+* Finds an I/O operation by the name it is written to a trace with
+* 
+*	name: The name of the operation
+* 
+* Returns: The operation, or FS_IO_NUM_OPS if the name is not known
+*/
+static fsioop_t FindOp(const char *name)
+{
+	for (int i=0; i<FS_IO_NUM_OPS; i++)
+	{
+		if (strcmp(opnames[i], name) == 0)
+			return((fsioop_t)i);
+	}
+
+	return(FS_IO_NUM_OPS);
+}
+
+/*
+* Function: StartTrace
+* Starts writing every recorded I/O operation to a CSV file, replaces any trace already running
+* 
+*	filename: The trace file to write
+* 
+* Returns: A boolean if the trace was started or not
+*/
+static bool StartTrace(const char *filename)
+{
+	FILE *file = fopen(filename, "w");
+	if (!file)
+	{
+		Log_Writef(LOG_ERROR, "Failed to open the filesystem trace file: %s", filename);
+		return(false);
+	}
+
+	fprintf(file, "%s\n", FSTRACE_HEADER);
+
+	Sys_LockMutex(iolock);
+
+	if (tracefile)
+		fclose(tracefile);
+
+	tracefile = file;
+	snprintf(tracename, SYS_MAX_PATH, "%s", filename);
+	tracestarttime = Sys_GetMicroseconds();
+
+	Sys_UnlockMutex(iolock);
+
+	Log_Writef(LOG_INFO, "Filesystem trace started: %s", filename);
+
+	return(true);
+}
+
+/*
+* Function: StopTrace
+* Stops the running trace and closes the trace file
+*/
+static void StopTrace(void)
+{
+	Sys_LockMutex(iolock);
+
+	if (tracefile)
+	{
+		fclose(tracefile);
+		Log_Writef(LOG_INFO, "Filesystem trace stopped: %s", tracename);
+	}
+
+	tracefile = NULL;
+	tracename[0] = '\0';
+
+	Sys_UnlockMutex(iolock);
+}
+
+/*
+* Function: PrintStats
+* Prints a table of I/O statistics
+* 
+*	title: The title of the table
+*	stats: The statistics to print
+*/
+static void PrintStats(const char *title, const fsiostats_t *stats)
+{
+	Common_Printf("%s:", title);
+
+	for (int i=0; i<FS_IO_NUM_OPS; i++)
+	{
+		Common_Printf("  %-6s count: %-10llu bytes: %-14llu time: %llu us",
+			opnames[i],
+			stats->count[i],
+			stats->bytes[i],
+			stats->time[i]
+		);
+	}
+}
+
+/*
+* Function: ReplayOp
+* Repeats a traced read or map of a whole file through a filesystem backend
+* 
+*	backend: The backend to read files with
+*	path: The path the operation was traced with
+*	bytes: Output for the number of bytes read
+* 
+* Returns: A boolean if the operation succeeded or not
+*/
+static bool ReplayOp(replaybackend_t backend, const char *path, size_t *bytes)
+{
+	*bytes = 0;
+
+	switch (backend)
+	{
+		case REPLAY_READ:
+		{
+			void *data = FileSys_ReadFile(path, bytes);
+			FileSys_FreeFile(data);
+			return(data != NULL);
+		}
+
+		case REPLAY_CACHE:
+		{
+			const void *data = FileSys_AcquireFile(path, bytes);
+			FileSys_ReleaseFile(data);
+			return(data != NULL);
+		}
+
+		case REPLAY_MAP:
+		{
+			const unsigned char *data = FileSys_MapFile(path, bytes);
+			if (!data)
+				return(false);
+
+			volatile unsigned char touch = 0;		// a view costs nothing until its pages are read
+			for (size_t i=0; i<*bytes; i+=4096)
+				touch ^= data[i];
+
+			(void)touch;
+
+			FileSys_UnmapFile(data, *bytes);
+			return(true);
+		}
+
+		case REPLAY_STREAM:
+		{
+			size_t size = 0;
+			fsstream_t *stream = FileSys_OpenStream(path, &size);
+			if (!stream)
+				return(false);
+
+			unsigned char *chunk = MemCache_Alloc(FSTRACE_STREAM_CHUNK);
+			if (chunk)
+			{
+				size_t count = 0;
+				while ((count = FileSys_ReadStream(stream, chunk, FSTRACE_STREAM_CHUNK)) > 0)
+					*bytes += count;
+
+				MemCache_Free(chunk);
+			}
+
+			FileSys_CloseStream(stream);
+			return(chunk && (*bytes == size));
+		}
+
+		default:
+			return(false);
+	}
+}
+
+/*
+* Function: ReplayTrace
+* Repeats the reads and maps in a trace file as fast as possible through a filesystem backend and compares the time taken
+* with the time the same operations took when they were traced. The opens, stats and listings in the trace are done by the
+* reads and maps, so they are not repeated on their own
+* 
+*	filename: The trace file to replay
+*	backend: The backend to read files with
+*/
+static void ReplayTrace(const char *filename, replaybackend_t backend)
+{
+	FILE *file = fopen(filename, "r");
+	if (!file)
+	{
+		Common_Warnf("Cannot open trace file: %s", filename);
+		return;
+	}
+
+	unsigned long long numops = 0;
+	unsigned long long numfailed = 0;
+	unsigned long long numbytes = 0;
+	unsigned long long tracedtime = 0;
+	unsigned long long replaytime = 0;
+
+	Sys_LockMutex(iolock);
+	replaying = true;
+	Sys_UnlockMutex(iolock);
+
+	char line[FSTRACE_MAX_LINE] = { 0 };
+	while (fgets(line, FSTRACE_MAX_LINE, file))
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+
+		char opname[16] = { 0 };
+		unsigned long long duration = 0;
+		int pathstart = 0;
+
+		if ((sscanf(line, "%*[0-9],%*[0-9],%15[^,],%*[0-9],%llu,%n", opname, &duration, &pathstart) != 2) || (pathstart == 0))
+			continue;		// the header or a damaged line
+
+		fsioop_t op = FindOp(opname);
+		if ((op != FS_IO_READ) && (op != FS_IO_MAP))
+			continue;
+
+		size_t bytes = 0;
+		unsigned long long start = Sys_GetMicroseconds();
+		bool success = ReplayOp(backend, line + pathstart, &bytes);
+		replaytime += Sys_GetMicroseconds() - start;
+
+		if (!success)
+			Log_Writef(LOG_WARN, "Replayed %s failed: %s", opname, line + pathstart);
+
+		numops++;
+		numfailed += success ? 0 : 1;
+		numbytes += bytes;
+		tracedtime += duration;
+	}
+
+	Sys_LockMutex(iolock);
+	replaying = false;
+	Sys_UnlockMutex(iolock);
+
+	fclose(file);
+
+	Common_Printf("Replayed %llu operations from %s with the %s backend, %llu failed", numops, filename, backendnames[backend], numfailed);
+	Common_Printf("Bytes: %llu, replay time: %llu us, traced time: %llu us", numbytes, replaytime, tracedtime);
+}
+
+/*
+* Function: Fsstats_Cmd
+* Prints the filesystem I/O statistics since startup and for the last frame, "fsstats reset" clears them
+* 
+* 	args: The command arguments, argv[1] can be reset
+*/
+static void Fsstats_Cmd(const cmdargs_t *args)
+{
+	if ((args->argc > 1) && (strcmp(args->argv[1], "reset") == 0))
+	{
+		Sys_LockMutex(iolock);
+		memset(&totalstats, 0, sizeof(totalstats));
+		memset(&framestartstats, 0, sizeof(framestartstats));
+		memset(&lastframestats, 0, sizeof(lastframestats));
+		Sys_UnlockMutex(iolock);
+		return;
+	}
+
+	fsiostats_t total;
+	fsiostats_t lastframe;
+	FSTrace_GetStats(&total, &lastframe);
+
+	PrintStats("Filesystem I/O since startup", &total);
+	PrintStats("Filesystem I/O last frame", &lastframe);
+}
+
+/*
+* Function: Fstrace_Cmd
+* Starts or stops the filesystem trace, with no arguments prints the trace that is running
+* 
+* 	args: The command arguments, argv[1] is the trace file or stop
+*/
+static void Fstrace_Cmd(const cmdargs_t *args)
+{
+	if (args->argc < 2)
+	{
+		if (tracefile)
+			Common_Printf("Tracing filesystem I/O to: %s", tracename);
+
+		else
+			Common_Printf("Filesystem trace is not running, usage: fstrace <filename|stop>");
+
+		return;
+	}
+
+	if (strcmp(args->argv[1], "stop") == 0)
+		StopTrace();
+
+	else
+		StartTrace(args->argv[1]);
+}
+
+/*
+* Function: Fsreplay_Cmd
+* Replays a filesystem trace, usage: fsreplay <filename> [read|cache|map|stream]
+* 
+* 	args: The command arguments, argv[1] is the trace file and argv[2] the backend, defaults to read
+*/
+static void Fsreplay_Cmd(const cmdargs_t *args)
+{
+	if (args->argc < 2)
+	{
+		Common_Printf("Usage: fsreplay <filename> [read|cache|map|stream]");
+		return;
+	}
+
+	replaybackend_t backend = REPLAY_READ;
+	if (args->argc > 2)
+	{
+		for (backend=0; backend<REPLAY_NUM_BACKENDS; backend++)
+		{
+			if (strcmp(backendnames[backend], args->argv[2]) == 0)
+				break;
+		}
+
+		if (backend == REPLAY_NUM_BACKENDS)
+		{
+			Common_Warnf("Unknown replay backend: %s", args->argv[2]);
+			return;
+		}
+	}
+
+	if (tracefile && (strcmp(tracename, args->argv[1]) == 0))
+	{
+		Common_Warnf("Cannot replay the trace that is being written: %s", tracename);
+		return;
+	}
+
+	ReplayTrace(args->argv[1], backend);
+}
+
+/*
+* Function: FSTrace_Init
+* Initializes the filesystem I/O counters, must be called before the filesystem so its startup is counted
+* 
+* 	filename: A trace file to start writing straight away, or an empty string
+* 
+* Returns: A boolean if the counters were initialized or not
+*/
+bool FSTrace_Init(const char *filename)
+{
+	iolock = Sys_CreateMutex();
+	if (!iolock)
+	{
+		Log_Write(LOG_ERROR, "Failed to create the filesystem trace mutex");
+		return(false);
+	}
+
+	memset(&totalstats, 0, sizeof(totalstats));
+	memset(&framestartstats, 0, sizeof(framestartstats));
+	memset(&lastframestats, 0, sizeof(lastframestats));
+	framecount = 0;
+
+	Cmd_RegisterCommand("fsstats", Fsstats_Cmd, "Prints the filesystem I/O statistics: fsstats [reset]");
+	Cmd_RegisterCommand("fstrace", Fstrace_Cmd, "Writes every filesystem I/O operation to a CSV file: fstrace <filename|stop>");
+	Cmd_RegisterCommand("fsreplay", Fsreplay_Cmd, "Replays the reads in a filesystem trace through a backend: fsreplay <filename> [read|cache|map|stream]");
+
+	initialized = true;
+
+	if (filename && filename[0])
+		StartTrace(filename);
+
+	return(true);
+}
+
+/*
+* Function: FSTrace_Shutdown
+* Stops the trace and shuts down the filesystem I/O counters, must be called after the filesystem is shut down
+*/
+void FSTrace_Shutdown(void)
+{
+	if (!initialized)
+		return;
+
+	StopTrace();
+
+	Log_Writef(LOG_INFO, "Filesystem I/O: %llu opens, %llu reads (%llu bytes), %llu maps, %llu stats, %llu listings, %llu writes",
+		totalstats.count[FS_IO_OPEN],
+		totalstats.count[FS_IO_READ],
+		totalstats.bytes[FS_IO_READ],
+		totalstats.count[FS_IO_MAP],
+		totalstats.count[FS_IO_STAT],
+		totalstats.count[FS_IO_LIST],
+		totalstats.count[FS_IO_WRITE]
+	);
+
+	Sys_DestroyMutex(iolock);
+	iolock = NULL;
+
+	initialized = false;
+}
+
+/*
+* Function: FSTrace_Begin
+* Gets the start time of an I/O operation, passed to FSTrace_Record when the operation finishes
+* 
+* Returns: The start time in microseconds
+*/
+unsigned long long FSTrace_Begin(void)
+{
+	return(Sys_GetMicroseconds());
+}
+
+/*
+* Function: FSTrace_Record
+* Counts a finished I/O operation and writes it to the trace if one is running, can be called from any thread
+* 
+* 	op: The type of the operation
+* 	path: The file or directory the operation was done on
+* 	bytes: The number of bytes read, mapped or written
+* 	start: The start time from FSTrace_Begin
+*/
+void FSTrace_Record(fsioop_t op, const char *path, size_t bytes, unsigned long long start)
+{
+	if (!initialized || (op >= FS_IO_NUM_OPS))
+		return;
+
+	unsigned long long duration = Sys_GetMicroseconds() - start;
+
+	Sys_LockMutex(iolock);
+
+	totalstats.count[op]++;
+	totalstats.bytes[op] += bytes;
+	totalstats.time[op] += duration;
+
+	if (tracefile && !replaying)
+		fprintf(tracefile, "%llu,%llu,%s,%zu,%llu,%s\n", start - tracestarttime, framecount, opnames[op], bytes, duration, path ? path : "");
+
+	Sys_UnlockMutex(iolock);
+}
+
+/*
+* Function: FSTrace_Frame
+* Ends the I/O counters of a frame, the totals of the frame are kept until the next frame ends
+*/
+void FSTrace_Frame(void)
+{
+	if (!initialized)
+		return;
+
+	Sys_LockMutex(iolock);
+
+	for (int i=0; i<FS_IO_NUM_OPS; i++)
+	{
+		lastframestats.count[i] = totalstats.count[i] - framestartstats.count[i];
+		lastframestats.bytes[i] = totalstats.bytes[i] - framestartstats.bytes[i];
+		lastframestats.time[i] = totalstats.time[i] - framestartstats.time[i];
+	}
+
+	framestartstats = totalstats;
+	framecount++;
+
+	if (tracefile)
+		fflush(tracefile);
+
+	Sys_UnlockMutex(iolock);
+}
+
+/*
+* Function: FSTrace_GetStats
+* Gets the filesystem I/O statistics
+* 
+* 	total: Output for the totals since startup, can be NULL
+* 	lastframe: Output for the totals of the last finished frame, can be NULL
+*/
+void FSTrace_GetStats(fsiostats_t *total, fsiostats_t *lastframe)
+{
+	if (!initialized)
+	{
+		if (total)
+			memset(total, 0, sizeof(*total));
+
+		if (lastframe)
+			memset(lastframe, 0, sizeof(*lastframe));
+
+		return;
+	}
+
+	Sys_LockMutex(iolock);
+
+	if (total)
+		*total = totalstats;
+
+	if (lastframe)
+		*lastframe = lastframestats;
+
+	Sys_UnlockMutex(iolock);
+}
@@ -168,7 +168,12 @@ static key_t *keys;
 static FILE *bindingsfile;
 static const char *bindingsdir = "configs";
 static const char *bindingsfilename = "bindings.cfg";
+static const char *bindingssnapshotname = "bindings.cfgb";
 static char bindingsfullname[SYS_MAX_PATH];
+static char bindingssnapshotfullname[SYS_MAX_PATH];
+static bool bindingsdirty;		// set when a binding changes, cleared when the bindings file is queued for writing
+static unsigned int bindingshash;	// hash of the bindings file contents as last read or written
+static bool snapshotcurrent;		// the snapshot on disk was written alongside the bindings file with bindingshash
 
 static bool initialized;
 
@@ -261,54 +266,147 @@ static void SetBinding(const keycode_t key, const char *binding)
 
 		snprintf(keys[key].binding, len + 1, "%s", binding);
 	}
+
+	bindingsdirty = true;
 }
 
 /*
 * Function: ReadBindings
-* Reads the key bindings from a file
-*
-* 	bindings: The file to read the bindings from
+* Reads the key bindings from the contents of a bindings file, each line is run as a command
+* 
+* 	data: The contents of the bindings file
+* 	size: The size of the contents
 */
-static void ReadBindings(FILE *bindings)
+static void ReadBindings(const char *data, size_t size)
 {
-	if (!bindings)
-		return;
+	const char *p = data;
+	const char *end = data + size;
 
-	char line[CMD_MAX_STR_LEN] = { 0 };
-	while (fgets(line, sizeof(line), bindings))
+	while (p < end)
 	{
-		char cmdline[CMD_MAX_STR_LEN] = { 0 };
+		const char *line = p;
+		const char *lineend = memchr(p, '\n', end - p);
 
-		if (line[0] == '\n' || line[0] == '\r' || line[0] == '#')
-			continue;
+		if (lineend)
+			p = lineend + 1;
 
-		char *saveptr = NULL;
+		else
+		{
+			lineend = end;
+			p = end;
+		}
 
-		char * const cmdname = Sys_Strtok(line, " ", &saveptr);
-		char * const args = Sys_Strtok(NULL, "\n\r", &saveptr);
+		if (lineend > line && lineend[-1] == '\r')
+			lineend--;
 
-		snprintf(cmdline, sizeof(cmdline), "%s %s", cmdname, args);
+		if (line == lineend || line[0] == '#')
+			continue;
+
+		char cmdline[CMD_MAX_STR_LEN] = { 0 };
+		snprintf(cmdline, sizeof(cmdline), "%.*s", (int)(lineend - line), line);
 
 		Cmd_BufferCommand(CMD_EXEC_NOW, cmdline);
 	}
 }
 
+/*
+* Function: ReadBindingsSnapshot
+* Reads the key bindings from a binary snapshot, the snapshot is only used if it was written alongside the current bindings file
+* 
+* 	filename: The snapshot file
+* 	texthash: The hash of the current bindings file
+* 
+* Returns: A boolean if the snapshot was used or not, if not the bindings file has to be read instead
+*/
+static bool ReadBindingsSnapshot(const char *filename, unsigned int texthash)
+{
+	snapshotreader_t reader;
+	if (!Snapshot_Open(&reader, filename, texthash))
+		return(false);
+
+	snapshotrecord_t record;
+	while (Snapshot_ReadRecord(&reader, &record))
+	{
+		char keyname[CMD_MAX_STR_LEN] = { 0 };
+		char binding[CMD_MAX_STR_LEN] = { 0 };
+
+		if ((record.keylen >= sizeof(keyname)) || (record.valuelen >= sizeof(binding)))
+			break;
+
+		memcpy(keyname, record.key, record.keylen);
+		memcpy(binding, record.value, record.valuelen);
+
+		SetBinding(GetKeyFromName(keyname), binding);
+	}
+
+	bool complete = (reader.numread == reader.numrecords);		// anything bound so far is bound again by the text reader if not
+
+	if (!complete)
+		Log_Writef(LOG_WARN, "snapshot is damaged, reading the bindings file instead: %s", filename);
+
+	Snapshot_Close(&reader);
+
+	return(complete);
+}
+
+/*
+* Function: WriteBindingsSnapshot
+* Queues a binary snapshot of the key bindings to be written
+* 
+* 	filename: The snapshot file
+* 	texthash: The hash of the bindings file written with the snapshot
+* 
+* Returns: A boolean if the snapshot was queued or not
+*/
+static bool WriteBindingsSnapshot(const char *filename, unsigned int texthash)
+{
+	snapshotwriter_t writer;
+	if (!Snapshot_BeginWrite(&writer, texthash))
+		return(false);
+
+	for (int i=0; i<KEY_FINAL; i++)
+	{
+		if (!keys[i].binding || !keys[i].binding[0])
+			continue;
+
+		const char *keyname = GetKeyName(i);
+		unsigned short keylen = (unsigned short)Sys_Strlen(keyname, CMD_MAX_STR_LEN);
+		unsigned short bindinglen = (unsigned short)Sys_Strlen(keys[i].binding, CMD_MAX_STR_LEN);
+
+		if (!Snapshot_WriteRecord(&writer, 0, keyname, keylen, keys[i].binding, bindinglen))
+		{
+			Snapshot_CancelWrite(&writer);
+			return(false);
+		}
+	}
+
+	return(Snapshot_EndWrite(&writer, filename));
+}
+
 /*
 * Function: WriteBindings
-* Writes the key bindings to a file
+* Writes the key bindings into a buffer in the bindings file format, call with a NULL buffer to get the size needed
 * 
-* 	bindings: The file to write the bindings to
+* 	out: The output buffer, can be NULL
+* 	outlen: The size of the output buffer
+* 
+* Returns: The length of the bindings text, not including the null terminator
 */
-void WriteBindings(FILE *bindings)
+static size_t WriteBindings(char *out, size_t outlen)
 {
-	if (!bindings)
-		return;
+	size_t len = 0;
 
 	for (int i=0; i<KEY_FINAL; i++)
 	{
 		if (keys[i].binding && keys[i].binding[0])
-			fprintf(bindings, "bind %s \"%s\"\n", GetKeyName(i), keys[i].binding);
+		{
+			int written = snprintf(out ? out + len : NULL, out ? outlen - len : 0, "bind %s \"%s\"\n", GetKeyName(i), keys[i].binding);
+			if (written > 0)
+				len += written;
+		}
 	}
+
+	return(len);
 }
 
 /*
@@ -368,8 +466,9 @@ bool Input_Init(void)
 		return(false);
 
 	snprintf(bindingsfullname, sizeof(bindingsfullname), "%s/%s", bindingsdir, bindingsfilename);
+	snprintf(bindingssnapshotfullname, sizeof(bindingssnapshotfullname), "%s/%s", bindingsdir, bindingssnapshotname);
 
-	if (!FileSys_FileExists(bindingsfullname))
+	if (!Sys_FileExists(bindingsfullname))		// user config lives in the working directory where it is written, not in the archives or data directory
 	{
 		bindingsfile = fopen(bindingsfullname, "w+");
 		if (!bindingsfile)
@@ -382,17 +481,24 @@ bool Input_Init(void)
 		bindingsfile = NULL;
 	}
 
-	bindingsfile = fopen(bindingsfullname, "r");
-	if (!bindingsfile)
+	bindingshash = Snapshot_HashText(NULL, 0);
+	snapshotcurrent = false;
+
+	size_t size = 0;
+	char *data = Sys_MapFile(bindingsfullname, &size);		// empty files are not mapped, there is nothing to read
+
+	if (data)
 	{
-		Log_Writef(LOG_ERROR, "failed to open bindings file: %s", bindingsfullname);
-		return(false);
-	}
+		bindingshash = Snapshot_HashText(data, size);
+		snapshotcurrent = ReadBindingsSnapshot(bindingssnapshotfullname, bindingshash);
+
+		if (!snapshotcurrent)
+			ReadBindings(data, size);
 
-	ReadBindings(bindingsfile);
+		Sys_UnmapFile(data, size);
+	}
 
-	fclose(bindingsfile);
-	bindingsfile = NULL;
+	bindingsdirty = false;		// the bindings match the file that was just read
 
 	initialized = true;
 
@@ -410,17 +516,7 @@ void Input_Shutdown(void)
 
 	Log_Write(LOG_INFO, "Shutting down input system");
 
-	bindingsfile = fopen(bindingsfullname, "w");
-	if (!bindingsfile)
-	{
-		Log_Writef(LOG_ERROR, "failed to open bindings file for writing: %s", bindingsfullname);
-		return;
-	}
-
-	WriteBindings(bindingsfile);
-
-	fclose(bindingsfile);
-	bindingsfile = NULL;
+	Input_FlushBindings();
 
 	for (int i=0; i<KEY_FINAL; i++)		// free all key bindings if they exist
 	{
@@ -434,6 +530,44 @@ void Input_Shutdown(void)
 	initialized = false;
 }
 
+/*
+* Function: Input_FlushBindings
+* Queues the key bindings to be written to the bindings file and its binary snapshot if any of them have changed since the last flush
+*/
+void Input_FlushBindings(void)
+{
+	if (!initialized || !bindingsdirty)
+		return;
+
+	size_t size = WriteBindings(NULL, 0);
+
+	char *buffer = MemCache_Alloc(size + 1);
+	if (!buffer)
+	{
+		Log_Writef(LOG_ERROR, "failed to allocate memory for bindings file: %s", bindingsfullname);
+		return;
+	}
+
+	WriteBindings(buffer, size + 1);
+
+	unsigned int hash = Snapshot_HashText(buffer, size);
+	if ((hash == bindingshash) && snapshotcurrent)		// the files on disk already hold these bindings
+	{
+		bindingsdirty = false;
+		MemCache_Free(buffer);
+		return;
+	}
+
+	if (FileSys_QueueWrite(bindingsfullname, buffer, size))
+	{
+		bindingsdirty = false;
+		bindingshash = hash;
+		snapshotcurrent = WriteBindingsSnapshot(bindingssnapshotfullname, hash);
+	}
+
+	MemCache_Free(buffer);
+}
+
 /*
 * Function: Input_ProcessKeyInput
 * Processes key input and adds the bound command to the buffer if the key is pressed
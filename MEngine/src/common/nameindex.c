@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sys/sys.h"
+#include "common.h"
+
+#define DEF_NAME_INDEX_CAPACITY 128
+
+/*
+* Function: ItemName
+* Gets the name of an item in a name index, every item starts with a pointer to its name
+* 
+*	item: The item
+* 
+* Returns: The name of the item
+*/
+static const char *ItemName(const void *item)
+{
+	return(*(const char * const *)item);
+}
+
+/*
+* Function: CompareItemNames
+* Compares two items by name, used to sort the name index
+* 
+*	a: The first item
+*	b: The second item
+* 
+* Returns: The result of comparing the names
+*/
+static int CompareItemNames(const void *a, const void *b)
+{
+	return(strcmp(ItemName(*(void * const *)a), ItemName(*(void * const *)b)));
+}
+
+/*
+* Function: NameIndex_Build
+* Rebuilds a sorted name index if items have been added or removed since it was last built
+* 
+*	index: The name index
+*	numitems: The number of items there are now
+*	Gather: Fills in every item, in any order, and returns the number written
+*	what: What the items are, for the error message
+* 
+* Returns: A boolean if the index is up to date or not
+*/
+bool NameIndex_Build(nameindex_t *index, size_t numitems, size_t (*Gather)(void **items), const char *what)
+{
+	if (!index->dirty)
+		return(true);
+
+	if (numitems > index->capacity)
+	{
+		size_t newcapacity = index->capacity ? index->capacity : DEF_NAME_INDEX_CAPACITY;
+		while (newcapacity < numitems)
+			newcapacity *= 2;
+
+		void **newitems = MemCache_Alloc(sizeof(*newitems) * newcapacity);
+		if (!newitems)
+		{
+			Log_Writef(LOG_ERROR, "Failed to allocate memory for the %s index", what);
+			return(false);
+		}
+
+		if (index->items)
+			MemCache_Free(index->items);
+
+		index->items = newitems;
+		index->capacity = newcapacity;
+	}
+
+	index->numitems = numitems ? Gather(index->items) : 0;
+
+	qsort(index->items, index->numitems, sizeof(*index->items), CompareItemNames);
+	index->dirty = false;
+
+	return(true);
+}
+
+/*
+* Function: NameIndex_FindPrefix
+* Finds the range of items in a built name index whose names start with a prefix, using two binary searches
+* 
+*	index: The name index
+*	prefix: The name prefix, an empty prefix matches every item
+*	first: Output for the index of the first matching item
+* 
+* Returns: The number of matching items
+*/
+size_t NameIndex_FindPrefix(const nameindex_t *index, const char *prefix, size_t *first)
+{
+	size_t prefixlen = Sys_Strlen(prefix, CMD_MAX_STR_LEN);
+
+	size_t low = 0, high = index->numitems;
+	while (low < high)		// first name that is not less than the prefix
+	{
+		size_t mid = low + ((high - low) / 2);
+		if (strncmp(ItemName(index->items[mid]), prefix, prefixlen) < 0)
+			low = mid + 1;
+
+		else
+			high = mid;
+	}
+
+	*first = low;
+
+	high = index->numitems;
+	while (low < high)		// first name past the names that start with the prefix
+	{
+		size_t mid = low + ((high - low) / 2);
+		if (strncmp(ItemName(index->items[mid]), prefix, prefixlen) <= 0)
+			low = mid + 1;
+
+		else
+			high = mid;
+	}
+
+	return(low - *first);
+}
+
+/*
+* Function: NameIndex_ParsePattern
+* Gets the prefix of a name pattern, a pattern is a name prefix with an optional * at the end: r_*
+* 
+*	pattern: The pattern
+*	prefix: Output buffer for the prefix
+*	prefixsize: The size of the prefix buffer
+* 
+* Returns: A boolean if the pattern is valid or not, a * anywhere but the end is not supported
+*/
+bool NameIndex_ParsePattern(const char *pattern, char *prefix, size_t prefixsize)
+{
+	const char *wildcard = strchr(pattern, '*');
+	if (wildcard && (wildcard[1] != '\0'))
+		return(false);
+
+	size_t len = wildcard ? (size_t)(wildcard - pattern) : strlen(pattern);
+	if (len >= prefixsize)
+		return(false);
+
+	memcpy(prefix, pattern, len);
+	prefix[len] = '\0';
+
+	return(true);
+}
+
+/*
+* Function: NameIndex_Free
+* Frees the memory of a name index and leaves it empty, it is rebuilt the next time it is used
+* 
+*	index: The name index
+*/
+void NameIndex_Free(nameindex_t *index)
+{
+	if (index->items)
+		MemCache_Free(index->items);
+
+	memset(index, 0, sizeof(*index));
+	index->dirty = true;
+}
@@ -0,0 +1,89 @@
+/*
+* The engines .pak archive format specification. Version 1.
+* This file (pak.h) contains the structures used to read and write .pak archives.
+* 
+* Overview:
+* A .pak file packs many game data files into one archive so that they can be found and read without touching the OS for each file:
+*	- A header at the start of the archive pointing at the central directory.
+*	- The file data, stored one after another.
+*	- The central directory at the end of the archive, an array of fixed size entries followed by a string table of paths.
+* 
+* The central directory is read once when the archive is mounted, every lookup after that is a hash table lookup in memory.
+* Paths are stored normalized: relative to the data directory, forward slashes only, lower case, no leading slash or "./".
+* 
+* File Format:
+* Pak Header:
+*  Offset |       Type       |    Field    | Description
+* --------|------------------|-------------|------------
+* 0       | char[4]          | magic       | Magic: "MPAK" to identify the file format
+* 4       | uint32_t         | version     | Version of the pak format
+* 8       | uint32_t         | entrycount  | Number of entries in the central directory (E)
+* 12      | uint32_t         | flags       | Archive flags, currently unused and set to 0
+* 16      | uint64_t         | diroffset   | Offset in the file where the central directory starts
+* 24      | uint64_t         | dirsize     | Size of the central directory in bytes, entries and string table
+* 
+* Pak Entry:
+*  Offset |       Type       |    Field    | Description
+* --------|------------------|-------------|------------
+* 0       | uint64_t         | offset      | Offset in the file where the data of the entry starts
+* 8       | uint64_t         | size        | Size of the file in bytes
+* 16      | uint64_t         | storedsize  | Size of the data in the archive in bytes, the same as size for uncompressed files
+* 24      | uint32_t         | pathoffset  | Offset of the null terminated path in the string table
+* 28      | uint32_t         | pathhash    | FNV-1a hash of the normalized path
+* 32      | uint32_t         | flags       | Entry flags, PAK_ENTRY_COMPRESSED if the data is stored as compressed blocks
+* 36      | uint32_t         | reserved    | Padding, set to 0
+* 
+* Central Directory:
+*  Offset |       Type       |    Field    | Description
+* --------|------------------|-------------|------------
+* 0       | pakentry_t[]     | entries     | Array of entries (E)
+* 40*E    | char[]           | strings     | String table of null terminated paths
+* 
+* Compressed Block (repeated until the entry size is reached, see compress.h for the block format):
+*  Offset |       Type       |    Field    | Description
+* --------|------------------|-------------|------------
+* 0       | uint32_t         | storedsize  | Size of the block data, if it is the same as rawsize the block is stored uncompressed
+* 4       | uint32_t         | rawsize     | Size of the block uncompressed, at most COMPRESS_BLOCK_SIZE
+* 8       | uint8_t[]        | data        | The block data
+* 
+* Notes:
+*	- The data of every entry starts on a PAK_ALIGNMENT byte boundary so uncompressed entries can be used in place from a mapped archive.
+*	- Entries with identical contents share the same data, only the directory entries differ. An entry that must be mappable never shares compressed data.
+*	- All fields are little endian and the structures have no padding, the engine reads them directly on little endian hosts.
+*	- When several mounted archives contain the same path, the archive mounted last wins.
+*/
+
+#pragma once
+
+#define PAK_MAGIC "MPAK"
+#define PAK_MAGIC_LEN 4
+#define PAK_VERSION 1
+#define PAK_EXTENSION ".pak"
+#define PAK_ALIGNMENT 64
+
+#define PAK_ENTRY_COMPRESSED (1 << 0)
+#define PAK_BLOCK_HEADER_SIZE 8
+
+typedef struct
+{
+	char magic[PAK_MAGIC_LEN];
+	unsigned int version;
+	unsigned int entrycount;
+	unsigned int flags;
+	unsigned long long diroffset;
+	unsigned long long dirsize;
+} pakheader_t;
+
+typedef struct
+{
+	unsigned long long offset;
+	unsigned long long size;
+	unsigned long long storedsize;
+	unsigned int pathoffset;
+	unsigned int pathhash;
+	unsigned int flags;
+	unsigned int reserved;
+} pakentry_t;
+
+_Static_assert(sizeof(pakheader_t) == 32, "pakheader_t must match the on disk layout");
+_Static_assert(sizeof(pakentry_t) == 40, "pakentry_t must match the on disk layout");
@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <string.h>
+#include "sys/sys.h"
+#include "common.h"
+
+#define SNAPSHOT_MAGIC 0x4253434d		// "MCSB" read as little endian
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_INITIAL_SIZE 0x1000
+
+/*
+* Snapshot file layout, written and read on the same machine so fields are in host byte order:
+*	header: snapshotheader_t
+*	records: numrecords of [unsigned char tag][unsigned char pad][unsigned short keylen][unsigned short valuelen][key][value]
+* The records are packed with no alignment, they are always read with memcpy
+*/
+typedef struct
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int texthash;		// hash of the text config the snapshot was written alongside
+	unsigned int numrecords;
+	unsigned int datasize;		// size of all the records in bytes, not including the header
+} snapshotheader_t;
+
+#define SNAPSHOT_RECORD_HEADER_SIZE (sizeof(unsigned char) * 2 + sizeof(unsigned short) * 2)
+
+/*
+* Function: ReserveSpace
+* Makes sure the snapshot buffer has room for more bytes, doubling it when it does not
+* 
+*	writer: The snapshot being written
+*	size: The number of bytes needed
+* 
+* Returns: A boolean if there is enough room or not
+*/
+static bool ReserveSpace(snapshotwriter_t *writer, size_t size)
+{
+	if ((writer->size + size) <= writer->capacity)
+		return(true);
+
+	size_t newcapacity = writer->capacity;
+	while ((writer->size + size) > newcapacity)
+		newcapacity *= 2;
+
+	char *newdata = MemCache_Alloc(newcapacity);
+	if (!newdata)
+		return(false);
+
+	memcpy(newdata, writer->data, writer->size);
+	MemCache_Free(writer->data);
+
+	writer->data = newdata;
+	writer->capacity = newcapacity;
+
+	return(true);
+}
+
+/*
+* Function: Snapshot_HashText
+* Hashes the contents of a text config file, using the FNV-1a algorithm
+* 
+*	data: The contents of the file
+*	size: The size of the contents
+* 
+* Returns: The hash value
+*/
+unsigned int Snapshot_HashText(const void *data, size_t size)
+{
+	const unsigned char *bytes = data;
+	unsigned int hash = 2166136261u;
+
+	for (size_t i=0; i<size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+
+	return(hash);
+}
+
+/*
+* Function: Snapshot_BeginWrite
+* Starts building a snapshot in memory
+* 
+*	writer: The snapshot to start
+*	texthash: The hash of the text config written alongside the snapshot
+* 
+* Returns: A boolean if the snapshot was started or not
+*/
+bool Snapshot_BeginWrite(snapshotwriter_t *writer, unsigned int texthash)
+{
+	memset(writer, 0, sizeof(*writer));
+
+	writer->data = MemCache_Alloc(SNAPSHOT_INITIAL_SIZE);
+	if (!writer->data)
+		return(false);
+
+	writer->capacity = SNAPSHOT_INITIAL_SIZE;
+	writer->size = sizeof(snapshotheader_t);
+	writer->texthash = texthash;
+
+	return(true);
+}
+
+/*
+* Function: Snapshot_WriteRecord
+* Adds a record to a snapshot being built
+* 
+*	writer: The snapshot being written
+*	tag: A value the caller can use to tell records apart, like the type of the value
+*	key: The key of the record, usually a name
+*	keylen: The length of the key
+*	value: The value of the record
+*	valuelen: The length of the value
+* 
+* Returns: A boolean if the record was added or not
+*/
+bool Snapshot_WriteRecord(snapshotwriter_t *writer, unsigned char tag, const void *key, unsigned short keylen, const void *value, unsigned short valuelen)
+{
+	if (!writer->data || !ReserveSpace(writer, SNAPSHOT_RECORD_HEADER_SIZE + keylen + valuelen))
+		return(false);
+
+	char *dst = writer->data + writer->size;
+	unsigned char pad = 0;
+
+	memcpy(dst, &tag, sizeof(tag));
+	memcpy(dst + 1, &pad, sizeof(pad));
+	memcpy(dst + 2, &keylen, sizeof(keylen));
+	memcpy(dst + 4, &valuelen, sizeof(valuelen));
+	memcpy(dst + SNAPSHOT_RECORD_HEADER_SIZE, key, keylen);
+	memcpy(dst + SNAPSHOT_RECORD_HEADER_SIZE + keylen, value, valuelen);
+
+	writer->size += SNAPSHOT_RECORD_HEADER_SIZE + keylen + valuelen;
+	writer->numrecords++;
+
+	return(true);
+}
+
+/*
+* Function: Snapshot_EndWrite
+* Finishes a snapshot and queues it to be written to a file, the snapshot memory is freed
+* 
+*	writer: The snapshot being written
+*	filename: The file to write the snapshot to
+* 
+* Returns: A boolean if the snapshot was queued for writing or not
+*/
+bool Snapshot_EndWrite(snapshotwriter_t *writer, const char *filename)
+{
+	if (!writer->data)
+		return(false);
+
+	snapshotheader_t header =
+	{
+		.magic = SNAPSHOT_MAGIC,
+		.version = SNAPSHOT_VERSION,
+		.texthash = writer->texthash,
+		.numrecords = writer->numrecords,
+		.datasize = (unsigned int)(writer->size - sizeof(header))
+	};
+
+	memcpy(writer->data, &header, sizeof(header));
+
+	bool queued = FileSys_QueueWrite(filename, writer->data, writer->size);
+
+	MemCache_Free(writer->data);
+	memset(writer, 0, sizeof(*writer));
+
+	return(queued);
+}
+
+/*
+* Function: Snapshot_CancelWrite
+* Throws away a snapshot being built without writing it
+* 
+*	writer: The snapshot being written
+*/
+void Snapshot_CancelWrite(snapshotwriter_t *writer)
+{
+	if (writer->data)
+		MemCache_Free(writer->data);
+
+	memset(writer, 0, sizeof(*writer));
+}
+
+/*
+* Function: Snapshot_Open
+* Maps a snapshot file and checks that it is valid and was written alongside the text config with the given hash
+* 
+*	reader: The snapshot to open
+*	filename: The snapshot file
+*	texthash: The hash of the current text config
+* 
+* Returns: A boolean if the snapshot can be used or not, if not the text config should be read instead
+*/
+bool Snapshot_Open(snapshotreader_t *reader, const char *filename, unsigned int texthash)
+{
+	memset(reader, 0, sizeof(*reader));
+
+	if (!Sys_FileExists(filename))		// opened by the path it is written to, a copy in the archives or data directory is never used
+		return(false);
+
+	size_t size = 0;
+	char *data = Sys_MapFile(filename, &size);
+	if (!data)
+		return(false);
+
+	snapshotheader_t header;
+	if (size < sizeof(header))
+	{
+		Sys_UnmapFile(data, size);
+		return(false);
+	}
+
+	memcpy(&header, data, sizeof(header));
+
+	if ((header.magic != SNAPSHOT_MAGIC) || (header.version != SNAPSHOT_VERSION) || (header.datasize != (size - sizeof(header))))
+	{
+		Log_Writef(LOG_WARN, "Ignoring invalid snapshot file: %s", filename);
+		Sys_UnmapFile(data, size);
+		return(false);
+	}
+
+	if (header.texthash != texthash)	// the text config was changed after the snapshot was written
+	{
+		Sys_UnmapFile(data, size);
+		return(false);
+	}
+
+	reader->data = data;
+	reader->size = size;
+	reader->offset = sizeof(header);
+	reader->numrecords = header.numrecords;
+
+	return(true);
+}
+
+/*
+* Function: Snapshot_ReadRecord
+* Reads the next record from an open snapshot, the key and value point into the mapped file and are not null terminated
+* 
+*	reader: The open snapshot
+*	record: Output for the record
+* 
+* Returns: A boolean if a record was read, false at the end of the snapshot or if the snapshot is truncated
+*/
+bool Snapshot_ReadRecord(snapshotreader_t *reader, snapshotrecord_t *record)
+{
+	if (!reader->data || (reader->numread >= reader->numrecords))
+		return(false);
+
+	if ((reader->size - reader->offset) < SNAPSHOT_RECORD_HEADER_SIZE)
+		return(false);
+
+	const char *src = reader->data + reader->offset;
+
+	memcpy(&record->tag, src, sizeof(record->tag));
+	memcpy(&record->keylen, src + 2, sizeof(record->keylen));
+	memcpy(&record->valuelen, src + 4, sizeof(record->valuelen));
+
+	size_t recordsize = SNAPSHOT_RECORD_HEADER_SIZE + record->keylen + record->valuelen;
+	if ((reader->size - reader->offset) < recordsize)
+		return(false);
+
+	record->key = src + SNAPSHOT_RECORD_HEADER_SIZE;
+	record->value = src + SNAPSHOT_RECORD_HEADER_SIZE + record->keylen;
+
+	reader->offset += recordsize;
+	reader->numread++;
+
+	return(true);
+}
+
+/*
+* Function: Snapshot_Close
+* Unmaps a snapshot opened with Snapshot_Open
+* 
+*	reader: The open snapshot
+*/
+void Snapshot_Close(snapshotreader_t *reader)
+{
+	Sys_UnmapFile((void *)reader->data, reader->size);
+	memset(reader, 0, sizeof(*reader));
+}
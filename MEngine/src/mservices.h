@@ -30,14 +30,71 @@ typedef enum
 	CMD_EXEC_APPEND
 } cmdexecution_t;
 
+typedef enum
+{
+	FS_PRIORITY_LOW = 0,
+	FS_PRIORITY_NORMAL,
+	FS_PRIORITY_HIGH
+} fspriority_t;
+
+typedef enum
+{
+	FS_READ_INVALID = 0,		// the handle is unknown or the read was already delivered
+	FS_READ_PENDING,
+	FS_READ_COMPLETE,
+	FS_READ_FAILED
+} fsreadstatus_t;
+
+typedef struct
+{
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long evictions;
+	size_t bytesused;
+	size_t budget;
+	unsigned int numentries;
+} fscachestats_t;
+
+typedef enum
+{
+	FS_IO_OPEN = 0,		// a file or archive opened or mapped on disk
+	FS_IO_READ,			// file data read or decompressed into memory
+	FS_IO_MAP,			// a read only view of a file handed out
+	FS_IO_STAT,			// a file status or existence check
+	FS_IO_LIST,			// a directory read
+	FS_IO_WRITE,		// a file written
+	FS_IO_NUM_OPS
+} fsioop_t;
+
+typedef struct
+{
+	unsigned long long count[FS_IO_NUM_OPS];
+	unsigned long long bytes[FS_IO_NUM_OPS];
+	unsigned long long time[FS_IO_NUM_OPS];		// in microseconds
+} fsiostats_t;
+
+typedef struct
+{
+	unsigned int entityid;
+	unsigned int area;			// the area and chunk the entity was loaded with
+	unsigned int chunk;
+	unsigned int index;			// the index of the entity in its chunk
+	int x;						// the position of the entity in the world
+	int y;
+	int z;
+} entitylocation_t;
+
 typedef struct cvar cvar_t;			// opaque type to cvar struct, only access through Cvar_ functions
 typedef struct thread thread_t;		// opaque type to thread struct, only access through Sys_ thread functions
 typedef struct mutex mutex_t;		// opaque type to mutex struct, only access through Sys_ mutex functions
 typedef struct condvar condvar_t;	// opaque type to condvar struct, only access through Sys_ condvar functions
 typedef struct filedata filedata_t;	// opaque type to filedata struct, only access through Sys_ file functions
 typedef struct cmdargs cmdargs_t;	// opaque type to cmdargs struct, only access through Cmd_ functions
+typedef struct fsstream fsstream_t;	// opaque type to fsstream struct, only access through FileSys_ stream functions
 
 typedef void (*cmdfunction_t)(const cmdargs_t *args);
+typedef void (*cvarcallback_t)(cvar_t *cvar);		// called after a cvars value has changed
+typedef void (*fsreadcallback_t)(unsigned int handle, const void *data, size_t size, void *userdata);	// called on the main thread when an async read finishes, data is NULL if it failed
 
 typedef struct		// logging service
 {
@@ -71,15 +128,19 @@ typedef struct		// cvar system
 	cvar_t *(*RegisterFloat)(const char *name, const float value, const unsigned long long flags, const char *description);
 	cvar_t *(*RegisterBool)(const char *name, const bool value, const unsigned long long flags, const char *description);
 
-	bool (*GetString)(const cvar_t *cvar, char *out);
+	bool (*GetString)(const cvar_t *cvar, char *out);		// the getters are lock free and safe to call from any thread
 	bool (*GetInt)(const cvar_t *cvar, int *out);
 	bool (*GetFloat)(const cvar_t *cvar, float *out);
 	bool (*GetBool)(const cvar_t *cvar, bool *out);
 
-	void (*SetString)(cvar_t *cvar, const char *value);
+	void (*SetString)(cvar_t *cvar, const char *value);	// the setters, Find and Register must be called from the main thread
 	void (*SetInt)(cvar_t *cvar, const int value);
 	void (*SetFloat)(cvar_t *cvar, const float value);
 	void (*SetBool)(cvar_t *cvar, const bool value);
+
+	unsigned int (*GetModifiedCount)(const cvar_t *cvar);		// increments each time the value changes, cache it and compare to detect changes
+	bool (*AddCallback)(cvar_t *cvar, cvarcallback_t callback);
+	void (*RemoveCallback)(cvar_t *cvar, cvarcallback_t callback);
 } cvarsystem_t;
 
 typedef struct
@@ -87,6 +148,23 @@ typedef struct
 	bool (*FileExists)(const char *filename);
 	filedata_t *(*ListFiles)(unsigned int *numfiles, const char *directory, const char *filter);
 	void (*FreeFileList)(filedata_t **filelist);
+	void *(*ReadFile)(const char *filename, size_t *size);		// searches the mounted pak files then the data directory, the data is null terminated
+	void (*FreeFile)(void *data);
+	const void *(*AcquireFile)(const char *filename, size_t *size);		// shared cached contents, reused until the file changes on disk
+	void (*ReleaseFile)(const void *data);
+	void (*GetCacheStats)(fscachestats_t *stats);
+	void (*GetIOStats)(fsiostats_t *total, fsiostats_t *lastframe);		// counts of every filesystem operation since startup and in the last frame
+	const void *(*MapFile)(const char *filename, size_t *size);		// read only view without copying, NULL for missing or empty files
+	void (*UnmapFile)(const void *data, size_t size);
+	fsstream_t *(*OpenStream)(const char *filename, size_t *size);		// reads a file in chunks, compressed archive entries are decompressed as they are read
+	size_t (*ReadStream)(fsstream_t *stream, void *buffer, size_t length);
+	void (*CloseStream)(fsstream_t *stream);
+	unsigned int (*ReadAsync)(const char *filename, size_t offset, size_t length, void *buffer, fspriority_t priority, fsreadcallback_t callback, void *userdata);
+	fsreadstatus_t (*PollRead)(unsigned int handle);
+	fsreadstatus_t (*WaitRead)(unsigned int handle);		// blocks until the read finishes and delivers it straight away
+	bool (*CancelRead)(unsigned int handle);
+	filedata_t *(*ListFileNames)(unsigned int *numfiles, const char *directory, const char *filter);		// like ListFiles but only the filenames are filled in
+	filedata_t *(*ListFilesInPAK)(unsigned int *numfiles, const char *directory, const char *filter);
 } filesystem_t;
 
 typedef struct		// system services
@@ -116,6 +194,17 @@ typedef struct		// system services
 	void *(*GetProcAddress)(void *handle, const char *procname);
 } sys_t;
 
+typedef struct		// world services, sets where the engines world streams chunks in and queries its chunks and the entities of the loaded chunks
+{
+	bool (*FindEntity)(unsigned int entityid, entitylocation_t *location);
+	unsigned int (*FindEntitiesInRect)(unsigned int area, int minx, int minz, int maxx, int maxz, entitylocation_t *entities, unsigned int maxentities);		// returns the number found, only maxentities are written
+	unsigned int (*FindEntitiesInRadius)(unsigned int area, int x, int z, unsigned int radius, entitylocation_t *entities, unsigned int maxentities);
+	unsigned int (*GetNumEntities)(void);
+	void (*SetFocus)(unsigned int area, int x, int y, int z);		// call each frame with the player or camera position, chunks are streamed in around it
+	bool (*FindChunk)(unsigned int area, int x, int z, unsigned int *chunk);
+	unsigned int (*FindChunksInRadius)(unsigned int area, int x, int z, unsigned int radius, unsigned int *chunks, unsigned int maxchunks);		// resident or not, the same test SetFocus streams chunks in with
+} worldsystem_t;
+
 typedef struct
 {
 	int version;							// version of the game
@@ -138,4 +227,5 @@ typedef struct
 	cvarsystem_t *cvarsystem;
 	filesystem_t *filesystem;
 	sys_t *sys;
+	worldsystem_t *world;
 } mservices_t;
@@ -19,10 +19,12 @@ void Render_StartFrame(void)
 */
 void Render_Frame(void)
 {
+	Render_UpdateWorld();
+
 	// set up for 3D rendering
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
-	gluPerspective(60.0, (GLdouble)glstate.width / (GLdouble)glstate.height, 0.1, 100.0);
+	gluPerspective(glstate.fov, (GLdouble)glstate.width / (GLdouble)glstate.height, 0.1, 100.0);
 	glMatrixMode(GL_MODELVIEW);
 
 	glPushMatrix();
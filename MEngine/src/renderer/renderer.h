@@ -26,11 +26,22 @@ void Render_EndFrame(void);
 #define R_DEF_REFRESH_RATE 60
 #define R_DEF_VSYNC 1
 #define R_DEF_FOV 60.0
+#define R_DEF_CHUNK_RADIUS 1024
+#define R_DEF_CHUNK_BUDGET 256
 #define R_DEF_WIN_NAME "MEngine"
 
 int Render_GetMinWidth(void);
 int Render_GetMinHeight(void);
 
+void Render_UpdateWorld(void);
+void Render_SetWorldFocus(unsigned int area, int x, int y, int z);
+bool Render_FindChunk(unsigned int area, int x, int z, unsigned int *chunk);
+unsigned int Render_FindChunksInRadius(unsigned int area, int x, int z, unsigned int radius, unsigned int *chunks, unsigned int maxchunks);
+bool Render_FindEntity(unsigned int entityid, entitylocation_t *location);
+unsigned int Render_FindEntitiesInRect(unsigned int area, int minx, int minz, int maxx, int maxz, entitylocation_t *entities, unsigned int maxentities);
+unsigned int Render_FindEntitiesInRadius(unsigned int area, int x, int z, unsigned int radius, entitylocation_t *entities, unsigned int maxentities);
+unsigned int Render_GetNumEntities(void);
+
 #define MAX_WIN_NAME SYS_MAX_PATH
 
 typedef struct
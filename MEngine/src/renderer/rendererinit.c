@@ -20,6 +20,8 @@ static cvar_t *rmultisamples;
 static cvar_t *rrefresh;
 static cvar_t *rvsync;
 static cvar_t *rfov;
+static cvar_t *rchunkradius;
+static cvar_t *rchunkbudget;
 
 static world_t *world;
 
@@ -255,6 +257,37 @@ static void InitOpenGL(void)
 	glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);	// better perspective correction
 }
 
+/*
+* Function: VSyncChanged
+* Change callback for the r_vsync cvar, applies the new swap interval without needing a restart
+* 
+*	cvar: The r_vsync cvar
+*/
+static void VSyncChanged(cvar_t *cvar)
+{
+	int vsync = 0;
+	if (!Cvar_GetInt(cvar, &vsync))
+		return;
+
+	GLWnd_SetVSync(vsync);
+	Log_Writef(LOG_INFO, "VSync changed, value set: %d", vsync);
+}
+
+/*
+* Function: FovChanged
+* Change callback for the r_fov cvar, the new field of view is picked up by the next frame
+* 
+*	cvar: The r_fov cvar
+*/
+static void FovChanged(cvar_t *cvar)
+{
+	float fov = 0.0f;
+	if (!Cvar_GetFloat(cvar, &fov))
+		return;
+
+	glstate.fov = (double)fov;
+}
+
 /*
 * Function: Sizeviewport_Cmd
 * Resizes the rendering viewport on window size change, this is just the client region
@@ -273,6 +306,67 @@ static void Sizeviewport_Cmd(const cmdargs_t *args)
 	Common_Printf("Resized viewport to %dx%d", glstate.width, glstate.height);
 }
 
+/*
+* Function: Worldstats_Cmd
+* Prints the chunk residency statistics of the loaded world
+* 
+*	args: The command arguments, this function takes no arguments
+*/
+static void Worldstats_Cmd(const cmdargs_t *args)
+{
+	if (args->argc != 1)
+	{
+		Common_Printf("%s : Invalid command usage, command takes no args", args->argv[0]);
+		return;
+	}
+
+	if (!world)
+	{
+		Common_Printf("No world loaded");
+		return;
+	}
+
+	worldstats_t stats;
+	World_GetStats(world, &stats);
+
+	unsigned long long lookups = stats.hits + stats.misses;
+
+	Common_Printf("Resident chunks: %u (%u pinned), %zu / %zu bytes", stats.numresident, stats.numpinned, stats.bytesresident, stats.budget);
+	Common_Printf("Hits: %llu, misses: %llu (%.1f%% hit rate), evictions: %llu",
+		stats.hits,
+		stats.misses,
+		lookups ? ((double)stats.hits * 100.0 / (double)lookups) : 0.0,
+		stats.evictions
+	);
+
+	Common_Printf("Loads: %llu, average load time: %llu us, max load time: %llu us",
+		stats.loads,
+		stats.loads ? (stats.loadtime / stats.loads) : 0,
+		stats.maxloadtime
+	);
+}
+
+/*
+* Function: Wldconvert_Cmd
+* Converts a world file to the version 2 .wld format
+* 
+*	args: The command arguments, argv[1] is the world file relative to the data directory and argv[2] is the file to write
+*/
+static void Wldconvert_Cmd(const cmdargs_t *args)
+{
+	if (args->argc != 3)
+	{
+		Common_Printf("%s : Invalid command usage, usage: %s <world> <outfile>", args->argv[0], args->argv[0]);
+		return;
+	}
+
+	if (World_ConvertFile(args->argv[1], args->argv[2]))
+		Common_Printf("Converted world %s to %s", args->argv[1], args->argv[2]);
+
+	else
+		Common_Printf("Failed to convert world %s, see the log for details", args->argv[1]);
+}
+
 /*
 * Function: Render_Init
 * Initializes the rendering system and sets up the window
@@ -292,6 +386,8 @@ bool Render_Init(void)
 	};
 
 	Cmd_RegisterCommand("sizeviewport", Sizeviewport_Cmd, "Resizes the viewport to the window size, happens on screen size change");
+	Cmd_RegisterCommand("worldstats", Worldstats_Cmd, "Prints the world chunk residency statistics");
+	Cmd_RegisterCommand("wldconvert", Wldconvert_Cmd, "Converts a world file to the version 2 format: wldconvert <world> <outfile>");
 
 	rwidth = Cvar_RegisterInt("r_width", R_DEF_WIN_WIDTH, CVAR_ARCHIVE | CVAR_RENDERER, "Custom width of the window");
 	rheight = Cvar_RegisterInt("r_height", R_DEF_WIN_HEIGHT, CVAR_ARCHIVE | CVAR_RENDERER, "Custom height of the window");
@@ -300,6 +396,8 @@ bool Render_Init(void)
 	rrefresh = Cvar_RegisterInt("r_refresh", R_DEF_REFRESH_RATE, CVAR_ARCHIVE | CVAR_RENDERER, "Refresh rate of the monitor");
 	rvsync = Cvar_RegisterInt("r_vsync", R_DEF_VSYNC, CVAR_ARCHIVE | CVAR_RENDERER, "Vertical sync");
 	rfov = Cvar_RegisterFloat("r_fov", R_DEF_FOV, CVAR_ARCHIVE | CVAR_RENDERER, "Field of view");
+	rchunkbudget = Cvar_RegisterInt("r_chunkbudget", R_DEF_CHUNK_BUDGET, CVAR_ARCHIVE | CVAR_RENDERER, "The memory budget of the resident world chunks in megabytes, chunks near the focus are kept even when over it");
+	rchunkradius = Cvar_RegisterInt("r_chunkradius", R_DEF_CHUNK_RADIUS, CVAR_ARCHIVE | CVAR_RENDERER, "Distance from the focus that world chunks are streamed in within");
 
 	if (!GetVideoModeInfo(&glstate.width, &glstate.height, -1))
 		return(false);
@@ -359,6 +457,9 @@ bool Render_Init(void)
 
 	InitOpenGL();
 
+	Cvar_AddCallback(rvsync, VSyncChanged);
+	Cvar_AddCallback(rfov, FovChanged);
+
 	Log_Writef(LOG_INFO, "OpenGL version: %s", glGetString(GL_VERSION));
 	Log_Writef(LOG_INFO, "OpenGL renderer: %s", glGetString(GL_RENDERER));
 	Log_Writef(LOG_INFO, "OpenGL vendor: %s", glGetString(GL_VENDOR));
@@ -390,6 +491,9 @@ void Render_Shutdown(void)
 
 	Log_Write(LOG_INFO, "Shutting down rendering system");
 
+	Cvar_RemoveCallback(rvsync, VSyncChanged);
+	Cvar_RemoveCallback(rfov, FovChanged);
+
 	if (world)
 	{
 		World_Unload(world);
@@ -423,3 +527,142 @@ int Render_GetMinHeight(void)
 {
 	return(videomodes[sizeof(videomodes) / sizeof(videomodes[0]) - 1].height);
 }
+
+/*
+* Function: Render_UpdateWorld
+* Streams the chunks of the loaded world around its focus, within the radius set by the r_chunkradius cvar
+* and keeping the resident chunks within the r_chunkbudget cvar
+*/
+void Render_UpdateWorld(void)
+{
+	if (!world)
+		return;
+
+	int radius = 0;
+	if (!Cvar_GetInt(rchunkradius, &radius) || (radius < 0))
+		radius = R_DEF_CHUNK_RADIUS;
+
+	int budgetmb = 0;
+	if (!Cvar_GetInt(rchunkbudget, &budgetmb) || (budgetmb < 0))
+		budgetmb = R_DEF_CHUNK_BUDGET;
+
+	World_Update(world, (unsigned int)radius, (size_t)budgetmb * 1024 * 1024);
+}
+
+/*
+* Function: Render_SetWorldFocus
+* Sets the position the chunks of the loaded world are streamed in around, the game calls it each frame with the position of the
+* player or camera, and the next Render_UpdateWorld loads and unloads the chunks around it
+* 
+*	area: The area the focus is in, only chunks of this area are loaded
+*	x: The X position
+*	y: The Y position, the height
+*	z: The Z position, the north-south axis
+*/
+void Render_SetWorldFocus(unsigned int area, int x, int y, int z)
+{
+	World_SetFocus(world, area, (worldpoint_t) { .x = x, .y = y, .z = z });
+}
+
+/*
+* Function: Render_FindEntity
+* Finds an entity of the loaded world by its ID, only the entities of the resident chunks can be found
+* 
+*	entityid: The ID of the entity
+*	location: The location of the entity found
+* 
+* Returns: A boolean if the entity was found or not, false if no world is loaded
+*/
+bool Render_FindEntity(unsigned int entityid, entitylocation_t *location)
+{
+	return(World_FindEntity(world, entityid, location));
+}
+
+/*
+* Function: Render_FindEntitiesInRect
+* Finds the entities of the loaded world in an area with their position inside a rectangle
+* 
+*	area: The index of the area to search
+*	minx: The smallest X position of the rectangle
+*	minz: The smallest Z position of the rectangle
+*	maxx: The largest X position of the rectangle, inclusive
+*	maxz: The largest Z position of the rectangle, inclusive
+*	entities: The array the entities found are written to
+*	maxentities: The size of the entities array
+* 
+* Returns: The number of entities found, if this is more than maxentities only maxentities were written
+*/
+unsigned int Render_FindEntitiesInRect(unsigned int area, int minx, int minz, int maxx, int maxz, entitylocation_t *entities, unsigned int maxentities)
+{
+	return(World_FindEntitiesInRect(world, area, minx, minz, maxx, maxz, entities, maxentities));
+}
+
+/*
+* Function: Render_FindEntitiesInRadius
+* Finds the entities of the loaded world in an area with their position within a radius of a point
+* 
+*	area: The index of the area to search
+*	x: The X position of the point
+*	z: The Z position of the point
+*	radius: The radius in world units
+*	entities: The array the entities found are written to
+*	maxentities: The size of the entities array
+* 
+* Returns: The number of entities found, if this is more than maxentities only maxentities were written
+*/
+unsigned int Render_FindEntitiesInRadius(unsigned int area, int x, int z, unsigned int radius, entitylocation_t *entities, unsigned int maxentities)
+{
+	return(World_FindEntitiesInRadius(world, area, (worldpoint_t) { .x = x, .z = z }, radius, entities, maxentities));
+}
+
+/*
+* Function: Render_FindChunk
+* Finds the chunk of the loaded world at a position, chunks are found whether they are resident or not
+* 
+*	area: The index of the area to search
+*	x: The X position
+*	z: The Z position
+*	chunk: The index of the chunk found in the area
+* 
+* Returns: A boolean if there is a chunk at the position or not, false if no world is loaded
+*/
+bool Render_FindChunk(unsigned int area, int x, int z, unsigned int *chunk)
+{
+	if ((x < 0) || (z < 0))		// chunk positions are never negative
+		return(false);
+
+	return(World_FindChunk(world, area, (unsigned int)x, (unsigned int)z, chunk));
+}
+
+/*
+* Function: Render_FindChunksInRadius
+* Finds the chunks of the loaded world in an area with their position within a radius of a point, the same test used to stream
+* chunks in around the focus, chunks are found whether they are resident or not
+* 
+*	area: The index of the area to search
+*	x: The X position of the point
+*	z: The Z position of the point
+*	radius: The radius in world units
+*	chunks: The array the indexes of the chunks found in the area are written to
+*	maxchunks: The size of the chunks array
+* 
+* Returns: The number of chunks found, if this is more than maxchunks only maxchunks were written
+*/
+unsigned int Render_FindChunksInRadius(unsigned int area, int x, int z, unsigned int radius, unsigned int *chunks, unsigned int maxchunks)
+{
+	return(World_FindChunksInRadius(world, area, (worldpoint_t) { .x = x, .z = z }, radius, chunks, maxchunks));
+}
+
+/*
+* Function: Render_GetNumEntities
+* Gets the number of entities in the resident chunks of the loaded world
+* 
+* Returns: The number of entities, 0 if no world is loaded
+*/
+unsigned int Render_GetNumEntities(void)
+{
+	worldstats_t stats;
+	World_GetStats(world, &stats);
+
+	return(stats.numentities);
+}
@@ -1,194 +1,2177 @@
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include "sys/sys.h"
 #include "common/common.h"
 #include "world.h"
+#include "worldgen.h"
 
-#define WLD_VERSION 1
-#define WLD_MAGIC "WLD1"
-#define AREA_MAGIC "AREA"
+#define WLD_TEMP_EXT ".tmp"
+#define WLD_MAX_STREAM_REQUESTS 64
+#define WLD_PAGE_SIZE 4096
+#define WLD_SECTOR_HEADER_SIZE (sizeof(unsigned int) * 3)	// pointscount, textureid and flags
+#define WLD_MAX_EMPTY_CELLS 16		// a chunk grid can have up to this many cells for each chunk before it is treated as not being a grid
+#define WLD_MAX_LOAD_THREADS 8
+#define WLD_PARALLEL_MIN_CHUNKS 16384	// worlds with fewer chunks prepare their areas on the loading thread, starting threads would cost more
+#define WLD_MIN_ENTITY_CAPACITY 256
+#define WLD_MAX_ENTITY_CAPACITY 0x80000000ull
+
+typedef struct
+{
+	const unsigned char *data;
+	size_t size;
+	size_t offset;
+} worldreader_t;
+
+typedef enum
+{
+	REQUEST_FREE = 0,
+	REQUEST_PENDING,
+	REQUEST_ACTIVE,
+	REQUEST_DONE
+} requeststate_t;
+
+typedef struct
+{
+	requeststate_t state;
+	unsigned int area;
+	unsigned int chunk;
+	unsigned long long distance;	// squared distance to the focus, the nearest chunks are read first
+	unsigned long long requested;	// the time the chunk was requested, for the load latency
+	bool valid;
+	chunkheader_t header;
+	unsigned int numpoints;			// the points of all the sectors, so the main thread can allocate the chunk in one go
+} chunkrequest_t;
+
+typedef struct		// the source World_ConvertFile writes a loaded world from
+{
+	const world_t *world;
+	char *namebuf;					// the area name being written, the names in the file are not null terminated
+} worldconverter_t;
+
+typedef struct
+{
+	mutex_t *lock;
+	world_t *world;
+	unsigned int nextarea;			// the next area to prepare, shared by the loading thread and the workers
+} arealoader_t;
+
+struct worldstreamer
+{
+	mutex_t *lock;
+	condvar_t *cond;				// signalled when a chunk is requested
+	thread_t *thread;
+	bool stop;
+	const world_t *world;			// only the mapped file and the chunk references are read by the thread
+	chunkrequest_t requests[WLD_MAX_STREAM_REQUESTS];
+};
+
+_Static_assert(sizeof(worldpoint_t) == 12, "worldpoint_t must match the on disk layout");
+_Static_assert(sizeof(worldentity_t) == 16, "worldentity_t must match the on disk layout");
 
 /*
 * Functn: ReadExactBytes
-* Reads a specified number of bytes from a file into a buffer, with byte size (1)
+* Copies a specified number of bytes from the mapped world file into a buffer and advances the read offset
 * 
-*	file: The file to read from
+*	reader: The mapped file to read from
 *	out: The buffer to read the bytes into
 *	num: The number of bytes to read
 * 
 * Returns: true if the exact number of bytes were read, else false
 */
-static bool ReadExactBytes(FILE *file, void *out, size_t num)
+static bool ReadExactBytes(worldreader_t *reader, void *out, size_t num)
+{
+	if (num > (reader->size - reader->offset))
+		return(false);
+
+	memcpy(out, reader->data + reader->offset, num);
+	reader->offset += num;
+
+	return(true);
+}
+
+/*
+* Functn: ReadInPlace
+* Gets a pointer to a specified number of bytes in the mapped world file without copying them and advances the read offset
+* 
+*	reader: The mapped file to read from
+*	num: The number of bytes to read
+* 
+* Returns: A pointer to the bytes in the mapped file, or NULL if there are not enough bytes left
+*/
+static const void *ReadInPlace(worldreader_t *reader, size_t num)
+{
+	if (num > (reader->size - reader->offset))
+		return(NULL);
+
+	const void *data = reader->data + reader->offset;
+	reader->offset += num;
+
+	return(data);
+}
+
+/*
+* Functn: PrefetchChunk
+* Asks the OS to start reading the pages of a chunk from the disk, so the streamer does not wait on every page fault in turn
+* 
+*	world: The world the chunk is in
+*	ref: The chunk reference
+*/
+static void PrefetchChunk(const world_t *world, const chunkref_t *ref)
+{
+	if ((ref->offset > world->filesize) || (ref->size > (world->filesize - ref->offset)))
+		return;		// the streamer reports the bad reference
+
+	Sys_PrefetchMemory((const unsigned char *)world->filedata + ref->offset, ref->size);
+}
+
+/*
+* Functn: ReadChunk
+* Reads a chunk for the streamer thread, every page of the chunk is touched so it is in memory before the main thread copies it out,
+* and the layout is checked and measured. Nothing is allocated here, the memory cache can only be used from the main thread
+* 
+*	world: The world the chunk is in
+*	request: The active request for the chunk
+*/
+static void ReadChunk(const world_t *world, chunkrequest_t *request)
+{
+	const chunkref_t *ref = &world->areas[request->area].chunks[request->chunk];
+
+	request->valid = false;
+	request->numpoints = 0;
+
+	if ((ref->offset > world->filesize) || (ref->size > (world->filesize - ref->offset)) || (ref->size < sizeof(chunkheader_t)))
+		return;
+
+	const unsigned char *data = (const unsigned char *)world->filedata + ref->offset;
+	const unsigned int *checksums = world->areas[request->area].checksums;
+
+	if (checksums)		// reading every byte for the checksum pages the chunk in as well
+	{
+		if (WorldGen_ChunkChecksum(data, ref->size) != checksums[request->chunk])
+			return;
+	}
+
+	else
+	{
+		volatile unsigned char touch = 0;
+		for (size_t i=0; i<ref->size; i+=WLD_PAGE_SIZE)
+			touch ^= data[i];
+
+		(void)touch;
+	}
+
+	memcpy(&request->header, data, sizeof(request->header));
+
+	size_t offset = sizeof(request->header);
+	unsigned long long numpoints = 0;
+
+	for (unsigned int i=0; i<request->header.sectorcount; i++)
+	{
+		unsigned int pointscount = 0;
+		if ((ref->size - offset) < WLD_SECTOR_HEADER_SIZE)
+			return;
+
+		memcpy(&pointscount, data + offset, sizeof(pointscount));
+
+		if (pointscount > ((ref->size - offset - WLD_SECTOR_HEADER_SIZE) / sizeof(worldpoint_t)))
+			return;
+
+		offset += WLD_SECTOR_HEADER_SIZE + (pointscount * sizeof(worldpoint_t));
+		numpoints += pointscount;
+	}
+
+	if ((numpoints > 0xffffffffull) || (request->header.entitycount > ((ref->size - offset) / sizeof(worldentity_t))))
+		return;
+
+	request->numpoints = (unsigned int)numpoints;
+	request->valid = true;
+}
+
+/*
+* Functn: StreamChunks
+* The chunk streamer thread, reads the requested chunks nearest to the focus first
+* 
+*	args: The world streamer
+* 
+* Returns: NULL, the thread will exit when the function returns
+*/
+static void *StreamChunks(void *args)
+{
+	worldstreamer_t *streamer = args;
+
+	Sys_LockMutex(streamer->lock);
+
+	while (1)
+	{
+		chunkrequest_t *request = NULL;
+		for (int i=0; i<WLD_MAX_STREAM_REQUESTS; i++)
+		{
+			chunkrequest_t *candidate = &streamer->requests[i];
+			if ((candidate->state == REQUEST_PENDING) && (!request || (candidate->distance < request->distance)))
+				request = candidate;
+		}
+
+		if (!request)
+		{
+			if (streamer->stop)
+				break;
+
+			Sys_WaitCondVar(streamer->cond, streamer->lock);
+			continue;
+		}
+
+		request->state = REQUEST_ACTIVE;	// the main thread will not touch an active request, so the lock can be dropped for the read
+		Sys_UnlockMutex(streamer->lock);
+
+		ReadChunk(streamer->world, request);
+
+		Sys_LockMutex(streamer->lock);
+		request->state = REQUEST_DONE;
+	}
+
+	Sys_UnlockMutex(streamer->lock);
+
+	return(NULL);
+}
+
+/*
+* Functn: StartStreamer
+* Starts the chunk streamer thread of a world
+* 
+*	world: The world to stream chunks for
+* 
+* Returns: A boolean if the streamer was started or not
+*/
+static bool StartStreamer(world_t *world)
+{
+	worldstreamer_t *streamer = MemCache_Alloc(sizeof(*streamer));
+	if (!streamer)
+		return(false);
+
+	memset(streamer, 0, sizeof(*streamer));
+	streamer->world = world;
+
+	streamer->lock = Sys_CreateMutex();
+	streamer->cond = Sys_CreateCondVar();
+
+	if (streamer->lock && streamer->cond)
+		streamer->thread = Sys_CreateThread(StreamChunks, streamer);
+
+	if (!streamer->thread)
+	{
+		if (streamer->cond)
+			Sys_DestroyCondVar(streamer->cond);
+
+		if (streamer->lock)
+			Sys_DestroyMutex(streamer->lock);
+
+		MemCache_Free(streamer);
+		return(false);
+	}
+
+	world->streamer = streamer;
+
+	return(true);
+}
+
+/*
+* Functn: StopStreamer
+* Stops the chunk streamer thread of a world, a chunk being read is finished first
+* 
+*	world: The world to stop streaming chunks for
+*/
+static void StopStreamer(world_t *world)
+{
+	worldstreamer_t *streamer = world->streamer;
+	if (!streamer)
+		return;
+
+	Sys_LockMutex(streamer->lock);
+	streamer->stop = true;
+	Sys_UnlockMutex(streamer->lock);
+
+	Sys_BroadcastCondVar(streamer->cond);
+
+	Sys_JoinThread(streamer->thread);
+	Sys_DestroyCondVar(streamer->cond);
+	Sys_DestroyMutex(streamer->lock);
+
+	MemCache_Free(streamer);
+	world->streamer = NULL;
+}
+
+/*
+* Functn: SquaredDistance
+* Gets the squared length of a distance on two axes without overflowing, the differences of two ints are up to 2^32
+* so they are squared as unsigned values and the sum saturates
+* 
+*	dx: The distance on the first axis
+*	dz: The distance on the second axis
+* 
+* Returns: The squared distance, ULLONG_MAX if it does not fit
+*/
+static unsigned long long SquaredDistance(long long dx, long long dz)
+{
+	unsigned long long ax = (unsigned long long)((dx < 0) ? -dx : dx);
+	unsigned long long az = (unsigned long long)((dz < 0) ? -dz : dz);
+
+	unsigned long long sx = ax * ax;
+	unsigned long long sz = az * az;
+
+	return((sx > (ULLONG_MAX - sz)) ? ULLONG_MAX : (sx + sz));
+}
+
+/*
+* Functn: ChunkDistance
+* Gets the squared distance from a point to a chunk, the chunk Y position is compared with the point Z (north-south) axis
+* 
+*	ref: The chunk reference
+*	point: The point
+* 
+* Returns: The squared distance
+*/
+static unsigned long long ChunkDistance(const chunkref_t *ref, worldpoint_t point)
 {
-	return(fread(out, 1, num, file) == num);
+	long long dx = (long long)ref->xpos - point.x;
+	long long dz = (long long)ref->ypos - point.z;
+
+	return(SquaredDistance(dx, dz));
+}
+
+/*
+* Functn: GreatestCommonDivisor
+* Gets the greatest common divisor of two numbers
+* 
+*	a: The first number
+*	b: The second number
+* 
+* Returns: The greatest common divisor, or the other number if one of them is 0
+*/
+static unsigned int GreatestCommonDivisor(unsigned int a, unsigned int b)
+{
+	while (b != 0)
+	{
+		unsigned int r = a % b;
+		a = b;
+		b = r;
+	}
+
+	return(a);
+}
+
+/*
+* Functn: HashCell
+* Hashes the coordinates of a grid cell to a bucket
+* 
+*	grid: The chunk grid
+*	cx: The X coordinate of the cell
+*	cy: The Y coordinate of the cell
+* 
+* Returns: The index of the bucket
+*/
+static unsigned int HashCell(const chunkgrid_t *grid, unsigned int cx, unsigned int cy)
+{
+	unsigned int hash = (cx * 73856093u) ^ (cy * 19349663u);
+	hash ^= hash >> 16;
+
+	return(hash & grid->mask);
+}
+
+/*
+* Functn: BuildChunkGrid
+* Builds the grid hash over the chunk references of an area. The cell size is the spacing of the chunk positions,
+* if the chunks are not laid out on a grid it is chosen so there is about one chunk in each cell.
+* Nothing is allocated here so it can run on an area loading thread
+* 
+*	area: The area to build the grid for, its chunk references must be loaded and its bucket arrays allocated
+*/
+static void BuildChunkGrid(areaheader_t *area)
+{
+	chunkgrid_t *grid = &area->grid;
+
+	if (area->chunkcount == 0)
+		return;
+
+	unsigned int maxx = 0;
+	unsigned int maxy = 0;
+
+	grid->minx = area->chunks[0].xpos;
+	grid->miny = area->chunks[0].ypos;
+
+	for (unsigned int i=0; i<area->chunkcount; i++)
+	{
+		grid->minx = (area->chunks[i].xpos < grid->minx) ? area->chunks[i].xpos : grid->minx;
+		grid->miny = (area->chunks[i].ypos < grid->miny) ? area->chunks[i].ypos : grid->miny;
+		maxx = (area->chunks[i].xpos > maxx) ? area->chunks[i].xpos : maxx;
+		maxy = (area->chunks[i].ypos > maxy) ? area->chunks[i].ypos : maxy;
+	}
+
+	unsigned int spacing = 0;
+	for (unsigned int i=0; i<area->chunkcount; i++)
+	{
+		spacing = GreatestCommonDivisor(spacing, area->chunks[i].xpos - grid->minx);
+		spacing = GreatestCommonDivisor(spacing, area->chunks[i].ypos - grid->miny);
+	}
+
+	double gridcells = spacing ? ((double)((maxx - grid->minx) / spacing + 1) * (double)((maxy - grid->miny) / spacing + 1)) : 0.0;
+
+	if ((spacing > 0) && (gridcells <= ((double)area->chunkcount * WLD_MAX_EMPTY_CELLS)))
+		grid->cellsize = spacing;
+
+	else
+	{
+		double cellarea = (((double)(maxx - grid->minx) + 1.0) * ((double)(maxy - grid->miny) + 1.0)) / (double)area->chunkcount;
+		grid->cellsize = 0;		// the square root of cellarea, stops chunks that are not on a grid making millions of cells
+
+		for (unsigned int bit=0x80000000u; bit>0; bit>>=1)
+		{
+			if (((double)(grid->cellsize | bit) * (double)(grid->cellsize | bit)) <= cellarea)
+				grid->cellsize |= bit;
+		}
+
+		grid->cellsize = (grid->cellsize > spacing) ? grid->cellsize : spacing;
+		grid->cellsize = (grid->cellsize > 0) ? grid->cellsize : 1;
+	}
+
+	grid->cellsx = ((maxx - grid->minx) / grid->cellsize) + 1;
+	grid->cellsy = ((maxy - grid->miny) / grid->cellsize) + 1;
+
+	for (unsigned int i=0; i<=grid->mask; i++)
+		grid->buckets[i] = WLD_NO_CHUNK;
+
+	for (unsigned int i=area->chunkcount; i>0; i--)		// inserted backwards so each bucket lists its chunks in file order
+	{
+		unsigned int cx = (area->chunks[i - 1].xpos - grid->minx) / grid->cellsize;
+		unsigned int cy = (area->chunks[i - 1].ypos - grid->miny) / grid->cellsize;
+		unsigned int bucket = HashCell(grid, cx, cy);
+
+		grid->next[i - 1] = grid->buckets[bucket];
+		grid->buckets[bucket] = i - 1;
+	}
+}
+
+/*
+* Functn: CellRange
+* Gets the range of grid cells a range of positions on one axis covers
+* 
+*	origin: The position of the first cell on the axis
+*	cellsize: The size of a cell
+*	numcells: The number of cells on the axis
+*	min: The start of the range of positions
+*	max: The end of the range of positions, inclusive
+*	first: The first cell in the range
+*	last: The last cell in the range
+* 
+* Returns: A boolean if the range covers any cells or not
+*/
+static bool CellRange(unsigned int origin, unsigned int cellsize, unsigned int numcells, long long min, long long max, unsigned int *first, unsigned int *last)
+{
+	if ((max < (long long)origin) || (min > max))
+		return(false);
+
+	long long start = (min > (long long)origin) ? ((min - origin) / cellsize) : 0;
+	long long end = (max - origin) / cellsize;
+
+	if (start >= numcells)
+		return(false);
+
+	*first = (unsigned int)start;
+	*last = (end < numcells) ? (unsigned int)end : (numcells - 1);
+
+	return(true);
+}
+
+/*
+* Functn: GatherChunks
+* Finds the chunks of an area with their position inside a rectangle, and optionally within a radius of a point.
+* Only the cells of the grid the rectangle covers are searched, unless that is more cells than there are chunks
+* 
+*	area: The area to search
+*	minx: The smallest X position of the rectangle
+*	miny: The smallest Y position of the rectangle
+*	maxx: The largest X position of the rectangle, inclusive
+*	maxy: The largest Y position of the rectangle, inclusive
+*	center: The point the chunks must be within the radius of, NULL to only use the rectangle
+*	radius: The squared radius
+*	chunks: The array the indexes of the chunks found are written to, in no particular order
+*	maxchunks: The size of the chunks array
+* 
+* Returns: The number of chunks found, this can be more than maxchunks but only maxchunks are written
+*/
+static unsigned int GatherChunks(const areaheader_t *area, long long minx, long long miny, long long maxx, long long maxy, const worldpoint_t *center, unsigned long long radius, unsigned int *chunks, unsigned int maxchunks)
+{
+	const chunkgrid_t *grid = &area->grid;
+	unsigned int numfound = 0;
+	unsigned int cx0, cx1, cy0, cy1;
+
+	if (!grid->buckets
+		|| !CellRange(grid->minx, grid->cellsize, grid->cellsx, minx, maxx, &cx0, &cx1)
+		|| !CellRange(grid->miny, grid->cellsize, grid->cellsy, miny, maxy, &cy0, &cy1))
+		return(0);
+
+	bool scan = (((unsigned long long)(cx1 - cx0) + 1) * ((unsigned long long)(cy1 - cy0) + 1)) > area->chunkcount;
+
+	for (unsigned int cy=cy0; cy<=cy1; cy++)
+	{
+		for (unsigned int cx=cx0; cx<=cx1; cx++)
+		{
+			unsigned int i = scan ? 0 : grid->buckets[HashCell(grid, cx, cy)];
+
+			while (i != WLD_NO_CHUNK)
+			{
+				const chunkref_t *ref = &area->chunks[i];
+				unsigned int next = scan ? (((i + 1) < area->chunkcount) ? (i + 1) : WLD_NO_CHUNK) : grid->next[i];
+
+				bool found = (ref->xpos >= minx) && (ref->xpos <= maxx) && (ref->ypos >= miny) && (ref->ypos <= maxy)
+					&& (!center || (ChunkDistance(ref, *center) <= radius))
+					&& (scan || ((((ref->xpos - grid->minx) / grid->cellsize) == cx) && (((ref->ypos - grid->miny) / grid->cellsize) == cy)));		// other cells can share the bucket
+
+				if (found)
+				{
+					if (numfound < maxchunks)
+						chunks[numfound] = i;
+
+					numfound++;
+				}
+
+				i = next;
+			}
+
+			if (scan)
+				return(numfound);		// every chunk was checked in one pass
+		}
+	}
+
+	return(numfound);
+}
+
+
+/*
+* Functn: UnlinkChunk
+* Removes a resident chunk from the LRU list
+* 
+*	world: The world the chunk is in
+*	chunk: The chunk to unlink
+*/
+static void UnlinkChunk(world_t *world, worldchunk_t *chunk)
+{
+	if (chunk->prev)
+		chunk->prev->next = chunk->next;
+
+	else
+		world->lruhead = chunk->next;
+
+	if (chunk->next)
+		chunk->next->prev = chunk->prev;
+
+	else
+		world->lrutail = chunk->prev;
+
+	chunk->prev = NULL;
+	chunk->next = NULL;
+}
+
+/*
+* Functn: LinkChunk
+* Adds a resident chunk to the head of the LRU list, as the most recently used
+* 
+*	world: The world the chunk is in
+*	chunk: The chunk to link
+*/
+static void LinkChunk(world_t *world, worldchunk_t *chunk)
+{
+	chunk->prev = NULL;
+	chunk->next = world->lruhead;
+
+	if (world->lruhead)
+		world->lruhead->prev = chunk;
+
+	else
+		world->lrutail = chunk;
+
+	world->lruhead = chunk;
+}
+
+/*
+* Functn: HashEntityId
+* Hashes an entity ID to a bucket of the entity index
+* 
+*	index: The entity index
+*	entityid: The entity ID
+* 
+* Returns: The index of the bucket
+*/
+static unsigned int HashEntityId(const entityindex_t *index, unsigned int entityid)
+{
+	unsigned int hash = entityid * 2654435761u;
+	hash ^= hash >> 16;
+
+	return(hash & (index->capacity - 1));
+}
+
+/*
+* Functn: HashEntityCell
+* Hashes a grid cell of an area to a bucket of the entity index
+* 
+*	index: The entity index
+*	area: The index of the area
+*	cx: The X coordinate of the cell
+*	cy: The Y coordinate of the cell
+* 
+* Returns: The index of the bucket
+*/
+static unsigned int HashEntityCell(const entityindex_t *index, unsigned int area, int cx, int cy)
+{
+	unsigned int hash = (area * 83492791u) ^ ((unsigned int)cx * 73856093u) ^ ((unsigned int)cy * 19349663u);
+	hash ^= hash >> 16;
+
+	return(hash & (index->capacity - 1));
+}
+
+/*
+* Functn: EntityCell
+* Gets the grid cell a position is in on one axis, unlike the chunk grid the cells go on forever in both directions
+* 
+*	position: The position on the axis
+*	cellsize: The cell size of the area
+* 
+* Returns: The cell
+*/
+static int EntityCell(long long position, unsigned int cellsize)
+{
+	long long cell = position / cellsize;
+
+	if ((position < 0) && ((cell * cellsize) != position))
+		cell--;		// round towards negative infinity, not zero
+
+	return((int)cell);
+}
+
+/*
+* Functn: LinkEntity
+* Adds a used entry to the ID and cell buckets of the entity index
+* 
+*	index: The entity index
+*	entry: The index of the entry
+*/
+static void LinkEntity(entityindex_t *index, unsigned int entry)
+{
+	entityentry_t *e = &index->entries[entry];
+	unsigned int idbucket = HashEntityId(index, e->location.entityid);
+	unsigned int cellbucket = HashEntityCell(index, e->location.area, e->cellx, e->celly);
+
+	e->idnext = index->idbuckets[idbucket];
+	index->idbuckets[idbucket] = entry;
+
+	e->cellnext = index->cellbuckets[cellbucket];
+	index->cellbuckets[cellbucket] = entry;
+}
+
+/*
+* Functn: UnlinkEntity
+* Removes a used entry from the ID and cell buckets of the entity index
+* 
+*	index: The entity index
+*	entry: The index of the entry
+*/
+static void UnlinkEntity(entityindex_t *index, unsigned int entry)
+{
+	const entityentry_t *e = &index->entries[entry];
+
+	unsigned int *link = &index->idbuckets[HashEntityId(index, e->location.entityid)];
+	while (*link != entry)
+		link = &index->entries[*link].idnext;
+
+	*link = e->idnext;
+
+	link = &index->cellbuckets[HashEntityCell(index, e->location.area, e->cellx, e->celly)];
+	while (*link != entry)
+		link = &index->entries[*link].cellnext;
+
+	*link = e->cellnext;
+}
+
+/*
+* Functn: GrowEntityIndex
+* Grows the entity index until it has room for more entities, the entries keep their indexes so the chunks
+* still point at their entities, only the buckets are rebuilt
+* 
+*	index: The entity index
+*	needed: The number of unused entries needed
+*	numused: The number of used entries
+* 
+* Returns: A boolean if there is room or not
+*/
+static bool GrowEntityIndex(entityindex_t *index, unsigned int needed, unsigned int numused)
+{
+	unsigned long long required = (unsigned long long)numused + needed;
+	if (required <= index->capacity)
+		return(true);
+
+	unsigned long long capacity = index->capacity ? index->capacity : WLD_MIN_ENTITY_CAPACITY;
+	while (capacity < required)
+		capacity <<= 1;
+
+	if (capacity > WLD_MAX_ENTITY_CAPACITY)
+		return(false);
+
+	entityentry_t *entries = MemCache_Alloc(sizeof(*entries) * capacity);
+	unsigned int *idbuckets = MemCache_Alloc(sizeof(*idbuckets) * capacity);
+	unsigned int *cellbuckets = MemCache_Alloc(sizeof(*cellbuckets) * capacity);
+
+	if (!entries || !idbuckets || !cellbuckets)
+	{
+		if (entries)
+			MemCache_Free(entries);
+
+		if (idbuckets)
+			MemCache_Free(idbuckets);
+
+		if (cellbuckets)
+			MemCache_Free(cellbuckets);
+
+		return(false);
+	}
+
+	unsigned int oldcapacity = index->capacity;
+
+	if (index->entries)
+	{
+		memcpy(entries, index->entries, sizeof(*entries) * oldcapacity);
+		MemCache_Free(index->entries);
+		MemCache_Free(index->idbuckets);
+		MemCache_Free(index->cellbuckets);
+	}
+
+	index->entries = entries;
+	index->idbuckets = idbuckets;
+	index->cellbuckets = cellbuckets;
+	index->capacity = (unsigned int)capacity;
+
+	for (unsigned int i=0; i<index->capacity; i++)
+	{
+		index->idbuckets[i] = WLD_NO_ENTITY;
+		index->cellbuckets[i] = WLD_NO_ENTITY;
+	}
+
+	for (unsigned int i=index->capacity; i>oldcapacity; i--)		// the new entries go on the free list
+	{
+		index->entries[i - 1].location.area = WLD_NO_ENTITY;
+		index->entries[i - 1].idnext = index->freelist;
+		index->freelist = i - 1;
+	}
+
+	for (unsigned int i=0; i<oldcapacity; i++)
+	{
+		if (index->entries[i].location.area != WLD_NO_ENTITY)
+			LinkEntity(index, i);
+	}
+
+	return(true);
+}
+
+/*
+* Functn: IndexEntities
+* Adds the entities of a chunk that was just built to the entity index of its world
+* 
+*	world: The world the chunk is in
+*	area: The index of the area the chunk is in
+*	chunk: The index of the chunk in the area
+* 
+* Returns: A boolean if the entities were added or not, none are added if there is not enough memory for all of them
+*/
+static bool IndexEntities(world_t *world, unsigned int area, unsigned int chunk)
+{
+	entityindex_t *index = &world->entities;
+	worldchunk_t *chunkdata = &world->areas[area].chunkdata[chunk];
+	unsigned int cellsize = world->areas[area].grid.cellsize;
+
+	chunkdata->firstentity = WLD_NO_ENTITY;
+
+	if (chunkdata->header.entitycount == 0)
+		return(true);
+
+	if (!GrowEntityIndex(index, chunkdata->header.entitycount, world->stats.numentities))
+		return(false);
+
+	for (unsigned int i=chunkdata->header.entitycount; i>0; i--)		// added backwards so the chunk lists its entities in order
+	{
+		const worldentity_t *entity = &chunkdata->entities[i - 1];
+		unsigned int entry = index->freelist;
+		entityentry_t *e = &index->entries[entry];
+
+		index->freelist = e->idnext;
+
+		e->location = (entitylocation_t)
+		{
+			.entityid = entity->entityid,
+			.area = area,
+			.chunk = chunk,
+			.index = i - 1,
+			.x = entity->position.x,
+			.y = entity->position.y,
+			.z = entity->position.z
+		};
+
+		e->cellx = EntityCell(entity->position.x, cellsize);
+		e->celly = EntityCell(entity->position.z, cellsize);
+		e->chunknext = chunkdata->firstentity;
+		chunkdata->firstentity = entry;
+
+		LinkEntity(index, entry);
+	}
+
+	world->stats.numentities += chunkdata->header.entitycount;
+
+	return(true);
+}
+
+/*
+* Functn: UnindexEntities
+* Removes the entities of a loaded chunk from the entity index of its world
+* 
+*	world: The world the chunk is in
+*	chunk: The chunk
+*/
+static void UnindexEntities(world_t *world, worldchunk_t *chunk)
+{
+	entityindex_t *index = &world->entities;
+	unsigned int entry = chunk->firstentity;
+
+	while (entry != WLD_NO_ENTITY)
+	{
+		entityentry_t *e = &index->entries[entry];
+		unsigned int next = e->chunknext;
+
+		UnlinkEntity(index, entry);
+
+		e->location.area = WLD_NO_ENTITY;
+		e->idnext = index->freelist;
+		index->freelist = entry;
+		world->stats.numentities--;
+
+		entry = next;
+	}
+
+	chunk->firstentity = WLD_NO_ENTITY;
+}
+
+/*
+* Functn: GatherEntities
+* Finds the loaded entities of an area inside a rectangle, and optionally within a radius of a point.
+* Only the cells the rectangle covers are searched, unless that is more cells than there are entities
+* 
+*	world: The world
+*	area: The index of the area to search
+*	minx: The smallest X position of the rectangle
+*	minz: The smallest Z position of the rectangle
+*	maxx: The largest X position of the rectangle, inclusive
+*	maxz: The largest Z position of the rectangle, inclusive
+*	center: The point the entities must be within the radius of, NULL to only use the rectangle
+*	radius: The squared radius
+*	entities: The array the entities found are written to, in no particular order
+*	maxentities: The size of the entities array
+* 
+* Returns: The number of entities found, this can be more than maxentities but only maxentities are written
+*/
+static unsigned int GatherEntities(const world_t *world, unsigned int area, long long minx, long long minz, long long maxx, long long maxz, const worldpoint_t *center, unsigned long long radius, entitylocation_t *entities, unsigned int maxentities)
+{
+	const entityindex_t *index = &world->entities;
+	unsigned int cellsize = world->areas[area].grid.cellsize;
+	unsigned int numfound = 0;
+
+	minx = (minx > INT_MIN) ? minx : INT_MIN;		// entity positions are ints, so the cells stay in range
+	minz = (minz > INT_MIN) ? minz : INT_MIN;
+	maxx = (maxx < INT_MAX) ? maxx : INT_MAX;
+	maxz = (maxz < INT_MAX) ? maxz : INT_MAX;
+
+	if ((world->stats.numentities == 0) || (cellsize == 0) || (minx > maxx) || (minz > maxz))
+		return(0);		// an area without chunks has no cell size, and no entities
+
+	int cx0 = EntityCell(minx, cellsize);
+	int cx1 = EntityCell(maxx, cellsize);
+	int cy0 = EntityCell(minz, cellsize);
+	int cy1 = EntityCell(maxz, cellsize);
+
+	unsigned long long spanx = (unsigned long long)((long long)cx1 - cx0) + 1;
+	unsigned long long spany = (unsigned long long)((long long)cy1 - cy0) + 1;
+	bool scan = (spanx > world->stats.numentities) || (spany > world->stats.numentities) || ((spanx * spany) > world->stats.numentities);
+
+	for (long long cy=cy0; cy<=cy1; cy++)
+	{
+		for (long long cx=cx0; cx<=cx1; cx++)
+		{
+			unsigned int i = scan ? 0 : index->cellbuckets[HashEntityCell(index, area, (int)cx, (int)cy)];
+
+			while (i != WLD_NO_ENTITY)
+			{
+				const entityentry_t *e = &index->entries[i];
+				unsigned int next = scan ? (((i + 1) < index->capacity) ? (i + 1) : WLD_NO_ENTITY) : e->cellnext;
+
+				long long dx = center ? ((long long)e->location.x - center->x) : 0;
+				long long dz = center ? ((long long)e->location.z - center->z) : 0;
+
+				bool found = (e->location.area == area)
+					&& (e->location.x >= minx) && (e->location.x <= maxx) && (e->location.z >= minz) && (e->location.z <= maxz)
+					&& (!center || (SquaredDistance(dx, dz) <= radius))
+					&& (scan || ((e->cellx == cx) && (e->celly == cy)));		// other cells can share the bucket
+
+				if (found)
+				{
+					if (numfound < maxentities)
+						entities[numfound] = e->location;
+
+					numfound++;
+				}
+
+				i = next;
+			}
+
+			if (scan)
+				return(numfound);		// every entry was checked in one pass
+		}
+	}
+
+	return(numfound);
+}
+
+/*
+* Functn: BuildChunk
+* Copies a chunk the streamer has read out of the mapped file into one allocation, called from the main thread.
+* The sectors are split into the geometry arrays as they are read, the allocation is laid out as the X, Y and Z point arrays,
+* the first point, point count, texture and flags arrays and then the entities, each starting on a WLD_GEOMETRY_ALIGNMENT boundary
+* 
+*	world: The world the chunk is in
+*	request: The finished request for the chunk
+* 
+* Returns: A boolean if the chunk was built or not
+*/
+static bool BuildChunk(world_t *world, const chunkrequest_t *request)
+{
+	const chunkref_t *ref = &world->areas[request->area].chunks[request->chunk];
+	worldchunk_t *chunk = &world->areas[request->area].chunkdata[request->chunk];
+
+	const unsigned char *src = (const unsigned char *)world->filedata + ref->offset + sizeof(chunkheader_t);
+
+	size_t paddedpoints = (((size_t)request->numpoints + WLD_GEOMETRY_LANES - 1) / WLD_GEOMETRY_LANES) * WLD_GEOMETRY_LANES;
+
+	size_t pointsize = (size_t)WorldGen_AlignOffset(sizeof(int) * paddedpoints, WLD_GEOMETRY_ALIGNMENT);
+	size_t sectorsize = (size_t)WorldGen_AlignOffset(sizeof(unsigned int) * request->header.sectorcount, WLD_GEOMETRY_ALIGNMENT);
+	size_t entitysize = sizeof(worldentity_t) * request->header.entitycount;
+
+	memset(chunk, 0, sizeof(*chunk));
+	chunk->header = request->header;
+	chunk->size = (pointsize * 3) + (sectorsize * 4) + entitysize;
+
+	if (chunk->size > 0)
+	{
+		chunk->size += WLD_GEOMETRY_ALIGNMENT - 1;		// MemCache_Alloc only aligns to 8 bytes
+
+		chunk->data = MemCache_Alloc(chunk->size);
+		if (!chunk->data)
+			return(false);
+
+		unsigned char *block = (unsigned char *)(uintptr_t)WorldGen_AlignOffset((uintptr_t)chunk->data, WLD_GEOMETRY_ALIGNMENT);
+		worldgeometry_t *geometry = &chunk->geometry;
+
+		geometry->numsectors = request->header.sectorcount;
+		geometry->numpoints = request->numpoints;
+		geometry->x = (int *)block;
+		geometry->y = (int *)(block + pointsize);
+		geometry->z = (int *)(block + (pointsize * 2));
+		geometry->firstpoint = (unsigned int *)(block + (pointsize * 3));
+		geometry->pointscount = (unsigned int *)(block + (pointsize * 3) + sectorsize);
+		geometry->textureid = (unsigned int *)(block + (pointsize * 3) + (sectorsize * 2));
+		geometry->flags = (unsigned int *)(block + (pointsize * 3) + (sectorsize * 3));
+		chunk->entities = entitysize ? (worldentity_t *)(block + (pointsize * 3) + (sectorsize * 4)) : NULL;
+
+		memset(block, 0, pointsize * 3);		// zero the padding at the end of the point arrays
+
+		unsigned int point = 0;
+
+		for (unsigned int i=0; i<geometry->numsectors; i++)		// the layout was checked by the streamer
+		{
+			unsigned int pointscount = 0;
+			memcpy(&pointscount, src, sizeof(pointscount));
+			src += sizeof(pointscount);
+
+			geometry->firstpoint[i] = point;
+			geometry->pointscount[i] = pointscount;
+
+			for (unsigned int j=0; j<pointscount; j++, point++)
+			{
+				worldpoint_t p;
+				memcpy(&p, src, sizeof(p));
+				src += sizeof(p);
+
+				geometry->x[point] = p.x;
+				geometry->y[point] = p.y;
+				geometry->z[point] = p.z;
+			}
+
+			memcpy(&geometry->textureid[i], src, sizeof(geometry->textureid[i]));
+			memcpy(&geometry->flags[i], src + sizeof(geometry->textureid[i]), sizeof(geometry->flags[i]));
+			src += sizeof(geometry->textureid[i]) + sizeof(geometry->flags[i]);
+		}
+
+		if (entitysize > 0)
+			memcpy(chunk->entities, src, entitysize);
+	}
+
+	if (!IndexEntities(world, request->area, request->chunk))
+	{
+		if (chunk->data)
+			MemCache_Free(chunk->data);
+
+		memset(chunk, 0, sizeof(*chunk));
+		return(false);
+	}
+
+	chunk->loaded = true;
+	LinkChunk(world, chunk);
+
+	unsigned long long loadtime = Sys_GetMicroseconds() - request->requested;
+
+	world->stats.loads++;
+	world->stats.loadtime += loadtime;
+	world->stats.maxloadtime = (loadtime > world->stats.maxloadtime) ? loadtime : world->stats.maxloadtime;
+	world->stats.bytesresident += chunk->size;
+	world->stats.numresident++;
+
+	return(true);
+}
+
+/*
+* Functn: FreeChunk
+* Frees the data of a loaded chunk and removes its entities from the entity index
+* 
+*	world: The world the chunk is in
+*	chunk: The chunk to free
+*/
+static void FreeChunk(world_t *world, worldchunk_t *chunk)
+{
+	if (chunk->data)
+		MemCache_Free(chunk->data);
+
+	if (chunk->loaded)
+	{
+		UnindexEntities(world, chunk);
+		UnlinkChunk(world, chunk);
+		world->stats.bytesresident -= chunk->size;
+		world->stats.numresident--;
+	}
+
+	bool queued = chunk->queued;
+	unsigned long long pinned = chunk->pinned;
+	memset(chunk, 0, sizeof(*chunk));
+	chunk->queued = queued;
+	chunk->pinned = pinned;
+}
+
+/*
+* Functn: FreeAreas
+* Frees every area of a world with its chunk references and loaded chunks
+* 
+*	world: The world
+*/
+static void FreeAreas(world_t *world)
+{
+	if (!world->areas)
+		return;
+
+	for (unsigned int i=0; i<world->header.areacount; i++)
+	{
+		areaheader_t *area = &world->areas[i];
+
+		if (area->chunkdata)
+		{
+			for (unsigned int j=0; j<area->chunkcount; j++)
+				FreeChunk(world, &area->chunkdata[j]);
+
+			MemCache_Free(area->chunkdata);
+		}
+
+		if (area->chunkcopy)
+			MemCache_Free(area->chunkcopy);
+
+		if (area->grid.buckets)
+			MemCache_Free(area->grid.buckets);
+
+		if (area->grid.next)
+			MemCache_Free(area->grid.next);
+	}
+
+	MemCache_Free(world->areas);
+	world->areas = NULL;
+
+	if (world->nearchunks)
+	{
+		MemCache_Free(world->nearchunks);
+		world->nearchunks = NULL;
+	}
+}
+
+/*
+* Functn: ReadAreasV1
+* Reads the area headers of a version 1 world file, the area names and chunk reference tables are used in place.
+* A table that is not aligned is given a copy, but the chunk references are only copied into it when the area is prepared
+* 
+*	world: The world to read the areas into
+*	reader: The mapped file, positioned at the start
+*	filename: The name of the file, for errors
+*	numcopied: The number of chunk reference tables that had to be copied as they were not aligned
+* 
+* Returns: A boolean if the areas were read or not
+*/
+static bool ReadAreasV1(world_t *world, worldreader_t *reader, const char *filename, unsigned int *numcopied)
+{
+	if (!ReadExactBytes(reader, &world->header, sizeof(world->header)) ||
+		memcmp(world->header.magic, WLD_MAGIC, WLD_MAGIC_LEN) != 0 ||
+		world->header.version != WLD_VERSION)
+	{
+		Log_Writef(LOG_ERROR, "Failed to read world header file record for file %s | world: [%.*s, %d] def: [%s, %d]",
+			filename,
+			WLD_MAGIC_LEN,
+			world->header.magic,
+			world->header.version,
+			WLD_MAGIC,
+			WLD_VERSION
+		);
+
+		return(false);
+	}
+
+	if (world->header.areacount == 0)
+		return(true);
+
+	world->areas = MemCache_Alloc(sizeof(*world->areas) * world->header.areacount);
+	if (!world->areas)
+	{
+		Log_Write(LOG_ERROR, "Failed to allocate memory for area array");
+		return(false);
+	}
+
+	memset(world->areas, 0, sizeof(*world->areas) * world->header.areacount);
+
+	for (unsigned int i=0; i<world->header.areacount; i++)
+	{
+		areaheader_t *area = &world->areas[i];
+		if (!ReadExactBytes(reader, area->magic, sizeof(area->magic)) ||
+			memcmp(area->magic, AREA_MAGIC, WLD_MAGIC_LEN) != 0)
+		{
+			Log_Writef(LOG_ERROR, "Failed to read area header file record for area %d in world %s", i, filename);
+			return(false);
+		}
+
+		if (!ReadExactBytes(reader, &area->areanamelen, sizeof(area->areanamelen)))
+		{
+			Log_Writef(LOG_ERROR, "Failed to read area name length for area %d in world %s", i, filename);
+			return(false);
+		}
+
+		area->areaname = ReadInPlace(reader, area->areanamelen);
+		if (!area->areaname)
+		{
+			Log_Writef(LOG_ERROR, "Failed to read area name for area %d in world %s", i, filename);
+			return(false);
+		}
+
+		if (!ReadExactBytes(reader, &area->chunkcount, sizeof(area->chunkcount)))
+		{
+			Log_Writef(LOG_ERROR, "Failed to read chunk count for area %d (%.*s) in world %s", i, area->areanamelen, area->areaname, filename);
+			return(false);
+		}
+
+		if (area->chunkcount == 0)
+			continue;		// an empty area has no chunk arrays or grid
+
+		if (area->chunkcount > ((reader->size - reader->offset) / sizeof(*area->chunks)))
+		{
+			Log_Writef(LOG_ERROR, "Failed to read chunk data for area %d (%.*s) in world %s", i, area->areanamelen, area->areaname, filename);
+			return(false);
+		}
+
+		area->chunks = ReadInPlace(reader, sizeof(*area->chunks) * area->chunkcount);
+
+		if (((uintptr_t)area->chunks % _Alignof(chunkref_t)) != 0)		// the area names before it can leave the table unaligned
+		{
+			area->chunkcopy = MemCache_Alloc(sizeof(*area->chunkcopy) * area->chunkcount);		// filled in when the area is prepared
+			if (!area->chunkcopy)
+			{
+				Log_Writef(LOG_ERROR, "Failed to allocate memory for chunk array in area %d (%.*s) in world %s", i, area->areanamelen, area->areaname, filename);
+				return(false);
+			}
+
+			(*numcopied)++;
+		}
+	}
+
+	return(true);
+}
+
+/*
+* Functn: FindSection
+* Finds a section in the table of contents of a version 2 world file and checks it lies inside the file
+* 
+*	reader: The mapped file
+*	toc: The table of contents
+*	sectioncount: The number of entries in the table of contents
+*	id: The id of the section to find
+*	itemsize: The size of each item in the section, or 0 for a section of bytes
+* 
+* Returns: The section, or NULL if it is missing or does not fit in the file
+*/
+static const worldsection_t *FindSection(const worldreader_t *reader, const worldsection_t *toc, unsigned int sectioncount, const char *id, size_t itemsize)
+{
+	for (unsigned int i=0; i<sectioncount; i++)
+	{
+		const worldsection_t *section = &toc[i];
+		if (memcmp(section->id, id, WLD_MAGIC_LEN) != 0)
+			continue;
+
+		if ((section->offset > reader->size) || (section->size > (reader->size - section->offset))
+			|| ((section->offset % WLD2_SECTION_ALIGNMENT) != 0)
+			|| (itemsize && (section->size != ((unsigned long long)section->count * itemsize))))
+			return(NULL);
+
+		return(section);
+	}
+
+	return(NULL);
+}
+
+/*
+* Functn: ReadAreasV2
+* Reads the areas of a version 2 world file, every table is used in place from the mapped file
+* 
+*	world: The world to read the areas into
+*	reader: The mapped file
+*	filename: The name of the file, for errors
+* 
+* Returns: A boolean if the areas were read or not
+*/
+static bool ReadAreasV2(world_t *world, worldreader_t *reader, const char *filename)
+{
+	worldheader2_t header = { 0 };		// logged below even when it could not be read
+	if (!ReadExactBytes(reader, &header, sizeof(header)) || (header.version != WLD2_VERSION))
+	{
+		Log_Writef(LOG_ERROR, "Failed to read world header file record for file %s | world: [%.*s, %d] def: [%s, %d]",
+			filename,
+			WLD_MAGIC_LEN,
+			header.magic,
+			header.version,
+			WLD2_MAGIC,
+			WLD2_VERSION
+		);
+
+		return(false);
+	}
+
+	if ((header.tocoffset > reader->size) || ((header.tocoffset % _Alignof(worldsection_t)) != 0)
+		|| (header.sectioncount > ((reader->size - header.tocoffset) / sizeof(worldsection_t))))
+	{
+		Log_Writef(LOG_ERROR, "Invalid table of contents in world %s", filename);
+		return(false);
+	}
+
+	const worldsection_t *toc = (const worldsection_t *)(reader->data + header.tocoffset);
+
+	const worldsection_t *areasection = FindSection(reader, toc, header.sectioncount, "AREA", sizeof(worldarea2_t));
+	const worldsection_t *namesection = FindSection(reader, toc, header.sectioncount, "NAME", 0);
+	const worldsection_t *chunksection = FindSection(reader, toc, header.sectioncount, "CREF", sizeof(chunkref_t));
+	const worldsection_t *checksumsection = FindSection(reader, toc, header.sectioncount, "CSUM", sizeof(unsigned int));
+
+	if (!areasection || !namesection || !chunksection || !checksumsection
+		|| (areasection->count != header.areacount) || (checksumsection->count != chunksection->count))
+	{
+		Log_Writef(LOG_ERROR, "Missing or invalid sections in world %s", filename);
+		return(false);
+	}
+
+	memcpy(world->header.magic, header.magic, WLD_MAGIC_LEN);
+	world->header.version = header.version;
+	world->header.areacount = header.areacount;
+
+	if (header.areacount == 0)
+		return(true);
+
+	world->areas = MemCache_Alloc(sizeof(*world->areas) * header.areacount);
+	if (!world->areas)
+	{
+		Log_Write(LOG_ERROR, "Failed to allocate memory for area array");
+		return(false);
+	}
+
+	memset(world->areas, 0, sizeof(*world->areas) * header.areacount);
+
+	const worldarea2_t *areas = (const worldarea2_t *)(reader->data + areasection->offset);
+	const char *names = (const char *)(reader->data + namesection->offset);
+	const chunkref_t *chunks = (const chunkref_t *)(reader->data + chunksection->offset);
+	const unsigned int *checksums = (const unsigned int *)(reader->data + checksumsection->offset);
+
+	for (unsigned int i=0; i<header.areacount; i++)
+	{
+		areaheader_t *area = &world->areas[i];
+
+		if ((areas[i].namelen > 0xffff) || (areas[i].nameoffset > namesection->size) || (areas[i].namelen > (namesection->size - areas[i].nameoffset)))
+		{
+			Log_Writef(LOG_ERROR, "Invalid area name for area %d in world %s", i, filename);
+			return(false);
+		}
+
+		memcpy(area->magic, AREA_MAGIC, WLD_MAGIC_LEN);
+		area->areanamelen = (unsigned short)areas[i].namelen;
+		area->areaname = names + areas[i].nameoffset;
+
+		if ((areas[i].firstchunk > chunksection->count) || (areas[i].chunkcount > (chunksection->count - areas[i].firstchunk)))
+		{
+			Log_Writef(LOG_ERROR, "Invalid chunk range for area %d (%.*s) in world %s", i, area->areanamelen, area->areaname, filename);
+			return(false);
+		}
+
+		area->chunkcount = areas[i].chunkcount;
+		area->chunks = area->chunkcount ? (chunks + areas[i].firstchunk) : NULL;
+		area->checksums = area->chunkcount ? (checksums + areas[i].firstchunk) : NULL;
+	}
+
+	return(true);
+}
+
+/*
+* Functn: FreeWorld
+* Frees a world that is not streaming with its entity index, and unmaps its file
+* 
+*	world: The world to free
+*/
+static void FreeWorld(world_t *world)
+{
+	FreeAreas(world);
+
+	if (world->entities.entries)
+	{
+		MemCache_Free(world->entities.entries);
+		MemCache_Free(world->entities.idbuckets);
+		MemCache_Free(world->entities.cellbuckets);
+	}
+
+	FileSys_UnmapFile(world->filedata, world->filesize);
+	MemCache_Free(world);
+}
+
+/*
+* Functn: AllocArea
+* Allocates the chunk state and the grid hash of an area, the memory cache can only be used from the loading thread
+* so everything an area needs is allocated here before the areas are prepared
+* 
+*	area: The area
+* 
+* Returns: A boolean if the area was allocated or not
+*/
+static bool AllocArea(areaheader_t *area)
+{
+	if (area->chunkcount == 0)
+		return(true);		// an empty area has no chunk arrays or grid
+
+	unsigned int numbuckets = 1;
+	while ((numbuckets < area->chunkcount) && (numbuckets < 0x80000000u))
+		numbuckets <<= 1;
+
+	area->grid.mask = numbuckets - 1;
+
+	area->chunkdata = MemCache_Alloc(sizeof(*area->chunkdata) * area->chunkcount);
+	area->grid.buckets = MemCache_Alloc(sizeof(*area->grid.buckets) * numbuckets);
+	area->grid.next = MemCache_Alloc(sizeof(*area->grid.next) * area->chunkcount);
+
+	if (area->chunkdata)
+		memset(area->chunkdata, 0, sizeof(*area->chunkdata) * area->chunkcount);		// cleared here so a failed load can free it
+
+	return(area->chunkdata && area->grid.buckets && area->grid.next);
+}
+
+/*
+* Functn: PrepareArea
+* Fills in an allocated area, copying its chunk references if they were not aligned in the file and building its grid hash. Only the area itself is touched, so different areas can be prepared at the same time
+* 
+*	area: The area
+*/
+static void PrepareArea(areaheader_t *area)
+{
+	if (area->chunkcount == 0)
+		return;
+
+	if (area->chunkcopy)
+	{
+		memcpy(area->chunkcopy, area->chunks, sizeof(*area->chunkcopy) * area->chunkcount);
+		area->chunks = area->chunkcopy;
+	}
+
+	BuildChunkGrid(area);
+}
+
+/*
+* Functn: PrepareAreas
+* An area loading thread, takes the next area that has not been prepared until there are none left
+* 
+*	args: The area loader
+* 
+* Returns: NULL, the thread will exit when the function returns
+*/
+static void *PrepareAreas(void *args)
+{
+	arealoader_t *loader = args;
+
+	while (1)
+	{
+		Sys_LockMutex(loader->lock);
+		unsigned int index = loader->nextarea++;
+		Sys_UnlockMutex(loader->lock);
+
+		if (index >= loader->world->header.areacount)
+			break;
+
+		PrepareArea(&loader->world->areas[index]);
+	}
+
+	return(NULL);
+}
+
+/*
+* Functn: PrepareAllAreas
+* Prepares every area of a world, spread over worker threads when the world is big enough for it to pay off.
+* The loading thread prepares areas as well, and does all of them if no workers could be started
+* 
+*	world: The world, with every area allocated
+*	numchunks: The number of chunks in the world
+* 
+* Returns: The number of threads that prepared the areas, including the loading thread
+*/
+static unsigned int PrepareAllAreas(world_t *world, unsigned long long numchunks)
+{
+	arealoader_t loader = { .world = world };
+	thread_t *workers[WLD_MAX_LOAD_THREADS];
+	unsigned int numworkers = 0;
+
+	unsigned long maxthreads = Sys_GetMaxThreads();
+	unsigned long wanted = (maxthreads > 1) ? (maxthreads - 1) : 0;		// the loading thread is one of them
+	wanted = (wanted < WLD_MAX_LOAD_THREADS) ? wanted : WLD_MAX_LOAD_THREADS;
+	wanted = (wanted < (world->header.areacount - 1)) ? wanted : (world->header.areacount - 1);
+
+	if ((world->header.areacount > 1) && (numchunks >= WLD_PARALLEL_MIN_CHUNKS) && (wanted > 0))
+		loader.lock = Sys_CreateMutex();
+
+	if (!loader.lock)
+	{
+		for (unsigned int i=0; i<world->header.areacount; i++)
+			PrepareArea(&world->areas[i]);
+
+		return(1);
+	}
+
+	for (; numworkers<wanted; numworkers++)
+	{
+		workers[numworkers] = Sys_CreateThread(PrepareAreas, &loader);
+		if (!workers[numworkers])
+			break;		// the threads that did start, and this one, still prepare every area
+	}
+
+	PrepareAreas(&loader);
+
+	for (unsigned int i=0; i<numworkers; i++)
+		Sys_JoinThread(workers[i]);
+
+	Sys_DestroyMutex(loader.lock);
+
+	return(numworkers + 1);
+}
+
+/*
+* Functn: ParseWorld
+* Maps a .wld file of either version and reads its metadata, without starting the chunk streamer
+* 
+*	filename: The path to the .wld file, relative to the data directory
+*	numcopied: The number of chunk reference tables that had to be copied as they were not aligned
+*	numthreads: The number of threads the areas were prepared on
+* 
+* Returns: A pointer to a new world_t structure, or NULL if the file could not be read
+*/
+static world_t *ParseWorld(const char *filename, unsigned int *numcopied, unsigned int *numthreads)
+{
+	unsigned int maxchunks = 0;
+	unsigned long long numchunks = 0;
+
+	worldreader_t reader = { 0 };
+	reader.data = FileSys_MapFile(filename, &reader.size);
+	if (!reader.data)
+	{
+		Log_Writef(LOG_ERROR, "Failed to open world file: %s", filename);
+		return(NULL);
+	}
+
+	world_t *world = MemCache_Alloc(sizeof(*world));
+	if (!world)
+	{
+		Log_Write(LOG_ERROR, "Failed to allocate memory for world_t structure");
+		FileSys_UnmapFile(reader.data, reader.size);
+		return(NULL);
+	}
+
+	memset(world, 0, sizeof(*world));
+	world->entities.freelist = WLD_NO_ENTITY;
+	world->filedata = reader.data;
+	world->filesize = reader.size;
+
+	bool version2 = (reader.size >= WLD_MAGIC_LEN) && (memcmp(reader.data, WLD2_MAGIC, WLD_MAGIC_LEN) == 0);
+	if (!(version2 ? ReadAreasV2(world, &reader, filename) : ReadAreasV1(world, &reader, filename, numcopied)))
+		goto error;
+
+	for (unsigned int i=0; i<world->header.areacount; i++)
+	{
+		areaheader_t *area = &world->areas[i];
+
+		if (!AllocArea(area))
+		{
+			Log_Writef(LOG_ERROR, "Failed to allocate memory for chunk state and grid in area %d (%.*s) in world %s", i, area->areanamelen, area->areaname, filename);
+			goto error;
+		}
+
+		maxchunks = (area->chunkcount > maxchunks) ? area->chunkcount : maxchunks;
+		numchunks += area->chunkcount;
+	}
+
+	if (maxchunks > 0)
+	{
+		world->nearchunks = MemCache_Alloc(sizeof(*world->nearchunks) * maxchunks);
+		if (!world->nearchunks)
+		{
+			Log_Writef(LOG_ERROR, "Failed to allocate memory for chunk query array in world %s", filename);
+			goto error;
+		}
+	}
+
+	*numthreads = PrepareAllAreas(world, numchunks);
+
+	return(world);
+
+error:
+	FreeWorld(world);
+
+	return(NULL);
 }
 
 /*
 * Functn: World_Load
-* Loads a .wld file from disk and returns a pointer to a new world_t structure.
+* Loads a .wld file through the filesystem and returns a pointer to a new world_t structure, version 1 and 2 files can be loaded.
+* The file is mapped rather than read, it stays mapped while the world is loaded so chunks can be read in place.
 * This function only loads the world metadata, everything else is loaded on demand
 * 
-*	filename: The full path to the .wld file to load
+*	filename: The path to the .wld file to load, relative to the data directory
 * 
 * Returns: A pointer to a new world_t structure, or NULL if the file could not be loaded
 */
 world_t *World_Load(const char *filename)
 {
-	unsigned int i = 0;
+	unsigned int numcopied = 0;
+	unsigned int numthreads = 0;
+	unsigned long long start = Sys_GetMicroseconds();
+
+	world_t *world = ParseWorld(filename, &numcopied, &numthreads);
+	if (!world)
+		return(NULL);
 
-	FILE *file = fopen(filename, "rb");
-	if (!file)
+	if (!StartStreamer(world))
 	{
-		Log_Writef(LOG_ERROR, "Failed to open world file: %s", filename);
+		Log_Writef(LOG_ERROR, "Failed to start the chunk streamer for world %s", filename);
+		FreeWorld(world);
 		return(NULL);
 	}
 
-	world_t *world = MemCache_Alloc(sizeof(*world));
+	Log_Writef(LOG_INFO, "Loaded world: %s [version: %u, areas: %u, size: %zu bytes, chunk tables copied: %u, load threads: %u, time: %llu us]",
+		filename,
+		world->header.version,
+		world->header.areacount,
+		world->filesize,
+		numcopied,
+		numthreads,
+		Sys_GetMicroseconds() - start
+	);
+
+	return(world);
+}
+
+/*
+* Functn: World_Unload
+* Unloads a world_t structure and frees all memory associated with it
+* 
+*	world: A pointer to the world_t structure to unload
+*/
+void World_Unload(world_t *world)
+{
 	if (!world)
+		return;
+
+	StopStreamer(world);
+
+	Log_Writef(LOG_INFO, "World chunk residency: [hits: %llu, misses: %llu, evictions: %llu, loads: %llu, max load time: %llu us]",
+		world->stats.hits,
+		world->stats.misses,
+		world->stats.evictions,
+		world->stats.loads,
+		world->stats.maxloadtime
+	);
+
+	FreeWorld(world);
+}
+
+/*
+* Functn: ConverterAreaName
+* Gets the name of an area of a loaded world for the world writer, the names in the file are not null terminated so it is copied
+* 
+*	context: The world converter
+*	area: The index of the area
+* 
+* Returns: The null terminated name of the area, valid until the next call
+*/
+static const char *ConverterAreaName(void *context, unsigned int area)
+{
+	worldconverter_t *converter = context;
+	const areaheader_t *header = &converter->world->areas[area];
+
+	memcpy(converter->namebuf, header->areaname, header->areanamelen);
+	converter->namebuf[header->areanamelen] = '\0';
+
+	return(converter->namebuf);
+}
+
+/*
+* Functn: ConverterChunkCount
+* Gets the number of chunks in an area of a loaded world for the world writer
+* 
+*	context: The world converter
+*	area: The index of the area
+* 
+* Returns: The number of chunks in the area
+*/
+static unsigned int ConverterChunkCount(void *context, unsigned int area)
+{
+	return(((worldconverter_t *)context)->world->areas[area].chunkcount);
+}
+
+/*
+* Functn: ConverterBuildChunk
+* Copies a chunk of a loaded world out of the mapped file for the world writer
+* 
+*	context: The world converter
+*	area: The index of the area
+*	chunk: The index of the chunk in the area
+*	out: The buffer to write the chunk to
+* 
+* Returns: A boolean if the chunk was copied or not
+*/
+static bool ConverterBuildChunk(void *context, unsigned int area, unsigned int chunk, worldbuffer_t *out)
+{
+	const world_t *world = ((worldconverter_t *)context)->world;
+	const chunkref_t *ref = &world->areas[area].chunks[chunk];
+
+	return(WorldGen_Append(out, (const unsigned char *)world->filedata + ref->offset, (size_t)ref->size));
+}
+
+/*
+* Functn: World_ConvertFile
+* Writes a world file of either version out as a version 2 file, with the chunk checksums computed from the chunk data.
+* The chunks are copied from the mapped file one at a time by the world writer, so the converted world is never held in memory,
+* the file is written to a temporary file and renamed over the output once it is complete
+* 
+*	filename: The path to the world file to convert, relative to the data directory
+*	outfile: The path to write the version 2 file to
+* 
+* Returns: A boolean if the file was converted or not
+*/
+bool World_ConvertFile(const char *filename, const char *outfile)
+{
+	unsigned int numcopied = 0;
+	unsigned int numthreads = 0;
+	unsigned short maxnamelen = 0;
+
+	char tempfile[SYS_MAX_PATH] = { 0 };
+	if (snprintf(tempfile, SYS_MAX_PATH, "%s%s", outfile, WLD_TEMP_EXT) >= SYS_MAX_PATH)
 	{
-		Log_Write(LOG_ERROR, "Failed to allocate memory for world_t structure");
-		goto error;
+		Log_Writef(LOG_ERROR, "File path too long: %s", outfile);
+		return(false);
 	}
 
-	memset(world, 0, sizeof(*world));
+	world_t *world = ParseWorld(filename, &numcopied, &numthreads);
+	if (!world)
+		return(false);
 
-	if (!ReadExactBytes(file, &world->header, sizeof(world->header)) ||
-		memcmp(world->header.magic, WLD_MAGIC, WLD_MAGIC_LEN) != 0 ||
-		world->header.version != WLD_VERSION)
+	for (unsigned int i=0; i<world->header.areacount; i++)
 	{
-		Log_Writef(LOG_ERROR, "Failed to read world header file record for file %s | world: [%s, %d] def: [%s, %d]",
-			filename,
-			world->header.magic,
-			world->header.version,
-			WLD_MAGIC,
-			WLD_VERSION
-		);
+		const areaheader_t *area = &world->areas[i];
+		maxnamelen = (area->areanamelen > maxnamelen) ? area->areanamelen : maxnamelen;
 
-		goto error;
+		for (unsigned int j=0; j<area->chunkcount; j++)
+		{
+			const chunkref_t *ref = &area->chunks[j];
+			if ((ref->offset > world->filesize) || (ref->size > (world->filesize - ref->offset)))
+			{
+				Log_Writef(LOG_ERROR, "Chunk %u in area %u (%.*s) lies outside world %s, not converting it", j, i, area->areanamelen, area->areaname, filename);
+				FreeWorld(world);
+				return(false);
+			}
+		}
 	}
 
-	world->areas = MemCache_Alloc(sizeof(*world->areas) * world->header.areacount);
-	if (!world->areas)
+	worldconverter_t converter =
 	{
-		Log_Write(LOG_ERROR, "Failed to allocate memory for area array");
-		goto error;
+		.world = world,
+		.namebuf = MemCache_Alloc((size_t)maxnamelen + 1)
+	};
+
+	if (!converter.namebuf)
+	{
+		Log_Writef(LOG_ERROR, "Failed to allocate memory to convert world %s", filename);
+		FreeWorld(world);
+		return(false);
 	}
 
-	memset(world->areas, 0, sizeof(*world->areas) * world->header.areacount);
+	worldsource_t source =
+	{
+		.context = &converter,
+		.numareas = world->header.areacount,
+		.AreaName = ConverterAreaName,
+		.ChunkCount = ConverterChunkCount,
+		.BuildChunk = ConverterBuildChunk
+	};
+
+	unsigned long long numchunks = 0;
+	worldgenerror_t error = WorldGen_Write(&source, tempfile, WLD2_VERSION, &numchunks);
+
+	bool converted = (error == WLDGEN_OK) && Sys_Rename(tempfile, outfile);
+	if (converted)
+		Log_Writef(LOG_INFO, "Converted world %s (version %u) to version 2: %s [areas: %u, chunks: %llu]", filename, world->header.version, outfile, world->header.areacount, numchunks);
+
+	else if (error != WLDGEN_OK)
+		Log_Writef(LOG_ERROR, "Failed to convert world %s to %s: %s, after %llu chunks", filename, outfile, WorldGen_ErrorString(error), numchunks);
+
+	else
+		Log_Writef(LOG_ERROR, "Failed to write converted world %s to %s", filename, outfile);
+
+	if (!converted)
+		remove(tempfile);
+
+	MemCache_Free(converter.namebuf);
+	FreeWorld(world);
+
+	return(converted);
+}
+
+/*
+* Functn: World_SetFocus
+* Sets the position chunks are streamed in around, the chunks are loaded and unloaded by the next World_Update
+* 
+*	world: The world
+*	area: The area the focus is in, only chunks of this area are loaded
+*	position: The focus position
+*/
+void World_SetFocus(world_t *world, unsigned int area, worldpoint_t position)
+{
+	if (!world)
+		return;
+
+	world->focusarea = area;
+	world->focus = position;
+}
+
+/*
+* Functn: World_Update
+* Streams the chunks around the focus, called once a frame from the main thread. Chunks read by the streamer are copied in,
+* chunks within the radius are pinned and the ones that are not resident are requested, then the least recently used chunks
+* that are not pinned are evicted until the resident chunks fit in the budget
+* 
+*	world: The world
+*	radius: The distance from the focus, in world units, that chunks are loaded within
+*	budget: The memory budget of the resident chunks in bytes, pinned chunks are kept even when they go over it
+*/
+void World_Update(world_t *world, unsigned int radius, size_t budget)
+{
+	if (!world || !world->streamer)
+		return;
+
+	worldstreamer_t *streamer = world->streamer;
+	chunkrequest_t finished[WLD_MAX_STREAM_REQUESTS];
+	unsigned int numfinished = 0;
+	unsigned int numrequested = 0;
 
-	for (i=0; i<world->header.areacount; i++)
+	unsigned long long loadradius = (unsigned long long)radius * radius;
+	unsigned long long cancelradius = loadradius + (loadradius / 2);		// a request is kept until it is well outside the radius, so it does not restart at the edge
+	unsigned long long now = Sys_GetMicroseconds();
+
+	world->updates++;
+	world->stats.budget = budget;
+	world->stats.numpinned = 0;
+
+	const areaheader_t *focusarea = (world->focusarea < world->header.areacount) ? &world->areas[world->focusarea] : NULL;
+
+	if (focusarea)
 	{
-		areaheader_t *area = &world->areas[i];
-		if (!ReadExactBytes(file, area->magic, sizeof(area->magic)) ||
-			memcmp(area->magic, AREA_MAGIC, WLD_MAGIC_LEN) != 0)
+		world->stats.numpinned = GatherChunks(focusarea,
+			(long long)world->focus.x - radius, (long long)world->focus.z - radius,
+			(long long)world->focus.x + radius, (long long)world->focus.z + radius,
+			&world->focus, loadradius, world->nearchunks, focusarea->chunkcount
+		);
+
+		for (unsigned int i=0; i<world->stats.numpinned; i++)
 		{
-			Log_Writef(LOG_ERROR, "Failed to read area header file record for area %d in world %s", i, filename);
-			goto error;
+			worldchunk_t *chunk = &focusarea->chunkdata[world->nearchunks[i]];
+
+			if ((chunk->pinned == 0) || ((chunk->pinned + 1) < world->updates))		// was not pinned by the last update
+			{
+				if (chunk->loaded)
+					world->stats.hits++;
+
+				else
+					world->stats.misses++;
+			}
+
+			chunk->pinned = world->updates;
+
+			if (chunk->loaded)
+			{
+				UnlinkChunk(world, chunk);		// pinned chunks stay at the head of the LRU list
+				LinkChunk(world, chunk);
+			}
 		}
+	}
+
+	Sys_LockMutex(streamer->lock);
+
+	for (int i=0; i<WLD_MAX_STREAM_REQUESTS; i++)
+	{
+		chunkrequest_t *request = &streamer->requests[i];
 
-		if (!ReadExactBytes(file, &area->areanamelen, sizeof(area->areanamelen)))
+		if (request->state == REQUEST_DONE)
 		{
-			Log_Writef(LOG_ERROR, "Failed to read area name length for area %d in world %s", i, filename);
-			goto error;
+			finished[numfinished++] = *request;		// stays queued until it is built, so it is not requested again below
+			request->state = REQUEST_FREE;
 		}
 
-		area->areaname = MemCache_Alloc(area->areanamelen + 1);
-		if (!area->areaname)
+		else if ((request->state == REQUEST_PENDING)
+			&& ((request->area != world->focusarea) || (ChunkDistance(&world->areas[request->area].chunks[request->chunk], world->focus) > cancelradius)))
 		{
-			Log_Writef(LOG_ERROR, "Failed to allocate memory for area name in area %d in world %s", i, filename);
-			goto error;
+			world->areas[request->area].chunkdata[request->chunk].queued = false;
+			request->state = REQUEST_FREE;
 		}
+	}
 
-		memset(area->areaname, 0, area->areanamelen + 1);
-
-		if (!ReadExactBytes(file, area->areaname, area->areanamelen))
+	if (focusarea)		// no chunks are requested while the focus is outside the world
+	{
+		for (unsigned int i=0, slot=0; i<world->stats.numpinned; i++)
 		{
-			Log_Writef(LOG_ERROR, "Failed to read area name for area %d in world %s", i, filename);
-			goto error;
-		}
+			unsigned int index = world->nearchunks[i];
+			worldchunk_t *chunk = &focusarea->chunkdata[index];
+			if (chunk->loaded || chunk->queued)
+				continue;
 
-		area->areaname[area->areanamelen] = '\0';
+			while ((slot < WLD_MAX_STREAM_REQUESTS) && (streamer->requests[slot].state != REQUEST_FREE))
+				slot++;
 
-		if (!ReadExactBytes(file, &area->chunkcount, sizeof(area->chunkcount)))
-		{
-			Log_Writef(LOG_ERROR, "Failed to read chunk count for area %d (%s) in world %s", i, area->areaname, filename);
-			goto error;
+			if (slot == WLD_MAX_STREAM_REQUESTS)
+				break;		// the rest are requested once some of these are read
+
+			chunkrequest_t *request = &streamer->requests[slot];
+			memset(request, 0, sizeof(*request));
+			request->state = REQUEST_PENDING;
+			request->area = world->focusarea;
+			request->chunk = index;
+			request->distance = ChunkDistance(&focusarea->chunks[index], world->focus);
+			request->requested = now;
+
+			PrefetchChunk(world, &focusarea->chunks[index]);
+
+			chunk->queued = true;
+			numrequested++;
 		}
+	}
+
+	Sys_UnlockMutex(streamer->lock);
+
+	if (numrequested > 0)
+		Sys_SignalCondVar(streamer->cond);
+
+	for (unsigned int i=0; i<numfinished; i++)
+	{
+		const chunkrequest_t *request = &finished[i];
 
-		area->chunks = MemCache_Alloc(sizeof(*area->chunks) * area->chunkcount);
-		if (!area->chunks)
+		if (!request->valid)
 		{
-			Log_Writef(LOG_ERROR, "Failed to allocate memory for chunk array in area %d (%s) in world %s", i, area->areaname, filename);
-			goto error;
+			Log_Writef(LOG_ERROR, "Invalid chunk %u in area %u (%.*s), not loading it", request->chunk, request->area, world->areas[request->area].areanamelen, world->areas[request->area].areaname);
+			continue;		// left marked as queued so it is never requested again
 		}
 
-		memset(area->chunks, 0, sizeof(*area->chunks) * area->chunkcount);
+		worldchunk_t *chunk = &world->areas[request->area].chunkdata[request->chunk];
+		chunk->queued = false;
+
+		unsigned long long pinned = chunk->pinned;		// a chunk the focus moved away from is still kept, it is evicted if it does not fit
+
+		if (!BuildChunk(world, request))
+			Log_Writef(LOG_ERROR, "Failed to allocate memory for chunk %u in area %u (%.*s)", request->chunk, request->area, world->areas[request->area].areanamelen, world->areas[request->area].areaname);
+
+		chunk->pinned = pinned;
+	}
+
+	worldchunk_t *chunk = world->lrutail;
+	while (chunk && (world->stats.bytesresident > budget))
+	{
+		worldchunk_t *prev = chunk->prev;
 
-		if (!ReadExactBytes(file, area->chunks, sizeof(*area->chunks) * area->chunkcount))
+		if (chunk->pinned != world->updates)
 		{
-			Log_Writef(LOG_ERROR, "Failed to read chunk data for area %d (%s) in world %s", i, area->areaname, filename);
-			goto error;
+			FreeChunk(world, chunk);
+			world->stats.evictions++;
 		}
+
+		chunk = prev;
 	}
+}
 
-	world->filehandle = file;
-	return(world);
+/*
+* Functn: World_GetChunk
+* Gets a chunk if it is loaded
+* 
+*	world: The world
+*	area: The index of the area the chunk is in
+*	chunk: The index of the chunk in the area
+* 
+* Returns: The chunk, or NULL if it is not loaded
+*/
+const worldchunk_t *World_GetChunk(const world_t *world, unsigned int area, unsigned int chunk)
+{
+	if (!world || (area >= world->header.areacount) || (chunk >= world->areas[area].chunkcount))
+		return(NULL);
 
-error:
-	if (world && world->areas)
+	const worldchunk_t *chunkdata = &world->areas[area].chunkdata[chunk];
+
+	return(chunkdata->loaded ? chunkdata : NULL);
+}
+
+/*
+* Functn: World_LoadChunk
+* Loads a chunk right away on the calling thread instead of waiting for the streamer, for tools and benchmarks that need a
+* specific chunk now. The chunk becomes the most recently used and can be evicted by World_Update like any streamed chunk
+* 
+*	world: The world
+*	area: The index of the area the chunk is in
+*	chunk: The index of the chunk in the area
+* 
+* Returns: A boolean if the chunk is loaded or not, false if it is invalid or the streamer is reading it
+*/
+bool World_LoadChunk(world_t *world, unsigned int area, unsigned int chunk)
+{
+	if (!world || (area >= world->header.areacount) || (chunk >= world->areas[area].chunkcount))
+		return(false);
+
+	worldchunk_t *chunkdata = &world->areas[area].chunkdata[chunk];
+
+	if (chunkdata->loaded)
 	{
-		for (unsigned int j=0; j<i; j++)
-		{
-			areaheader_t *area = &world->areas[j];
+		UnlinkChunk(world, chunkdata);
+		LinkChunk(world, chunkdata);
+		return(true);
+	}
 
-			if (area->areaname)
-				MemCache_Free(area->areaname);
+	if (chunkdata->queued)
+		return(false);		// either requested from the streamer or already found to be invalid
 
-			if (area->chunks)
-				MemCache_Free(area->chunks);
-		}
+	chunkrequest_t request = { .area = area, .chunk = chunk, .requested = Sys_GetMicroseconds() };
+	ReadChunk(world, &request);
 
-		MemCache_Free(world->areas);
+	if (!request.valid)
+	{
+		Log_Writef(LOG_ERROR, "Invalid chunk %u in area %u (%.*s), not loading it", chunk, area, world->areas[area].areanamelen, world->areas[area].areaname);
+		chunkdata->queued = true;		// never requested again, the same as an invalid streamed chunk
+		return(false);
 	}
 
-	if (world)
-		MemCache_Free(world);
+	unsigned long long pinned = chunkdata->pinned;		// BuildChunk clears the chunk, when it fails as well
+
+	bool built = BuildChunk(world, &request);
+	chunkdata->pinned = pinned;
 
-	if (file)
+	if (!built)
 	{
-		fclose(file);
-		file = NULL;
+		Log_Writef(LOG_ERROR, "Failed to allocate memory for chunk %u in area %u (%.*s)", chunk, area, world->areas[area].areanamelen, world->areas[area].areaname);
+		return(false);
 	}
 
-	return(NULL);
+	return(true);
 }
 
 /*
-* Functn: World_Unload
-* Unloads a world_t structure and frees all memory associated with it
+* Functn: World_GetStats
+* Gets the chunk residency statistics of a world
 * 
-*	world: A pointer to the world_t structure to unload
+*	world: The world
+*	stats: The statistics to fill in
 */
-void World_Unload(world_t *world)
+void World_GetStats(const world_t *world, worldstats_t *stats)
 {
-	if (!world)
+	if (!stats)
 		return;
 
-	for (unsigned int i=0; i<world->header.areacount; i++)
+	if (!world)
 	{
-		areaheader_t *area = &world->areas[i];
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	*stats = world->stats;
+}
+
+/*
+* Functn: World_FindChunk
+* Finds the chunk at a position, a chunk covers the cell size of its area in each direction from its position
+* 
+*	world: The world
+*	area: The index of the area to search
+*	x: The X position
+*	y: The Y position, the north-south axis
+*	chunk: The index of the chunk found in the area
+* 
+* Returns: A boolean if there is a chunk at the position or not
+*/
+bool World_FindChunk(const world_t *world, unsigned int area, unsigned int x, unsigned int y, unsigned int *chunk)
+{
+	if (!world || !chunk || (area >= world->header.areacount))
+		return(false);
+
+	const areaheader_t *areadata = &world->areas[area];
+	long long cellsize = areadata->grid.cellsize;
+
+	return(GatherChunks(areadata, (long long)x - cellsize + 1, (long long)y - cellsize + 1, x, y, NULL, 0, chunk, 1) > 0);
+}
+
+/*
+* Functn: World_FindChunksInRect
+* Finds the chunks with their position inside a rectangle
+* 
+*	world: The world
+*	area: The index of the area to search
+*	minx: The smallest X position of the rectangle
+*	miny: The smallest Y position of the rectangle
+*	maxx: The largest X position of the rectangle, inclusive
+*	maxy: The largest Y position of the rectangle, inclusive
+*	chunks: The array the indexes of the chunks found in the area are written to
+*	maxchunks: The size of the chunks array
+* 
+* Returns: The number of chunks found, if this is more than maxchunks only maxchunks were written
+*/
+unsigned int World_FindChunksInRect(const world_t *world, unsigned int area, unsigned int minx, unsigned int miny, unsigned int maxx, unsigned int maxy, unsigned int *chunks, unsigned int maxchunks)
+{
+	if (!world || (area >= world->header.areacount))
+		return(0);
+
+	return(GatherChunks(&world->areas[area], minx, miny, maxx, maxy, NULL, 0, chunks, chunks ? maxchunks : 0));
+}
 
-		if (area->areaname)
-			MemCache_Free(area->areaname);
+/*
+* Functn: World_FindChunksInRadius
+* Finds the chunks with their position within a radius of a point, the same test used to stream chunks in around the focus
+* 
+*	world: The world
+*	area: The index of the area to search
+*	center: The point, its Z axis is compared with the chunk Y positions
+*	radius: The radius in world units
+*	chunks: The array the indexes of the chunks found in the area are written to
+*	maxchunks: The size of the chunks array
+* 
+* Returns: The number of chunks found, if this is more than maxchunks only maxchunks were written
+*/
+unsigned int World_FindChunksInRadius(const world_t *world, unsigned int area, worldpoint_t center, unsigned int radius, unsigned int *chunks, unsigned int maxchunks)
+{
+	if (!world || (area >= world->header.areacount))
+		return(0);
+
+	return(GatherChunks(&world->areas[area],
+		(long long)center.x - radius, (long long)center.z - radius,
+		(long long)center.x + radius, (long long)center.z + radius,
+		&center, (unsigned long long)radius * radius, chunks, chunks ? maxchunks : 0
+	));
+}
+
+/*
+* Functn: World_FindEntity
+* Finds a loaded entity by its ID, only the entities of resident chunks can be found
+* 
+*	world: The world
+*	entityid: The ID of the entity
+*	location: The location of the entity found, if more than one loaded entity has the ID it is the one loaded last
+* 
+* Returns: A boolean if the entity is loaded or not
+*/
+bool World_FindEntity(const world_t *world, unsigned int entityid, entitylocation_t *location)
+{
+	if (!world || !location || (world->stats.numentities == 0))
+		return(false);
+
+	const entityindex_t *index = &world->entities;
 
-		if (area->chunks)
-			MemCache_Free(area->chunks);
+	for (unsigned int i=index->idbuckets[HashEntityId(index, entityid)]; i!=WLD_NO_ENTITY; i=index->entries[i].idnext)
+	{
+		if (index->entries[i].location.entityid == entityid)
+		{
+			*location = index->entries[i].location;
+			return(true);
+		}
 	}
 
-	if (world->areas)
-		MemCache_Free(world->areas);
+	return(false);
+}
 
-	if (world->filehandle)
-		fclose(world->filehandle);
+/*
+* Functn: World_FindEntitiesInRect
+* Finds the loaded entities of an area with their position inside a rectangle
+* 
+*	world: The world
+*	area: The index of the area to search
+*	minx: The smallest X position of the rectangle
+*	minz: The smallest Z position of the rectangle
+*	maxx: The largest X position of the rectangle, inclusive
+*	maxz: The largest Z position of the rectangle, inclusive
+*	entities: The array the entities found are written to
+*	maxentities: The size of the entities array
+* 
+* Returns: The number of entities found, if this is more than maxentities only maxentities were written
+*/
+unsigned int World_FindEntitiesInRect(const world_t *world, unsigned int area, int minx, int minz, int maxx, int maxz, entitylocation_t *entities, unsigned int maxentities)
+{
+	if (!world || (area >= world->header.areacount))
+		return(0);
 
-	MemCache_Free(world);
+	return(GatherEntities(world, area, minx, minz, maxx, maxz, NULL, 0, entities, entities ? maxentities : 0));
+}
+
+/*
+* Functn: World_FindEntitiesInRadius
+* Finds the loaded entities of an area with their position within a radius of a point, on the X and Z axes
+* 
+*	world: The world
+*	area: The index of the area to search
+*	center: The point, its Y axis is not used
+*	radius: The radius in world units
+*	entities: The array the entities found are written to
+*	maxentities: The size of the entities array
+* 
+* Returns: The number of entities found, if this is more than maxentities only maxentities were written
+*/
+unsigned int World_FindEntitiesInRadius(const world_t *world, unsigned int area, worldpoint_t center, unsigned int radius, entitylocation_t *entities, unsigned int maxentities)
+{
+	if (!world || (area >= world->header.areacount))
+		return(0);
+
+	return(GatherEntities(world, area,
+		(long long)center.x - radius, (long long)center.z - radius,
+		(long long)center.x + radius, (long long)center.z + radius,
+		&center, (unsigned long long)radius * radius, entities, entities ? maxentities : 0
+	));
 }
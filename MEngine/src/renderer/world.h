@@ -1,5 +1,5 @@
 /*
-* The engines .wld file format specification. Version 1.
+* The engines .wld file format specification. Versions 1 and 2.
 * This file (world.h) contains the structures used to represent the world data following the .wld format.
 * 
 * Overview:
@@ -37,8 +37,8 @@
 * --------|------------------|-------------|------------
 * 0       | uint32_t         | posx        | X position of the chunk in the world
 * 4       | uint32_t         | posy        | Y position of the chunk in the world
-* 8       | size_t           | offset      | Offset in the file where the chunk data starts
-* 16      | size_t           | size        | Size of the chunk data in bytes
+* 8       | uint64_t         | offset      | Offset in the file where the chunk data starts
+* 16      | uint64_t         | size        | Size of the chunk data in bytes
 * 
 * Chunk Header:
 *  Offset |       Type       |    Field    | Description
@@ -66,19 +66,86 @@
 *  Offset |       Type       |    Field    | Description
 * --------|------------------|-------------|------------
 * 0       | chunkheader_t    | header      | Header of the chunk
-* 16      | worldsector_t[]  | sectors     | Array of sectors in the chunk
+* 16      | Sector[]         | sectors     | Array of sectors in the chunk
 * 16+S*12 | worldentity_t[]  | entities    | Array of entities in the chunk
 * 
+* Version 2:
+* Version 2 keeps the chunk layout above but replaces everything around it with fixed width little endian fields in sections
+* found through a table of contents, so no part of the file has to be read to find another. Sections start on a WLD2_SECTION_ALIGNMENT
+* byte boundary and chunks on a WLD2_CHUNK_ALIGNMENT byte boundary, so every table can be used in place from the mapped file.
+* 
+* World Header:
+*  Offset |       Type       |    Field     | Description
+* --------|------------------|--------------|------------
+* 0       | char[4]          | magic        | Magic: "WLD2" to identify the file format
+* 4       | uint32_t         | version      | Version of the world format, 2
+* 8       | uint32_t         | areacount    | Number of areas in the world (A)
+* 12      | uint32_t         | sectioncount | Number of entries in the table of contents
+* 16      | uint64_t         | tocoffset    | Offset in the file where the table of contents starts
+* 24      | uint32_t         | flags        | World flags, currently unused and set to 0
+* 28      | uint32_t         | reserved     | Padding, set to 0
+* 
+* Table of Contents Entry:
+*  Offset |       Type       |    Field    | Description
+* --------|------------------|-------------|------------
+* 0       | char[4]          | id          | The section: "AREA", "NAME", "CREF", "CSUM" or "CDAT"
+* 4       | uint32_t         | count       | Number of items in the section, 0 for byte sections
+* 8       | uint64_t         | offset      | Offset in the file where the section starts
+* 16      | uint64_t         | size        | Size of the section in bytes
+* 
+* Sections:
+*	- AREA: An area entry for each area (A).
+*	- NAME: The area names, each followed by a null terminator.
+*	- CREF: The chunk references of every area, each area owns a contiguous run. The same layout as version 1, with 64 bit offsets and sizes.
+*	- CSUM: A uint32_t FNV-1a checksum of the data of each chunk, in the same order as CREF.
+*	- CDAT: The chunk data, the offsets in CREF are from the start of the file.
+* 
+* Area Entry:
+*  Offset |       Type       |    Field    | Description
+* --------|------------------|-------------|------------
+* 0       | uint32_t         | nameoffset  | Offset of the area name in the NAME section
+* 4       | uint32_t         | namelen     | Length of the area name, without the null terminator
+* 8       | uint32_t         | firstchunk  | Index of the first chunk reference of the area in the CREF section
+* 12      | uint32_t         | chunkcount  | Number of chunks in the area
+* 
 * Notes:
 *	-The size of the worldpoint_t structure is 12 bytes packed (3 integers (X, Y, Z), each 4 bytes).
+*	-Chunks are read on demand by World_Update, which streams in the chunks of the focus area within a radius of the focus position.
+*	 The game sets the focus each frame through the SetFocus function of worldsystem_t, until then it is area 0 at the origin.
+*	 A chunks X and Y position are compared with the X and Z (north-south) axes of the focus position.
+*	-Chunks stay resident after they leave the radius, the least recently used are evicted once the resident chunks go over the budget.
+*	-The file is mapped and the area names and chunk reference tables are used in place, only what is touched is read from the disk.
+*	 A version 1 chunk reference table that is not aligned to 8 bytes in the file is copied instead.
+*	-A loaded chunk stores its sectors as a structure of arrays in worldgeometry_t, the points of every sector are in one X, one Y and one Z array
+*	 and each sector is a range of them, so passes over all the geometry of a chunk read contiguous memory.
+*	-Version 2 chunks are checked against their checksum when they are streamed in, a chunk that does not match is not loaded.
+*	-World_ConvertFile upgrades a version 1 file to version 2, the wldconvert command runs it.
+*	-Each area has a grid hash over its chunk references built when the world is loaded, so chunks can be found by position without a scan.
+*	 The cell size is the spacing of the chunk grid, found from the chunk positions, and is also taken as the width of every chunk in the area.
+*	-The entities of every loaded chunk are kept in an entity index, added when a chunk is built and removed when it is freed.
+*	 It hashes them by ID and by the grid cell of their position, so they can be found without walking the chunks.
+*	-All fields of both versions are little endian and are read in place without swapping, so building for a big endian host is an error.
 */
 
 #pragma once
 
 #include <stddef.h>
 #include <stdbool.h>
+#include "mservices.h"
 
+#define WLD_VERSION 1
+#define WLD_MAGIC "WLD1"
+#define WLD2_VERSION 2
+#define WLD2_MAGIC "WLD2"
+#define AREA_MAGIC "AREA"
 #define WLD_MAGIC_LEN 4
+#define WLD2_SECTION_ALIGNMENT 64
+#define WLD2_CHUNK_ALIGNMENT 16
+#define WLD2_NUM_SECTIONS 5			// AREA, NAME, CREF, CSUM and CDAT
+#define WLD_GEOMETRY_ALIGNMENT 32		// every geometry array starts on this boundary, so it can be loaded with aligned SIMD loads
+#define WLD_GEOMETRY_LANES 8			// the point arrays are padded to a multiple of this many points, so SIMD loops need no scalar tail
+#define WLD_NO_CHUNK 0xffffffffu
+#define WLD_NO_ENTITY 0xffffffffu
 
 typedef struct
 {
@@ -89,11 +156,16 @@ typedef struct
 
 typedef struct
 {
-	unsigned int pointscount;
-	worldpoint_t *points;
-	unsigned int textureid;
-	unsigned int flags;
-} worldsector_t;
+	unsigned int numsectors;
+	unsigned int numpoints;
+	int *x;							// the points of every sector, one array per axis, padded with zeros to a multiple of WLD_GEOMETRY_LANES
+	int *y;
+	int *z;
+	unsigned int *firstpoint;		// the index of the first point of each sector
+	unsigned int *pointscount;
+	unsigned int *textureid;
+	unsigned int *flags;
+} worldgeometry_t;
 
 typedef struct
 {
@@ -112,18 +184,45 @@ typedef struct
 {
 	unsigned int xpos;
 	unsigned int ypos;
-	size_t offset;
-	size_t size;
+	unsigned long long offset;
+	unsigned long long size;
 } chunkref_t;
 
 typedef struct
 {
 	char magic[WLD_MAGIC_LEN];
-	unsigned short areanamelen;
-	char *areaname;
+	unsigned int version;
+	unsigned int areacount;
+	unsigned int sectioncount;
+	unsigned long long tocoffset;
+	unsigned int flags;
+	unsigned int reserved;
+} worldheader2_t;
+
+typedef struct
+{
+	char id[WLD_MAGIC_LEN];
+	unsigned int count;
+	unsigned long long offset;
+	unsigned long long size;
+} worldsection_t;
+
+typedef struct
+{
+	unsigned int nameoffset;
+	unsigned int namelen;
+	unsigned int firstchunk;
 	unsigned int chunkcount;
-	chunkref_t *chunks;
-} areaheader_t;
+} worldarea2_t;
+
+_Static_assert(sizeof(chunkref_t) == 24, "chunkref_t must match the on disk layout");
+_Static_assert(sizeof(worldheader2_t) == 32, "worldheader2_t must match the on disk layout");
+_Static_assert(sizeof(worldsection_t) == 24, "worldsection_t must match the on disk layout");
+_Static_assert(sizeof(worldarea2_t) == 16, "worldarea2_t must match the on disk layout");
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)		// MSVC only targets little endian hosts and does not define it
+#error "The world file format is read in place and requires a little endian host"
+#endif
 
 typedef struct
 {
@@ -133,20 +232,111 @@ typedef struct
 	unsigned int entitycount;
 } chunkheader_t;
 
-typedef struct
+typedef struct worldchunk
 {
 	chunkheader_t header;
-	worldsector_t *sectors;
+	worldgeometry_t geometry;
 	worldentity_t *entities;
+	void *data;						// one allocation holding the geometry arrays and the entities
+	size_t size;					// the size of data in bytes
 	bool loaded;
+	bool queued;					// waiting for or being read by the chunk streamer
+	unsigned long long pinned;		// the last update the chunk was within the load radius of the focus, pinned chunks are never evicted
+	unsigned int firstentity;		// the entity index entry of the first entity, WLD_NO_ENTITY if it has none
+	struct worldchunk *prev;		// the resident chunks, most recently used first
+	struct worldchunk *next;
 } worldchunk_t;
 
+typedef struct
+{
+	unsigned int minx;				// the smallest chunk position in the area, the corner of cell 0, 0
+	unsigned int miny;
+	unsigned int cellsize;			// the width of a cell and of a chunk, the spacing of the chunk grid
+	unsigned int cellsx;			// the number of cells the chunks span on each axis
+	unsigned int cellsy;
+	unsigned int mask;				// the number of buckets minus 1, always a power of 2
+	unsigned int *buckets;			// the first chunk in each bucket, WLD_NO_CHUNK if empty
+	unsigned int *next;				// the next chunk in the same bucket, in the same order as chunks
+} chunkgrid_t;
+
+typedef struct
+{
+	char magic[WLD_MAGIC_LEN];
+	unsigned short areanamelen;
+	const char *areaname;			// points into the mapped file and is not null terminated, print it with %.*s
+	unsigned int chunkcount;
+	const chunkref_t *chunks;		// points into the mapped file, or at chunkcopy if the table is not aligned in the file
+	chunkref_t *chunkcopy;
+	const unsigned int *checksums;	// the checksum of each chunk, in the same order as chunks, NULL for version 1 files
+	worldchunk_t *chunkdata;		// the streamed in state of each chunk, in the same order as chunks
+	chunkgrid_t grid;
+} areaheader_t;
+
+typedef struct
+{
+	entitylocation_t location;		// location.area is WLD_NO_ENTITY if the entry is unused
+	int cellx;						// the grid cell of the position, an entity can be outside the cell of its chunk
+	int celly;
+	unsigned int idnext;			// the next entry in the same ID bucket, or the next unused entry
+	unsigned int cellnext;			// the next entry in the same cell bucket
+	unsigned int chunknext;			// the next entity of the same chunk
+} entityentry_t;
+
+typedef struct
+{
+	entityentry_t *entries;
+	unsigned int *idbuckets;		// the first entry in each bucket, WLD_NO_ENTITY if empty
+	unsigned int *cellbuckets;
+	unsigned int capacity;			// the number of entries and of buckets in each hash, always a power of 2
+	unsigned int freelist;			// the first unused entry
+} entityindex_t;
+
+typedef struct worldstreamer worldstreamer_t;
+
+typedef struct
+{
+	unsigned long long hits;			// chunks that came into the load radius and were still resident
+	unsigned long long misses;			// chunks that came into the load radius and had to be streamed in
+	unsigned long long evictions;
+	unsigned long long loads;
+	unsigned long long loadtime;		// microseconds from request to resident, summed over all loads
+	unsigned long long maxloadtime;
+	size_t bytesresident;
+	size_t budget;
+	unsigned int numresident;
+	unsigned int numpinned;
+	unsigned int numentities;			// entities in the resident chunks
+} worldstats_t;
+
 typedef struct
 {
 	worldheader_t header;
 	areaheader_t *areas;
-	void *filehandle;
+	const void *filedata;		// the mapped .wld file, chunks are read from here
+	size_t filesize;
+	worldstreamer_t *streamer;	// reads chunks in the background
+	unsigned int focusarea;		// chunks are streamed in around the focus position in this area
+	worldpoint_t focus;
+	worldchunk_t *lruhead;		// the resident chunks, pinned chunks are kept at the head
+	worldchunk_t *lrutail;
+	worldstats_t stats;
+	unsigned long long updates;	// the number of times World_Update has run
+	unsigned int *nearchunks;	// the chunks within the load radius, large enough for the biggest area
+	entityindex_t entities;		// the entities of the resident chunks
 } world_t;
 
 world_t *World_Load(const char *filename);
 void World_Unload(world_t *world);
+bool World_ConvertFile(const char *filename, const char *outfile);
+void World_SetFocus(world_t *world, unsigned int area, worldpoint_t position);
+void World_Update(world_t *world, unsigned int radius, size_t budget);
+const worldchunk_t *World_GetChunk(const world_t *world, unsigned int area, unsigned int chunk);
+bool World_LoadChunk(world_t *world, unsigned int area, unsigned int chunk);
+bool World_FindChunk(const world_t *world, unsigned int area, unsigned int x, unsigned int y, unsigned int *chunk);
+unsigned int World_FindChunksInRect(const world_t *world, unsigned int area, unsigned int minx, unsigned int miny, unsigned int maxx, unsigned int maxy, unsigned int *chunks, unsigned int maxchunks);
+unsigned int World_FindChunksInRadius(const world_t *world, unsigned int area, worldpoint_t center, unsigned int radius, unsigned int *chunks, unsigned int maxchunks);
+void World_GetStats(const world_t *world, worldstats_t *stats);
+bool World_FindEntity(const world_t *world, unsigned int entityid, entitylocation_t *location);
+unsigned int World_FindEntitiesInRect(const world_t *world, unsigned int area, int minx, int minz, int maxx, int maxz, entitylocation_t *entities, unsigned int maxentities);
+unsigned int World_FindEntitiesInRadius(const world_t *world, unsigned int area, worldpoint_t center, unsigned int radius, entitylocation_t *entities, unsigned int maxentities);
+bool World_Benchmark(const char *outfile);
@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <string.h>
+#include "common/common.h"
+#include "sys/sys.h"
+#include "world.h"
+#include "worldgen.h"
+
+#define WLDBENCH_HEADER "version,areas,chunks,filebytes,generatetime,loadtime,firstchunktime,sequentialchunks,sequentialrate,randomchunks,randomrate,tablebytes,peakresident,pagefaults,hardfaults"
+#define WLDBENCH_DIR "worldbench"
+#define WLDBENCH_BATCH 1024					// chunks loaded between evictions, only the loads are timed
+#define WLDBENCH_MAX_RANDOM 65536			// random reads per world
+#define WLDBENCH_FIRST_CHUNK_TIMEOUT 10000000ULL
+
+typedef struct
+{
+	unsigned int numareas;
+	unsigned int numchunks;		// per area
+} benchsize_t;
+
+typedef struct
+{
+	unsigned long long generatetime;
+	unsigned long long loadtime;			// World_Load, the headers and chunk tables
+	unsigned long long firstchunktime;		// from the start of World_Load until the streamer has the first chunk resident
+	unsigned long long sequentialchunks;
+	unsigned long long sequentialtime;
+	unsigned long long randomchunks;
+	unsigned long long randomtime;
+	size_t filesize;
+	size_t tablebytes;						// memory cache used by the loaded world before any chunk is loaded
+	sysmemstats_t memstart;
+	sysmemstats_t memend;
+} benchresult_t;
+
+static const benchsize_t benchsizes[] =		// each size is run as a version 1 and a version 2 file
+{
+	{ 1, 256 },
+	{ 4, 1024 },
+	{ 16, 4096 },
+	{ 64, 4096 }
+};
+
+/*
+* Function: EvictChunks
+* Evicts every loaded chunk of a world, the focus is moved out of the world so nothing is pinned
+* 
+*	world: The world
+*/
+static void EvictChunks(world_t *world)
+{
+	World_SetFocus(world, world->header.areacount, (worldpoint_t) { 0 });
+	World_Update(world, 0, 0);
+}
+
+/*
+* Function: LoadFirstChunk
+* Streams in the first chunk of the world through the streamer, the same way a game waits for the chunk under the player
+* 
+*	world: The world
+*	start: When the world started loading
+* 
+* Returns: The microseconds from start until the chunk was resident, 0 if it never was
+*/
+static unsigned long long LoadFirstChunk(world_t *world, unsigned long long start)
+{
+	for (unsigned int i=0; i<world->header.areacount; i++)
+	{
+		if (world->areas[i].chunkcount == 0)
+			continue;
+
+		const chunkref_t *ref = &world->areas[i].chunks[0];
+		World_SetFocus(world, i, (worldpoint_t) { .x = (int)ref->xpos, .z = (int)ref->ypos });
+
+		while (!World_GetChunk(world, i, 0))
+		{
+			if ((Sys_GetMicroseconds() - start) > WLDBENCH_FIRST_CHUNK_TIMEOUT)
+				return(0);
+
+			World_Update(world, 0, (size_t)-1);
+		}
+
+		return(Sys_GetMicroseconds() - start);
+	}
+
+	return(0);
+}
+
+/*
+* Function: LoadSequential
+* Loads every chunk of the world in file order, evicting them in batches so memory use stays flat
+* 
+*	world: The world
+*	result: The result to fill in
+*/
+static void LoadSequential(world_t *world, benchresult_t *result)
+{
+	unsigned int inbatch = 0;
+	unsigned long long start = Sys_GetMicroseconds();
+
+	for (unsigned int i=0; i<world->header.areacount; i++)
+	{
+		for (unsigned int j=0; j<world->areas[i].chunkcount; j++)
+		{
+			if (World_LoadChunk(world, i, j))
+				result->sequentialchunks++;
+
+			if (++inbatch == WLDBENCH_BATCH)
+			{
+				result->sequentialtime += Sys_GetMicroseconds() - start;
+				EvictChunks(world);
+				inbatch = 0;
+				start = Sys_GetMicroseconds();
+			}
+		}
+	}
+
+	result->sequentialtime += Sys_GetMicroseconds() - start;
+	EvictChunks(world);
+}
+
+/*
+* Function: LoadRandom
+* Loads chunks picked at random from every area, evicting them in batches so memory use stays flat
+* 
+*	world: The world
+*	numchunks: The number of chunks in the world
+*	result: The result to fill in
+*/
+static void LoadRandom(world_t *world, unsigned long long numchunks, benchresult_t *result)
+{
+	unsigned long long count = (numchunks < WLDBENCH_MAX_RANDOM) ? numchunks : WLDBENCH_MAX_RANDOM;
+	unsigned int state = 0x9e3779b9u;
+	unsigned int inbatch = 0;
+	unsigned long long start = Sys_GetMicroseconds();
+
+	for (unsigned long long i=0; i<count; i++)
+	{
+		state ^= state << 13;		// xorshift, the same chunks are picked every run
+		state ^= state >> 17;
+		state ^= state << 5;
+
+		unsigned int area = state % world->header.areacount;
+		unsigned int chunkcount = world->areas[area].chunkcount;
+
+		if ((chunkcount > 0) && World_LoadChunk(world, area, (state >> 8) % chunkcount))
+			result->randomchunks++;
+
+		if (++inbatch == WLDBENCH_BATCH)
+		{
+			result->randomtime += Sys_GetMicroseconds() - start;
+			EvictChunks(world);
+			inbatch = 0;
+			start = Sys_GetMicroseconds();
+		}
+	}
+
+	result->randomtime += Sys_GetMicroseconds() - start;
+	EvictChunks(world);
+}
+
+/*
+* Function: RunWorld
+* Generates a world file of one size and version, then loads it and measures it
+* 
+*	size: The size of the world
+*	version: The .wld version to write
+*	result: The result to fill in
+* 
+* Returns: A boolean if the world was generated and loaded or not
+*/
+static bool RunWorld(const benchsize_t *size, unsigned int version, benchresult_t *result)
+{
+	char filename[SYS_MAX_PATH] = { 0 };
+	char fullpath[SYS_MAX_PATH] = { 0 };
+
+	snprintf(filename, SYS_MAX_PATH, "%s/bench_%ux%u_v%u.wld", WLDBENCH_DIR, size->numareas, size->numchunks, version);
+	if (snprintf(fullpath, SYS_MAX_PATH, "%s/%s", FileSys_GetDataPath(), filename) >= SYS_MAX_PATH)
+	{
+		Log_Writef(LOG_ERROR, "Benchmark world path too long, skipping it: %s/%s", FileSys_GetDataPath(), filename);
+		return(false);
+	}
+
+	worldgenerator_t generator =
+	{
+		.numareas = size->numareas,
+		.numchunks = size->numchunks,
+		.numsectors = 8,
+		.numpoints = 4,
+		.numentities = 4,
+		.chunksize = WLDGEN_DEF_CHUNK_SIZE,
+		.seed = 1
+	};
+
+	worldsource_t source;
+	WorldGen_InitGenerator(&generator, &source);
+
+	unsigned long long numchunks = 0;
+	unsigned long long start = Sys_GetMicroseconds();
+
+	worldgenerror_t error = WorldGen_Write(&source, fullpath, version, &numchunks);
+	if (error != WLDGEN_OK)
+	{
+		Log_Writef(LOG_ERROR, "Failed to generate the benchmark world: %s: %s, after %llu chunks", fullpath, WorldGen_ErrorString(error), numchunks);
+		remove(fullpath);
+		return(false);
+	}
+
+	result->generatetime = Sys_GetMicroseconds() - start;
+
+	Sys_GetProcessMemory(&result->memstart);
+	size_t memused = MemCache_GetMemUsed();
+
+	start = Sys_GetMicroseconds();
+	world_t *world = World_Load(filename);
+	result->loadtime = Sys_GetMicroseconds() - start;
+
+	if (!world)
+	{
+		remove(fullpath);
+		return(false);
+	}
+
+	result->filesize = world->filesize;
+	result->tablebytes = MemCache_GetMemUsed() - memused;
+	result->firstchunktime = LoadFirstChunk(world, start);
+
+	EvictChunks(world);
+	LoadSequential(world, result);
+	LoadRandom(world, numchunks, result);
+
+	Sys_GetProcessMemory(&result->memend);
+
+	World_Unload(world);
+	remove(fullpath);
+
+	return(true);
+}
+
+/*
+* Function: World_Benchmark
+* Generates worlds of increasing size, loads each one and writes the measurements to a CSV file, one row per world.
+* Times are in microseconds and rates in chunks per second, the peak resident memory is for the whole process so far
+* 
+*	outfile: The CSV file to write
+* 
+* Returns: A boolean if every world was measured or not
+*/
+bool World_Benchmark(const char *outfile)
+{
+	FILE *file = fopen(outfile, "w");
+	if (!file)
+	{
+		Log_Writef(LOG_ERROR, "Failed to open the world benchmark file: %s", outfile);
+		return(false);
+	}
+
+	char directory[SYS_MAX_PATH] = { 0 };
+	if (snprintf(directory, SYS_MAX_PATH, "%s/%s", FileSys_GetDataPath(), WLDBENCH_DIR) >= SYS_MAX_PATH)
+	{
+		Log_Writef(LOG_ERROR, "World benchmark directory path too long: %s/%s", FileSys_GetDataPath(), WLDBENCH_DIR);
+		fclose(file);
+		return(false);
+	}
+
+	Sys_Mkdir(directory);
+
+	fprintf(file, "%s\n", WLDBENCH_HEADER);
+	Common_Printf("%s", WLDBENCH_HEADER);
+
+	const unsigned int versions[] = { WLD_VERSION, WLD2_VERSION };
+	bool success = true;
+
+	for (size_t i=0; success && (i<(sizeof(benchsizes) / sizeof(benchsizes[0]))); i++)
+	{
+		for (size_t j=0; j<(sizeof(versions) / sizeof(versions[0])); j++)
+		{
+			benchresult_t result = { 0 };
+			const benchsize_t *size = &benchsizes[i];
+
+			success = RunWorld(size, versions[j], &result);
+			if (!success)
+				break;
+
+			char row[512] = { 0 };
+			snprintf(row, sizeof(row), "%u,%u,%llu,%zu,%llu,%llu,%llu,%llu,%.0f,%llu,%.0f,%zu,%zu,%llu,%llu",
+				versions[j],
+				size->numareas,
+				(unsigned long long)size->numareas * size->numchunks,
+				result.filesize,
+				result.generatetime,
+				result.loadtime,
+				result.firstchunktime,
+				result.sequentialchunks,
+				result.sequentialtime ? ((double)result.sequentialchunks * 1000000.0 / (double)result.sequentialtime) : 0.0,
+				result.randomchunks,
+				result.randomtime ? ((double)result.randomchunks * 1000000.0 / (double)result.randomtime) : 0.0,
+				result.tablebytes,
+				result.memend.peakresident,
+				result.memend.pagefaults - result.memstart.pagefaults,
+				result.memend.hardfaults - result.memstart.hardfaults
+			);
+
+			fprintf(file, "%s\n", row);
+			fflush(file);		// a long run can be watched as it goes
+			Common_Printf("%s", row);
+		}
+	}
+
+	fclose(file);
+
+	if (success)
+		Log_Writef(LOG_INFO, "World benchmark written: %s", outfile);
+
+	else
+		Log_Writef(LOG_ERROR, "World benchmark stopped early, partial results written: %s", outfile);
+
+	return(success);
+}
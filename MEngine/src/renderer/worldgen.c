@@ -0,0 +1,462 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "worldgen.h"
+
+/*
+* Function: WorldGen_Append
+* Appends bytes to a buffer, growing it if needed
+* 
+*	buffer: The buffer
+*	data: The bytes to append
+*	size: The number of bytes
+* 
+* Returns: A boolean if the bytes were appended or not
+*/
+bool WorldGen_Append(worldbuffer_t *buffer, const void *data, size_t size)
+{
+	if (size == 0)
+		return(true);		// empty arrays may be NULL
+
+	if (!buffer->data || ((buffer->capacity - buffer->size) < size))
+	{
+		size_t newcapacity = buffer->capacity ? buffer->capacity : 4096;
+		while ((newcapacity - buffer->size) < size)
+			newcapacity *= 2;
+
+		unsigned char *newdata = realloc(buffer->data, newcapacity);
+		if (!newdata)
+			return(false);
+
+		buffer->data = newdata;
+		buffer->capacity = newcapacity;
+	}
+
+	memcpy(buffer->data + buffer->size, data, size);
+	buffer->size += size;
+
+	return(true);
+}
+
+/*
+* Function: WorldGen_ChunkChecksum
+* Gets the checksum of the data of a chunk, using the FNV-1a algorithm, written to the CSUM section and checked by the engine
+* 
+*	data: The chunk data
+*	size: The size of the chunk data in bytes
+* 
+* Returns: The checksum
+*/
+unsigned int WorldGen_ChunkChecksum(const unsigned char *data, size_t size)
+{
+	unsigned int hash = 2166136261u;
+
+	for (size_t i=0; i<size; i++)
+	{
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+
+	return(hash);
+}
+
+/*
+* Function: WorldGen_AlignOffset
+* Rounds an offset up to a multiple of an alignment
+* 
+*	offset: The offset
+*	alignment: The alignment, a power of 2
+* 
+* Returns: The aligned offset
+*/
+unsigned long long WorldGen_AlignOffset(unsigned long long offset, unsigned long long alignment)
+{
+	return((offset + alignment - 1) & ~(alignment - 1));
+}
+
+/*
+* Function: WriteAt
+* Writes bytes at an offset in a file
+* 
+*	file: The file
+*	offset: The offset to write at
+*	data: The bytes to write
+*	size: The number of bytes
+* 
+* Returns: A boolean if the bytes were written or not
+*/
+static bool WriteAt(FILE *file, unsigned long long offset, const void *data, size_t size)
+{
+	if ((offset > LONG_MAX) || (fseek(file, (long)offset, SEEK_SET) != 0))		// fseek takes a long, which is 32 bits on Windows
+		return(false);
+
+	return(fwrite(data, 1, size, file) == size);
+}
+
+/*
+* Function: NextRandom
+* Steps a xorshift random number generator, the generated worlds only depend on the seed
+* 
+*	state: The generator state, must not be 0
+* 
+* Returns: The next random number
+*/
+static unsigned int NextRandom(unsigned int *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+
+	return(*state);
+}
+
+static const char *GeneratorAreaName(void *context, unsigned int area)
+{
+	worldgenerator_t *generator = context;
+	snprintf(generator->namebuf, sizeof(generator->namebuf), "area%u", area);
+
+	return(generator->namebuf);
+}
+
+static unsigned int GeneratorChunkCount(void *context, unsigned int area)
+{
+	(void)area;
+
+	return(((worldgenerator_t *)context)->numchunks);
+}
+
+/*
+* Function: GeneratorBuildChunk
+* Generates a chunk. The chunks of an area are laid out on a square grid, each sector is a polygon inside its chunk
+* and each entity is at a random position in its chunk
+* 
+*	context: The generator settings
+*	area: The index of the area
+*	chunk: The index of the chunk in the area
+*	out: The buffer to write the chunk to
+* 
+* Returns: A boolean if the chunk was generated or not
+*/
+static bool GeneratorBuildChunk(void *context, unsigned int area, unsigned int chunk, worldbuffer_t *out)
+{
+	const worldgenerator_t *generator = context;
+
+	unsigned int gridsize = 1;
+	while (((unsigned long long)gridsize * gridsize) < generator->numchunks)
+		gridsize++;
+
+	unsigned int state = (generator->seed * 2654435761u) ^ (area * 40503u) ^ (chunk * 2246822519u);
+	state = state ? state : 1;
+
+	chunkheader_t header =
+	{
+		.xpos = (chunk % gridsize) * generator->chunksize,
+		.ypos = (chunk / gridsize) * generator->chunksize,
+		.sectorcount = generator->numsectors,
+		.entitycount = generator->numentities
+	};
+
+	if (!WorldGen_Append(out, &header, sizeof(header)))
+		return(false);
+
+	for (unsigned int i=0; i<generator->numsectors; i++)
+	{
+		unsigned int textureid = NextRandom(&state) % 256;
+		unsigned int flags = NextRandom(&state) % 4;
+		int height = (int)(NextRandom(&state) % 64);
+
+		if (!WorldGen_Append(out, &generator->numpoints, sizeof(generator->numpoints)))
+			return(false);
+
+		for (unsigned int j=0; j<generator->numpoints; j++)
+		{
+			worldpoint_t point =
+			{
+				.x = (int)(header.xpos + (NextRandom(&state) % generator->chunksize)),
+				.y = height,
+				.z = (int)(header.ypos + (NextRandom(&state) % generator->chunksize))
+			};
+
+			if (!WorldGen_Append(out, &point, sizeof(point)))
+				return(false);
+		}
+
+		if (!WorldGen_Append(out, &textureid, sizeof(textureid)) || !WorldGen_Append(out, &flags, sizeof(flags)))
+			return(false);
+	}
+
+	for (unsigned int i=0; i<generator->numentities; i++)
+	{
+		worldentity_t entity =
+		{
+			.position =
+			{
+				.x = (int)(header.xpos + (NextRandom(&state) % generator->chunksize)),
+				.y = 0,
+				.z = (int)(header.ypos + (NextRandom(&state) % generator->chunksize))
+			},
+			.entityid = (unsigned int)((((unsigned long long)area * generator->numchunks + chunk) * generator->numentities) + i)
+		};
+
+		if (!WorldGen_Append(out, &entity, sizeof(entity)))
+			return(false);
+	}
+
+	return(true);
+}
+
+/*
+* Function: WorldGen_Write
+* Writes a world file. The file offsets of the tables only depend on the number of areas and chunks, so the chunk data is written
+* first as each chunk is built and the tables are written at the end, only one chunk is held in memory at a time
+* 
+*	source: Where to get the world from
+*	filename: The file to write
+*	version: The .wld version to write, 1 or 2
+*	numchunks: Output for the number of chunks written, on a chunk error the index of the chunk that failed
+* 
+* Returns: WLDGEN_OK if the world was written, else what went wrong
+*/
+worldgenerror_t WorldGen_Write(const worldsource_t *source, const char *filename, unsigned int version, unsigned long long *numchunks)
+{
+	unsigned long long totalchunks = 0;
+	unsigned long long namesize = 0;
+
+	*numchunks = 0;
+
+	for (unsigned int i=0; i<source->numareas; i++)
+	{
+		totalchunks += source->ChunkCount(source->context, i);
+		namesize += strlen(source->AreaName(source->context, i)) + 1;
+	}
+
+	if (totalchunks > 0xffffffffull)
+		return(WLDGEN_ERROR_TOO_MANY_CHUNKS);
+
+	worldsection_t toc[WLD2_NUM_SECTIONS] =
+	{
+		{ .id = { 'A', 'R', 'E', 'A' }, .count = source->numareas, .size = sizeof(worldarea2_t) * source->numareas },
+		{ .id = { 'N', 'A', 'M', 'E' }, .count = 0, .size = namesize },
+		{ .id = { 'C', 'R', 'E', 'F' }, .count = (unsigned int)totalchunks, .size = sizeof(chunkref_t) * totalchunks },
+		{ .id = { 'C', 'S', 'U', 'M' }, .count = (unsigned int)totalchunks, .size = sizeof(unsigned int) * totalchunks },
+		{ .id = { 'C', 'D', 'A', 'T' }, .count = 0, .size = 0 }
+	};
+
+	unsigned long long dataoffset = 0;
+
+	if (version == WLD2_VERSION)
+	{
+		unsigned long long offset = sizeof(worldheader2_t) + sizeof(toc);
+		for (int i=0; i<WLD2_NUM_SECTIONS; i++)
+		{
+			toc[i].offset = WorldGen_AlignOffset(offset, WLD2_SECTION_ALIGNMENT);
+			offset = toc[i].offset + toc[i].size;
+		}
+
+		dataoffset = toc[4].offset;
+	}
+
+	else
+	{
+		dataoffset = sizeof(worldheader_t);
+		for (unsigned int i=0; i<source->numareas; i++)
+		{
+			dataoffset += WLD_MAGIC_LEN + sizeof(unsigned short) + strlen(source->AreaName(source->context, i)) + sizeof(unsigned int);
+			dataoffset += sizeof(chunkref_t) * (unsigned long long)source->ChunkCount(source->context, i);
+		}
+	}
+
+	chunkref_t *refs = malloc(sizeof(*refs) * (totalchunks ? totalchunks : 1));
+	unsigned int *checksums = malloc(sizeof(*checksums) * (totalchunks ? totalchunks : 1));
+	FILE *file = fopen(filename, "wb");
+
+	worldbuffer_t chunk = { 0 };
+	worldgenerror_t error = WLDGEN_OK;
+	unsigned long long offset = dataoffset;
+	unsigned int chunkindex = 0;
+
+	if (!file || !refs || !checksums)
+	{
+		error = WLDGEN_ERROR_OPEN;
+		goto done;
+	}
+
+	for (unsigned int i=0; i<source->numareas; i++)
+	{
+		unsigned int count = source->ChunkCount(source->context, i);
+
+		for (unsigned int j=0; j<count; j++, chunkindex++)
+		{
+			*numchunks = chunkindex;
+
+			chunk.size = 0;
+			if (!source->BuildChunk(source->context, i, j, &chunk) || (chunk.size < sizeof(chunkheader_t)))
+			{
+				error = WLDGEN_ERROR_BUILD_CHUNK;
+				goto done;
+			}
+
+			chunkheader_t header;
+			memcpy(&header, chunk.data, sizeof(header));
+
+			if (version == WLD2_VERSION)
+				offset = WorldGen_AlignOffset(offset, WLD2_CHUNK_ALIGNMENT);
+
+			if (!WriteAt(file, offset, chunk.data, chunk.size))
+			{
+				error = WLDGEN_ERROR_WRITE_CHUNK;
+				goto done;
+			}
+
+			refs[chunkindex].xpos = header.xpos;
+			refs[chunkindex].ypos = header.ypos;
+			refs[chunkindex].offset = offset;
+			refs[chunkindex].size = chunk.size;
+			checksums[chunkindex] = WorldGen_ChunkChecksum(chunk.data, chunk.size);
+
+			offset += chunk.size;
+		}
+	}
+
+	if (version == WLD2_VERSION)
+	{
+		toc[4].size = offset - toc[4].offset;
+
+		worldheader2_t header =
+		{
+			.version = WLD2_VERSION,
+			.areacount = source->numareas,
+			.sectioncount = WLD2_NUM_SECTIONS,
+			.tocoffset = sizeof(worldheader2_t)
+		};
+
+		memcpy(header.magic, WLD2_MAGIC, WLD_MAGIC_LEN);
+
+		if (!WriteAt(file, 0, &header, sizeof(header)) || !WriteAt(file, header.tocoffset, toc, sizeof(toc)))
+			goto writeerror;
+
+		unsigned int nameoffset = 0;
+		unsigned int firstchunk = 0;
+
+		for (unsigned int i=0; i<source->numareas; i++)
+		{
+			const char *name = source->AreaName(source->context, i);
+
+			worldarea2_t area =
+			{
+				.nameoffset = nameoffset,
+				.namelen = (unsigned int)strlen(name),
+				.firstchunk = firstchunk,
+				.chunkcount = source->ChunkCount(source->context, i)
+			};
+
+			if (!WriteAt(file, toc[0].offset + (sizeof(area) * i), &area, sizeof(area))
+				|| !WriteAt(file, toc[1].offset + nameoffset, name, area.namelen + 1))
+				goto writeerror;
+
+			nameoffset += area.namelen + 1;
+			firstchunk += area.chunkcount;
+		}
+
+		if (totalchunks && (!WriteAt(file, toc[2].offset, refs, (size_t)toc[2].size) || !WriteAt(file, toc[3].offset, checksums, (size_t)toc[3].size)))
+			goto writeerror;
+
+		if (!totalchunks && !WriteAt(file, toc[4].offset - 1, "", 1))		// pad the file out so the empty sections still lie inside it
+			goto writeerror;
+	}
+
+	else
+	{
+		worldheader_t header = { .version = WLD_VERSION, .areacount = source->numareas };
+		memcpy(header.magic, WLD_MAGIC, WLD_MAGIC_LEN);
+
+		if (!WriteAt(file, 0, &header, sizeof(header)))
+			goto writeerror;
+
+		unsigned int firstchunk = 0;
+
+		for (unsigned int i=0; i<source->numareas; i++)		// each write follows the last, so no seeking is needed
+		{
+			const char *name = source->AreaName(source->context, i);
+			unsigned short namelen = (unsigned short)strlen(name);
+			unsigned int count = source->ChunkCount(source->context, i);
+
+			if ((fwrite(AREA_MAGIC, 1, WLD_MAGIC_LEN, file) != WLD_MAGIC_LEN)
+				|| (fwrite(&namelen, sizeof(namelen), 1, file) != 1)
+				|| (fwrite(name, 1, namelen, file) != namelen)
+				|| (fwrite(&count, sizeof(count), 1, file) != 1)
+				|| (count && (fwrite(&refs[firstchunk], sizeof(*refs), count, file) != count)))
+				goto writeerror;
+
+			firstchunk += count;
+		}
+	}
+
+	*numchunks = totalchunks;
+	goto done;
+
+writeerror:
+	error = WLDGEN_ERROR_WRITE_TABLES;
+
+done:
+	if (file && (fclose(file) != 0) && (error == WLDGEN_OK))
+		error = WLDGEN_ERROR_WRITE_TABLES;		// buffered writes may only fail when the file is closed
+
+	free(chunk.data);
+	free(checksums);
+	free(refs);
+
+	return(error);
+}
+
+/*
+* Function: WorldGen_ErrorString
+* Gets a description of an error returned by WorldGen_Write, for the caller to report
+* 
+*	error: The error
+* 
+* Returns: The description of the error
+*/
+const char *WorldGen_ErrorString(worldgenerror_t error)
+{
+	switch (error)
+	{
+		case WLDGEN_OK:
+			return("No error");
+
+		case WLDGEN_ERROR_TOO_MANY_CHUNKS:
+			return("The world has more chunks than a .wld file can index");
+
+		case WLDGEN_ERROR_OPEN:
+			return("Cannot open the file for writing");
+
+		case WLDGEN_ERROR_BUILD_CHUNK:
+			return("Failed to build a chunk");
+
+		case WLDGEN_ERROR_WRITE_CHUNK:
+			return("Failed to write a chunk");
+
+		case WLDGEN_ERROR_WRITE_TABLES:
+			return("Failed to write the tables");
+
+		default:
+			return("Unknown error");
+	}
+}
+
+/*
+* Function: WorldGen_InitGenerator
+* Sets up a source that generates a world with the given settings
+* 
+*	generator: The settings of the world, must stay valid while the source is used
+*	source: The source to set up
+*/
+void WorldGen_InitGenerator(worldgenerator_t *generator, worldsource_t *source)
+{
+	source->context = generator;
+	source->numareas = generator->numareas;
+	source->AreaName = GeneratorAreaName;
+	source->ChunkCount = GeneratorChunkCount;
+	source->BuildChunk = GeneratorBuildChunk;
+}
@@ -0,0 +1,67 @@
+/*
+* The .wld file writer and the synthetic world generator. Shared by the engine and the MEngineWorldTool tool,
+* so this code does not depend on any engine system.
+* 
+* Overview:
+* A world is written from a worldsource_t, a set of callbacks that give the areas and build each chunk on demand:
+*	- The file offsets of the tables only depend on the number of areas and chunks, so they are known before any chunk is built.
+*	- The chunks are built and written one at a time, only one chunk is ever held in memory.
+*	- The tables are written last, with the chunk offsets and checksums gathered while the chunks were written.
+* 
+* The generator is a worldsource_t that makes up chunks from a seed, the same settings always give the same file.
+* The engine also converts loaded worlds to version 2 through a worldsource_t over the mapped file.
+* Nothing is printed, WorldGen_Write returns an error for the caller to report with WorldGen_ErrorString.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "world.h"
+
+#define WLDGEN_DEF_CHUNK_SIZE 256
+
+typedef enum
+{
+	WLDGEN_OK = 0,
+	WLDGEN_ERROR_TOO_MANY_CHUNKS,
+	WLDGEN_ERROR_OPEN,				// the file could not be opened or the tables could not be allocated
+	WLDGEN_ERROR_BUILD_CHUNK,		// the source failed to build a chunk or built one smaller than its header
+	WLDGEN_ERROR_WRITE_CHUNK,
+	WLDGEN_ERROR_WRITE_TABLES
+} worldgenerror_t;
+
+typedef struct
+{
+	unsigned char *data;
+	size_t size;
+	size_t capacity;
+} worldbuffer_t;
+
+typedef struct		// where the writer gets the world from
+{
+	void *context;
+	unsigned int numareas;
+	const char *(*AreaName)(void *context, unsigned int area);
+	unsigned int (*ChunkCount)(void *context, unsigned int area);
+	bool (*BuildChunk)(void *context, unsigned int area, unsigned int chunk, worldbuffer_t *out);		// the whole chunk, starting with its chunkheader_t
+} worldsource_t;
+
+typedef struct		// the settings of a generated world
+{
+	unsigned int numareas;
+	unsigned int numchunks;			// per area
+	unsigned int numsectors;		// per chunk
+	unsigned int numpoints;			// per sector
+	unsigned int numentities;		// per chunk
+	unsigned int chunksize;			// the width of a chunk in world units, the chunks of an area are laid out on a square grid
+	unsigned int seed;
+	char namebuf[32];
+} worldgenerator_t;
+
+bool WorldGen_Append(worldbuffer_t *buffer, const void *data, size_t size);
+unsigned int WorldGen_ChunkChecksum(const unsigned char *data, size_t size);
+unsigned long long WorldGen_AlignOffset(unsigned long long offset, unsigned long long alignment);
+void WorldGen_InitGenerator(worldgenerator_t *generator, worldsource_t *source);
+worldgenerror_t WorldGen_Write(const worldsource_t *source, const char *filename, unsigned int version, unsigned long long *numchunks);
+const char *WorldGen_ErrorString(worldgenerror_t error);
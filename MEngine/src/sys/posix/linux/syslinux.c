@@ -1,8 +1,54 @@
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
 #include "common/common.h"
 #include "sys/sys.h"
 #include "posixlocal.h"
 
+#define DIR_WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct
+{
+	bool used;
+	bool changed;
+	int wd;
+} dirwatch_t;
+
+static int inotifyfd = -1;			// one inotify instance is shared by all the watches, opened with the first watch
+static unsigned int numwatches;
+static dirwatch_t watches[SYS_MAX_DIR_WATCHES];
+
+/*
+* Function: ReadWatchEvents
+* Reads all the queued inotify events without blocking and flags the watches they belong to
+*/
+static void ReadWatchEvents(void)
+{
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	while (1)
+	{
+		ssize_t len = read(inotifyfd, buffer, sizeof(buffer));
+		if (len <= 0)
+			break;		// EAGAIN, nothing left to read
+
+		for (char *ptr=buffer; ptr<(buffer + len); )
+		{
+			const struct inotify_event *event = (const struct inotify_event *)ptr;
+
+			for (int i=0; i<SYS_MAX_DIR_WATCHES; i++)
+			{
+				if (watches[i].used && ((event->mask & IN_Q_OVERFLOW) || (watches[i].wd == event->wd)))		// on overflow assume everything changed
+					watches[i].changed = true;
+			}
+
+			ptr += sizeof(struct inotify_event) + event->len;
+		}
+	}
+}
+
 /*
 * Function: Sys_Init
 * Initializes the system services and gets the OS system information for Linux systems
@@ -32,6 +78,121 @@ bool Sys_Init(void)
 	return(true);
 }
 
+/*
+* Function: Sys_WatchDir
+* Starts watching a directory for changes to its entries, using inotify
+* 
+*	directory: The directory to watch
+* 
+* Returns: A handle to the watch, or NULL if the directory cannot be watched
+*/
+void *Sys_WatchDir(const char *directory)
+{
+	dirwatch_t *watch = NULL;
+	for (int i=0; !watch && i<SYS_MAX_DIR_WATCHES; i++)
+	{
+		if (!watches[i].used)
+			watch = &watches[i];
+	}
+
+	if (!watch)
+		return(NULL);
+
+	if (inotifyfd == -1)
+	{
+		inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotifyfd == -1)
+		{
+			Log_Writef(LOG_ERROR, "%s, Failed to initialize inotify: %s", __func__, strerror(errno));
+			return(NULL);
+		}
+	}
+
+	int wd = inotify_add_watch(inotifyfd, directory, DIR_WATCH_EVENTS);
+	if (wd == -1)
+	{
+		if (errno != ENOENT)		// a missing directory is not an error, it just is not cached
+			Log_Writef(LOG_ERROR, "%s, Failed to watch directory: %s: %s", __func__, directory, strerror(errno));
+
+		if (numwatches == 0)
+		{
+			close(inotifyfd);
+			inotifyfd = -1;
+		}
+
+		return(NULL);
+	}
+
+	watch->used = true;
+	watch->changed = false;
+	watch->wd = wd;
+	numwatches++;
+
+	return(watch);
+}
+
+/*
+* Function: Sys_DirChanged
+* Checks if a watched directory has changed since the last check, does not block
+* 
+*	watch: The watch handle
+* 
+* Returns: A boolean if the directory has changed or not
+*/
+bool Sys_DirChanged(void *watch)
+{
+	dirwatch_t *dirwatch = watch;
+
+	ReadWatchEvents();
+
+	bool changed = dirwatch->changed;
+	dirwatch->changed = false;
+
+	return(changed);
+}
+
+/*
+* Function: Sys_UnwatchDir
+* Stops watching a directory, the inotify instance is closed with the last watch
+* 
+*	watch: The watch handle
+*/
+void Sys_UnwatchDir(void *watch)
+{
+	dirwatch_t *dirwatch = watch;
+	if (!dirwatch || !dirwatch->used)
+		return;
+
+	inotify_rm_watch(inotifyfd, dirwatch->wd);
+	memset(dirwatch, 0, sizeof(*dirwatch));
+	numwatches--;
+
+	if (numwatches == 0)
+	{
+		close(inotifyfd);
+		inotifyfd = -1;
+	}
+}
+
+/*
+* Function: Sys_GetProcessMemory
+* Gets the peak resident memory and the page fault counts of the process
+* 
+*	stats: The memory statistics to fill in
+*/
+void Sys_GetProcessMemory(sysmemstats_t *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return;
+
+	stats->peakresident = (size_t)usage.ru_maxrss * 1024;		// Linux reports it in kilobytes
+	stats->pagefaults = (unsigned long long)(usage.ru_minflt + usage.ru_majflt);
+	stats->hardfaults = (unsigned long long)usage.ru_majflt;
+}
+
 /*
 * Function: Sys_GetDefDLLName
 * Gets the default DLL name for the demo game library for Linux systems
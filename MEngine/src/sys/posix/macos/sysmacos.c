@@ -32,6 +32,67 @@ bool Sys_Init(void)
 	return(true);
 }
 
+/*
+* Function: Sys_WatchDir
+* Directory watches are not supported on MacOS yet, kqueue only reports changes to the entries of a directory
+* and not to the files in it, so callers fall back to reading the directory each time
+* 
+*	directory: The directory to watch
+* 
+* Returns: NULL, the directory cannot be watched
+*/
+void *Sys_WatchDir(const char *directory)
+{
+	(void)directory;
+
+	return(NULL);
+}
+
+/*
+* Function: Sys_DirChanged
+* Checks if a watched directory has changed, always true as watches are not supported
+* 
+*	watch: The watch handle
+* 
+* Returns: true
+*/
+bool Sys_DirChanged(void *watch)
+{
+	(void)watch;
+
+	return(true);
+}
+
+/*
+* Function: Sys_UnwatchDir
+* Stops watching a directory, does nothing as watches are not supported
+* 
+*	watch: The watch handle
+*/
+void Sys_UnwatchDir(void *watch)
+{
+	(void)watch;
+}
+
+/*
+* Function: Sys_GetProcessMemory
+* Gets the peak resident memory and the page fault counts of the process
+* 
+*	stats: The memory statistics to fill in
+*/
+void Sys_GetProcessMemory(sysmemstats_t *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return;
+
+	stats->peakresident = (size_t)usage.ru_maxrss;		// MacOS reports it in bytes
+	stats->pagefaults = (unsigned long long)(usage.ru_minflt + usage.ru_majflt);
+	stats->hardfaults = (unsigned long long)usage.ru_majflt;
+}
+
 /*
 * Function: Sys_GetDefDLLName
 * Gets the default DLL name for the demo game library for MacOS systems
@@ -35,6 +35,13 @@ int main(int argc, char **argv)
 		return(1);
 	}
 
+	if (Common_IsHeadless())
+	{
+		int status = Common_RunHeadless() ? 0 : 1;
+		Common_Shutdown();
+		return(status);
+	}
+
 	while (!glfwWindowShouldClose(posixstate.window))
 	{
 		Common_Frame();
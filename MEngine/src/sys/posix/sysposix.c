@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <stdarg.h>
 #include <time.h>
 #include <errno.h>
@@ -263,6 +264,47 @@ void Sys_Stat(const char *filepath, filedata_t *filedata)
 	filedata->ctime = st.st_ctime;
 }
 
+/*
+* Function: Sys_FileExists
+* Checks if a regular file exists with a single call to stat, without opening it
+* 
+*	filepath: The full path and name of the file
+* 
+* Returns: A boolean if the file exists and is not a directory
+*/
+bool Sys_FileExists(const char *filepath)
+{
+	struct stat st;
+	if (stat(filepath, &st) == -1)
+		return(false);
+
+	return(!S_ISDIR(st.st_mode));
+}
+
+/*
+* Function: Sys_StatFile
+* Gets the file status of a regular file with a single call to stat, a missing file is not an error so nothing is logged
+* 
+*	filepath: The full path and name of the file
+*	filedata: The filedata_t structure to fill
+* 
+* Returns: A boolean if the file exists and is not a directory, filedata is only filled if it does
+*/
+bool Sys_StatFile(const char *filepath, filedata_t *filedata)
+{
+	struct stat st;
+	if ((stat(filepath, &st) == -1) || S_ISDIR(st.st_mode))
+		return(false);
+
+	snprintf(filedata->filename, SYS_MAX_PATH, "%s", filepath);
+	filedata->filesize = st.st_size;
+	filedata->atime = st.st_atime;
+	filedata->mtime = st.st_mtime;
+	filedata->ctime = st.st_ctime;
+
+	return(true);
+}
+
 /*
 * Function: Sys_Strtok
 * A thread safe and portable version of strtok
@@ -318,6 +360,129 @@ void Sys_Localtime(struct tm *buf, const time_t *timer)
 	localtime_r(timer, buf);
 }
 
+/*
+* Function: Sys_GetMicroseconds
+* Gets the value of a monotonic clock, only useful for measuring elapsed time
+* 
+* Returns: The current time in microseconds
+*/
+unsigned long long Sys_GetMicroseconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return(((unsigned long long)ts.tv_sec * 1000000ULL) + ((unsigned long long)ts.tv_nsec / 1000ULL));
+}
+
+/*
+* Function: Sys_SyncFile
+* Flushes a files buffers and waits for the data to reach the disk
+* 
+*	file: The file to sync
+* 
+* Returns: A boolean if the data was written to the disk or not
+*/
+bool Sys_SyncFile(FILE *file)
+{
+	if (!file || (fflush(file) != 0))
+		return(false);
+
+	return(fsync(fileno(file)) == 0);
+}
+
+/*
+* Function: Sys_Rename
+* Renames a file, replacing the destination if it exists, the replace is atomic
+* 
+*	oldpath: The file to rename
+*	newpath: The new name of the file
+* 
+* Returns: A boolean if the file was renamed or not
+*/
+bool Sys_Rename(const char *oldpath, const char *newpath)
+{
+	return(rename(oldpath, newpath) == 0);
+}
+
+/*
+* Function: Sys_MapFile
+* Maps a whole file into memory as read only, an empty file cannot be mapped
+* 
+*	filename: The file to map
+*	size: Output for the size of the file in bytes
+* 
+* Returns: A pointer to the mapped file, or NULL if the file is empty or could not be mapped
+*/
+void *Sys_MapFile(const char *filename, size_t *size)
+{
+	*size = 0;
+
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1)
+	{
+		Log_Writef(LOG_ERROR, "%s, Failed to open file: %s", __func__, filename);
+		return(NULL);
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+	{
+		Log_Writef(LOG_ERROR, "%s, Failed to make a call to fstat(): %s", __func__, filename);
+		close(fd);
+		return(NULL);
+	}
+
+	if (st.st_size == 0)
+	{
+		close(fd);
+		return(NULL);
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);		// the mapping keeps its own reference to the file
+
+	if (data == MAP_FAILED)
+	{
+		Log_Writef(LOG_ERROR, "%s, Failed to map file: %s", __func__, filename);
+		return(NULL);
+	}
+
+	*size = st.st_size;
+
+	return(data);
+}
+
+/*
+* Function: Sys_UnmapFile
+* Unmaps a file mapped with Sys_MapFile
+* 
+*	data: The pointer returned by Sys_MapFile
+*	size: The size of the mapped file
+*/
+void Sys_UnmapFile(void *data, size_t size)
+{
+	if (data)
+		munmap(data, size);
+}
+
+/*
+* Function: Sys_PrefetchMemory
+* Hints that a range of mapped memory will be used soon, so the OS starts reading it in without blocking
+* 
+*	data: The start of the range, it does not need to be page aligned
+*	size: The size of the range in bytes
+*/
+void Sys_PrefetchMemory(const void *data, size_t size)
+{
+	if (!data || (size == 0))
+		return;
+
+	uintptr_t pagesize = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t)data & ~(pagesize - 1);
+
+	madvise((void *)start, ((uintptr_t)data + size) - start, MADV_WILLNEED);
+}
+
 /*
 * Function: Sys_OpenDir
 * Opens a directory for reading
@@ -337,15 +502,16 @@ void *Sys_OpenDir(const char *directory)
 
 /*
 * Function: Sys_ReadDir
-* Reads a directory entry
+* Reads a directory entry, the entry type comes from the directory itself so no stat is needed on most filesystems
 * 
 *	directory: The directory handle
 *	filename: The filename to fill
 *	filenamelen: The length of the filename buffer
+*	isdirectory: Set to true if the entry is a directory
 * 
 * Returns: A boolean if the read was successful or not
 */
-bool Sys_ReadDir(void *directory, char *filename, size_t filenamelen)
+bool Sys_ReadDir(void *directory, char *filename, size_t filenamelen, bool *isdirectory)
 {
 	struct dirent * const entry = readdir((DIR *)directory);
 	if (!entry)
@@ -353,6 +519,15 @@ bool Sys_ReadDir(void *directory, char *filename, size_t filenamelen)
 
 	snprintf(filename, filenamelen, "%s", entry->d_name);
 
+	*isdirectory = (entry->d_type == DT_DIR);
+
+	if ((entry->d_type == DT_UNKNOWN) || (entry->d_type == DT_LNK))		// the filesystem does not report types, or a link needs to be followed
+	{
+		struct stat st;
+		if (fstatat(dirfd((DIR *)directory), entry->d_name, &st, 0) == 0)
+			*isdirectory = S_ISDIR(st.st_mode);
+	}
+
 	return(true);
 }
 
@@ -581,6 +756,17 @@ void Sys_SignalCondVar(condvar_t *condvar)
 	pthread_cond_signal(&condvar->cond);
 }
 
+/*
+* Function: Sys_BroadcastCondVar
+* Wakes every thread waiting on a condition variable
+* 
+* 	condvar: The condition variable to broadcast
+*/
+void Sys_BroadcastCondVar(condvar_t *condvar)
+{
+	pthread_cond_broadcast(&condvar->cond);
+}
+
 /*
 * Function: Sys_LoadDLL
 * Loads a dynamic link library
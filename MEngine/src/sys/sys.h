@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdio.h>
 #include "common/common.h"
 
 bool Sys_Init(void);
@@ -20,17 +21,40 @@ cmdline_t *Sys_ParseCommandLine(void);
 bool Sys_IsTTY(void);
 bool Sys_Mkdir(const char *path);
 void Sys_Stat(const char *filepath, filedata_t *filedata);
+bool Sys_FileExists(const char *filepath);
+bool Sys_StatFile(const char *filepath, filedata_t *filedata);
 char *Sys_Strtok(char *string, const char *delimiter, char **context);
 size_t Sys_Strlen(const char *string, size_t maxlen);
 void Sys_Sleep(unsigned long milliseconds);
 void Sys_Localtime(struct tm *buf, const time_t *timer);
+unsigned long long Sys_GetMicroseconds(void);
+bool Sys_SyncFile(FILE *file);
+bool Sys_Rename(const char *oldpath, const char *newpath);
+void *Sys_MapFile(const char *filename, size_t *size);
+void Sys_UnmapFile(void *data, size_t size);
+void Sys_PrefetchMemory(const void *data, size_t size);
 
 void *Sys_OpenDir(const char *directory);
-bool Sys_ReadDir(void *directory, char *filename, size_t filenamelen);
+bool Sys_ReadDir(void *directory, char *filename, size_t filenamelen, bool *isdirectory);
 void Sys_CloseDir(void *directory);
 
+#define SYS_MAX_DIR_WATCHES 64
+
+void *Sys_WatchDir(const char *directory);
+bool Sys_DirChanged(void *watch);
+void Sys_UnwatchDir(void *watch);
+
 size_t Sys_GetSystemMemory(void);
 
+typedef struct
+{
+	size_t peakresident;				// the most memory the process has had resident at once, in bytes
+	unsigned long long pagefaults;		// every page fault so far, including the ones served without reading from disk
+	unsigned long long hardfaults;		// the page faults that had to read from disk, 0 where the OS does not count them apart
+} sysmemstats_t;
+
+void Sys_GetProcessMemory(sysmemstats_t *stats);
+
 #define SYS_MAX_THREADS 64
 #define SYS_MAX_MUTEXES 64
 #define SYS_MAX_CONDVARS 64
@@ -49,6 +73,7 @@ condvar_t *Sys_CreateCondVar(void);
 void Sys_DestroyCondVar(condvar_t *condvar);
 void Sys_WaitCondVar(condvar_t *condvar, mutex_t *mutex);
 void Sys_SignalCondVar(condvar_t *condvar);
+void Sys_BroadcastCondVar(condvar_t *condvar);
 
 void *Sys_LoadDLL(const char *dllname);
 void Sys_UnloadDLL(void *handle);
@@ -3,6 +3,7 @@
 #include <stdarg.h>
 #include <time.h>
 #include <direct.h>
+#include <io.h>
 #include <process.h>
 #include <sys/stat.h>
 #include <threads.h>
@@ -10,6 +11,7 @@
 #include "common/common.h"
 #include "winlocal.h"
 #include <DbgHelp.h>
+#include <Psapi.h>
 #include "../../../../EMCrashHandler/src/emstatus.h"
 
 struct thread
@@ -437,6 +439,47 @@ void Sys_Stat(const char *filepath, filedata_t *filedata)
 	filedata->ctime = st.st_ctime;
 }
 
+/*
+* Function: Sys_FileExists
+* Checks if a regular file exists with a single call to stat, without opening it
+* 
+*	filepath: The path of the file to check
+* 
+* Returns: A boolean if the file exists and is not a directory
+*/
+bool Sys_FileExists(const char *filepath)
+{
+	struct _stat st;
+	if (_stat(filepath, &st) == -1)
+		return(false);
+
+	return((st.st_mode & _S_IFDIR) == 0);
+}
+
+/*
+* Function: Sys_StatFile
+* Gets the file information for a regular file with a single call to stat, a missing file is not an error so nothing is logged
+* 
+*	filepath: The path of the file to get the information for
+*	filedata: The filedata struct to store the file information in
+* 
+* Returns: A boolean if the file exists and is not a directory, filedata is only filled if it does
+*/
+bool Sys_StatFile(const char *filepath, filedata_t *filedata)
+{
+	struct _stat st;
+	if ((_stat(filepath, &st) == -1) || (st.st_mode & _S_IFDIR))
+		return(false);
+
+	snprintf(filedata->filename, SYS_MAX_PATH, "%s", filepath);
+	filedata->filesize = st.st_size;
+	filedata->atime = st.st_atime;
+	filedata->mtime = st.st_mtime;
+	filedata->ctime = st.st_ctime;
+
+	return(true);
+}
+
 /*
 * Function: Sys_Strtok
 * Portable version of strtok_s and thread safe
@@ -489,6 +532,150 @@ void Sys_Localtime(struct tm *buf, const time_t *timer)
 	localtime_s(buf, timer);
 }
 
+/*
+* Function: Sys_GetMicroseconds
+* Gets the value of the performance counter, only useful for measuring elapsed time
+* 
+* Returns: The current time in microseconds
+*/
+unsigned long long Sys_GetMicroseconds(void)
+{
+	static LARGE_INTEGER frequency;
+
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	return((unsigned long long)((counter.QuadPart / frequency.QuadPart) * 1000000LL) +
+		(unsigned long long)(((counter.QuadPart % frequency.QuadPart) * 1000000LL) / frequency.QuadPart));
+}
+
+/*
+* Function: Sys_SyncFile
+* Flushes a files buffers and commits the data to the disk
+* 
+*	file: The file to sync
+* 
+* Returns: A boolean if the data was written to the disk or not
+*/
+bool Sys_SyncFile(FILE *file)
+{
+	if (!file || (fflush(file) != 0))
+		return(false);
+
+	return(_commit(_fileno(file)) == 0);
+}
+
+/*
+* Function: Sys_Rename
+* Renames a file, replacing the destination if it exists
+* 
+*	oldpath: The file to rename
+*	newpath: The new name of the file
+* 
+* Returns: A boolean if the file was renamed or not
+*/
+bool Sys_Rename(const char *oldpath, const char *newpath)
+{
+	wchar_t woldpath[SYS_MAX_PATH] = { 0 };
+	if (!MultiByteToWideChar(CP_UTF8, 0, oldpath, -1, woldpath, SYS_MAX_PATH))
+		return(false);
+
+	wchar_t wnewpath[SYS_MAX_PATH] = { 0 };
+	if (!MultiByteToWideChar(CP_UTF8, 0, newpath, -1, wnewpath, SYS_MAX_PATH))
+		return(false);
+
+	return(MoveFileEx(woldpath, wnewpath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH));
+}
+
+/*
+* Function: Sys_MapFile
+* Maps a whole file into memory as read only, an empty file cannot be mapped
+* 
+*	filename: The file to map
+*	size: Output for the size of the file in bytes
+* 
+* Returns: A pointer to the mapped file, or NULL if the file is empty or could not be mapped
+*/
+void *Sys_MapFile(const char *filename, size_t *size)
+{
+	*size = 0;
+
+	wchar_t wfilename[SYS_MAX_PATH] = { 0 };
+	if (!MultiByteToWideChar(CP_UTF8, 0, filename, -1, wfilename, SYS_MAX_PATH))
+		return(NULL);
+
+	HANDLE file = CreateFile(wfilename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		Log_Writef(LOG_ERROR, "%s, Failed to open file: %s", __func__, filename);
+		return(NULL);
+	}
+
+	LARGE_INTEGER filesize;
+	if (!GetFileSizeEx(file, &filesize) || filesize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return(NULL);
+	}
+
+	HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping)
+	{
+		Log_Writef(LOG_ERROR, "%s, Failed to create file mapping: %s", __func__, filename);
+		CloseHandle(file);
+		return(NULL);
+	}
+
+	void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	CloseHandle(mapping);	// the view keeps its own reference to the mapping and the file
+	CloseHandle(file);
+
+	if (!data)
+	{
+		Log_Writef(LOG_ERROR, "%s, Failed to map file: %s", __func__, filename);
+		return(NULL);
+	}
+
+	*size = (size_t)filesize.QuadPart;
+
+	return(data);
+}
+
+/*
+* Function: Sys_UnmapFile
+* Unmaps a file mapped with Sys_MapFile
+* 
+*	data: The pointer returned by Sys_MapFile
+*	size: The size of the mapped file, unused on Windows
+*/
+void Sys_UnmapFile(void *data, size_t size)
+{
+	(void)size;
+
+	if (data)
+		UnmapViewOfFile(data);
+}
+
+/*
+* Function: Sys_PrefetchMemory
+* Hints that a range of mapped memory will be used soon, so the OS starts reading it in without blocking
+* 
+*	data: The start of the range
+*	size: The size of the range in bytes
+*/
+void Sys_PrefetchMemory(const void *data, size_t size)
+{
+	if (!data || (size == 0))
+		return;
+
+	WIN32_MEMORY_RANGE_ENTRY range = { (PVOID)data, size };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
 /*
 * Function: Sys_OpenDir
 * Opens a directory for reading
@@ -522,10 +709,11 @@ void *Sys_OpenDir(const char *directory)
 *	directory: The directory handle to read from
 *	filename: The buffer to store the filename in
 *	filenamelen: The length of the filename buffer
+*	isdirectory: Set to true if the file is a directory
 * 
 * Returns: A boolean if the file was read or not
 */
-bool Sys_ReadDir(void *directory, char *filename, size_t filenamelen)
+bool Sys_ReadDir(void *directory, char *filename, size_t filenamelen, bool *isdirectory)
 {
 	HANDLE handle = (HANDLE)directory;
 	WIN32_FIND_DATA findfiledata = { 0 };
@@ -536,6 +724,8 @@ bool Sys_ReadDir(void *directory, char *filename, size_t filenamelen)
 	if (!WideCharToMultiByte(CP_UTF8, 0, findfiledata.cFileName, -1, filename, (int)filenamelen, NULL, NULL))	// saves the filename as a UTF-8 string
 		return(false);
 
+	*isdirectory = (findfiledata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+
 	return(true);
 }
 
@@ -550,6 +740,67 @@ void Sys_CloseDir(void *directory)
 	FindClose((HANDLE)directory);
 }
 
+/*
+* Function: Sys_WatchDir
+* Starts watching a directory for changes to its files, using a change notification handle
+* 
+*	directory: The directory to watch
+* 
+* Returns: A handle to the watch, or NULL if the directory cannot be watched
+*/
+void *Sys_WatchDir(const char *directory)
+{
+	wchar_t wdirectory[SYS_MAX_PATH] = { 0 };
+	if (!MultiByteToWideChar(CP_UTF8, 0, directory, -1, wdirectory, SYS_MAX_PATH))
+		return(NULL);
+
+	HANDLE handle = FindFirstChangeNotification(wdirectory, FALSE,
+		FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		Log_Writef(LOG_ERROR, "%s, Failed to watch directory: %s", __func__, directory);
+		return(NULL);
+	}
+
+	return(handle);
+}
+
+/*
+* Function: Sys_DirChanged
+* Checks if a watched directory has changed since the last check, does not block
+* 
+*	watch: The watch handle
+* 
+* Returns: A boolean if the directory has changed or not
+*/
+bool Sys_DirChanged(void *watch)
+{
+	bool changed = false;
+
+	while (WaitForSingleObject((HANDLE)watch, 0) == WAIT_OBJECT_0)		// rearm the notification until no more changes are signalled
+	{
+		changed = true;
+
+		if (!FindNextChangeNotification((HANDLE)watch))
+			break;
+	}
+
+	return(changed);
+}
+
+/*
+* Function: Sys_UnwatchDir
+* Stops watching a directory
+* 
+*	watch: The watch handle
+*/
+void Sys_UnwatchDir(void *watch)
+{
+	if (watch)
+		FindCloseChangeNotification((HANDLE)watch);
+}
+
 /*
 * Function: Sys_GetSystemMemory
 * Gets the total system memory in MB
@@ -564,6 +815,26 @@ size_t Sys_GetSystemMemory(void)
 	return((size_t)(meminfo.ullTotalPhys / 1024 / 1024));
 }
 
+/*
+* Function: Sys_GetProcessMemory
+* Gets the peak resident memory and the page fault counts of the process, Windows does not count hard faults apart
+* 
+*	stats: The memory statistics to fill in
+*/
+void Sys_GetProcessMemory(sysmemstats_t *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	PROCESS_MEMORY_COUNTERS counters = { 0 };
+	counters.cb = sizeof(counters);
+
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return;
+
+	stats->peakresident = counters.PeakWorkingSetSize;
+	stats->pagefaults = counters.PageFaultCount;
+}
+
 /*
 * Function: Sys_GetMaxThreads
 * Gets the maximum number of threads the system supports
@@ -776,6 +1047,17 @@ void Sys_SignalCondVar(condvar_t *condvar)
 	cnd_signal(&condvar->cond);
 }
 
+/*
+* Function: Sys_BroadcastCondVar
+* Wakes every thread waiting on a condition variable
+* 
+*	condvar: The condition variable to broadcast
+*/
+void Sys_BroadcastCondVar(condvar_t *condvar)
+{
+	cnd_broadcast(&condvar->cond);
+}
+
 /*
 * Function: Sys_LoadDLL
 * Loads a DLL
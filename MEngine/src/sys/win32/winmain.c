@@ -55,6 +55,20 @@ int WINAPI wWinMain(HINSTANCE hinst, HINSTANCE hprevinst, PWSTR pcmdline, int nc
 		return(1);
 	}
 
+	if (Common_IsHeadless())
+	{
+		int status = Common_RunHeadless() ? 0 : 1;
+		Common_Shutdown();
+
+		if (win32state.conshow)
+		{
+			ShutdownConsole();
+			CloseConsoleFiles();
+		}
+
+		return(status);
+	}
+
 	MSG msg;
 	while (1)
 	{
@@ -0,0 +1,724 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include "common/pak.h"
+#include "common/compress.h"
+
+#if defined(MENGINE_PLATFORM_WINDOWS)
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#define PAK_MAX_PATH 1024
+#define PAK_MAX_STORE_FILTERS 32
+#define PAK_DEF_FILE_LIST_SIZE 256
+#define PAK_TEMP_EXT ".tmp"
+
+typedef struct
+{
+	char path[PAK_MAX_PATH];		// path on disk
+	char name[PAK_MAX_PATH];		// normalized path stored in the archive
+} packfile_t;
+
+typedef struct
+{
+	packfile_t *files;
+	size_t numfiles;
+	size_t capacity;
+} filelist_t;
+
+typedef struct		// data already written to the archive, files with the same contents point at it
+{
+	unsigned long long hash;
+	unsigned long long offset;
+	unsigned long long size;
+	unsigned long long storedsize;
+	unsigned int flags;
+	size_t file;					// the first file written with these contents
+} blob_t;
+
+typedef struct
+{
+	const char *store[PAK_MAX_STORE_FILTERS];		// files matching these filters are never compressed, so the engine can map them
+	unsigned int numstore;
+	bool verbose;
+} packoptions_t;
+
+/*
+* Function: MatchFilter
+* Checks if a name matches a filter, supports * and ? wildcards
+* 
+*	filter: The filter
+*	name: The name to check
+* 
+* Returns: A boolean if the name matches or not
+*/
+static bool MatchFilter(const char *filter, const char *name)
+{
+	const char *star = NULL;
+	const char *resume = NULL;
+
+	while (*name)
+	{
+		if ((*filter == '?') || ((*filter != '*') && (*filter == *name)))
+		{
+			filter++;
+			name++;
+		}
+
+		else if (*filter == '*')
+		{
+			star = filter++;
+			resume = name;
+		}
+
+		else if (star)
+		{
+			filter = star + 1;
+			name = ++resume;
+		}
+
+		else
+			return(false);
+	}
+
+	while (*filter == '*')
+		filter++;
+
+	return(*filter == '\0');
+}
+
+/*
+* Function: HashPath
+* Hashes a normalized path with the FNV-1a algorithm, must match the hash used by the engine filesystem
+* 
+*	path: The normalized path
+* 
+* Returns: The hash value
+*/
+static unsigned int HashPath(const char *path)
+{
+	unsigned int hash = 2166136261u;
+
+	for (; *path; path++)
+	{
+		hash ^= (unsigned char)*path;
+		hash *= 16777619u;
+	}
+
+	return(hash);
+}
+
+/*
+* Function: HashContents
+* Hashes the contents of a file with the 64 bit FNV-1a algorithm, used to find files with the same contents
+* 
+*	data: The contents of the file
+*	size: The size of the contents
+* 
+* Returns: The hash value
+*/
+static unsigned long long HashContents(const unsigned char *data, size_t size)
+{
+	unsigned long long hash = 14695981039346656037ull;
+
+	for (size_t i=0; i<size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+
+	return(hash);
+}
+
+/*
+* Function: AddFile
+* Adds a file to the list of files to pack, the stored name is lower cased
+* 
+*	list: The file list
+*	path: The path of the file on disk
+*	name: The path of the file relative to the data directory
+* 
+* Returns: A boolean if the file was added or not
+*/
+static bool AddFile(filelist_t *list, const char *path, const char *name)
+{
+	if (list->numfiles >= list->capacity)
+	{
+		size_t newcapacity = list->capacity ? (list->capacity * 2) : PAK_DEF_FILE_LIST_SIZE;
+		packfile_t *newfiles = realloc(list->files, newcapacity * sizeof(*newfiles));
+		if (!newfiles)
+		{
+			fprintf(stderr, "Out of memory\n");
+			return(false);
+		}
+
+		list->files = newfiles;
+		list->capacity = newcapacity;
+	}
+
+	packfile_t *file = &list->files[list->numfiles];
+	snprintf(file->path, PAK_MAX_PATH, "%s", path);
+
+	size_t len = 0;
+	for (; name[len] && (len < (PAK_MAX_PATH - 1)); len++)
+		file->name[len] = (name[len] == '\\') ? '/' : (char)tolower((unsigned char)name[len]);
+
+	file->name[len] = '\0';
+
+	list->numfiles++;
+
+	return(true);
+}
+
+/*
+* Function: WalkDirectory
+* Adds every file under a directory to the file list, pak archives are skipped
+* 
+*	list: The file list
+*	dir: The directory on disk
+*	prefix: The path of the directory relative to the data directory, empty for the data directory
+* 
+* Returns: A boolean if the directory was read or not
+*/
+static bool WalkDirectory(filelist_t *list, const char *dir, const char *prefix)
+{
+	char path[PAK_MAX_PATH] = { 0 };
+	char name[PAK_MAX_PATH] = { 0 };
+
+#if defined(MENGINE_PLATFORM_WINDOWS)
+	char search[PAK_MAX_PATH] = { 0 };
+	snprintf(search, PAK_MAX_PATH, "%s/*", dir);
+
+	WIN32_FIND_DATAA finddata;
+	HANDLE find = FindFirstFileA(search, &finddata);
+	if (find == INVALID_HANDLE_VALUE)
+	{
+		fprintf(stderr, "Cannot open directory: %s\n", dir);
+		return(false);
+	}
+
+	bool success = true;
+
+	do
+	{
+		const char *entry = finddata.cFileName;
+		bool isdirectory = (finddata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+	DIR *handle = opendir(dir);
+	if (!handle)
+	{
+		fprintf(stderr, "Cannot open directory: %s\n", dir);
+		return(false);
+	}
+
+	bool success = true;
+
+	struct dirent *dirent = NULL;
+	while (success && (dirent = readdir(handle)))
+	{
+		const char *entry = dirent->d_name;
+
+		snprintf(path, PAK_MAX_PATH, "%s/%s", dir, entry);
+
+		struct stat st;
+		if (stat(path, &st) != 0)
+			continue;
+
+		bool isdirectory = S_ISDIR(st.st_mode);
+#endif
+
+		if ((strcmp(entry, ".") == 0) || (strcmp(entry, "..") == 0))
+			continue;
+
+		snprintf(path, PAK_MAX_PATH, "%s/%s", dir, entry);
+		snprintf(name, PAK_MAX_PATH, "%s%s%s", prefix, prefix[0] ? "/" : "", entry);
+
+		if (isdirectory)
+			success = WalkDirectory(list, path, name);
+
+		else if (!MatchFilter("*" PAK_EXTENSION, name) && !MatchFilter("*" PAK_EXTENSION PAK_TEMP_EXT, name))
+			success = AddFile(list, path, name);
+#if defined(MENGINE_PLATFORM_WINDOWS)
+	} while (success && FindNextFileA(find, &finddata));
+
+	FindClose(find);
+#else
+	}
+
+	closedir(handle);
+#endif
+
+	return(success);
+}
+
+/*
+* Function: CompareFiles
+* Compares two files by their stored name, used to sort the file list
+* 
+*	a: The first file
+*	b: The second file
+* 
+* Returns: The result of strcmp on the stored names
+*/
+static int CompareFiles(const void *a, const void *b)
+{
+	return(strcmp(((const packfile_t *)a)->name, ((const packfile_t *)b)->name));
+}
+
+/*
+* Function: ReadWholeFile
+* Reads a whole file into a new buffer
+* 
+*	path: The file to read
+*	size: Output for the size of the file
+* 
+* Returns: The contents of the file, free with free, or NULL if the file could not be read
+*/
+static unsigned char *ReadWholeFile(const char *path, size_t *size)
+{
+	*size = 0;
+
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return(NULL);
+
+	if ((fseek(file, 0, SEEK_END) != 0))
+	{
+		fclose(file);
+		return(NULL);
+	}
+
+	long length = ftell(file);
+	rewind(file);
+
+	if (length < 0)
+	{
+		fclose(file);
+		return(NULL);
+	}
+
+	unsigned char *data = malloc((size_t)length + 1);		// never 0 bytes, empty files still get a buffer
+	if (!data || ((length > 0) && (fread(data, (size_t)length, 1, file) != 1)))
+	{
+		free(data);
+		fclose(file);
+		return(NULL);
+	}
+
+	fclose(file);
+
+	*size = (size_t)length;
+
+	return(data);
+}
+
+/*
+* Function: CompressFile
+* Compresses a file into blocks in the pak block format
+* 
+*	data: The contents of the file
+*	size: The size of the contents
+*	storedsize: Output for the size of the compressed data with the block headers
+* 
+* Returns: The compressed data, free with free, or NULL if the file does not get smaller or on error
+*/
+static unsigned char *CompressFile(const unsigned char *data, size_t size, size_t *storedsize)
+{
+	*storedsize = 0;
+
+	size_t numblocks = (size + COMPRESS_BLOCK_SIZE - 1) / COMPRESS_BLOCK_SIZE;
+	if (numblocks == 0)
+		return(NULL);
+
+	unsigned char *out = malloc(numblocks * (PAK_BLOCK_HEADER_SIZE + Compress_Bound(COMPRESS_BLOCK_SIZE)));
+	if (!out)
+		return(NULL);
+
+	size_t outsize = 0;
+
+	for (size_t offset=0; offset<size; offset+=COMPRESS_BLOCK_SIZE)
+	{
+		unsigned int rawsize = (unsigned int)(((size - offset) < COMPRESS_BLOCK_SIZE) ? (size - offset) : COMPRESS_BLOCK_SIZE);
+		unsigned char *block = out + outsize + PAK_BLOCK_HEADER_SIZE;
+
+		unsigned int blocksize = (unsigned int)Compress_Block(data + offset, rawsize, block, Compress_Bound(rawsize));
+		if ((blocksize == 0) || (blocksize >= rawsize))		// store the block as is, the engine checks for storedsize == rawsize
+		{
+			memcpy(block, data + offset, rawsize);
+			blocksize = rawsize;
+		}
+
+		memcpy(out + outsize, &blocksize, sizeof(blocksize));
+		memcpy(out + outsize + sizeof(blocksize), &rawsize, sizeof(rawsize));
+		outsize += PAK_BLOCK_HEADER_SIZE + blocksize;
+	}
+
+	if (outsize >= size)
+	{
+		free(out);
+		return(NULL);
+	}
+
+	*storedsize = outsize;
+
+	return(out);
+}
+
+/*
+* Function: PadOutput
+* Writes zeros until the output is aligned to PAK_ALIGNMENT bytes
+* 
+*	out: The output file
+*	offset: The current offset in the output, moved to the aligned offset
+* 
+* Returns: A boolean if the padding was written or not
+*/
+static bool PadOutput(FILE *out, unsigned long long *offset)
+{
+	static const unsigned char zeros[PAK_ALIGNMENT] = { 0 };
+
+	size_t padding = (size_t)((PAK_ALIGNMENT - (*offset % PAK_ALIGNMENT)) % PAK_ALIGNMENT);
+	if ((padding > 0) && (fwrite(zeros, padding, 1, out) != 1))
+		return(false);
+
+	*offset += padding;
+
+	return(true);
+}
+
+/*
+* Function: IsDuplicate
+* Checks if a file has the same contents as data already written to the archive
+* 
+*	list: The file list
+*	blob: The data already written
+*	data: The contents of the file
+*	size: The size of the contents
+*	hash: The hash of the contents
+* 
+* Returns: A boolean if the contents are the same or not
+*/
+static bool IsDuplicate(const filelist_t *list, const blob_t *blob, const unsigned char *data, size_t size, unsigned long long hash)
+{
+	if ((blob->hash != hash) || (blob->size != size))
+		return(false);
+
+	size_t othersize = 0;
+	unsigned char *other = ReadWholeFile(list->files[blob->file].path, &othersize);		// the hash only finds candidates, the contents must match
+
+	bool same = other && (othersize == size) && (memcmp(other, data, size) == 0);
+	free(other);
+
+	return(same);
+}
+
+/*
+* Function: FindBlob
+* Finds data already written to the archive with the same contents as a file, the blobs are indexed by content hash
+* with open addressing so each file only compares against the blobs with the same hash
+* 
+*	list: The file list
+*	blobs: The data already written
+*	slots: The blob index, a blob index plus one per slot, zero for empty slots
+*	capacity: The number of slots, a power of 2
+*	data: The contents of the file
+*	size: The size of the contents
+*	hash: The hash of the contents
+*	store: If the file must be stored uncompressed, compressed blobs are skipped so the file can still be mapped
+*	slot: Output for the empty slot to index the contents with if they are not found
+* 
+* Returns: The blob with the same contents, or NULL if there is none
+*/
+static const blob_t *FindBlob(const filelist_t *list, const blob_t *blobs, const size_t *slots, size_t capacity, const unsigned char *data, size_t size, unsigned long long hash, bool store, size_t *slot)
+{
+	size_t i = (size_t)hash & (capacity - 1);
+
+	for (; slots[i]; i=(i + 1) & (capacity - 1))
+	{
+		const blob_t *blob = &blobs[slots[i] - 1];
+		if (store && (blob->flags & PAK_ENTRY_COMPRESSED))
+			continue;
+
+		if (IsDuplicate(list, blob, data, size, hash))
+			return(blob);
+	}
+
+	*slot = i;
+
+	return(NULL);
+}
+
+/*
+* Function: WritePak
+* Writes every file in the list to a pak archive
+* 
+*	list: The sorted file list
+*	options: The packing options
+*	filename: The pak file to write
+* 
+* Returns: A boolean if the archive was written or not
+*/
+static bool WritePak(const filelist_t *list, const packoptions_t *options, const char *filename)
+{
+	FILE *out = fopen(filename, "wb");
+	if (!out)
+	{
+		fprintf(stderr, "Cannot open output file: %s\n", filename);
+		return(false);
+	}
+
+	pakentry_t *entries = calloc(list->numfiles ? list->numfiles : 1, sizeof(*entries));
+	blob_t *blobs = calloc(list->numfiles ? list->numfiles : 1, sizeof(*blobs));
+
+	size_t capacity = 1;
+	while (capacity < (list->numfiles * 2))		// at most half full so probe runs stay short
+		capacity *= 2;
+
+	size_t *slots = calloc(capacity, sizeof(*slots));
+	if (!entries || !blobs || !slots)
+	{
+		fprintf(stderr, "Out of memory\n");
+		free(entries);
+		free(blobs);
+		free(slots);
+		fclose(out);
+		return(false);
+	}
+
+	pakheader_t header = { 0 };
+	bool success = (fwrite(&header, sizeof(header), 1, out) == 1);		// written again once the directory offset is known
+
+	unsigned long long offset = sizeof(header);
+	unsigned long long totalsize = 0;
+	unsigned long long totalstored = 0;
+	size_t numblobs = 0;
+	size_t numduplicates = 0;
+	size_t numcompressed = 0;
+	unsigned int stringsize = 0;
+
+	for (size_t i=0; success && (i<list->numfiles); i++)
+	{
+		const packfile_t *file = &list->files[i];
+
+		size_t size = 0;
+		unsigned char *data = ReadWholeFile(file->path, &size);
+		if (!data)
+		{
+			fprintf(stderr, "Cannot read file: %s\n", file->path);
+			success = false;
+			break;
+		}
+
+		unsigned long long hash = HashContents(data, size);
+
+		bool store = false;
+		for (unsigned int j=0; j<options->numstore; j++)
+			store = store || MatchFilter(options->store[j], file->name);
+
+		size_t slot = 0;
+		const blob_t *blob = FindBlob(list, blobs, slots, capacity, data, size, hash, store, &slot);
+
+		if (blob)
+			numduplicates++;
+
+		else
+		{
+			size_t storedsize = size;
+			unsigned char *compressed = store ? NULL : CompressFile(data, size, &storedsize);
+			if (!compressed)
+				storedsize = size;
+
+			blob_t *newblob = &blobs[numblobs++];
+			newblob->hash = hash;
+			newblob->size = size;
+			newblob->storedsize = storedsize;
+			newblob->flags = compressed ? PAK_ENTRY_COMPRESSED : 0;
+			newblob->file = i;
+			slots[slot] = numblobs;
+
+			success = PadOutput(out, &offset);
+			newblob->offset = offset;
+
+			if (success && (storedsize > 0))
+				success = (fwrite(compressed ? compressed : data, storedsize, 1, out) == 1);
+
+			offset += storedsize;
+			totalstored += storedsize;
+			numcompressed += compressed ? 1 : 0;
+
+			free(compressed);
+			blob = newblob;
+		}
+
+		totalsize += size;
+
+		pakentry_t *entry = &entries[i];
+		entry->offset = blob->offset;
+		entry->size = blob->size;
+		entry->storedsize = blob->storedsize;
+		entry->pathoffset = stringsize;
+		entry->pathhash = HashPath(file->name);
+		entry->flags = blob->flags;
+
+		stringsize += (unsigned int)strlen(file->name) + 1;
+
+		if (options->verbose)
+			printf("%s%s [%zu -> %llu bytes]\n", file->name, (blob->file != i) ? " (duplicate)" : "", size, (blob->file != i) ? 0ull : blob->storedsize);
+
+		free(data);
+	}
+
+	if (success)
+		success = PadOutput(out, &offset);
+
+	memcpy(header.magic, PAK_MAGIC, PAK_MAGIC_LEN);
+	header.version = PAK_VERSION;
+	header.entrycount = (unsigned int)list->numfiles;
+	header.diroffset = offset;
+	header.dirsize = (list->numfiles * sizeof(pakentry_t)) + stringsize;
+
+	if (success && (list->numfiles > 0))
+		success = (fwrite(entries, sizeof(*entries), list->numfiles, out) == list->numfiles);
+
+	for (size_t i=0; success && (i<list->numfiles); i++)
+		success = (fwrite(list->files[i].name, strlen(list->files[i].name) + 1, 1, out) == 1);
+
+	if (success)
+		success = (fseek(out, 0, SEEK_SET) == 0) && (fwrite(&header, sizeof(header), 1, out) == 1);
+
+	if (fclose(out) != 0)
+		success = false;
+
+	free(entries);
+	free(blobs);
+	free(slots);
+
+	if (!success)
+	{
+		fprintf(stderr, "Failed to write output file: %s\n", filename);
+		return(false);
+	}
+
+	printf("Files: %zu, unique: %zu, duplicates: %zu, compressed: %zu\n", list->numfiles, numblobs, numduplicates, numcompressed);
+	printf("Data: %llu bytes, stored: %llu bytes (%.1f%%), archive: %llu bytes\n", totalsize, totalstored,
+		totalsize ? ((double)totalstored * 100.0 / (double)totalsize) : 100.0, header.diroffset + header.dirsize);
+
+	return(true);
+}
+
+/*
+* Function: PrintUsage
+* Prints how to use the tool
+* 
+*	program: The name of the program
+*/
+static void PrintUsage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [options] <data directory> <output pak file>\n", program);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "\t-store <filter>\tStore matching files uncompressed so the engine can map them, can be repeated, defaults to *.wld, *.cfg and *.cfgb\n");
+	fprintf(stderr, "\t-compressall\tCompress every file, clears the store filters\n");
+	fprintf(stderr, "\t-verbose\tPrint every file as it is packed\n");
+}
+
+int main(int argc, char **argv)
+{
+	packoptions_t options =
+	{
+		.store = { "*.wld", "*.cfg", "*.cfgb" },		// read through FileSys_MapFile, which cannot map compressed files
+		.numstore = 3
+	};
+
+	bool userstore = false;
+	int argi = 1;
+
+	for (; (argi < argc) && (argv[argi][0] == '-'); argi++)
+	{
+		if ((strcmp(argv[argi], "-store") == 0) && ((argi + 1) < argc))
+		{
+			if (!userstore)
+				options.numstore = 0;
+
+			if (options.numstore >= PAK_MAX_STORE_FILTERS)
+			{
+				fprintf(stderr, "Too many store filters\n");
+				return(1);
+			}
+
+			options.store[options.numstore++] = argv[++argi];
+			userstore = true;
+		}
+
+		else if (strcmp(argv[argi], "-compressall") == 0)
+		{
+			options.numstore = 0;
+			userstore = true;
+		}
+
+		else if (strcmp(argv[argi], "-verbose") == 0)
+			options.verbose = true;
+
+		else
+		{
+			PrintUsage(argv[0]);
+			return(1);
+		}
+	}
+
+	if ((argc - argi) != 2)
+	{
+		PrintUsage(argv[0]);
+		return(1);
+	}
+
+	const char *datadir = argv[argi];
+	const char *outfile = argv[argi + 1];
+
+	filelist_t list = { 0 };
+	if (!WalkDirectory(&list, datadir, ""))
+	{
+		free(list.files);
+		return(1);
+	}
+
+	if (list.numfiles > 0)
+		qsort(list.files, list.numfiles, sizeof(*list.files), CompareFiles);
+
+	for (size_t i=1; i<list.numfiles; i++)
+	{
+		if (strcmp(list.files[i - 1].name, list.files[i].name) == 0)
+		{
+			fprintf(stderr, "Two files have the same path when lower cased: %s and %s\n", list.files[i - 1].path, list.files[i].path);
+			free(list.files);
+			return(1);
+		}
+	}
+
+	char tempfile[PAK_MAX_PATH] = { 0 };
+	snprintf(tempfile, PAK_MAX_PATH, "%s%s", outfile, PAK_TEMP_EXT);
+
+	bool success = WritePak(&list, &options, tempfile);
+	free(list.files);
+
+	if (!success)
+	{
+		remove(tempfile);
+		return(1);
+	}
+
+	remove(outfile);		// rename does not replace an existing file on Windows
+	if (rename(tempfile, outfile) != 0)
+	{
+		fprintf(stderr, "Cannot rename %s to %s\n", tempfile, outfile);
+		return(1);
+	}
+
+	printf("Wrote %s\n", outfile);
+
+	return(0);
+}
@@ -0,0 +1,73 @@
+# storededup.cmake : Regression test for MEnginePak, files that must be stored uncompressed
+# cannot share data with an identical file that was compressed, or the engine cannot map them.
+#
+# Usage: cmake -DPAKTOOL=<MEnginePak executable> -DWORKDIR=<scratch directory> -P storededup.cmake
+#
+
+# Reads a little endian unsigned integer of size bytes at offset from the hex dump of the archive
+function(read_uint hexdata offset size outvar)
+	math(EXPR hexoffset "${offset} * 2")
+	math(EXPR hexsize "${size} * 2")
+	string(SUBSTRING "${hexdata}" ${hexoffset} ${hexsize} bytes)
+
+	set(value "")
+	math(EXPR last "${size} - 1")
+	foreach(i RANGE ${last} 0 -1)
+		math(EXPR byteoffset "${i} * 2")
+		string(SUBSTRING "${bytes}" ${byteoffset} 2 byte)
+		string(APPEND value "${byte}")
+	endforeach()
+
+	math(EXPR value "0x${value}")
+	set(${outvar} ${value} PARENT_SCOPE)
+endfunction()
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}/data")
+
+# Identical compressible contents, a.bin is packed first and gets compressed, the stored files need their own copy
+string(REPEAT "MEnginePak store filter dedup regression " 256 contents)
+file(WRITE "${WORKDIR}/data/a.bin" "${contents}")
+file(WRITE "${WORKDIR}/data/b.wld" "${contents}")
+file(WRITE "${WORKDIR}/data/c.cfgb" "${contents}")
+file(WRITE "${WORKDIR}/data/d.bin" "${contents}")
+
+execute_process(COMMAND "${PAKTOOL}" "${WORKDIR}/data" "${WORKDIR}/test.pak" RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "MEnginePak failed: ${result}")
+endif()
+
+file(READ "${WORKDIR}/test.pak" hexdata HEX)
+
+read_uint("${hexdata}" 8 4 entrycount)
+read_uint("${hexdata}" 16 8 diroffset)
+if(NOT entrycount EQUAL 4)
+	message(FATAL_ERROR "Expected 4 entries, got ${entrycount}")
+endif()
+
+# The entries are sorted by path: a.bin, b.wld, c.cfgb, d.bin
+set(expected 1 0 0 1)
+foreach(i RANGE 0 3)
+	math(EXPR entryoffset "${diroffset} + (${i} * 40)")
+	math(EXPR flagsoffset "${entryoffset} + 32")
+	read_uint("${hexdata}" ${entryoffset} 8 offset${i})
+	read_uint("${hexdata}" ${flagsoffset} 4 flags)
+
+	list(GET expected ${i} compressed)
+	if(NOT flags EQUAL compressed)
+		message(FATAL_ERROR "Entry ${i} has flags ${flags}, expected ${compressed}")
+	endif()
+endforeach()
+
+# Files in the same state still share their data
+if(NOT offset0 EQUAL offset3)
+	message(FATAL_ERROR "a.bin and d.bin should share their data")
+endif()
+
+if(NOT offset1 EQUAL offset2)
+	message(FATAL_ERROR "b.wld and c.cfgb should share their data")
+endif()
+
+if(offset0 EQUAL offset1)
+	message(FATAL_ERROR "b.wld shares the compressed data of a.bin")
+endif()
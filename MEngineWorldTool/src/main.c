@@ -0,0 +1,498 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "renderer/worldgen.h"
+
+#define WORLD_MAX_LINE 4096
+#define WORLD_MAX_AREA_NAME 0xffff
+#define WORLD_TEMP_EXT ".tmp"
+
+typedef struct
+{
+	unsigned int textureid;
+	unsigned int flags;
+	unsigned int numpoints;
+	worldpoint_t *points;
+} toolsector_t;
+
+typedef struct
+{
+	unsigned int xpos;
+	unsigned int ypos;
+	toolsector_t *sectors;
+	unsigned int numsectors;
+	unsigned int sectorcapacity;
+	worldentity_t *entities;
+	unsigned int numentities;
+	unsigned int entitycapacity;
+} toolchunk_t;
+
+typedef struct
+{
+	size_t nameoffset;				// the null terminated name in the name buffer of the description
+	toolchunk_t *chunks;
+	unsigned int numchunks;
+	unsigned int chunkcapacity;
+} toolarea_t;
+
+typedef struct		// a world read from a text description
+{
+	toolarea_t *areas;
+	unsigned int numareas;
+	unsigned int areacapacity;
+	worldbuffer_t names;
+} description_t;
+
+/*
+* Function: Grow
+* Makes room for one more item in a dynamic array
+* 
+*	array: The array, reallocated if it is full
+*	capacity: The number of items the array can hold, updated if it grows
+*	count: The number of items in the array
+*	itemsize: The size of each item
+* 
+* Returns: The array with room for one more item, or NULL if it could not grow, the old array is still valid then
+*/
+static void *Grow(void *array, unsigned int *capacity, unsigned int count, size_t itemsize)
+{
+	if (count < *capacity)
+		return(array);
+
+	unsigned int newcapacity = *capacity ? (*capacity * 2) : 16;
+	if (newcapacity <= *capacity)
+		return(NULL);
+
+	void *newarray = realloc(array, itemsize * newcapacity);
+	if (newarray)
+		*capacity = newcapacity;
+
+	return(newarray);
+}
+
+/*
+* Function: SerializeChunk
+* Writes a chunk from a description in the .wld chunk layout
+* 
+*	chunk: The chunk
+*	out: The buffer to write to
+* 
+* Returns: A boolean if the chunk was written or not
+*/
+static bool SerializeChunk(const toolchunk_t *chunk, worldbuffer_t *out)
+{
+	chunkheader_t header =
+	{
+		.xpos = chunk->xpos,
+		.ypos = chunk->ypos,
+		.sectorcount = chunk->numsectors,
+		.entitycount = chunk->numentities
+	};
+
+	if (!WorldGen_Append(out, &header, sizeof(header)))
+		return(false);
+
+	for (unsigned int i=0; i<chunk->numsectors; i++)
+	{
+		const toolsector_t *sector = &chunk->sectors[i];
+
+		if (!WorldGen_Append(out, &sector->numpoints, sizeof(sector->numpoints))
+			|| !WorldGen_Append(out, sector->points, sizeof(*sector->points) * sector->numpoints)
+			|| !WorldGen_Append(out, &sector->textureid, sizeof(sector->textureid))
+			|| !WorldGen_Append(out, &sector->flags, sizeof(sector->flags)))
+			return(false);
+	}
+
+	return(WorldGen_Append(out, chunk->entities, sizeof(*chunk->entities) * chunk->numentities));
+}
+
+static const char *DescriptionAreaName(void *context, unsigned int area)
+{
+	description_t *description = context;
+
+	return((const char *)description->names.data + description->areas[area].nameoffset);
+}
+
+static unsigned int DescriptionChunkCount(void *context, unsigned int area)
+{
+	return(((description_t *)context)->areas[area].numchunks);
+}
+
+static bool DescriptionBuildChunk(void *context, unsigned int area, unsigned int chunk, worldbuffer_t *out)
+{
+	return(SerializeChunk(&((description_t *)context)->areas[area].chunks[chunk], out));
+}
+
+/*
+* Function: FreeDescription
+* Frees a world description
+* 
+*	description: The description to free
+*/
+static void FreeDescription(description_t *description)
+{
+	for (unsigned int i=0; i<description->numareas; i++)
+	{
+		toolarea_t *area = &description->areas[i];
+
+		for (unsigned int j=0; j<area->numchunks; j++)
+		{
+			for (unsigned int k=0; k<area->chunks[j].numsectors; k++)
+				free(area->chunks[j].sectors[k].points);
+
+			free(area->chunks[j].sectors);
+			free(area->chunks[j].entities);
+		}
+
+		free(area->chunks);
+	}
+
+	free(description->areas);
+	free(description->names.data);
+	memset(description, 0, sizeof(*description));
+}
+
+/*
+* Function: ParseSector
+* Parses the values of a sector line, "sector <textureid> <flags> <x> <y> <z> ...", each group of 3 numbers is a point
+* 
+*	args: The line after the keyword
+*	sector: The sector to fill
+* 
+* Returns: A boolean if the sector was parsed or not
+*/
+static bool ParseSector(const char *args, toolsector_t *sector)
+{
+	char *end = NULL;
+	unsigned int capacity = 0;
+	int point[3] = { 0 };
+
+	memset(sector, 0, sizeof(*sector));
+
+	sector->textureid = (unsigned int)strtoul(args, &end, 10);
+	if (end == args)
+		return(false);
+
+	args = end;
+	sector->flags = (unsigned int)strtoul(args, &end, 10);
+	if (end == args)
+		return(false);
+
+	args = end;
+
+	while (1)
+	{
+		for (int i=0; i<3; i++)
+		{
+			point[i] = (int)strtol(args, &end, 10);
+			if (end == args)
+				return((i == 0) && (sector->numpoints > 0));		// a sector needs at least one point and only whole points
+
+			args = end;
+		}
+
+		worldpoint_t *points = Grow(sector->points, &capacity, sector->numpoints, sizeof(*points));
+		if (!points)
+			return(false);
+
+		sector->points = points;
+
+		sector->points[sector->numpoints].x = point[0];
+		sector->points[sector->numpoints].y = point[1];
+		sector->points[sector->numpoints].z = point[2];
+		sector->numpoints++;
+	}
+}
+
+/*
+* Function: ReadDescription
+* Reads a world from a text description, one statement per line and # starts a comment:
+*	area <name>
+*	chunk <x> <y>
+*	sector <textureid> <flags> <x> <y> <z> [<x> <y> <z> ...]
+*	entity <id> <x> <y> <z>
+* A chunk belongs to the last area, sectors and entities belong to the last chunk
+* 
+*	filename: The description file
+*	description: The description to fill
+* 
+* Returns: A boolean if the description was read or not
+*/
+static bool ReadDescription(const char *filename, description_t *description)
+{
+	FILE *file = fopen(filename, "r");
+	if (!file)
+	{
+		fprintf(stderr, "Cannot open %s\n", filename);
+		return(false);
+	}
+
+	char line[WORLD_MAX_LINE];
+	unsigned int linenum = 0;
+	bool success = true;
+
+	memset(description, 0, sizeof(*description));
+
+	while (success && fgets(line, sizeof(line), file))
+	{
+		linenum++;
+
+		char *comment = strchr(line, '#');
+		if (comment)
+			*comment = '\0';
+
+		char keyword[16] = { 0 };
+		int consumed = 0;
+		if (sscanf(line, " %15s %n", keyword, &consumed) != 1)
+			continue;		// blank line
+
+		const char *args = line + consumed;
+		toolarea_t *area = description->numareas ? &description->areas[description->numareas - 1] : NULL;
+		toolchunk_t *chunk = (area && area->numchunks) ? &area->chunks[area->numchunks - 1] : NULL;
+
+		if (strcmp(keyword, "area") == 0)
+		{
+			size_t namelen = strcspn(args, "\r\n");
+			while ((namelen > 0) && ((args[namelen - 1] == ' ') || (args[namelen - 1] == '\t')))
+				namelen--;
+
+			toolarea_t *areas = NULL;
+			if ((namelen == 0) || (namelen > WORLD_MAX_AREA_NAME)
+				|| !(areas = Grow(description->areas, &description->areacapacity, description->numareas, sizeof(*areas))))
+			{
+				success = false;
+				break;
+			}
+
+			description->areas = areas;
+			area = &description->areas[description->numareas++];
+			memset(area, 0, sizeof(*area));
+			area->nameoffset = description->names.size;
+
+			if (!WorldGen_Append(&description->names, args, namelen) || !WorldGen_Append(&description->names, "", 1))
+			{
+				success = false;
+				break;
+			}
+		}
+
+		else if (strcmp(keyword, "chunk") == 0)
+		{
+			unsigned int xpos = 0;
+			unsigned int ypos = 0;
+
+			toolchunk_t *chunks = NULL;
+			if (!area || (sscanf(args, "%u %u", &xpos, &ypos) != 2)
+				|| !(chunks = Grow(area->chunks, &area->chunkcapacity, area->numchunks, sizeof(*chunks))))
+			{
+				success = false;
+				break;
+			}
+
+			area->chunks = chunks;
+			chunk = &area->chunks[area->numchunks++];
+			memset(chunk, 0, sizeof(*chunk));
+			chunk->xpos = xpos;
+			chunk->ypos = ypos;
+		}
+
+		else if (strcmp(keyword, "sector") == 0)
+		{
+			toolsector_t sector;
+			bool parsed = ParseSector(args, &sector);
+
+			toolsector_t *sectors = NULL;
+			if (!chunk || !parsed || !(sectors = Grow(chunk->sectors, &chunk->sectorcapacity, chunk->numsectors, sizeof(*sectors))))
+			{
+				free(sector.points);
+				success = false;
+				break;
+			}
+
+			chunk->sectors = sectors;
+			chunk->sectors[chunk->numsectors++] = sector;
+		}
+
+		else if (strcmp(keyword, "entity") == 0)
+		{
+			worldentity_t entity = { 0 };
+
+			worldentity_t *entities = NULL;
+			if (!chunk || (sscanf(args, "%u %d %d %d", &entity.entityid, &entity.position.x, &entity.position.y, &entity.position.z) != 4)
+				|| !(entities = Grow(chunk->entities, &chunk->entitycapacity, chunk->numentities, sizeof(*entities))))
+			{
+				success = false;
+				break;
+			}
+
+			chunk->entities = entities;
+			chunk->entities[chunk->numentities++] = entity;
+		}
+
+		else
+			success = false;
+	}
+
+	if (!success)
+		fprintf(stderr, "%s:%u: Invalid statement: %s\n", filename, linenum, line);
+
+	fclose(file);
+
+	return(success);
+}
+
+/*
+* Function: ReadCount
+* Reads the numeric value of a command line option
+* 
+*	arg: The value
+*	value: Output for the value
+* 
+* Returns: A boolean if the value was a number or not
+*/
+static bool ReadCount(const char *arg, unsigned int *value)
+{
+	char *end = NULL;
+	unsigned long count = strtoul(arg, &end, 10);
+
+	if ((end == arg) || (*end != '\0') || (count > 0xffffffffu))
+		return(false);
+
+	*value = (unsigned int)count;
+
+	return(true);
+}
+
+/*
+* Function: PrintUsage
+* Prints how to use the tool
+* 
+*	program: The name of the program
+*/
+static void PrintUsage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [options] compile <description file> <output wld file>\n", program);
+	fprintf(stderr, "       %s [options] generate <output wld file>\n", program);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "\t-v1\t\tWrite a version 1 file instead of version 2\n");
+	fprintf(stderr, "\t-areas <n>\tNumber of areas to generate, defaults to 1\n");
+	fprintf(stderr, "\t-chunks <n>\tNumber of chunks in each generated area, defaults to 64\n");
+	fprintf(stderr, "\t-sectors <n>\tNumber of sectors in each generated chunk, defaults to 16\n");
+	fprintf(stderr, "\t-points <n>\tNumber of points in each generated sector, defaults to 4\n");
+	fprintf(stderr, "\t-entities <n>\tNumber of entities in each generated chunk, defaults to 4\n");
+	fprintf(stderr, "\t-chunksize <n>\tWidth of each generated chunk in world units, defaults to %d\n", WLDGEN_DEF_CHUNK_SIZE);
+	fprintf(stderr, "\t-seed <n>\tSeed of the generator, defaults to 1\n");
+}
+
+int main(int argc, char **argv)
+{
+	worldgenerator_t generator =
+	{
+		.numareas = 1,
+		.numchunks = 64,
+		.numsectors = 16,
+		.numpoints = 4,
+		.numentities = 4,
+		.chunksize = WLDGEN_DEF_CHUNK_SIZE,
+		.seed = 1
+	};
+
+	unsigned int version = WLD2_VERSION;
+	int argi = 1;
+
+	for (; (argi < argc) && (argv[argi][0] == '-'); argi++)
+	{
+		bool hasvalue = (argi + 1) < argc;
+
+		if (strcmp(argv[argi], "-v1") == 0)
+			version = WLD_VERSION;
+
+		else if (hasvalue && (strcmp(argv[argi], "-areas") == 0) && ReadCount(argv[argi + 1], &generator.numareas))
+			argi++;
+
+		else if (hasvalue && (strcmp(argv[argi], "-chunks") == 0) && ReadCount(argv[argi + 1], &generator.numchunks))
+			argi++;
+
+		else if (hasvalue && (strcmp(argv[argi], "-sectors") == 0) && ReadCount(argv[argi + 1], &generator.numsectors))
+			argi++;
+
+		else if (hasvalue && (strcmp(argv[argi], "-points") == 0) && ReadCount(argv[argi + 1], &generator.numpoints))
+			argi++;
+
+		else if (hasvalue && (strcmp(argv[argi], "-entities") == 0) && ReadCount(argv[argi + 1], &generator.numentities))
+			argi++;
+
+		else if (hasvalue && (strcmp(argv[argi], "-chunksize") == 0) && ReadCount(argv[argi + 1], &generator.chunksize) && (generator.chunksize > 0))
+			argi++;
+
+		else if (hasvalue && (strcmp(argv[argi], "-seed") == 0) && ReadCount(argv[argi + 1], &generator.seed))
+			argi++;
+
+		else
+		{
+			PrintUsage(argv[0]);
+			return(1);
+		}
+	}
+
+	description_t description = { 0 };
+	worldsource_t source = { 0 };
+	const char *outfile = NULL;
+
+	if (((argc - argi) == 3) && (strcmp(argv[argi], "compile") == 0))
+	{
+		if (!ReadDescription(argv[argi + 1], &description))
+		{
+			FreeDescription(&description);
+			return(1);
+		}
+
+		source.context = &description;
+		source.numareas = description.numareas;
+		source.AreaName = DescriptionAreaName;
+		source.ChunkCount = DescriptionChunkCount;
+		source.BuildChunk = DescriptionBuildChunk;
+		outfile = argv[argi + 2];
+	}
+
+	else if (((argc - argi) == 2) && (strcmp(argv[argi], "generate") == 0))
+	{
+		WorldGen_InitGenerator(&generator, &source);
+		outfile = argv[argi + 1];
+	}
+
+	else
+	{
+		PrintUsage(argv[0]);
+		return(1);
+	}
+
+	char tempfile[WORLD_MAX_LINE] = { 0 };
+	snprintf(tempfile, sizeof(tempfile), "%s%s", outfile, WORLD_TEMP_EXT);
+
+	clock_t start = clock();
+	unsigned long long numchunks = 0;
+
+	worldgenerror_t error = WorldGen_Write(&source, tempfile, version, &numchunks);
+	FreeDescription(&description);
+
+	if (error != WLDGEN_OK)
+	{
+		fprintf(stderr, "Cannot write %s: %s, after %llu chunks\n", outfile, WorldGen_ErrorString(error), numchunks);
+		remove(tempfile);
+		return(1);
+	}
+
+	remove(outfile);		// rename does not replace an existing file on Windows
+	if (rename(tempfile, outfile) != 0)
+	{
+		fprintf(stderr, "Cannot rename %s to %s\n", tempfile, outfile);
+		return(1);
+	}
+
+	printf("Wrote %s [version: %u, areas: %u, chunks: %llu, time: %.2f s]\n", outfile, version, source.numareas, numchunks, (double)(clock() - start) / CLOCKS_PER_SEC);
+
+	return(0);
+}